@@ -0,0 +1,109 @@
+/*
+ * Grouped dispatch (MA_NET_GROUP_DISPATCH) against ma_step on a network
+ * whose automata use 32 different transition functions, interleaved so
+ * that consecutive indirect calls change target.
+ *
+ * Usage: bench_dispatch [automata] [steps]
+ * Prints ns per automaton and branch misses per automaton (-1 when the
+ * hardware counter is unavailable).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "ma.h"
+
+#define KERNELS 32
+
+#define KERNEL(k)                                                                  \
+    static void kernel_##k(uint64_t *next_state, uint64_t const *input,            \
+                           uint64_t const *state, size_t n, size_t s)              \
+    {                                                                              \
+        (void)n;                                                                   \
+        (void)s;                                                                   \
+        next_state[0] = (state[0] * (2 * k + 3) + input[0] + k) & 0xff;            \
+    }
+
+KERNEL(0) KERNEL(1) KERNEL(2) KERNEL(3) KERNEL(4) KERNEL(5) KERNEL(6) KERNEL(7)
+KERNEL(8) KERNEL(9) KERNEL(10) KERNEL(11) KERNEL(12) KERNEL(13) KERNEL(14) KERNEL(15)
+KERNEL(16) KERNEL(17) KERNEL(18) KERNEL(19) KERNEL(20) KERNEL(21) KERNEL(22) KERNEL(23)
+KERNEL(24) KERNEL(25) KERNEL(26) KERNEL(27) KERNEL(28) KERNEL(29) KERNEL(30) KERNEL(31)
+
+static const transition_function_t kernels[KERNELS] = {
+    kernel_0, kernel_1, kernel_2, kernel_3, kernel_4, kernel_5, kernel_6, kernel_7,
+    kernel_8, kernel_9, kernel_10, kernel_11, kernel_12, kernel_13, kernel_14, kernel_15,
+    kernel_16, kernel_17, kernel_18, kernel_19, kernel_20, kernel_21, kernel_22, kernel_23,
+    kernel_24, kernel_25, kernel_26, kernel_27, kernel_28, kernel_29, kernel_30, kernel_31,
+};
+
+/* Steps network (net NULL: ma_step on at) and prints one result line */
+static void measure(char const *name, moore_t **at, size_t num, ma_net_t *net, int steps,
+                    int counter)
+{
+    /* Warm up (and let the network calibrate its prefetch distance) */
+    for (int i = 0; i < 16; i++)
+        net ? ma_net_step(net) : ma_step(at, num);
+
+    bench_counter_start(counter);
+    const double begin = bench_now();
+    for (int i = 0; i < steps; i++)
+        net ? ma_net_step(net) : ma_step(at, num);
+    const double seconds = bench_now() - begin;
+    const long long misses = bench_counter_stop(counter);
+
+    const double per = (double)num * steps;
+    printf("%-14s %8zu automata: %7.1f ns/aut, %6.2f branch misses/aut\n", name, num,
+           seconds * 1e9 / per, misses < 0 ? -1.0 : (double)misses / per);
+}
+
+static int run(size_t num, int steps, int counter)
+{
+    moore_t **at = malloc(num * sizeof(moore_t *));
+    if (!at)
+        return -1;
+
+    /* Kernel order is pseudo-random so the call target is unpredictable */
+    uint64_t x = 88172645463325252ULL;
+    for (size_t i = 0; i < num; i++)
+    {
+        x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+        at[i] = ma_create_simple(8, 8, kernels[x % KERNELS]);
+        if (!at[i])
+            return -1;
+    }
+    for (size_t i = 1; i < num; i++)
+        ma_connect(at[i], 0, at[(i * 7919) % num], 0, 8);
+
+    ma_net_t *plain = ma_net_create(at, num, 0);
+    ma_net_t *grouped = ma_net_create(at, num, MA_NET_GROUP_DISPATCH);
+    if (!plain || !grouped)
+        return -1;
+
+    measure("ma_step", at, num, NULL, steps, counter);
+    measure("net", at, num, plain, steps, counter);
+    measure("net grouped", at, num, grouped, steps, counter);
+
+    ma_net_delete(plain);
+    ma_net_delete(grouped);
+    for (size_t i = 0; i < num; i++)
+        ma_delete(at[i]);
+    free(at);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const int counter = bench_counter_open(PERF_COUNT_HW_BRANCH_MISSES);
+    if (counter < 0)
+        printf("(branch miss counter unavailable)\n");
+
+    if (argc > 1)
+        return run(strtoull(argv[1], NULL, 0), argc > 2 ? atoi(argv[2]) : 100, counter) ? 1 : 0;
+
+    /* Cache resident and memory bound networks */
+    if (run(2000, 2000, counter) != 0 || run(200000, 20, counter) != 0)
+    {
+        perror("bench_dispatch");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * Software prefetch distance on a network larger than the last level cache.
+ * Automata (256-bit input, output and state) are wired to random sources
+ * and stepped in shuffled order, so gather reads miss the cache.
+ *
+ * Usage: bench_prefetch [automata] [steps]
+ * The default size is twice the LLC (sysconf, 32 MiB when unknown) divided
+ * by the approximate footprint of one automaton.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "bench.h"
+#include "ma.h"
+
+#define WIDTH 256
+#define FOOTPRINT 512 /* Approximate bytes per automaton */
+
+static void mix(uint64_t *next_state, uint64_t const *input, uint64_t const *state, size_t n,
+                size_t s)
+{
+    (void)n;
+    for (size_t i = 0; i < s / 64; i++)
+        next_state[i] = state[i] ^ (input[i] + 0x9e3779b97f4a7c15ULL);
+}
+
+static uint64_t xorshift(uint64_t *x)
+{
+    *x ^= *x << 13, *x ^= *x >> 7, *x ^= *x << 17;
+    return *x;
+}
+
+/* Returns ns per automaton for steps of at (or of net when not NULL) */
+static double measure(moore_t **at, size_t num, ma_net_t *net, int steps)
+{
+    for (int i = 0; i < 2; i++)
+        net ? ma_net_step(net) : ma_step(at, num);
+
+    const double begin = bench_now();
+    for (int i = 0; i < steps; i++)
+        net ? ma_net_step(net) : ma_step(at, num);
+    return (bench_now() - begin) * 1e9 / ((double)num * steps);
+}
+
+int main(int argc, char **argv)
+{
+    long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (llc <= 0)
+        llc = 32L << 20;
+    const size_t num = argc > 1 ? strtoull(argv[1], NULL, 0) : 2 * (size_t)llc / FOOTPRINT;
+    const int steps = argc > 2 ? atoi(argv[2]) : 5;
+
+    moore_t **at = malloc(num * sizeof(moore_t *));
+    if (!at)
+        goto fail;
+
+    /* Shuffled order separates neighbours in the array from neighbours in memory */
+    uint64_t x = 88172645463325252ULL;
+    for (size_t i = 0; i < num; i++)
+        if (!(at[i] = ma_create_simple(WIDTH, WIDTH, mix)))
+            goto fail;
+    for (size_t i = num - 1; i > 0; i--)
+    {
+        const size_t j = xorshift(&x) % (i + 1);
+        moore_t *tmp = at[i];
+        at[i] = at[j];
+        at[j] = tmp;
+    }
+    for (size_t i = 0; i < num; i++)
+        for (size_t k = 0; k < WIDTH; k += 64)
+            ma_connect(at[i], k, at[xorshift(&x) % num], k, 64);
+
+    printf("%zu automata, ~%zu MiB (LLC %ld MiB)\n", num, num * FOOTPRINT >> 20, llc >> 20);
+
+    static const size_t distances[] = {0, 4, 8, 16, 32};
+    for (size_t i = 0; i < sizeof(distances) / sizeof(distances[0]); i++)
+    {
+        ma_set_prefetch_distance(distances[i]);
+        ma_net_t *net = ma_net_create(at, num, 0);
+        if (!net)
+            goto fail;
+        printf("distance %2zu: ma_step %6.1f ns/aut, net %6.1f ns/aut\n", distances[i],
+               measure(at, num, NULL, steps), measure(at, num, net, steps));
+        ma_net_delete(net);
+    }
+
+    /* Calibrated network: warm up until the distance settles */
+    ma_set_prefetch_distance(MA_PREFETCH_AUTO);
+    ma_net_t *net = ma_net_create(at, num, 0);
+    if (!net)
+        goto fail;
+    for (int i = 0; i < 16; i++)
+        ma_net_step(net);
+    printf("auto (%2zu):                        net %6.1f ns/aut\n",
+           ma_net_prefetch_distance(net), measure(at, num, net, steps));
+    ma_net_delete(net);
+
+    for (size_t i = 0; i < num; i++)
+        ma_delete(at[i]);
+    free(at);
+    return 0;
+
+fail:
+    perror("bench_prefetch");
+    return 1;
+}
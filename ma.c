@@ -4,64 +4,174 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 #include "ma.h"
+#include "ma_internal.h"
 
 #define INIT_CONNECTION_CAPACITY 8
+#define INIT_LOG_CAPACITY 16
 #define MOORE_MAGIC 0xDEADBEEF
 #define MOORE_DELETED 0x00000000
 
+/* Software prefetching */
+#define DEFAULT_PREFETCH_DISTANCE 8 /* Distance used by ma_step in automatic mode */
+#define PREFETCH_SOURCE_ENTRIES 8   /* Gather runs whose sources are prefetched ahead */
+#define PREFETCH_BIT_DISTANCE 16    /* Distance (in input bits) inside the bitwise gather loop */
+
+/* Gather plans */
+#define GATHER_MASK_MAX_RUN 8 /* Shorter runs are moved with pext/pdep masks */
+#define MA_PREFETCH(p) __builtin_prefetch((p), 0, 3)
+#define MA_PREFETCH_W(p) __builtin_prefetch((p), 1, 3)
+
+/* Input mailbox */
+#define MAILBOX_SLOTS 3          /* Triple buffer: front, middle, back */
+#define MAILBOX_FRESH 0x4u       /* Flag in middle: published and not yet consumed */
+#define MAILBOX_SLOT_MASK 0x3u   /* Slot index in middle */
+
+static size_t prefetch_distance = MA_PREFETCH_AUTO; /* Set by ma_set_prefetch_distance */
+
 /**
- * @brief Structure representing a Moore automaton
+ * @brief Calls the transition function of automaton
  *
- * Contains automaton parameters (n, m, s), transition and output functions,
- * buffers for states and signals, and information about connections to other automata.
+ * @param a Automaton
+ *
+ * @note Dispatches to plain or context-carrying variant
  */
-typedef struct moore
+static inline void run_transition(moore_t *a)
 {
-    /* Basic automaton parameters and logic */
-    size_t n;                /* Number of inputs */
-    size_t m;                /* Number of outputs */
-    size_t s;                /* Number of state bits */
-    transition_function_t t; /* Pointer to transition function */
-    output_function_t y;     /* Pointer to output function */
+    if (a->t)
+        a->t(a->next_state, a->input_view, a->state, a->n, a->s);
+    else if (a->t_ex)
+        a->t_ex(a->next_state, a->input_view, a->state, a->n, a->s, a->ctx);
+    else
+        a->t_log(&a->log, a->input_view, a->state, a->n, a->s, a->ctx);
+}
 
-    /* Data buffers */
-    uint32_t magic; /* Magic number: object lifetime marker (MOORE_MAGIC after creation,
-                       MOORE_DELETED after deletion) */
-    uint64_t *state;      /* Buffer for CURRENT automaton state */
-    uint64_t *next_state; /* Buffer for NEXT state (calculated in ma_step) */
-    uint64_t *output;     /* Buffer for output signals */
+/**
+ * @brief Makes transition result current state of automaton
+ *
+ * @param a Automaton
+ * @return false if an in-place transition lost a write (state unchanged)
+ *
+ * @note Swaps state buffers, or applies words logged by an in-place
+ *       transition so the cost follows the number of writes
+ */
+static inline bool commit_state(moore_t *a)
+{
+    if (!a->t_log)
+    {
+        uint64_t *tmp = a->state;
+        a->state = a->next_state;
+        a->next_state = tmp;
+        return true;
+    }
 
-    /* Buffers for input management */
-    uint64_t *manual_input; /* Buffer for values set by ma_set_input */
-    uint64_t *final_input;  /* Buffer for final input signal */
+    /* Applying part of the writes would commit an inconsistent state */
+    struct ma_write_log *log = &a->log;
+    if (log->lost)
+    {
+        log->count = 0;
+        log->lost = false;
+        return false;
+    }
 
-    /* Input connection management */
-    input_connection_info *incoming_connections;
+    for (size_t i = 0; i < log->count; i++)
+        a->state[log->entries[i].word] = log->entries[i].value;
+    if (log->count && a->s % 64)
+        a->state[log->words - 1] &= ((uint64_t)1 << (a->s % 64)) - 1;
+    log->count = 0;
+    return true;
+}
 
-    /* Disconnection management during automaton deletion */
-    struct moore **connected_to_me;
-    size_t connected_to_me_count;    /* Number of current connections */
-    size_t connected_to_me_capacity; /* Capacity of allocated array */
-} moore_t;
+/**
+ * @brief Calls the output function of automaton
+ *
+ * @param a Automaton
+ *
+ * @note Dispatches to plain or context-carrying variant
+ */
+static inline void run_output(moore_t *a)
+{
+    if (a->y)
+        a->y(a->output, a->state, a->m, a->s);
+    else
+        a->y_ex(a->output, a->state, a->m, a->s, a->ctx);
+}
 
 /**
- * @brief Creates a new Moore automaton with full parameterization
+ * @brief Checks whether clock of automaton ticks on given cycle
+ *
+ * @param a Automaton
+ * @param cycle Cycle number counted by the stepping engine
+ *
+ * @note The gate is read before any output of the step changes
+ */
+static inline bool clock_ticks(moore_t const *a, uint64_t cycle)
+{
+    if (cycle % a->clock_divider != a->clock_phase)
+        return false;
+
+    moore_t const *gate = a->clock_gate;
+    return !gate || (gate->output[a->clock_gate_bit / 64] >> (a->clock_gate_bit % 64)) & 1;
+}
+
+/**
+ * @brief Returns size of input mailbox in bytes
+ *
+ * @param n_words Words per input vector
+ */
+static inline size_t mailbox_size(size_t n_words)
+{
+    return sizeof(input_mailbox) + MAILBOX_SLOTS * n_words * sizeof(uint64_t);
+}
+
+/**
+ * @brief Moves latest posted input vector into manual input buffer
+ *
+ * @param a Automaton with enabled mailbox
+ *
+ * @note Called only by the step thread; wait-free
+ */
+static inline void consume_mailbox(moore_t *a)
+{
+    input_mailbox *box = a->mailbox;
+
+    if (!(atomic_load_explicit(&box->middle, memory_order_relaxed) & MAILBOX_FRESH))
+        return;
+
+    const uint32_t old = atomic_exchange_explicit(&box->middle, box->front,
+                                                  memory_order_acq_rel);
+    box->front = old & MAILBOX_SLOT_MASK;
+    memcpy(a->manual_input, &box->slots[box->front * box->n_words],
+           box->n_words * sizeof(uint64_t));
+}
+
+/**
+ * @brief Allocates and initializes automaton (common part of constructors)
  *
  * @param n Number of input signals
  * @param m Number of output signals
  * @param s Number of internal state bits
- * @param t Transition function
- * @param y Output function
+ * @param t Transition function (or NULL if t_ex is used)
+ * @param y Output function (or NULL if y_ex is used)
+ * @param t_ex Context-carrying transition function (or NULL)
+ * @param y_ex Context-carrying output function (or NULL)
+ * @param t_log In-place transition function (or NULL)
  * @param q Initial automaton state
+ * @param ctx User context for t_ex, t_log and y_ex
  * @return Pointer to new automaton or NULL on error
  */
-moore_t *ma_create_full(size_t n, size_t m, size_t s,
-                        transition_function_t t, output_function_t y,
-                        uint64_t const *q)
+static moore_t *create_automaton(size_t n, size_t m, size_t s,
+                                 transition_function_t t, output_function_t y,
+                                 transition_function_ex_t t_ex, output_function_ex_t y_ex,
+                                 transition_function_log_t t_log, uint64_t const *q, void *ctx)
 {
     /* Check input parameters */
-    if (!t || !y || !q || m == 0 || s == 0)
+    if ((!t && !t_ex && !t_log) || (!y && !y_ex) || !q || m == 0 || s == 0)
     {
         errno = EINVAL;
         return NULL;
@@ -90,7 +200,7 @@ moore_t *ma_create_full(size_t n, size_t m, size_t s,
     }
 
     /* Allocate main structure */
-    moore_t *new = calloc(1, sizeof(moore_t));
+    moore_t *new = ma_mem_calloc(1, sizeof(moore_t));
     if (!new)
     {
         errno = ENOMEM;
@@ -101,36 +211,40 @@ moore_t *ma_create_full(size_t n, size_t m, size_t s,
     /* Allocate buffers for inputs (only if n > 0) */
     if (n > 0)
     {
-        new->manual_input = calloc(n_elements, sizeof(uint64_t));
+        new->manual_input = ma_mem_calloc(n_elements, sizeof(uint64_t));
         if (!new->manual_input)
             goto cleanup_fail;
 
-        new->final_input = calloc(n_elements, sizeof(uint64_t));
+        new->final_input = ma_mem_calloc(n_elements, sizeof(uint64_t));
         if (!new->final_input)
             goto cleanup_fail;
 
-        new->incoming_connections = calloc(n, sizeof(input_connection_info));
+        new->incoming_connections = ma_mem_calloc(n, sizeof(input_connection_info));
         if (!new->incoming_connections)
             goto cleanup_fail;
     }
 
     /* Allocate buffers for states */
-    new->state = calloc(s_elements, sizeof(uint64_t));
+    new->state = ma_mem_calloc(s_elements, sizeof(uint64_t));
     if (!new->state)
         goto cleanup_fail;
 
-    new->next_state = calloc(s_elements, sizeof(uint64_t));
-    if (!new->next_state)
-        goto cleanup_fail;
+    /* In-place automata write through their log and need no second buffer */
+    if (!t_log)
+    {
+        new->next_state = ma_mem_calloc(s_elements, sizeof(uint64_t));
+        if (!new->next_state)
+            goto cleanup_fail;
+    }
 
     /* Allocate output buffer */
-    new->output = calloc(m_elements, sizeof(uint64_t));
+    new->output = ma_mem_calloc(m_elements, sizeof(uint64_t));
     if (!new->output)
         goto cleanup_fail;
 
     /* Allocate output connection array */
     new->connected_to_me_capacity = INIT_CONNECTION_CAPACITY;
-    new->connected_to_me = calloc(new->connected_to_me_capacity, sizeof(moore_t *));
+    new->connected_to_me = ma_mem_calloc(new->connected_to_me_capacity, sizeof(moore_t *));
     if (!new->connected_to_me)
         goto cleanup_fail;
 
@@ -140,31 +254,162 @@ moore_t *ma_create_full(size_t n, size_t m, size_t s,
     new->s = s;
     new->t = t;
     new->y = y;
+    new->t_ex = t_ex;
+    new->y_ex = y_ex;
+    new->t_log = t_log;
+    new->log.words = s_elements;
+    new->ctx = ctx;
     new->connected_to_me_count = 0;
+    new->input_view = new->final_input;
+    new->plan_dirty = true;
+    new->input_mode = MA_INPUT_COPY;
+    new->clock_divider = 1;
     new->magic = MOORE_MAGIC;
 
     /* Copy initial state */
     memcpy(new->state, q, s_elements * sizeof(uint64_t));
 
     /* Calculate initial output */
-    new->y(new->output, new->state, new->m, new->s);
+    run_output(new);
 
     return new;
 
 cleanup_fail:
     /* Free all allocated buffers */
     errno = ENOMEM;
-    free(new->manual_input);
-    free(new->final_input);
-    free(new->incoming_connections);
-    free(new->state);
-    free(new->next_state);
-    free(new->output);
-    free(new->connected_to_me);
-    free(new);
+    ma_mem_free(new->manual_input, n_elements * sizeof(uint64_t));
+    ma_mem_free(new->final_input, n_elements * sizeof(uint64_t));
+    ma_mem_free(new->incoming_connections, n * sizeof(input_connection_info));
+    ma_mem_free(new->state, s_elements * sizeof(uint64_t));
+    ma_mem_free(new->next_state, s_elements * sizeof(uint64_t));
+    ma_mem_free(new->output, m_elements * sizeof(uint64_t));
+    ma_mem_free(new->connected_to_me, new->connected_to_me_capacity * sizeof(moore_t *));
+    ma_mem_free(new, sizeof(moore_t));
     return NULL;
 }
 
+/**
+ * @brief Creates a new Moore automaton with full parameterization
+ *
+ * @param n Number of input signals
+ * @param m Number of output signals
+ * @param s Number of internal state bits
+ * @param t Transition function
+ * @param y Output function
+ * @param q Initial automaton state
+ * @return Pointer to new automaton or NULL on error
+ */
+moore_t *ma_create_full(size_t n, size_t m, size_t s,
+                        transition_function_t t, output_function_t y,
+                        uint64_t const *q)
+{
+    if (!t || !y)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return create_automaton(n, m, s, t, y, NULL, NULL, NULL, q, NULL);
+}
+
+/**
+ * @brief Creates a new Moore automaton with context-carrying functions
+ *
+ * @param n Number of input signals
+ * @param m Number of output signals
+ * @param s Number of internal state bits
+ * @param t Transition function receiving ctx
+ * @param y Output function receiving ctx
+ * @param q Initial automaton state
+ * @param ctx User context passed to t and y (not owned by the automaton)
+ * @return Pointer to new automaton or NULL on error
+ *
+ * @note Lets one kernel serve many automata differing only in parameters
+ */
+moore_t *ma_create_full_ex(size_t n, size_t m, size_t s,
+                           transition_function_ex_t t, output_function_ex_t y,
+                           uint64_t const *q, void *ctx)
+{
+    if (!t || !y)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return create_automaton(n, m, s, NULL, NULL, t, y, NULL, q, ctx);
+}
+
+/**
+ * @brief Creates a new Moore automaton updating its state in place
+ *
+ * @param n Number of input signals
+ * @param m Number of output signals
+ * @param s Number of internal state bits
+ * @param t In-place transition function receiving ctx
+ * @param y Output function receiving ctx
+ * @param q Initial automaton state
+ * @param ctx User context passed to t and y (not owned by the automaton)
+ * @return Pointer to new automaton or NULL on error
+ *
+ * @note t reads the current state and records changed words with
+ *       ma_log_write; words not logged keep their value. The writes are
+ *       applied after all automata have computed their transitions, so
+ *       a step costs the number of written words instead of s.
+ * @note Only one state buffer is allocated (there is no next state)
+ */
+moore_t *ma_create_in_place(size_t n, size_t m, size_t s,
+                            transition_function_log_t t, output_function_ex_t y,
+                            uint64_t const *q, void *ctx)
+{
+    if (!t || !y)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return create_automaton(n, m, s, NULL, NULL, NULL, y, t, q, ctx);
+}
+
+/**
+ * @brief Records new value of state word during an in-place transition
+ *
+ * @param log Write log passed to the transition function
+ * @param word Index of state word
+ * @param value New value (bits above s are cleared on commit)
+ * @return 0 on success, -1 on error
+ *
+ * @note A later write to the same word wins; the log keeps its capacity
+ *       between steps, so it stops allocating once it has grown
+ * @note If the log cannot grow (errno ENOMEM), the whole transition is
+ *       dropped: the state stays unchanged and the step reports ENOMEM
+ */
+int ma_log_write(ma_write_log_t *log, size_t word, uint64_t value)
+{
+    if (!log || word >= log->words)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (log->count == log->capacity)
+    {
+        const size_t capacity = log->capacity ? log->capacity * 2 : INIT_LOG_CAPACITY;
+        ma_log_entry *entries = ma_mem_realloc(log->entries, log->capacity * sizeof(ma_log_entry),
+                                               capacity * sizeof(ma_log_entry));
+        if (!entries)
+        {
+            log->lost = true;
+            errno = ENOMEM;
+            return -1;
+        }
+        log->entries = entries;
+        log->capacity = capacity;
+    }
+
+    log->entries[log->count++] = (ma_log_entry){.word = word, .value = value};
+    return 0;
+}
+
 /**
  * @brief Identity function copying state to output
  *
@@ -208,7 +453,7 @@ moore_t *ma_create_simple(size_t n, size_t s, transition_function_t t)
 
     /* Create temporary, zeroed initial state */
     const size_t s_elements = (s + 63) / 64;
-    uint64_t *q_zero = calloc(s_elements, sizeof(uint64_t));
+    uint64_t *q_zero = ma_mem_calloc(s_elements, sizeof(uint64_t));
     if (s > 0 && !q_zero)
     {
         errno = ENOMEM;
@@ -219,7 +464,7 @@ moore_t *ma_create_simple(size_t n, size_t s, transition_function_t t)
     moore_t *new_automaton = ma_create_full(n, s, s, t, identity_func, q_zero);
 
     /* Free temporary state buffer */
-    free(q_zero);
+    ma_mem_free(q_zero, s_elements * sizeof(uint64_t));
 
     /* Return result (errno already set by ma_create_full on error) */
     return new_automaton;
@@ -249,8 +494,9 @@ static int append_to_connected_list(moore_t *a_out, moore_t *a_in)
         /* Calculate new capacity (double or set minimum 8) */
         const size_t new_capacity = (a_out->connected_to_me_capacity == 0) ? 8 : a_out->connected_to_me_capacity * 2;
 
-        moore_t **new_ptr = realloc(a_out->connected_to_me,
-                                    new_capacity * sizeof(moore_t *));
+        moore_t **new_ptr = ma_mem_realloc(a_out->connected_to_me,
+                                           a_out->connected_to_me_capacity * sizeof(moore_t *),
+                                           new_capacity * sizeof(moore_t *));
         if (!new_ptr)
         {
             errno = ENOMEM;
@@ -267,6 +513,70 @@ static int append_to_connected_list(moore_t *a_out, moore_t *a_in)
     return 0;
 }
 
+/**
+ * @brief Removes automaton from output connection list
+ *
+ * @param a_in Automaton to remove from list
+ * @param a_out Automaton owner of connection list
+ */
+void remove_connected(moore_t *a_in, moore_t *a_out)
+{
+    if (!a_in || !a_out)
+        return;
+
+    /* Compact array removing all occurrences of a_in */
+    size_t j = 0;
+    for (size_t i = 0; i < a_out->connected_to_me_count; i++)
+    {
+        if (a_out->connected_to_me[i] && a_out->connected_to_me[i] != a_in)
+        {
+            a_out->connected_to_me[j++] = a_out->connected_to_me[i];
+        }
+    }
+    a_out->connected_to_me_count = j;
+}
+
+/**
+ * @brief Clears connections of input range and updates fanout lists
+ *
+ * @param a_in Receiving automaton
+ * @param in Index of first input
+ * @param num Number of inputs (range must be valid)
+ *
+ * @note a_in is removed from connected_to_me of a source only if it has
+ *       NO MORE connections to that source outside the range
+ */
+static void disconnect_range(moore_t *a_in, size_t in, size_t num)
+{
+    moore_t *previous = NULL;
+
+    for (size_t i = 0; i < num; i++)
+    {
+        moore_t *src = a_in->incoming_connections[in + i].source_automaton;
+        if (!src || src == previous)
+            continue;
+        previous = src;
+
+        bool still_connected = a_in->clock_gate == src;
+        for (size_t j = 0; j < a_in->n && !still_connected; j++)
+        {
+            if ((j < in || j >= in + num) &&
+                a_in->incoming_connections[j].source_automaton == src)
+                still_connected = true;
+        }
+
+        if (!still_connected)
+            remove_connected(a_in, src);
+    }
+
+    for (size_t i = 0; i < num; i++)
+    {
+        a_in->incoming_connections[in + i].source_automaton = NULL;
+        a_in->incoming_connections[in + i].source_output_index = 0;
+    }
+    a_in->plan_dirty = true;
+}
+
 /**
  * @brief Connects inputs of one automaton with outputs of another
  *
@@ -294,12 +604,16 @@ int ma_connect(moore_t *a_in, size_t in, moore_t *a_out, size_t out, size_t num)
         return -1;
     }
 
+    /* Drop replaced connections so no stale fanout entries remain */
+    disconnect_range(a_in, in, num);
+
     /* Create connections */
     for (size_t i = 0; i < num; ++i)
     {
         a_in->incoming_connections[in + i].source_automaton = a_out;
         a_in->incoming_connections[in + i].source_output_index = out + i;
     }
+    a_in->plan_dirty = true;
 
     /* Add to output connection list */
     if (append_to_connected_list(a_out, a_in) != 0)
@@ -312,26 +626,55 @@ int ma_connect(moore_t *a_in, size_t in, moore_t *a_out, size_t out, size_t num)
 }
 
 /**
- * @brief Removes automaton from output connection list
+ * @brief Connects inputs of one automaton with arbitrary outputs of another
  *
- * @param a_in Automaton to remove from list
- * @param a_out Automaton owner of connection list
+ * @param a_in Target automaton (receiving signals)
+ * @param in Index of first input in a_in
+ * @param a_out Source automaton (sending signals)
+ * @param out Array of num output indices; input in + i reads output out[i]
+ * @param num Number of connected signals
+ * @return 0 on success, -1 on error
+ *
+ * @note Any bit permutation (reversal, interleave, ...) is allowed; the
+ *       gather compiles it into reversed runs and pext/pdep masks
  */
-void remove_connected(moore_t *a_in, moore_t *a_out)
+int ma_connect_permuted(moore_t *a_in, size_t in, moore_t *a_out, size_t const *out, size_t num)
 {
-    if (!a_in || !a_out)
-        return;
+    /* Check basic parameters */
+    if (!a_in || !a_out || !out || num == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
 
-    /* Compact array removing all occurrences of a_in */
-    size_t j = 0;
-    for (size_t i = 0; i < a_out->connected_to_me_count; i++)
+    if (in >= a_in->n || num > a_in->n - in)
     {
-        if (a_out->connected_to_me[i] && a_out->connected_to_me[i] != a_in)
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (size_t i = 0; i < num; ++i)
+    {
+        if (out[i] >= a_out->m)
         {
-            a_out->connected_to_me[j++] = a_out->connected_to_me[i];
+            errno = EINVAL;
+            return -1;
         }
     }
-    a_out->connected_to_me_count = j;
+
+    /* Drop replaced connections so no stale fanout entries remain */
+    disconnect_range(a_in, in, num);
+
+    /* Create connections */
+    for (size_t i = 0; i < num; ++i)
+    {
+        a_in->incoming_connections[in + i].source_automaton = a_out;
+        a_in->incoming_connections[in + i].source_output_index = out[i];
+    }
+    a_in->plan_dirty = true;
+
+    /* Add to output connection list */
+    return append_to_connected_list(a_out, a_in);
 }
 
 /**
@@ -358,6 +701,8 @@ void ma_delete(moore_t *a)
             remove_connected(a, src);
         }
     }
+    if (a->clock_gate && a->clock_gate->magic == MOORE_MAGIC)
+        remove_connected(a, a->clock_gate);
 
     /* Disconnect all its output connections: */
     for (size_t i = 0; i < a->connected_to_me_count; i++)
@@ -374,17 +719,41 @@ void ma_delete(moore_t *a)
                 in->incoming_connections[j].source_output_index = 0;
             }
         }
+        in->plan_dirty = true;
+
+        /* Gated automata keep ticking on their divider alone */
+        if (in->clock_gate == a)
+        {
+            in->clock_gate = NULL;
+            in->clocked = in->clock_divider > 1;
+            in->idle = false;
+        }
     }
 
     /* Free memory */
-    free(a->state);
-    free(a->next_state);
-    free(a->output);
-    free(a->manual_input);
-    free(a->final_input);
-    free(a->incoming_connections);
-    free(a->connected_to_me);
-    free(a);
+    const size_t n_elements = (a->n + 63) / 64;
+    const size_t m_elements = (a->m + 63) / 64;
+    const size_t s_elements = (a->s + 63) / 64;
+    if (!(a->external & MA_EXTERNAL_STATE))
+    {
+        ma_mem_free(a->state, s_elements * sizeof(uint64_t));
+        ma_mem_free(a->next_state, s_elements * sizeof(uint64_t));
+    }
+    if (!(a->external & MA_EXTERNAL_OUTPUT))
+        ma_mem_free(a->output, m_elements * sizeof(uint64_t));
+    if (!(a->external & MA_EXTERNAL_INPUT))
+        ma_mem_free(a->manual_input, n_elements * sizeof(uint64_t));
+    ma_mem_free(a->final_input, n_elements * sizeof(uint64_t));
+    ma_mem_free(a->incoming_connections, a->n * sizeof(input_connection_info));
+    ma_mem_free(a->connected_to_me, a->connected_to_me_capacity * sizeof(moore_t *));
+    ma_mem_free(a->runs, a->run_capacity * sizeof(gather_run));
+    ma_mem_free(a->masks, a->mask_capacity * sizeof(gather_mask));
+    ma_mem_free(a->log.entries, a->log.capacity * sizeof(ma_log_entry));
+    if (a->mailbox)
+        ma_mem_free(a->mailbox, mailbox_size(a->mailbox->n_words));
+    if (a->release)
+        a->release(a->ctx);
+    ma_mem_free(a, sizeof(moore_t));
 }
 
 /**
@@ -428,79 +797,99 @@ int ma_disconnect(moore_t *a_in, size_t in, size_t num)
         return -1;
     }
 
-    /* Collect all sources to be disconnected (avoid duplicates) */
-    moore_t *sources_to_remove[num];
-    size_t unique_sources = 0;
+    disconnect_range(a_in, in, num);
+    return 0;
+}
 
-    for (size_t i = 0; i < num; i++)
+/**
+ * @brief Sets signal values on unconnected automaton inputs
+ *
+ * @param a Pointer to automaton
+ * @param input Array with input values (n bits)
+ * @return 0 on success, -1 on error
+ */
+int ma_set_input(moore_t *a, uint64_t const *input)
+{
+    if (!a || !input || a->n == 0)
     {
-        moore_t *src = a_in->incoming_connections[in + i].source_automaton;
-        if (src)
-        {
-            /* Check if src is not already on the list */
-            bool already_listed = false;
-            for (size_t j = 0; j < unique_sources; j++)
-            {
-                if (sources_to_remove[j] == src)
-                {
-                    already_listed = true;
-                    break;
-                }
-            }
+        errno = EINVAL;
+        return -1;
+    }
 
-            if (!already_listed)
-            {
-                sources_to_remove[unique_sources++] = src;
-            }
-        }
-
-        /* Disconnect input */
-        a_in->incoming_connections[in + i].source_automaton = NULL;
-        a_in->incoming_connections[in + i].source_output_index = 0;
-    }
+    size_t n_elements = (a->n + 63) / 64;
+    memcpy(a->manual_input, input, n_elements * sizeof(uint64_t));
+    return 0;
+}
 
-    /* Remove from connected_to_me only if automaton has NO MORE
-       connections to given source */
-    for (size_t i = 0; i < unique_sources; i++)
+/**
+ * @brief Enables input mailbox of automaton
+ *
+ * @param a Pointer to automaton
+ * @return 0 on success, -1 on error
+ *
+ * @note Must not race with ma_step or ma_post_input; enabling twice is a no-op
+ * @note Afterwards other threads may call ma_post_input while ma_step runs
+ */
+int ma_enable_input_mailbox(moore_t *a)
+{
+    if (!a || a->n == 0)
     {
-        moore_t *src = sources_to_remove[i];
-        bool still_connected = false;
+        errno = EINVAL;
+        return -1;
+    }
 
-        for (size_t j = 0; j < a_in->n; j++)
-        {
-            if (a_in->incoming_connections[j].source_automaton == src)
-            {
-                still_connected = true;
-                break;
-            }
-        }
+    if (a->mailbox)
+        return 0;
 
-        if (!still_connected)
-        {
-            remove_connected(a_in, src);
-        }
+    const size_t n_words = (a->n + 63) / 64;
+    input_mailbox *box = ma_mem_calloc(1, mailbox_size(n_words));
+    if (!box)
+    {
+        errno = ENOMEM;
+        return -1;
     }
 
+    atomic_flag_clear(&box->producer_lock);
+    box->back = 0;
+    atomic_init(&box->middle, 1);
+    box->front = 2;
+    box->n_words = n_words;
+    a->mailbox = box;
     return 0;
 }
 
 /**
- * @brief Sets signal values on unconnected automaton inputs
+ * @brief Publishes input vector to be used by the next step of automaton
  *
- * @param a Pointer to automaton
+ * @param a Pointer to automaton with enabled mailbox
  * @param input Array with input values (n bits)
  * @return 0 on success, -1 on error
+ *
+ * @note Safe to call from any thread while ma_step runs; the step takes the
+ *       latest complete vector at the start of its gather phase
+ * @note Like ma_set_input, only affects unconnected inputs
  */
-int ma_set_input(moore_t *a, uint64_t const *input)
+int ma_post_input(moore_t *a, uint64_t const *input)
 {
-    if (!a || !input || a->n == 0)
+    if (!a || !input || !a->mailbox)
     {
         errno = EINVAL;
         return -1;
     }
 
-    size_t n_elements = (a->n + 63) / 64;
-    memcpy(a->manual_input, input, n_elements * sizeof(uint64_t));
+    input_mailbox *box = a->mailbox;
+
+    while (atomic_flag_test_and_set_explicit(&box->producer_lock, memory_order_acquire))
+        MA_CPU_RELAX();
+
+    memcpy(&box->slots[box->back * box->n_words], input, box->n_words * sizeof(uint64_t));
+
+    /* Publish filled slot and take over the previous one */
+    const uint32_t old = atomic_exchange_explicit(&box->middle, box->back | MAILBOX_FRESH,
+                                                  memory_order_acq_rel);
+    box->back = old & MAILBOX_SLOT_MASK;
+
+    atomic_flag_clear_explicit(&box->producer_lock, memory_order_release);
     return 0;
 }
 
@@ -521,7 +910,7 @@ int ma_set_state(moore_t *a, uint64_t const *state)
 
     size_t s_elements = (a->s + 63) / 64;
     memcpy(a->state, state, s_elements * sizeof(uint64_t));
-    a->y(a->output, a->state, a->m, a->s);
+    run_output(a);
     return 0;
 }
 
@@ -544,6 +933,23 @@ uint64_t const *ma_get_output(moore_t const *a)
     return a->output;
 }
 
+/**
+ * @brief Returns user context of automaton
+ *
+ * @param a Pointer to automaton
+ * @return Context given to ma_create_full_ex (NULL for other automata)
+ */
+void *ma_get_context(moore_t const *a)
+{
+    if (!a)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return a->ctx;
+}
+
 /* Helper functions for bit operations */
 static inline int bit_word(size_t idx)
 {
@@ -556,18 +962,14 @@ static inline int bit_pos(size_t idx)
 }
 
 /**
- * @brief Updates final input signals of automaton
+ * @brief Updates final input signals of automaton bit by bit
  *
  * @param a Automaton to update
  *
- * @note Combines signals from connections and manual_input into one final_input buffer
+ * @note Fallback used when the gather plan cannot be allocated
  */
-static void update_final_input(moore_t *a)
+static void gather_bitwise(moore_t *a)
 {
-    if (!a || a->n == 0 || !a->final_input ||
-        !a->manual_input || !a->incoming_connections)
-        return;
-
     const size_t n_words = (a->n + 63) / 64;
 
     /* Clear output buffer */
@@ -581,6 +983,14 @@ static void update_final_input(moore_t *a)
         const uint64_t mask = (1ULL << b);
         uint64_t value = 0;
 
+        /* Overlap the miss on a later source's output with this bit */
+        if (i + PREFETCH_BIT_DISTANCE < a->n)
+        {
+            moore_t const *ahead = a->incoming_connections[i + PREFETCH_BIT_DISTANCE].source_automaton;
+            if (ahead)
+                MA_PREFETCH(ahead->output);
+        }
+
         moore_t *src = a->incoming_connections[i].source_automaton;
 
         /* Safe access to src */
@@ -614,53 +1024,1786 @@ static void update_final_input(moore_t *a)
 }
 
 /**
- * @brief Executes one simulation step for given automata
+ * @brief Reads up to 64 bits starting at any bit position
  *
- * @param at Array of pointers to automata
- * @param num Number of automata in array
+ * @param src Source buffer
+ * @param bit First bit
+ * @param len Number of bits (1..64)
+ * @return Bits in the low len positions
+ */
+static inline uint64_t read_bits(uint64_t const *src, size_t bit, size_t len)
+{
+    const size_t w = bit / 64, b = bit % 64;
+
+    uint64_t value = src[w] >> b;
+    if (b + len > 64)
+        value |= src[w + 1] << (64 - b);
+
+    return (len == 64) ? value : (value & (((uint64_t)1 << len) - 1));
+}
+
+/**
+ * @brief Writes up to 64 bits within one word
+ *
+ * @param dst Destination buffer
+ * @param bit First bit (bit % 64 + len <= 64)
+ * @param len Number of bits (1..64)
+ * @param value Bits in the low len positions
+ */
+static inline void write_bits(uint64_t *dst, size_t bit, size_t len, uint64_t value)
+{
+    const size_t w = bit / 64, b = bit % 64;
+    const uint64_t mask = (len == 64) ? ~(uint64_t)0 : (((uint64_t)1 << len) - 1);
+    dst[w] = (dst[w] & ~(mask << b)) | (value << b);
+}
+
+/**
+ * @brief Reverses order of bits in word
+ */
+static inline uint64_t reverse_bits(uint64_t x)
+{
+    x = __builtin_bswap64(x);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    return x;
+}
+
+/**
+ * @brief Copies bit range between buffers
+ *
+ * @param dst Destination buffer
+ * @param dst_bit First destination bit
+ * @param src Source buffer
+ * @param src_bit First source bit
+ * @param len Number of bits
+ *
+ * @note Works a destination word at a time with shift/merge
+ */
+static void copy_bits(uint64_t *dst, size_t dst_bit, uint64_t const *src,
+                      size_t src_bit, size_t len)
+{
+    while (len > 0)
+    {
+        const size_t db = dst_bit % 64;
+        const size_t chunk = (64 - db < len) ? 64 - db : len;
+
+        write_bits(dst, dst_bit, chunk, read_bits(src, src_bit, chunk));
+
+        dst_bit += chunk;
+        src_bit += chunk;
+        len -= chunk;
+    }
+}
+
+/**
+ * @brief Copies bit range between buffers (for other translation units)
+ */
+void ma_copy_bits(uint64_t *dst, size_t dst_bit, uint64_t const *src,
+                  size_t src_bit, size_t len)
+{
+    copy_bits(dst, dst_bit, src, src_bit, len);
+}
+
+/**
+ * @brief Copies bit range between buffers reversing its order
+ *
+ * @param dst Destination buffer
+ * @param dst_bit First destination bit
+ * @param src Source buffer
+ * @param src_bit Source bit copied to dst_bit (following ones descend)
+ * @param len Number of bits
+ */
+static void copy_bits_reversed(uint64_t *dst, size_t dst_bit, uint64_t const *src,
+                               size_t src_bit, size_t len)
+{
+    while (len > 0)
+    {
+        const size_t db = dst_bit % 64;
+        const size_t chunk = (64 - db < len) ? 64 - db : len;
+
+        /* Source bits [src_bit - chunk + 1, src_bit] land reversed */
+        const uint64_t value = read_bits(src, src_bit + 1 - chunk, chunk);
+        write_bits(dst, dst_bit, chunk, reverse_bits(value) >> (64 - chunk));
+
+        dst_bit += chunk;
+        src_bit -= chunk;
+        len -= chunk;
+    }
+}
+
+/**
+ * @brief Portable equivalent of BMI2 pext
+ */
+static inline uint64_t extract_bits(uint64_t value, uint64_t mask)
+{
+    uint64_t result = 0;
+    for (uint64_t bit = 1; mask; bit <<= 1)
+    {
+        if (value & mask & -mask)
+            result |= bit;
+        mask &= mask - 1;
+    }
+    return result;
+}
+
+/**
+ * @brief Portable equivalent of BMI2 pdep
+ */
+static inline uint64_t deposit_bits(uint64_t value, uint64_t mask)
+{
+    uint64_t result = 0;
+    for (uint64_t bit = 1; mask; bit <<= 1)
+    {
+        if (value & bit)
+            result |= mask & -mask;
+        mask &= mask - 1;
+    }
+    return result;
+}
+
+/**
+ * @brief Moves scattered bits of automaton using portable bit loops
+ *
+ * @param a Automaton with compiled masks
+ */
+static void apply_masks_portable(moore_t *a)
+{
+    for (size_t k = 0; k < a->mask_count; k++)
+    {
+        const gather_mask *mk = &a->masks[k];
+        const uint64_t bits = extract_bits(mk->src->output[mk->src_word], mk->src_mask);
+        a->final_input[mk->dst_word] = (a->final_input[mk->dst_word] & ~mk->dst_mask) |
+                                       deposit_bits(bits, mk->dst_mask);
+    }
+}
+
+#ifdef __x86_64__ /* _pext_u64 and _pdep_u64 do not exist on i386 */
+/**
+ * @brief Moves scattered bits of automaton using BMI2 pext/pdep
+ *
+ * @param a Automaton with compiled masks
+ */
+__attribute__((target("bmi2"))) static void apply_masks_bmi2(moore_t *a)
+{
+    for (size_t k = 0; k < a->mask_count; k++)
+    {
+        const gather_mask *mk = &a->masks[k];
+        const uint64_t bits = _pext_u64(mk->src->output[mk->src_word], mk->src_mask);
+        a->final_input[mk->dst_word] = (a->final_input[mk->dst_word] & ~mk->dst_mask) |
+                                       _pdep_u64(bits, mk->dst_mask);
+    }
+}
+
+static _Atomic int bmi2_supported = -1; /* Cached result of cpu_has_bmi2 */
+
+/**
+ * @brief Checks once whether CPU supports BMI2
+ *
+ * @note Threads stepping separate networks may race on the first call;
+ *       they store the same value
+ */
+static bool cpu_has_bmi2(void)
+{
+    int supported = atomic_load_explicit(&bmi2_supported, memory_order_relaxed);
+    if (supported < 0)
+    {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("bmi2") ? 1 : 0;
+        atomic_store_explicit(&bmi2_supported, supported, memory_order_relaxed);
+    }
+    return supported;
+}
+#endif
+
+/**
+ * @brief Moves scattered bits of automaton with the best available method
+ *
+ * @param a Automaton with compiled masks
+ */
+static inline void apply_masks(moore_t *a)
+{
+#ifdef __x86_64__
+    if (cpu_has_bmi2())
+    {
+        apply_masks_bmi2(a);
+        return;
+    }
+#endif
+    apply_masks_portable(a);
+}
+
+/**
+ * @brief Allows or forbids the BMI2 path of the gather (for tests)
+ *
+ * @param enable false forces portable bit loops, true uses BMI2 if the CPU has it
+ * @return true if masks are now moved with BMI2
+ */
+bool ma_gather_use_bmi2(bool enable)
+{
+#ifdef __x86_64__
+    atomic_store_explicit(&bmi2_supported, enable ? -1 : 0, memory_order_relaxed);
+    return cpu_has_bmi2();
+#else
+    (void)enable;
+    return false;
+#endif
+}
+
+/**
+ * @brief Appends run to gather plan of automaton
+ *
+ * @param a Automaton
+ * @param run Run to append
  * @return 0 on success, -1 on error
+ */
+static int append_run(moore_t *a, gather_run run)
+{
+    if (a->run_count == a->run_capacity)
+    {
+        const size_t new_capacity = (a->run_capacity == 0) ? 4 : a->run_capacity * 2;
+        gather_run *new_ptr = ma_mem_realloc(a->runs, a->run_capacity * sizeof(gather_run),
+                                             new_capacity * sizeof(gather_run));
+        if (!new_ptr)
+            return -1;
+
+        a->runs = new_ptr;
+        a->run_capacity = new_capacity;
+    }
+
+    a->runs[a->run_count++] = run;
+    return 0;
+}
+
+/**
+ * @brief Appends mask to gather plan of automaton
  *
- * @note All automata operate synchronously and in parallel
+ * @param a Automaton
+ * @param mask Mask to append
+ * @return 0 on success, -1 on error
  */
-int ma_step(moore_t *at[], size_t num)
+static int append_mask(moore_t *a, gather_mask mask)
 {
-    if (num == 0 || !at)
+    if (a->mask_count == a->mask_capacity)
     {
-        errno = EINVAL;
-        return -1;
+        const size_t new_capacity = (a->mask_capacity == 0) ? 4 : a->mask_capacity * 2;
+        gather_mask *new_ptr = ma_mem_realloc(a->masks, a->mask_capacity * sizeof(gather_mask),
+                                              new_capacity * sizeof(gather_mask));
+        if (!new_ptr)
+            return -1;
+
+        a->masks = new_ptr;
+        a->mask_capacity = new_capacity;
     }
 
-    /* Update inputs of all automata */
-    for (size_t i = 0; i < num; i++)
+    a->masks[a->mask_count++] = mask;
+    return 0;
+}
+
+/**
+ * @brief Single connected bit awaiting grouping into masks
+ */
+typedef struct
+{
+    moore_t *src;   /* Source automaton */
+    size_t src_bit; /* Output bit of source */
+    size_t dst_bit; /* Input bit of receiving automaton */
+} gather_bit;
+
+/**
+ * @brief Comparator ordering bits by (input word, source, source word, input bit)
+ */
+static int compare_gather_bits(void const *lhs, void const *rhs)
+{
+    const gather_bit *l = lhs, *r = rhs;
+
+    if (l->dst_bit / 64 != r->dst_bit / 64)
+        return l->dst_bit / 64 < r->dst_bit / 64 ? -1 : 1;
+    if (l->src != r->src)
+        return (uintptr_t)l->src < (uintptr_t)r->src ? -1 : 1;
+    if (l->src_bit / 64 != r->src_bit / 64)
+        return l->src_bit / 64 < r->src_bit / 64 ? -1 : 1;
+    return (l->dst_bit > r->dst_bit) - (l->dst_bit < r->dst_bit);
+}
+
+/**
+ * @brief Compiles bits sharing input word, source and source word into masks
+ *
+ * @param a Automaton
+ * @param bits Bits of one group sorted by input bit
+ * @param count Number of bits
+ * @return 0 on success, -1 on error
+ *
+ * @note pext/pdep keep bit order, so the group is split greedily into
+ *       chains whose source bits ascend; a permutation needs one mask per
+ *       chain (e.g. two for an interleave)
+ */
+static int compile_mask_group(moore_t *a, gather_bit const *bits, size_t count)
+{
+    uint64_t src_masks[64], dst_masks[64];
+    unsigned last_src[64];
+    size_t chains = 0;
+
+    for (size_t i = 0; i < count; i++)
     {
-        if (!at[i])
+        const unsigned sb = (unsigned)(bits[i].src_bit % 64);
+        const unsigned db = (unsigned)(bits[i].dst_bit % 64);
+
+        size_t c = 0;
+        while (c < chains && last_src[c] >= sb)
+            c++;
+
+        if (c == chains)
         {
-            errno = EINVAL;
-            return -1;
+            src_masks[c] = 0;
+            dst_masks[c] = 0;
+            chains++;
         }
-        update_final_input(at[i]);
+
+        src_masks[c] |= (uint64_t)1 << sb;
+        dst_masks[c] |= (uint64_t)1 << db;
+        last_src[c] = sb;
     }
 
-    /* Calculate next states */
-    for (size_t j = 0; j < num; j++)
+    for (size_t c = 0; c < chains; c++)
     {
-        moore_t *a = at[j];
-        a->t(a->next_state, a->final_input, a->state, a->n, a->s);
+        const gather_mask mask = {bits[0].src, bits[0].src_bit / 64, bits[0].dst_bit / 64,
+                                  src_masks[c], dst_masks[c]};
+        if (append_mask(a, mask) != 0)
+            return -1;
     }
 
-    /* Update states and calculate outputs */
-    for (size_t k = 0; k < num; k++)
+    return 0;
+}
+
+/**
+ * @brief Replaces short runs of gather plan with pext/pdep masks
+ *
+ * @param a Automaton with runs built
+ * @return 0 on success, -1 on error
+ */
+static int compile_scattered_bits(moore_t *a)
+{
+    size_t scattered = 0;
+    for (size_t r = 0; r < a->run_count; r++)
+        if (a->runs[r].len < GATHER_MASK_MAX_RUN)
+            scattered += a->runs[r].len;
+
+    if (scattered == 0)
+        return 0;
+
+    gather_bit *bits = ma_mem_alloc(scattered * sizeof(gather_bit));
+    if (!bits)
+        return -1;
+
+    /* Split short runs into bits and keep long runs */
+    size_t b = 0, kept = 0;
+    for (size_t r = 0; r < a->run_count; r++)
     {
-        moore_t *a = at[k];
+        const gather_run run = a->runs[r];
+        if (run.len >= GATHER_MASK_MAX_RUN)
+        {
+            a->runs[kept++] = run;
+            continue;
+        }
 
-        /* Swap state buffers */
-        uint64_t *tmp = a->state;
-        a->state = a->next_state;
-        a->next_state = tmp;
+        for (size_t k = 0; k < run.len; k++)
+        {
+            bits[b].src = run.src;
+            bits[b].src_bit = run.reversed ? run.src_bit - k : run.src_bit + k;
+            bits[b].dst_bit = run.dst_bit + k;
+            b++;
+        }
+    }
+    a->run_count = kept;
 
-        /* Calculate new output */
-        a->y(a->output, a->state, a->m, a->s);
+    qsort(bits, scattered, sizeof(gather_bit), compare_gather_bits);
+
+    int result = 0;
+    for (size_t first = 0; first < scattered && result == 0;)
+    {
+        size_t last = first + 1;
+        while (last < scattered && bits[last].dst_bit / 64 == bits[first].dst_bit / 64 &&
+               bits[last].src == bits[first].src &&
+               bits[last].src_bit / 64 == bits[first].src_bit / 64)
+            last++;
+
+        result = compile_mask_group(a, bits + first, last - first);
+        first = last;
     }
 
+    ma_mem_free(bits, scattered * sizeof(gather_bit));
+    return result;
+}
+
+/**
+ * @brief Compiles connections of automaton into runs and picks input view
+ *
+ * @param a Automaton
+ * @return 0 on success, -1 on error (plan stays dirty)
+ *
+ * @note Runs shorter than GATHER_MASK_MAX_RUN are regrouped into
+ *       pext/pdep masks per (input word, source word) pair
+ * @note In MA_INPUT_SHARED mode an automaton whose inputs are all
+ *       unconnected, or all come in one run from a word-aligned output
+ *       range, reads that buffer directly and needs no gather
+ */
+static int build_gather_plan(moore_t *a)
+{
+    a->run_count = 0;
+    a->mask_count = 0;
+    a->connected_inputs = 0;
+
+    for (size_t i = 0; i < a->n; i++)
+    {
+        moore_t *src = a->incoming_connections[i].source_automaton;
+        const size_t src_idx = a->incoming_connections[i].source_output_index;
+        if (!src || src->magic != MOORE_MAGIC || src_idx >= src->m)
+            continue;
+
+        a->connected_inputs++;
+
+        /* Extend previous run if this bit continues it */
+        if (a->run_count > 0)
+        {
+            gather_run *last = &a->runs[a->run_count - 1];
+            if (last->src == src && last->dst_bit + last->len == i)
+            {
+                if (!last->reversed && last->src_bit + last->len == src_idx)
+                {
+                    last->len++;
+                    continue;
+                }
+                if ((last->reversed || last->len == 1) && src_idx + last->len == last->src_bit)
+                {
+                    last->reversed = true;
+                    last->len++;
+                    continue;
+                }
+            }
+        }
+
+        const gather_run run = {src, src_idx, i, 1, false};
+        if (append_run(a, run) != 0)
+            return -1;
+    }
+
+    if (compile_scattered_bits(a) != 0)
+        return -1;
+
+    a->input_view = a->final_input;
+    if (a->input_mode == MA_INPUT_SHARED)
+    {
+        if (a->connected_inputs == 0)
+        {
+            a->input_view = a->manual_input;
+        }
+        else if (a->run_count == 1 && a->mask_count == 0 && a->connected_inputs == a->n &&
+                 !a->runs[0].reversed && a->runs[0].src_bit % 64 == 0)
+        {
+            a->input_view = a->runs[0].src->output + a->runs[0].src_bit / 64;
+        }
+    }
+
+    a->plan_dirty = false;
+    return 0;
+}
+
+/**
+ * @brief Updates final input signals of automaton
+ *
+ * @param a Automaton to update
+ *
+ * @note Combines signals from connections and manual_input into one final_input buffer
+ */
+static void update_final_input(moore_t *a)
+{
+    if (!a || a->n == 0 || !a->final_input ||
+        !a->manual_input || !a->incoming_connections)
+        return;
+
+    if (a->mailbox)
+        consume_mailbox(a);
+
+    if (a->plan_dirty && build_gather_plan(a) != 0)
+    {
+        a->input_view = a->final_input;
+        gather_bitwise(a);
+        return;
+    }
+
+    /* Input is read in place from manual_input or a source's output */
+    if (a->input_view != a->final_input)
+        return;
+
+    const size_t n_words = (a->n + 63) / 64;
+
+    /* Unconnected inputs take values set by ma_set_input */
+    if (a->connected_inputs < a->n)
+    {
+        memcpy(a->final_input, a->manual_input, n_words * sizeof(uint64_t));
+        if (a->n % 64 != 0)
+            a->final_input[n_words - 1] &= ((uint64_t)1 << (a->n % 64)) - 1;
+    }
+
+    /* Copy connected runs */
+    for (size_t r = 0; r < a->run_count; r++)
+    {
+        const gather_run *run = &a->runs[r];
+
+        /* Overlap the miss on a later source's output with this run */
+        if (r + 1 < a->run_count)
+            MA_PREFETCH(a->runs[r + 1].src->output);
+
+        if (run->reversed)
+            copy_bits_reversed(a->final_input, run->dst_bit, run->src->output,
+                               run->src_bit, run->len);
+        else
+            copy_bits(a->final_input, run->dst_bit, run->src->output, run->src_bit, run->len);
+    }
+
+    /* Move scattered bits */
+    if (a->mask_count > 0)
+        apply_masks(a);
+}
+
+/**
+ * @brief Selects how inputs of automaton are passed to its transition function
+ *
+ * @param a Pointer to automaton
+ * @param mode MA_INPUT_COPY or MA_INPUT_SHARED
+ * @return 0 on success, -1 on error
+ *
+ * @note In MA_INPUT_SHARED mode t may receive a pointer into the manual
+ *       input buffer or a source's output buffer, so it must ignore
+ *       input bits at positions n and above
+ */
+int ma_set_input_mode(moore_t *a, int mode)
+{
+    if (!a || (mode != MA_INPUT_COPY && mode != MA_INPUT_SHARED))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    a->input_mode = mode;
+    a->plan_dirty = true;
+    return 0;
+}
+
+/**
+ * @brief Sets clock divider and phase of automaton
+ *
+ * @param a Pointer to automaton
+ * @param divider Cycles per clock period (1 ticks on every cycle)
+ * @param phase Cycle of the period on which the clock ticks (below divider)
+ * @return 0 on success, -1 on error
+ *
+ * @note On cycles without a tick the automaton is not gathered, stepped
+ *       or output; its state and outputs hold
+ * @note ma_step counts cycles per automaton from this call; a network
+ *       uses ma_net_cycle and takes clocks when it is created, so clocks
+ *       must not change while the automaton belongs to a network
+ */
+int ma_set_clock(moore_t *a, uint64_t divider, uint64_t phase)
+{
+    if (!a || divider == 0 || phase >= divider)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    a->clock_divider = divider;
+    a->clock_phase = phase;
+    a->clock_count = 0;
+    a->clocked = divider > 1 || a->clock_gate;
+    a->idle = false;
+    return 0;
+}
+
+/**
+ * @brief Checks whether any input of automaton is connected to source
+ */
+static bool has_input_from(moore_t const *a_in, moore_t const *src)
+{
+    for (size_t j = 0; j < a_in->n; j++)
+    {
+        if (a_in->incoming_connections[j].source_automaton == src)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Gates clock of automaton with an output bit of another automaton
+ *
+ * @param a Pointer to automaton
+ * @param gate Automaton providing the enable bit (NULL removes the gate)
+ * @param bit Output bit of gate
+ * @return 0 on success, -1 on error
+ *
+ * @note The clock ticks only while the bit is 1 at the start of a cycle;
+ *       deleting gate removes the gate
+ */
+int ma_set_clock_gate(moore_t *a, moore_t *gate, size_t bit)
+{
+    if (!a || (gate && (gate->magic != MOORE_MAGIC || bit >= gate->m)))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* The gate is tracked like a connection so ma_delete can clear it */
+    if (gate && append_to_connected_list(gate, a) != 0)
+        return -1;
+
+    moore_t *old = a->clock_gate;
+    a->clock_gate = gate;
+    a->clock_gate_bit = gate ? bit : 0;
+    if (old && old != gate && !has_input_from(a, old))
+        remove_connected(a, old);
+
+    a->clocked = a->clock_divider > 1 || gate;
+    a->idle = false;
+    return 0;
+}
+
+/**
+ * @brief Prefetches buffers read by gather of automaton
+ *
+ * @param a Automaton (its structure should already be in cache)
+ */
+static inline void prefetch_gather_buffers(moore_t const *a)
+{
+    MA_PREFETCH(a->runs);
+    MA_PREFETCH(a->masks);
+    MA_PREFETCH(a->manual_input);
+    MA_PREFETCH_W(a->final_input);
+}
+
+/**
+ * @brief Prefetches structures of first sources of automaton
+ *
+ * @param a Automaton (its gather plan should already be in cache)
+ */
+static inline void prefetch_gather_sources(moore_t const *a)
+{
+    if (a->plan_dirty)
+        return;
+
+    const size_t count = a->run_count < PREFETCH_SOURCE_ENTRIES ? a->run_count
+                                                                : PREFETCH_SOURCE_ENTRIES;
+    for (size_t j = 0; j < count; j++)
+        MA_PREFETCH(a->runs[j].src);
+}
+
+/**
+ * @brief Gathers inputs of automata with a prefetch pipeline
+ *
+ * @param at Array of pointers to automata
+ * @param num Number of automata in array
+ * @param d Prefetch distance (0 disables prefetching)
+ *
+ * @param clocked Evaluate clocks of automata (ma_step) and mark idle ones
+ *
+ * @note Structure of automaton i+d, its buffers at i+d/2 and its sources
+ *       at i+d/4 are requested while automaton i is processed
+ */
+static void gather_phase(moore_t *const *at, size_t num, size_t d, bool clocked)
+{
+    const size_t d2 = d / 2, d4 = d / 4;
+
+    for (size_t i = 0; i < num; i++)
+    {
+        if (d)
+        {
+            if (i + d < num)
+                MA_PREFETCH(at[i + d]);
+            if (i + d2 < num)
+                prefetch_gather_buffers(at[i + d2]);
+            if (i + d4 < num)
+                prefetch_gather_sources(at[i + d4]);
+        }
+
+        /* Idle automata skip the whole step */
+        if (clocked && at[i]->clocked)
+        {
+            moore_t *a = at[i];
+            a->idle = !clock_ticks(a, a->clock_count++);
+            if (a->idle)
+                continue;
+        }
+        update_final_input(at[i]);
+    }
+}
+
+/**
+ * @brief Prefetches data used by transition of automata ahead of position i
+ *
+ * @param at Array of pointers to automata
+ * @param num Number of automata in array
+ * @param i Position being processed
+ * @param d Distance of structure prefetch
+ * @param d2 Distance of buffer prefetch
+ */
+static inline void prefetch_transition(moore_t *const *at, size_t num,
+                                       size_t i, size_t d, size_t d2)
+{
+    if (i + d < num)
+        MA_PREFETCH(at[i + d]);
+    if (i + d2 < num)
+    {
+        moore_t const *ahead = at[i + d2];
+        MA_PREFETCH(ahead->state);
+        MA_PREFETCH(ahead->final_input);
+        MA_PREFETCH_W(ahead->next_state);
+    }
+}
+
+/**
+ * @brief Prefetches data used by commit of automata ahead of position i
+ *
+ * @param at Array of pointers to automata
+ * @param num Number of automata in array
+ * @param i Position being processed
+ * @param d Distance of structure prefetch
+ * @param d2 Distance of buffer prefetch
+ */
+static inline void prefetch_commit(moore_t *const *at, size_t num,
+                                   size_t i, size_t d, size_t d2)
+{
+    if (i + d < num)
+        MA_PREFETCH_W(at[i + d]);
+    if (i + d2 < num)
+    {
+        moore_t const *ahead = at[i + d2];
+        MA_PREFETCH(ahead->next_state);
+        MA_PREFETCH_W(ahead->output);
+    }
+}
+
+/**
+ * @brief Calculates next states of automata with a prefetch pipeline
+ *
+ * @param at Array of pointers to automata
+ * @param num Number of automata in array
+ * @param d Prefetch distance (0 disables prefetching)
+ * @param clocked Skip automata marked idle by gather_phase
+ */
+static void transition_phase(moore_t *const *at, size_t num, size_t d, bool clocked)
+{
+    const size_t d2 = d / 2;
+
+    for (size_t i = 0; i < num; i++)
+    {
+        if (d)
+            prefetch_transition(at, num, i, d, d2);
+        if (clocked && at[i]->idle)
+            continue;
+        run_transition(at[i]);
+    }
+}
+
+/**
+ * @brief Swaps state buffers and calculates outputs with a prefetch pipeline
+ *
+ * @param at Array of pointers to automata
+ * @param num Number of automata in array
+ * @param d Prefetch distance (0 disables prefetching)
+ * @param clocked Skip automata marked idle by gather_phase
+ * @return false if an in-place automaton lost a write and kept its state
+ */
+static bool commit_phase(moore_t *const *at, size_t num, size_t d, bool clocked)
+{
+    const size_t d2 = d / 2;
+    bool committed = true;
+
+    for (size_t i = 0; i < num; i++)
+    {
+        if (d)
+            prefetch_commit(at, num, i, d, d2);
+
+        moore_t *a = at[i];
+        if (clocked && a->idle)
+            continue;
+
+        /* Swap state buffers or apply logged writes */
+        committed &= commit_state(a);
+
+        /* Calculate new output */
+        run_output(a);
+    }
+    return committed;
+}
+
+/**
+ * @brief Sets software prefetch distance used by step loops
+ *
+ * @param d Distance in automata, 0 to disable, or MA_PREFETCH_AUTO
+ *
+ * @note In automatic mode ma_step uses a fixed default and networks
+ *       calibrate the distance during their first steps
+ * @note Affects networks created after the call
+ */
+void ma_set_prefetch_distance(size_t d)
+{
+    prefetch_distance = d;
+}
+
+/**
+ * @brief Returns prefetch distance used by ma_step
+ */
+static inline size_t step_prefetch_distance(void)
+{
+    return prefetch_distance == MA_PREFETCH_AUTO ? DEFAULT_PREFETCH_DISTANCE
+                                                 : prefetch_distance;
+}
+
+/**
+ * @brief Executes one simulation step for given automata
+ *
+ * @param at Array of pointers to automata
+ * @param num Number of automata in array
+ * @return 0 on success, -1 on error
+ *
+ * @note All automata operate synchronously and in parallel
+ * @note Each call is one cycle of every clocked automaton in the array;
+ *       idle automata keep their inputs, state and outputs
+ * @note errno is ENOMEM if an in-place automaton could not record a write;
+ *       it keeps its previous state while all other automata step
+ */
+int ma_step(moore_t *at[], size_t num)
+{
+    if (num == 0 || !at)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    bool clocked = false;
+    for (size_t i = 0; i < num; i++)
+    {
+        if (!at[i])
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        clocked |= at[i]->clocked;
+    }
+
+    const size_t d = step_prefetch_distance();
+
+    /* Update inputs of all automata */
+    gather_phase(at, num, d, clocked);
+
+    /* Calculate next states */
+    transition_phase(at, num, d, clocked);
+
+    /* Update states and calculate outputs */
+    if (!commit_phase(at, num, d, clocked))
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Gathers inputs of automata (first part of ma_step)
+ *
+ * @param at Array of pointers to automata (validated by caller)
+ * @param num Number of automata in array
+ */
+void ma_step_gather(moore_t *const *at, size_t num)
+{
+    gather_phase(at, num, step_prefetch_distance(), true);
+}
+
+/**
+ * @brief Calculates next states and outputs of automata (rest of ma_step)
+ *
+ * @param at Array of pointers to automata (validated by caller)
+ * @param num Number of automata in array
+ * @return 0 on success, -1 if an in-place automaton lost a write (see ma_step)
+ */
+int ma_step_update(moore_t *const *at, size_t num)
+{
+    const size_t d = step_prefetch_distance();
+    transition_phase(at, num, d, true);
+    if (!commit_phase(at, num, d, true))
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Run of consecutive automata sharing the same function
+ */
+typedef struct
+{
+    size_t start; /* Index of first automaton of the run in network order */
+    size_t count; /* Number of automata in the run */
+    ma_group_transition_t kernel; /* Built-in kernel stepping the whole run (or NULL) */
+} ma_group_t;
+
+/**
+ * @brief Run of consecutive automata sharing one clock, with its groups
+ */
+typedef struct
+{
+    size_t start;   /* Index of first automaton of the run in network order */
+    size_t count;   /* Number of automata in the run */
+    size_t t_first; /* First transition group of the run */
+    size_t t_count; /* Number of transition groups */
+    size_t y_first; /* First output group of the run */
+    size_t y_count; /* Number of output groups */
+} ma_domain_t;
+
+/**
+ * @brief Structure representing a compiled network of automata
+ *
+ * Holds a private copy of the automata list (possibly reordered),
+ * precomputed dispatch groups and clock domains used by ma_net_step.
+ */
+struct ma_net
+{
+    moore_t **at;      /* Automata in evaluation order */
+    size_t num;        /* Number of automata */
+    unsigned flags;    /* MA_NET_* flags given at creation */
+    uint64_t cycle;    /* Number of steps executed so far */
+    _Atomic uint64_t own_seq; /* Output seqlock used unless outputs are exported */
+    _Atomic uint64_t *seq;    /* Output seqlock: odd while commit phase rewrites outputs */
+
+    /* Software prefetching */
+    size_t prefetch;       /* Prefetch distance used by steps */
+    size_t calibration;    /* Index of candidate being timed (CALIBRATION_DONE when fixed) */
+    uint64_t best_ns;      /* Best step time seen during calibration */
+    size_t best_prefetch;  /* Distance which achieved best_ns */
+
+    /* Dispatch groups (only with MA_NET_GROUP_DISPATCH) */
+    ma_group_t *t_groups; /* Runs with the same transition function */
+    size_t t_group_count;
+    ma_group_t *y_groups; /* Runs with the same output function */
+    size_t y_group_count;
+
+    /* Clock domains (a single one covering all automata without clocks) */
+    ma_domain_t *domains; /* Runs with the same divider, phase and gate */
+    size_t domain_count;
+    size_t *active;       /* Domains ticking in current step */
+};
+
+/* Prefetch distances tried by automatic calibration, one per step */
+static const size_t calibration_candidates[] = {0, 0, 2, 2, 4, 4, 8, 8, 16, 16, 32, 32, 64, 64};
+#define CALIBRATION_COUNT (sizeof(calibration_candidates) / sizeof(calibration_candidates[0]))
+#define CALIBRATION_DONE SIZE_MAX
+#define CALIBRATION_MIN_AUTOMATA 256 /* Smaller networks use the default distance */
+
+/* Helper functions returning function identity used as grouping key */
+static inline uintptr_t transition_key(moore_t const *a)
+{
+    if (a->t)
+        return (uintptr_t)a->t;
+    return a->t_ex ? (uintptr_t)a->t_ex : (uintptr_t)a->t_log;
+}
+
+static inline uintptr_t output_key(moore_t const *a)
+{
+    return a->y ? (uintptr_t)a->y : (uintptr_t)a->y_ex;
+}
+
+/**
+ * @brief Orders automata by clock (divider, phase, gate, gate bit)
+ *
+ * @return Negative, zero or positive like a qsort comparator
+ */
+static int compare_clocks(moore_t const *l, moore_t const *r)
+{
+    if (l->clock_divider != r->clock_divider)
+        return l->clock_divider < r->clock_divider ? -1 : 1;
+    if (l->clock_phase != r->clock_phase)
+        return l->clock_phase < r->clock_phase ? -1 : 1;
+    if (l->clock_gate != r->clock_gate)
+        return (uintptr_t)l->clock_gate < (uintptr_t)r->clock_gate ? -1 : 1;
+    return (l->clock_gate_bit > r->clock_gate_bit) - (l->clock_gate_bit < r->clock_gate_bit);
+}
+
+/**
+ * @brief Sort entry used to stably reorder automata by their functions
+ */
+typedef struct
+{
+    moore_t *a;   /* Automaton */
+    size_t index; /* Position in the caller's array (stability tie-breaker) */
+} net_sort_entry;
+
+/**
+ * @brief Comparator ordering automata by (clock, index)
+ */
+static int compare_net_clocks(void const *lhs, void const *rhs)
+{
+    const net_sort_entry *l = lhs, *r = rhs;
+    const int clock = compare_clocks(l->a, r->a);
+    if (clock)
+        return clock;
+
+    return (l->index > r->index) - (l->index < r->index);
+}
+
+/**
+ * @brief Comparator ordering automata by (clock, transition, output, index)
+ */
+static int compare_net_entries(void const *lhs, void const *rhs)
+{
+    const net_sort_entry *l = lhs, *r = rhs;
+    const int clock = compare_clocks(l->a, r->a);
+    if (clock)
+        return clock;
+
+    const uintptr_t lt = transition_key(l->a), rt = transition_key(r->a);
+    if (lt != rt)
+        return lt < rt ? -1 : 1;
+
+    const uintptr_t ly = output_key(l->a), ry = output_key(r->a);
+    if (ly != ry)
+        return ly < ry ? -1 : 1;
+
+    return (l->index > r->index) - (l->index < r->index);
+}
+
+/**
+ * @brief Splits network order into runs with equal key and clock
+ *
+ * @param at Automata in network order
+ * @param num Number of automata
+ * @param key Key function
+ * @param count Output: number of runs
+ * @return Newly allocated array of runs or NULL on error
+ */
+static ma_group_t *build_groups(moore_t *const *at, size_t num,
+                                uintptr_t (*key)(moore_t const *), size_t *count)
+{
+    ma_group_t *groups = ma_mem_alloc(num * sizeof(ma_group_t));
+    if (!groups)
+        return NULL;
+
+    size_t g = 0;
+    for (size_t i = 0; i < num; i++)
+    {
+        if (g > 0 && key(at[i]) == key(at[groups[g - 1].start]) &&
+            compare_clocks(at[i], at[groups[g - 1].start]) == 0)
+        {
+            groups[g - 1].count++;
+        }
+        else
+        {
+            groups[g].start = i;
+            groups[g].count = 1;
+            g++;
+        }
+    }
+
+    *count = g;
+    return groups;
+}
+
+/**
+ * @brief Splits network order into clock domains and assigns their groups
+ *
+ * @param net Network with automata sorted by clock (and groups, if any)
+ * @return 0 on success, -1 on error
+ */
+static int build_domains(ma_net_t *net)
+{
+    size_t count = 1;
+    for (size_t i = 1; i < net->num; i++)
+    {
+        if (compare_clocks(net->at[i], net->at[i - 1]) != 0)
+            count++;
+    }
+
+    net->domain_count = count;
+    net->domains = ma_mem_calloc(count, sizeof(ma_domain_t));
+    net->active = ma_mem_alloc(count * sizeof(size_t));
+    if (!net->domains || !net->active)
+        return -1;
+
+    size_t k = 0;
+    for (size_t i = 1; i <= net->num; i++)
+    {
+        if (i == net->num || compare_clocks(net->at[i], net->at[i - 1]) != 0)
+        {
+            net->domains[k].count = i - net->domains[k].start;
+            if (++k < count)
+                net->domains[k].start = i;
+        }
+    }
+
+    /* Groups never cross domains, so each domain owns a run of them */
+    size_t tg = 0, yg = 0;
+    for (k = 0; k < count; k++)
+    {
+        ma_domain_t *domain = &net->domains[k];
+        const size_t end = domain->start + domain->count;
+
+        domain->t_first = tg;
+        while (tg < net->t_group_count && net->t_groups[tg].start < end)
+            tg++;
+        domain->t_count = tg - domain->t_first;
+
+        domain->y_first = yg;
+        while (yg < net->y_group_count && net->y_groups[yg].start < end)
+            yg++;
+        domain->y_count = yg - domain->y_first;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Frees network and its arrays
+ *
+ * @param net Network (its num field gives sizes of arrays)
+ */
+static void net_free(ma_net_t *net)
+{
+    ma_mem_free(net->at, net->num * sizeof(moore_t *));
+    ma_mem_free(net->t_groups, net->num * sizeof(ma_group_t));
+    ma_mem_free(net->y_groups, net->num * sizeof(ma_group_t));
+    ma_mem_free(net->domains, net->domain_count * sizeof(ma_domain_t));
+    ma_mem_free(net->active, net->domain_count * sizeof(size_t));
+    ma_mem_free(net, sizeof(ma_net_t));
+}
+
+/**
+ * @brief Creates a compiled network from a set of automata
+ *
+ * @param at Array of pointers to automata (copied, caller keeps ownership)
+ * @param num Number of automata in array
+ * @param flags Combination of MA_NET_* flags
+ * @return Pointer to new network or NULL on error
+ *
+ * @note Automata must not be deleted while they belong to a network
+ * @note With MA_NET_GROUP_DISPATCH automata are stably reordered so that
+ *       those sharing t/y run back-to-back; results are identical to ma_step
+ * @note Automata sharing a clock (ma_set_clock, ma_set_clock_gate) are
+ *       reordered into one domain; a step visits only ticking domains
+ */
+ma_net_t *ma_net_create(moore_t *at[], size_t num, unsigned flags)
+{
+    if (!at || num == 0 || (flags & ~MA_NET_GROUP_DISPATCH))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    bool clocked = false;
+    for (size_t i = 0; i < num; i++)
+    {
+        if (!at[i] || at[i]->magic != MOORE_MAGIC)
+        {
+            errno = EINVAL;
+            return NULL;
+        }
+        clocked |= at[i]->clocked;
+    }
+
+    if (num > SIZE_MAX / sizeof(net_sort_entry))
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    ma_net_t *net = ma_mem_calloc(1, sizeof(ma_net_t));
+    if (!net)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    atomic_init(&net->own_seq, 0);
+    net->seq = &net->own_seq;
+
+    net->at = ma_mem_alloc(num * sizeof(moore_t *));
+    if (!net->at)
+        goto cleanup_fail;
+
+    net->num = num;
+    net->flags = flags;
+
+    if (prefetch_distance != MA_PREFETCH_AUTO)
+    {
+        net->prefetch = prefetch_distance;
+        net->calibration = CALIBRATION_DONE;
+    }
+    else if (num < CALIBRATION_MIN_AUTOMATA)
+    {
+        net->prefetch = DEFAULT_PREFETCH_DISTANCE;
+        net->calibration = CALIBRATION_DONE;
+    }
+    else
+    {
+        net->prefetch = calibration_candidates[0];
+        net->calibration = 0;
+        net->best_ns = UINT64_MAX;
+    }
+
+    if ((flags & MA_NET_GROUP_DISPATCH) || clocked)
+    {
+        net_sort_entry *entries = ma_mem_alloc(num * sizeof(net_sort_entry));
+        if (!entries)
+            goto cleanup_fail;
+
+        for (size_t i = 0; i < num; i++)
+        {
+            entries[i].a = at[i];
+            entries[i].index = i;
+        }
+        qsort(entries, num, sizeof(net_sort_entry),
+              (flags & MA_NET_GROUP_DISPATCH) ? compare_net_entries : compare_net_clocks);
+        for (size_t i = 0; i < num; i++)
+            net->at[i] = entries[i].a;
+        ma_mem_free(entries, num * sizeof(net_sort_entry));
+    }
+    else
+    {
+        memcpy(net->at, at, num * sizeof(moore_t *));
+    }
+
+    if (flags & MA_NET_GROUP_DISPATCH)
+    {
+        net->t_groups = build_groups(net->at, num, transition_key, &net->t_group_count);
+        if (!net->t_groups)
+            goto cleanup_fail;
+
+        /* Runs of built-in primitives are stepped by one loop each */
+        for (size_t g = 0; g < net->t_group_count; g++)
+            net->t_groups[g].kernel = ma_prim_group_kernel(net->at[net->t_groups[g].start]);
+
+        net->y_groups = build_groups(net->at, num, output_key, &net->y_group_count);
+        if (!net->y_groups)
+            goto cleanup_fail;
+    }
+
+    if (build_domains(net) != 0)
+        goto cleanup_fail;
+
+    return net;
+
+cleanup_fail:
+    errno = ENOMEM;
+    net_free(net);
+    return NULL;
+}
+
+/**
+ * @brief Deletes compiled network (automata themselves are not deleted)
+ *
+ * @param net Pointer to network (can be NULL)
+ */
+void ma_net_delete(ma_net_t *net)
+{
+    if (!net)
+        return;
+
+    net_free(net);
+}
+
+/**
+ * @brief Calculates next states group by group
+ *
+ * @param net Network with dispatch groups
+ * @param first First transition group
+ * @param groups Number of groups
+ *
+ * @note The function pointer is loaded once per group, so the indirect
+ *       call inside the loop always has the same target
+ */
+static void net_transition_grouped(ma_net_t *net, size_t first, size_t groups)
+{
+    const size_t d = net->prefetch, d2 = d / 2;
+
+    for (size_t g = first; g < first + groups; g++)
+    {
+        const size_t start = net->t_groups[g].start;
+        const size_t count = net->t_groups[g].count;
+        moore_t **group = net->at + start;
+
+        if (net->t_groups[g].kernel)
+        {
+            net->t_groups[g].kernel(group, count);
+        }
+        else if (group[0]->t)
+        {
+            const transition_function_t t = group[0]->t;
+            for (size_t i = 0; i < count; i++)
+            {
+                if (d)
+                    prefetch_transition(net->at, net->num, start + i, d, d2);
+                moore_t *a = group[i];
+                t(a->next_state, a->input_view, a->state, a->n, a->s);
+            }
+        }
+        else if (group[0]->t_ex)
+        {
+            const transition_function_ex_t t = group[0]->t_ex;
+            for (size_t i = 0; i < count; i++)
+            {
+                if (d)
+                    prefetch_transition(net->at, net->num, start + i, d, d2);
+                moore_t *a = group[i];
+                t(a->next_state, a->input_view, a->state, a->n, a->s, a->ctx);
+            }
+        }
+        else
+        {
+            const transition_function_log_t t = group[0]->t_log;
+            for (size_t i = 0; i < count; i++)
+            {
+                if (d)
+                    prefetch_transition(net->at, net->num, start + i, d, d2);
+                moore_t *a = group[i];
+                t(&a->log, a->input_view, a->state, a->n, a->s, a->ctx);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Swaps state buffers and calculates outputs group by group
+ *
+ * @param net Network with dispatch groups
+ * @param first First output group
+ * @param groups Number of groups
+ * @return false if an in-place automaton lost a write and kept its state
+ */
+static bool net_commit_grouped(ma_net_t *net, size_t first, size_t groups)
+{
+    const size_t d = net->prefetch, d2 = d / 2;
+    bool committed = true;
+
+    for (size_t g = first; g < first + groups; g++)
+    {
+        const size_t start = net->y_groups[g].start;
+        const size_t count = net->y_groups[g].count;
+        moore_t **group = net->at + start;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            if (d)
+                prefetch_commit(net->at, net->num, start + i, d, d2);
+            committed &= commit_state(group[i]);
+        }
+
+        if (group[0]->y)
+        {
+            const output_function_t y = group[0]->y;
+            for (size_t i = 0; i < count; i++)
+            {
+                moore_t *a = group[i];
+                y(a->output, a->state, a->m, a->s);
+            }
+        }
+        else
+        {
+            const output_function_ex_t y = group[0]->y_ex;
+            for (size_t i = 0; i < count; i++)
+            {
+                moore_t *a = group[i];
+                y(a->output, a->state, a->m, a->s, a->ctx);
+            }
+        }
+    }
+    return committed;
+}
+
+/**
+ * @brief Records time of a calibration step and moves to next candidate
+ *
+ * @param net Network being calibrated
+ * @param ns Duration of the step just executed
+ *
+ * @note Each candidate distance is timed on real steps, so calibration
+ *       has no effect on simulation results
+ */
+static void calibrate_step(ma_net_t *net, uint64_t ns)
+{
+    if (ns < net->best_ns)
+    {
+        net->best_ns = ns;
+        net->best_prefetch = net->prefetch;
+    }
+
+    net->calibration++;
+    if (net->calibration == CALIBRATION_COUNT)
+    {
+        net->prefetch = net->best_prefetch;
+        net->calibration = CALIBRATION_DONE;
+    }
+    else
+    {
+        net->prefetch = calibration_candidates[net->calibration];
+    }
+}
+
+/**
+ * @brief Executes one simulation step for all automata of network
+ *
+ * @param net Pointer to network
+ * @return 0 on success, -1 on error
+ *
+ * @note Equivalent to ma_step on the array given to ma_net_create, except
+ *       that clock dividers count ma_net_cycle; idle domains cost O(1)
+ * @note Like ma_step, fails with ENOMEM after completing the cycle if an
+ *       in-place automaton lost a write (that automaton keeps its state)
+ */
+int ma_net_step(ma_net_t *net)
+{
+    if (!net)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct timespec begin, end;
+    const bool calibrating = net->calibration != CALIBRATION_DONE;
+    if (calibrating)
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+
+    /* Domains whose clock ticks (gates are read before outputs change) */
+    size_t active = 0;
+    for (size_t k = 0; k < net->domain_count; k++)
+    {
+        if (clock_ticks(net->at[net->domains[k].start], net->cycle))
+            net->active[active++] = k;
+    }
+
+    /* Update inputs of ticking automata */
+    for (size_t k = 0; k < active; k++)
+    {
+        const ma_domain_t *domain = &net->domains[net->active[k]];
+        gather_phase(net->at + domain->start, domain->count, net->prefetch, false);
+    }
+
+    /* Calculate next states */
+    for (size_t k = 0; k < active; k++)
+    {
+        const ma_domain_t *domain = &net->domains[net->active[k]];
+        if (net->flags & MA_NET_GROUP_DISPATCH)
+            net_transition_grouped(net, domain->t_first, domain->t_count);
+        else
+            transition_phase(net->at + domain->start, domain->count, net->prefetch, false);
+    }
+
+    /* Update states and calculate outputs (readers retry meanwhile) */
+    const uint64_t seq = atomic_load_explicit(net->seq, memory_order_relaxed);
+    atomic_store_explicit(net->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    bool committed = true;
+    for (size_t k = 0; k < active; k++)
+    {
+        const ma_domain_t *domain = &net->domains[net->active[k]];
+        if (net->flags & MA_NET_GROUP_DISPATCH)
+            committed &= net_commit_grouped(net, domain->y_first, domain->y_count);
+        else
+            committed &= commit_phase(net->at + domain->start, domain->count, net->prefetch, false);
+    }
+
+    atomic_store_explicit(net->seq, seq + 2, memory_order_release);
+
+    if (calibrating)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        calibrate_step(net, (uint64_t)(end.tv_sec - begin.tv_sec) * 1000000000u +
+                                (uint64_t)end.tv_nsec - (uint64_t)begin.tv_nsec);
+    }
+
+    net->cycle++;
+    if (!committed)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns prefetch distance currently used by network
+ *
+ * @param net Pointer to network
+ * @return Prefetch distance (changes until automatic calibration finishes)
+ */
+size_t ma_net_prefetch_distance(ma_net_t const *net)
+{
+    if (!net)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    return net->prefetch;
+}
+
+/**
+ * @brief Returns number of steps executed by network
+ *
+ * @param net Pointer to network
+ * @return Number of ma_net_step calls completed (0 on error)
+ */
+uint64_t ma_net_cycle(ma_net_t const *net)
+{
+    if (!net)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    return net->cycle;
+}
+
+/**
+ * @brief Selects sequence counter used as output seqlock of network
+ *
+ * @param net Pointer to network
+ * @param seq Counter to use (its value is continued), NULL for the own one
+ */
+void ma_net_set_sequence(ma_net_t *net, _Atomic uint64_t *seq)
+{
+    _Atomic uint64_t *next = seq ? seq : &net->own_seq;
+    atomic_store_explicit(next, atomic_load_explicit(net->seq, memory_order_relaxed),
+                          memory_order_release);
+    net->seq = next;
+}
+
+/**
+ * @brief Copies consistent snapshot of outputs of network automata
+ *
+ * @param net Pointer to network
+ * @param at Automata of net whose outputs are copied
+ * @param num Number of automata in array
+ * @param dst Buffer receiving outputs one after another, each taking
+ *            (m + 63) / 64 words
+ * @param cycle If not NULL, receives number of the step which produced
+ *              the snapshot
+ * @return 0 on success, -1 on error
+ *
+ * @note Safe to call from any thread while ma_net_step runs; never blocks
+ *       the stepping thread, retries if a commit phase overlapped the copy
+ * @note All outputs come from the same step
+ */
+int ma_net_read_outputs(ma_net_t const *net, moore_t *const at[], size_t num,
+                        uint64_t *dst, uint64_t *cycle)
+{
+    if (!net || !at || !dst || num == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (size_t i = 0; i < num; i++)
+    {
+        if (!at[i])
+        {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    uint64_t begin, end;
+    do
+    {
+        begin = atomic_load_explicit(net->seq, memory_order_acquire);
+        if (begin & 1)
+        {
+            MA_CPU_RELAX();
+            end = begin + 1;
+            continue;
+        }
+
+        uint64_t *out = dst;
+        for (size_t i = 0; i < num; i++)
+        {
+            const size_t m_words = (at[i]->m + 63) / 64;
+            memcpy(out, at[i]->output, m_words * sizeof(uint64_t));
+            out += m_words;
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        end = atomic_load_explicit(net->seq, memory_order_relaxed);
+    } while (begin != end);
+
+    if (cycle)
+        *cycle = begin / 2;
+    return 0;
+}
+
+/**
+ * @brief Sums categories of memory usage report into its total
+ *
+ * @param usage Report to update
+ */
+void ma_usage_total(ma_memory_usage_t *usage)
+{
+    const ma_memory_bytes_t *parts[] = {&usage->headers, &usage->state, &usage->output,
+                                        &usage->input, &usage->connections, &usage->fanout};
+
+    usage->total.allocated = 0;
+    usage->total.used = 0;
+    for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++)
+    {
+        usage->total.allocated += parts[i]->allocated;
+        usage->total.used += parts[i]->used;
+    }
+}
+
+/**
+ * @brief Adds buffer of automaton to memory usage category
+ *
+ * @param category Category to update
+ * @param ptr Buffer
+ * @param size Size requested for buffer
+ * @param used Bytes holding meaningful bits
+ * @param external Buffer lives in a shared mapping (only used bytes count)
+ */
+static inline void add_buffer_usage(ma_memory_bytes_t *category, void const *ptr,
+                                    size_t size, size_t used, bool external)
+{
+    if (!ptr)
+        return;
+    if (external)
+        category->used += used;
+    else
+        ma_usage_add(category, ptr, size, used);
+}
+
+/**
+ * @brief Adds memory used by automaton to report (without total)
+ *
+ * @param a Automaton
+ * @param usage Report to update
+ */
+static void add_automaton_usage(moore_t const *a, ma_memory_usage_t *usage)
+{
+    const size_t n_bytes = (a->n + 7) / 8, n_size = (a->n + 63) / 64 * sizeof(uint64_t);
+    const size_t m_bytes = (a->m + 7) / 8, m_size = (a->m + 63) / 64 * sizeof(uint64_t);
+    const size_t s_bytes = (a->s + 7) / 8, s_size = (a->s + 63) / 64 * sizeof(uint64_t);
+
+    size_t connected = 0;
+    for (size_t i = 0; i < a->n; i++)
+        if (a->incoming_connections[i].source_automaton)
+            connected++;
+
+    ma_usage_add(&usage->headers, a, sizeof(moore_t), sizeof(moore_t));
+    add_buffer_usage(&usage->state, a->state, s_size, s_bytes, a->external & MA_EXTERNAL_STATE);
+    add_buffer_usage(&usage->state, a->next_state, s_size, s_bytes, a->external & MA_EXTERNAL_STATE);
+    ma_usage_add(&usage->state, a->log.entries, a->log.capacity * sizeof(ma_log_entry),
+                 a->log.count * sizeof(ma_log_entry));
+    add_buffer_usage(&usage->output, a->output, m_size, m_bytes, a->external & MA_EXTERNAL_OUTPUT);
+    add_buffer_usage(&usage->input, a->manual_input, n_size, n_bytes, a->external & MA_EXTERNAL_INPUT);
+    ma_usage_add(&usage->input, a->final_input, n_size, n_bytes);
+    if (a->mailbox)
+        ma_usage_add(&usage->input, a->mailbox, mailbox_size(a->mailbox->n_words),
+                     mailbox_size(a->mailbox->n_words));
+    ma_usage_add(&usage->connections, a->incoming_connections,
+                 a->n * sizeof(input_connection_info), connected * sizeof(input_connection_info));
+    ma_usage_add(&usage->connections, a->runs, a->run_capacity * sizeof(gather_run),
+                 a->run_count * sizeof(gather_run));
+    ma_usage_add(&usage->connections, a->masks, a->mask_capacity * sizeof(gather_mask),
+                 a->mask_count * sizeof(gather_mask));
+    ma_usage_add(&usage->fanout, a->connected_to_me,
+                 a->connected_to_me_capacity * sizeof(moore_t *),
+                 a->connected_to_me_count * sizeof(moore_t *));
+}
+
+/**
+ * @brief Reports memory used by automaton
+ *
+ * @param a Pointer to automaton
+ * @param usage Report to fill
+ * @return 0 on success, -1 on error
+ *
+ * @note "allocated" includes allocator rounding and bookkeeping, "used"
+ *       counts bytes holding meaningful bits, live connections and
+ *       fanout entries
+ */
+int ma_memory_usage(moore_t const *a, ma_memory_usage_t *usage)
+{
+    if (!a || !usage || a->magic != MOORE_MAGIC)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(usage, 0, sizeof(*usage));
+    add_automaton_usage(a, usage);
+    ma_usage_total(usage);
+    return 0;
+}
+
+/**
+ * @brief Reports memory used by set of automata
+ *
+ * @param at Array of pointers to automata
+ * @param num Number of automata in array
+ * @param usage Report to fill
+ * @return 0 on success, -1 on error
+ */
+int ma_network_memory_usage(moore_t *const at[], size_t num, ma_memory_usage_t *usage)
+{
+    if (!at || !usage)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(usage, 0, sizeof(*usage));
+    for (size_t i = 0; i < num; i++)
+    {
+        if (!at[i] || at[i]->magic != MOORE_MAGIC)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        add_automaton_usage(at[i], usage);
+    }
+
+    ma_usage_total(usage);
+    return 0;
+}
+
+/**
+ * @brief Reports memory used by compiled network and its automata
+ *
+ * @param net Pointer to network
+ * @param usage Report to fill
+ * @return 0 on success, -1 on error
+ *
+ * @note Network arrays are counted as headers
+ */
+int ma_net_memory_usage(ma_net_t const *net, ma_memory_usage_t *usage)
+{
+    if (!net || !usage)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ma_network_memory_usage(net->at, net->num, usage) != 0)
+        return -1;
+
+    ma_usage_add(&usage->headers, net, sizeof(ma_net_t), sizeof(ma_net_t));
+    ma_usage_add(&usage->headers, net->at, net->num * sizeof(moore_t *),
+                 net->num * sizeof(moore_t *));
+    ma_usage_add(&usage->headers, net->t_groups, net->num * sizeof(ma_group_t),
+                 net->t_group_count * sizeof(ma_group_t));
+    ma_usage_add(&usage->headers, net->y_groups, net->num * sizeof(ma_group_t),
+                 net->y_group_count * sizeof(ma_group_t));
+    ma_usage_add(&usage->headers, net->domains, net->domain_count * sizeof(ma_domain_t),
+                 net->domain_count * sizeof(ma_domain_t));
+    ma_usage_add(&usage->headers, net->active, net->domain_count * sizeof(size_t),
+                 net->domain_count * sizeof(size_t));
+    ma_usage_total(usage);
     return 0;
 }
@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 // Forward declarations
 struct moore;
@@ -15,6 +16,98 @@ typedef void (*transition_function_t)(uint64_t *next_state, uint64_t const *inpu
 typedef void (*output_function_t)(uint64_t *output, uint64_t const *state,
                                   size_t m, size_t s);
 
+// Extended function pointer types receiving a user context pointer
+typedef void (*transition_function_ex_t)(uint64_t *next_state, uint64_t const *input,
+                                         uint64_t const *state, size_t n, size_t s,
+                                         void *ctx);
+
+typedef void (*output_function_ex_t)(uint64_t *output, uint64_t const *state,
+                                     size_t m, size_t s, void *ctx);
+
+// In-place transition: state is updated only by words recorded in log
+struct ma_write_log;
+typedef struct ma_write_log ma_write_log_t;
+
+typedef void (*transition_function_log_t)(ma_write_log_t *log, uint64_t const *input,
+                                          uint64_t const *state, size_t n, size_t s,
+                                          void *ctx);
+
+struct ma_net;
+typedef struct ma_net ma_net_t;
+
+struct ma_pool;
+typedef struct ma_pool ma_pool_t;
+
+struct ma_part;
+typedef struct ma_part ma_part_t;
+
+struct ma_dist;
+typedef struct ma_dist ma_dist_t;
+
+struct ma_cmd;
+typedef struct ma_cmd ma_cmd_t;
+
+struct ma_table;
+typedef struct ma_table ma_table_t;
+
+struct ma_memo;
+typedef struct ma_memo ma_memo_t;
+
+struct ma_grid;
+typedef struct ma_grid ma_grid_t;
+
+struct ma_module;
+typedef struct ma_module ma_module_t;
+
+// Field layout of packed automata pool (widths are powers of two)
+typedef struct {
+    size_t n, m, s;                      /* Inputs, outputs and state bits per automaton */
+    unsigned n_width, m_width, s_width;  /* Width of packed input, output and state fields */
+} ma_pool_layout_t;
+
+// Batch kernels processing count packed automata at once
+typedef void (*ma_batch_transition_t)(uint64_t *next_state, uint64_t const *input,
+                                      uint64_t const *state, size_t count,
+                                      ma_pool_layout_t const *layout, void *ctx);
+
+typedef void (*ma_batch_output_t)(uint64_t *output, uint64_t const *state, size_t count,
+                                  ma_pool_layout_t const *layout, void *ctx);
+
+// Memory allocation hooks (free receives the size given to alloc)
+typedef void *(*ma_alloc_function_t)(size_t size, void *ctx);
+
+typedef void (*ma_free_function_t)(void *ptr, size_t size, void *ctx);
+
+// Memory usage of one category in bytes
+typedef struct {
+    size_t allocated; /* Reserved from the allocator, including its overhead */
+    size_t used;      /* Holding live data */
+} ma_memory_bytes_t;
+
+// Memory usage report broken down by category
+typedef struct {
+    ma_memory_bytes_t headers;     /* Automaton, pool and network structures */
+    ma_memory_bytes_t state;       /* Current and next state buffers */
+    ma_memory_bytes_t output;      /* Output buffers */
+    ma_memory_bytes_t input;       /* Manual and final input buffers */
+    ma_memory_bytes_t connections; /* Incoming connection tables */
+    ma_memory_bytes_t fanout;      /* Lists of automata connected to outputs */
+    ma_memory_bytes_t total;       /* Sum of all categories */
+} ma_memory_usage_t;
+
+// Stencil kernel of grid: next[i] from cell[k][i], the state of neighbour k of cell i
+typedef void (*ma_grid_kernel_t)(uint8_t *next, uint8_t const *const cell[], size_t count,
+                                 void *ctx);
+
+// Counters of memoized stepping
+typedef struct {
+    uint64_t hits;      /* Supersteps taken from the cache */
+    uint64_t misses;    /* Supersteps composed from two shorter ones */
+    uint64_t evictions; /* Entries dropped to make room */
+    uint64_t steps;     /* Cycles computed by ma_step */
+    size_t entries;     /* Entries currently cached */
+} ma_memo_stats_t;
+
 // Structure for input connections
 typedef struct {
     moore_t *source_automaton;  /* Pointer to source automaton */
@@ -26,20 +119,287 @@ moore_t *ma_create_full(size_t n, size_t m, size_t s,
                         transition_function_t t, output_function_t y, 
                         uint64_t const *q);
 
+moore_t *ma_create_full_ex(size_t n, size_t m, size_t s,
+                           transition_function_ex_t t, output_function_ex_t y,
+                           uint64_t const *q, void *ctx);
+
+moore_t *ma_create_in_place(size_t n, size_t m, size_t s,
+                            transition_function_log_t t, output_function_ex_t y,
+                            uint64_t const *q, void *ctx);
+
+int ma_log_write(ma_write_log_t *log, size_t word, uint64_t value);
+
+// Memory primitive: dense storage with addressed read and write ports
+#define MA_MEMORY_MMAP 0x1u /* Storage in a lazily committed shared mapping */
+
+moore_t *ma_create_memory(size_t depth, size_t width, size_t read_ports, size_t write_ports,
+                          unsigned flags);
+
+uint64_t *ma_memory_data(moore_t *a, size_t *words);
+
+size_t ma_memory_address_bits(moore_t const *a);
+
+// Primitive automata with built-in word-parallel kernels
+moore_t *ma_create_counter(size_t width);
+
+moore_t *ma_create_shift_register(size_t length, size_t lanes);
+
+moore_t *ma_create_adder(size_t width);
+
+moore_t *ma_create_comparator(size_t width);
+
+moore_t *ma_create_mux(size_t width, size_t ways);
+
+moore_t *ma_create_lfsr(size_t width, uint64_t const *taps, uint64_t const *seed);
+
 moore_t *ma_create_simple(size_t n, size_t m, transition_function_t t);
 
 void ma_delete(moore_t *a);
 
 int ma_connect(moore_t *a_in, size_t in, moore_t *a_out, size_t out, size_t num);
 
+int ma_connect_permuted(moore_t *a_in, size_t in, moore_t *a_out, size_t const *out, size_t num);
+
 int ma_disconnect(moore_t *a_in, size_t in, size_t num);
 
 int ma_set_input(moore_t *a, uint64_t const *input);
 
 int ma_set_state(moore_t *a, uint64_t const *state);
 
+// Input mailbox, wait-free for the stepping thread; producers are serialised
+// by a spinlock. ma_post_input may be called from other threads while
+// ma_step runs; the latest posted vector is used by the next gather
+int ma_enable_input_mailbox(moore_t *a);
+
+int ma_post_input(moore_t *a, uint64_t const *input);
+
+// Input passing modes
+#define MA_INPUT_COPY 0   /* t reads gathered copy of inputs (default) */
+#define MA_INPUT_SHARED 1 /* t may read source buffers in place (ignore bits >= n) */
+
+int ma_set_input_mode(moore_t *a, int mode);
+
+// Clock domains: a clocked automaton is gathered, stepped and output only
+// on cycles with cycle % divider == phase while its gate bit (if any) is 1
+int ma_set_clock(moore_t *a, uint64_t divider, uint64_t phase);
+
+int ma_set_clock_gate(moore_t *a, moore_t *gate, size_t bit);
+
 uint64_t const *ma_get_output(moore_t const *a);
 
+void *ma_get_context(moore_t const *a);
+
 int ma_step(moore_t *at[], size_t num);
 
+// Software prefetching in step loops
+#define MA_PREFETCH_AUTO SIZE_MAX /* Default distance, calibrated by networks */
+
+void ma_set_prefetch_distance(size_t d);
+
+// Memory usage introspection (reports are zeroed and filled)
+int ma_memory_usage(moore_t const *a, ma_memory_usage_t *usage);
+
+int ma_network_memory_usage(moore_t *const at[], size_t num, ma_memory_usage_t *usage);
+
+int ma_net_memory_usage(ma_net_t const *net, ma_memory_usage_t *usage);
+
+int ma_pool_memory_usage(ma_pool_t const *pool, ma_memory_usage_t *usage);
+
+// Memory allocation
+#define MA_HUGEPAGES_OFF 0         /* Use libc (default) */
+#define MA_HUGEPAGES_TRANSPARENT 1 /* 2 MB aligned mmap with MADV_HUGEPAGE */
+#define MA_HUGEPAGES_EXPLICIT 2    /* MAP_HUGETLB, transparent if unavailable */
+
+int ma_set_allocator(ma_alloc_function_t alloc, ma_free_function_t free, void *ctx);
+
+int ma_set_hugepages(int mode);
+
+void *ma_hugepage_alloc(size_t size, void *ctx);
+
+void ma_hugepage_free(void *ptr, size_t size, void *ctx);
+
+// Packed pools of tiny automata
+ma_pool_t *ma_pool_create(size_t count, size_t n, size_t m, size_t s,
+                          ma_batch_transition_t t, ma_batch_output_t y, void *ctx);
+
+void ma_pool_delete(ma_pool_t *pool);
+
+ma_pool_layout_t const *ma_pool_layout(ma_pool_t const *pool);
+
+int ma_pool_connect(ma_pool_t *pool, size_t dst, size_t in, size_t src, size_t out, size_t num);
+
+int ma_pool_disconnect(ma_pool_t *pool, size_t dst, size_t in, size_t num);
+
+int ma_pool_set_input(ma_pool_t *pool, size_t i, uint64_t input);
+
+int ma_pool_set_state(ma_pool_t *pool, size_t i, uint64_t state);
+
+uint64_t ma_pool_get_state(ma_pool_t const *pool, size_t i);
+
+uint64_t ma_pool_get_output(ma_pool_t const *pool, size_t i);
+
+int ma_pool_step(ma_pool_t *pool);
+
+// Helpers for kernels: field i of width bits in packed words
+static inline uint64_t ma_pool_get_field(uint64_t const *words, unsigned width, size_t i)
+{
+    const size_t bit = i * width;
+    const uint64_t mask = width == 64 ? ~(uint64_t)0 : ((uint64_t)1 << width) - 1;
+    return (words[bit / 64] >> (bit % 64)) & mask;
+}
+
+static inline void ma_pool_set_field(uint64_t *words, unsigned width, size_t i, uint64_t value)
+{
+    const size_t bit = i * width;
+    const uint64_t mask = width == 64 ? ~(uint64_t)0 : ((uint64_t)1 << width) - 1;
+    words[bit / 64] = (words[bit / 64] & ~(mask << (bit % 64))) | ((value & mask) << (bit % 64));
+}
+
+// Compiled networks
+#define MA_NET_GROUP_DISPATCH 0x1u /* Run automata sharing t/y back-to-back */
+
+ma_net_t *ma_net_create(moore_t *at[], size_t num, unsigned flags);
+
+void ma_net_delete(ma_net_t *net);
+
+int ma_net_step(ma_net_t *net);
+
+uint64_t ma_net_cycle(ma_net_t const *net);
+
+size_t ma_net_prefetch_distance(ma_net_t const *net);
+
+// Consistent output snapshot, callable from other threads during ma_net_step
+int ma_net_read_outputs(ma_net_t const *net, moore_t *const at[], size_t num,
+                        uint64_t *dst, uint64_t *cycle);
+
+// Partitioned simulation in local processes sharing buffers (Linux)
+ma_part_t *ma_part_create(moore_t *at[], size_t num, size_t processes);
+
+int ma_part_step(ma_part_t *part, size_t cycles);
+
+int ma_part_delete(ma_part_t *part);
+
+// Distributed stepping over TCP: one rank per process/host, cut edges go
+// through proxies and are exchanged every batch cycles
+ma_dist_t *ma_dist_create(moore_t *at[], size_t num, size_t rank, size_t ranks,
+                          char const *const addresses[], size_t batch);
+
+int ma_dist_export(ma_dist_t *d, uint64_t id, moore_t *const chain[], size_t depth);
+
+moore_t *ma_dist_import(ma_dist_t *d, size_t rank, uint64_t id, size_t out, size_t num);
+
+int ma_dist_start(ma_dist_t *d);
+
+int ma_dist_step(ma_dist_t *d, size_t cycles);
+
+void ma_dist_delete(ma_dist_t *d);
+
+// Command buffers: record once, run with one ma_exec call (offsets in words)
+ma_cmd_t *ma_cmd_create(void);
+
+void ma_cmd_delete(ma_cmd_t *cmd);
+
+void ma_cmd_clear(ma_cmd_t *cmd);
+
+int ma_cmd_set_input(ma_cmd_t *cmd, moore_t *a, size_t offset);
+
+int ma_cmd_get_output(ma_cmd_t *cmd, moore_t *a, size_t offset);
+
+int ma_cmd_step(ma_cmd_t *cmd, moore_t *at[], size_t num, size_t count);
+
+int ma_cmd_net_step(ma_cmd_t *cmd, ma_net_t *net, size_t count);
+
+int ma_cmd_watch(ma_cmd_t *cmd, moore_t *a, size_t bit, int value);
+
+int ma_cmd_buffer_sizes(ma_cmd_t const *cmd, size_t *in_words, size_t *out_words);
+
+int ma_exec(ma_cmd_t const *cmd, uint64_t const *in, uint64_t *out);
+
+// Saved networks: functions are stored by name ("delay", "toggle", "add",
+// "counter", "shift", "adder" and "comparator" are built in)
+int ma_register_kernel(char const *name, transition_function_t t, output_function_t y);
+
+int ma_save_network(FILE *f, moore_t *const at[], size_t num);
+
+moore_t **ma_load_network(FILE *f, size_t *num);
+
+void ma_free_network(moore_t **at, size_t num);
+
+// Table automata (n, s <= 16) consuming streams of input symbols
+ma_table_t *ma_table_create(size_t n, size_t m, size_t s, transition_function_t t,
+                            output_function_t y, uint64_t q);
+
+void ma_table_delete(ma_table_t *table);
+
+int ma_table_set_stride(ma_table_t *table, size_t k);
+
+size_t ma_table_stride(ma_table_t const *table);
+
+int ma_table_set_state(ma_table_t *table, uint64_t state);
+
+uint64_t ma_table_get_state(ma_table_t const *table);
+
+uint64_t ma_table_get_output(ma_table_t const *table);
+
+int ma_table_run(ma_table_t *table, uint16_t const *input, size_t count, uint64_t *output);
+
+int ma_table_run_parallel(ma_table_t *table, uint16_t const *input, size_t count,
+                          uint64_t *output, size_t threads);
+
+int ma_table_step_many(ma_table_t const *table, uint8_t *states, uint8_t const *input,
+                       size_t count, uint64_t *output);
+
+// Memoized stepping of networks without external inputs
+ma_memo_t *ma_memo_create(moore_t *at[], size_t num, size_t capacity);
+
+void ma_memo_delete(ma_memo_t *memo);
+
+void ma_memo_clear(ma_memo_t *memo);
+
+int ma_memo_run(ma_memo_t *memo, uint64_t cycles);
+
+int ma_memo_stats(ma_memo_t const *memo, ma_memo_stats_t *stats);
+
+// Lattices of identical automata with stencil gather (1D to 3D)
+#define MA_GRID_VON_NEUMANN 0 /* Cell and neighbours sharing a face (2d + 1) */
+#define MA_GRID_MOORE 1       /* Cell and all touching neighbours (3^d) */
+#define MA_GRID_PERIODIC 0    /* Opposite edges are neighbours */
+#define MA_GRID_FIXED 1       /* Cells outside the grid hold the boundary value */
+
+ma_grid_t *ma_grid_create(size_t d, size_t const dims[], size_t s, int neighbourhood,
+                          int boundary, ma_grid_kernel_t kernel, void *ctx);
+
+void ma_grid_delete(ma_grid_t *grid);
+
+int ma_grid_set_boundary(ma_grid_t *grid, uint64_t value);
+
+int ma_grid_set_cell(ma_grid_t *grid, size_t const coords[], uint64_t state);
+
+uint64_t ma_grid_get_cell(ma_grid_t const *grid, size_t const coords[]);
+
+int ma_grid_step(ma_grid_t *grid);
+
+int ma_grid_run(ma_grid_t *grid, uint64_t steps, size_t threads);
+
+moore_t *ma_grid_edge(ma_grid_t *grid, size_t side);
+
+int ma_grid_memory_usage(ma_grid_t const *grid, ma_memory_usage_t *usage);
+
+void ma_grid_life(uint8_t *next, uint8_t const *const cell[], size_t count, void *ctx);
+
+// Hierarchical modules: blocks of connected automata instantiated as one automaton
+#define MA_MODULE_PORT SIZE_MAX /* Module inputs (as src) or outputs (as dst) */
+
+ma_module_t *ma_module_create(size_t n, size_t m);
+
+void ma_module_delete(ma_module_t *mod);
+
+int ma_module_add(ma_module_t *mod, moore_t const *proto);
+
+int ma_module_connect(ma_module_t *mod, size_t dst, size_t in, size_t src, size_t out, size_t num);
+
+moore_t *ma_module_instance(ma_module_t *mod);
+
+uint64_t const *ma_module_part_state(moore_t const *a, size_t part);
+
 #endif
\ No newline at end of file
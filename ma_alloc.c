@@ -0,0 +1,398 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "ma_internal.h"
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define HUGEPAGE_SIZE ((size_t)2 << 20)  /* Size of one huge page */
+#define SMALL_GRANULE 16                 /* Size class step for small blocks */
+#define SMALL_LIMIT 4096                 /* Largest block with 16-byte classes */
+#define MEDIUM_LIMIT ((size_t)1 << 20)   /* Largest block carved from chunks */
+#define SMALL_CLASSES (SMALL_LIMIT / SMALL_GRANULE)
+#define MEDIUM_CLASSES 8                 /* Power-of-two classes 8 KiB .. 1 MiB */
+
+/* Allocation hooks (NULL means libc) */
+static ma_alloc_function_t user_alloc = NULL;
+static ma_free_function_t user_free = NULL;
+static void *user_ctx = NULL;
+static _Atomic size_t live_allocations = 0; /* Blocks not yet freed, guards hook changes */
+
+/**
+ * @brief Free block kept on a size class list of the huge page pool
+ */
+typedef struct free_block
+{
+    struct free_block *next;
+} free_block;
+
+/**
+ * @brief State of the built-in huge page pool
+ *
+ * Blocks up to MEDIUM_LIMIT are carved from 2 MB aligned chunks and
+ * recycled through per-class free lists; larger blocks get their own
+ * mapping. Chunks are never returned to the system. The lock makes the
+ * pool usable by threads creating and deleting independent automata.
+ */
+static struct
+{
+    pthread_mutex_t lock;              /* Guards all fields below */
+    char *chunk;                       /* Current chunk */
+    size_t chunk_used;                 /* Bytes carved from current chunk */
+    free_block *small[SMALL_CLASSES];  /* Free lists of 16-byte classes */
+    free_block *medium[MEDIUM_CLASSES]; /* Free lists of power-of-two classes */
+} pool = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/**
+ * @brief Maps region backed by huge pages
+ *
+ * @param size Size in bytes (multiple of HUGEPAGE_SIZE)
+ * @param mode MA_HUGEPAGES_TRANSPARENT or MA_HUGEPAGES_EXPLICIT
+ * @return Pointer to HUGEPAGE_SIZE aligned region or NULL on error
+ *
+ * @note Explicit mode falls back to transparent huge pages when no
+ *       huge pages are reserved in the system
+ */
+static void *map_hugepages(size_t size, int mode)
+{
+#ifdef MAP_HUGETLB
+    if (mode == MA_HUGEPAGES_EXPLICIT)
+    {
+        void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED)
+            return p;
+    }
+#endif
+
+    /* Over-allocate to align the region to a huge page boundary */
+    char *raw = mmap(NULL, size + HUGEPAGE_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+        return NULL;
+
+    const uintptr_t addr = (uintptr_t)raw;
+    const uintptr_t aligned = (addr + HUGEPAGE_SIZE - 1) & ~(uintptr_t)(HUGEPAGE_SIZE - 1);
+    const size_t head = aligned - addr;
+    const size_t tail = HUGEPAGE_SIZE - head;
+    if (head)
+        munmap(raw, head);
+    if (tail)
+        munmap((char *)aligned + size, tail);
+
+#ifdef MADV_HUGEPAGE
+    madvise((void *)aligned, size, MADV_HUGEPAGE);
+#endif
+    return (void *)aligned;
+}
+
+/**
+ * @brief Returns size class list and rounded size for block
+ *
+ * @param size Requested size (at most MEDIUM_LIMIT)
+ * @param rounded Output: size of blocks in the class
+ * @return Pointer to free list head of the class
+ */
+static free_block **pool_class(size_t size, size_t *rounded)
+{
+    if (size <= SMALL_LIMIT)
+    {
+        const size_t cls = (size + SMALL_GRANULE - 1) / SMALL_GRANULE;
+        *rounded = cls * SMALL_GRANULE;
+        return &pool.small[cls - 1];
+    }
+
+    size_t cls = 0, block = SMALL_LIMIT * 2;
+    while (block < size)
+    {
+        block *= 2;
+        cls++;
+    }
+    *rounded = block;
+    return &pool.medium[cls];
+}
+
+/**
+ * @brief Allocates block from built-in huge page pool
+ *
+ * @param size Requested size in bytes
+ * @param ctx Huge page mode (MA_HUGEPAGES_* cast to pointer)
+ * @return Pointer to block or NULL on error
+ */
+void *ma_hugepage_alloc(size_t size, void *ctx)
+{
+    const int mode = (int)(intptr_t)ctx;
+    if (size == 0)
+        size = 1;
+
+    if (size > MEDIUM_LIMIT)
+    {
+        const size_t mapped = (size + HUGEPAGE_SIZE - 1) & ~(HUGEPAGE_SIZE - 1);
+        return map_hugepages(mapped, mode);
+    }
+
+    size_t rounded;
+    free_block **list = pool_class(size, &rounded);
+    void *block = NULL;
+
+    pthread_mutex_lock(&pool.lock);
+    if (*list)
+    {
+        block = *list;
+        *list = (*list)->next;
+    }
+    else
+    {
+        if (!pool.chunk || pool.chunk_used + rounded > HUGEPAGE_SIZE)
+        {
+            char *chunk = map_hugepages(HUGEPAGE_SIZE, mode);
+            if (chunk)
+            {
+                pool.chunk = chunk;
+                pool.chunk_used = 0;
+            }
+        }
+        if (pool.chunk && pool.chunk_used + rounded <= HUGEPAGE_SIZE)
+        {
+            block = pool.chunk + pool.chunk_used;
+            pool.chunk_used += rounded;
+        }
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return block;
+}
+
+/**
+ * @brief Returns block to built-in huge page pool
+ *
+ * @param ptr Block returned by ma_hugepage_alloc (can be NULL)
+ * @param size Size given at allocation
+ * @param ctx Huge page mode (unused)
+ */
+void ma_hugepage_free(void *ptr, size_t size, void *ctx)
+{
+    (void)ctx;
+    if (!ptr)
+        return;
+    if (size == 0)
+        size = 1;
+
+    if (size > MEDIUM_LIMIT)
+    {
+        munmap(ptr, (size + HUGEPAGE_SIZE - 1) & ~(HUGEPAGE_SIZE - 1));
+        return;
+    }
+
+    size_t rounded;
+    free_block **list = pool_class(size, &rounded);
+    free_block *block = ptr;
+
+    pthread_mutex_lock(&pool.lock);
+    block->next = *list;
+    *list = block;
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/**
+ * @brief Sets functions used for all memory allocated by the library
+ *
+ * @param alloc Allocation function (NULL together with free restores libc)
+ * @param free Deallocation function receiving the allocated size
+ * @param ctx User context passed to both functions
+ * @return 0 on success, -1 on error
+ *
+ * @note Fails with EBUSY while blocks from the previous allocator are alive
+ * @note alloc need not return zeroed memory
+ */
+int ma_set_allocator(ma_alloc_function_t alloc, ma_free_function_t free, void *ctx)
+{
+    if (!alloc != !free)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (atomic_load_explicit(&live_allocations, memory_order_relaxed) != 0)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    user_alloc = alloc;
+    user_free = free;
+    user_ctx = ctx;
+    return 0;
+}
+
+/**
+ * @brief Enables or disables huge page backed allocation
+ *
+ * @param mode MA_HUGEPAGES_OFF, MA_HUGEPAGES_TRANSPARENT or MA_HUGEPAGES_EXPLICIT
+ * @return 0 on success, -1 on error
+ *
+ * @note Installs the built-in pool with ma_set_allocator (or restores libc)
+ */
+int ma_set_hugepages(int mode)
+{
+    switch (mode)
+    {
+    case MA_HUGEPAGES_OFF:
+        return ma_set_allocator(NULL, NULL, NULL);
+    case MA_HUGEPAGES_TRANSPARENT:
+    case MA_HUGEPAGES_EXPLICIT:
+        return ma_set_allocator(ma_hugepage_alloc, ma_hugepage_free, (void *)(intptr_t)mode);
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/**
+ * @brief Allocates uninitialized memory through current hooks
+ *
+ * @param size Size in bytes
+ * @return Pointer to memory or NULL (errno = ENOMEM)
+ */
+void *ma_mem_alloc(size_t size)
+{
+    void *p = user_alloc ? user_alloc(size, user_ctx) : malloc(size);
+    if (!p)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    atomic_fetch_add_explicit(&live_allocations, 1, memory_order_relaxed);
+    return p;
+}
+
+/**
+ * @brief Allocates zeroed array through current hooks
+ *
+ * @param count Number of elements
+ * @param size Size of one element
+ * @return Pointer to memory or NULL (errno = ENOMEM)
+ */
+void *ma_mem_calloc(size_t count, size_t size)
+{
+    if (size != 0 && count > SIZE_MAX / size)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *p;
+    if (user_alloc)
+    {
+        p = user_alloc(count * size, user_ctx);
+        if (p)
+            memset(p, 0, count * size);
+    }
+    else
+    {
+        p = calloc(count, size);
+    }
+
+    if (!p)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    atomic_fetch_add_explicit(&live_allocations, 1, memory_order_relaxed);
+    return p;
+}
+
+/**
+ * @brief Resizes block allocated through current hooks
+ *
+ * @param ptr Block to resize (can be NULL)
+ * @param old_size Current size of block
+ * @param new_size Requested size
+ * @return Pointer to resized block or NULL (block left untouched)
+ */
+void *ma_mem_realloc(void *ptr, size_t old_size, size_t new_size)
+{
+    if (!ptr)
+        return ma_mem_alloc(new_size);
+
+    if (!user_alloc)
+    {
+        void *p = realloc(ptr, new_size);
+        if (!p)
+            errno = ENOMEM;
+        return p;
+    }
+
+    void *p = user_alloc(new_size, user_ctx);
+    if (!p)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memcpy(p, ptr, old_size < new_size ? old_size : new_size);
+    user_free(ptr, old_size, user_ctx);
+    return p;
+}
+
+/**
+ * @brief Frees block allocated through current hooks
+ *
+ * @param ptr Block to free (can be NULL)
+ * @param size Size given at allocation
+ */
+void ma_mem_free(void *ptr, size_t size)
+{
+    if (!ptr)
+        return;
+
+    if (user_free)
+        user_free(ptr, size, user_ctx);
+    else
+        free(ptr);
+
+    atomic_fetch_sub_explicit(&live_allocations, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Returns number of bytes actually reserved for block
+ *
+ * @param ptr Block allocated through current hooks (can be NULL)
+ * @param size Size given at allocation
+ * @return Reserved bytes including allocator rounding and bookkeeping
+ *
+ * @note Custom allocators are assumed to reserve exactly size bytes, and
+ *       so is libc outside glibc (no malloc_usable_size)
+ */
+size_t ma_mem_reserved(void const *ptr, size_t size)
+{
+    if (!ptr)
+        return 0;
+
+#ifdef __GLIBC__
+    if (!user_alloc)
+        return malloc_usable_size((void *)ptr) + sizeof(size_t); /* libc chunk header */
+#endif
+
+    if (user_alloc == ma_hugepage_alloc)
+    {
+        if (size == 0)
+            size = 1;
+        if (size > MEDIUM_LIMIT)
+            return (size + HUGEPAGE_SIZE - 1) & ~(HUGEPAGE_SIZE - 1);
+
+        size_t rounded;
+        pool_class(size, &rounded);
+        return rounded;
+    }
+
+    return size;
+}
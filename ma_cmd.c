@@ -0,0 +1,357 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "ma.h"
+#include "ma_internal.h"
+
+#define CMD_INIT_CAPACITY 16
+
+/* Operations of recorded commands */
+enum
+{
+    CMD_SET_INPUT,  /* manual_input of a <- in[offset ..] */
+    CMD_GET_OUTPUT, /* out[offset ..] <- output of a */
+    CMD_STEP,       /* ma_step on recorded array, count times */
+    CMD_NET_STEP,   /* ma_net_step on net, count times */
+    CMD_WATCH       /* stop if output bit of a equals value */
+};
+
+/**
+ * @brief Recorded command (fields used depend on op)
+ */
+typedef struct
+{
+    int op;
+    moore_t *a;      /* Automaton of SET_INPUT, GET_OUTPUT, WATCH */
+    ma_net_t *net;   /* Network of NET_STEP */
+    size_t first;    /* First entry of STEP array in automata pool */
+    size_t num;      /* Number of automata of STEP */
+    size_t count;    /* Repetitions of STEP and NET_STEP */
+    size_t offset;   /* Word offset in in/out buffer */
+    size_t words;    /* Words copied by SET_INPUT and GET_OUTPUT */
+    size_t bit;      /* Output bit of WATCH */
+    uint64_t value;  /* Expected bit value of WATCH */
+} ma_command;
+
+/**
+ * @brief Structure representing a recorded sequence of operations
+ *
+ * Every command is validated when recorded, so ma_exec only walks the
+ * list. Arrays given to step commands are copied into one pool.
+ */
+struct ma_cmd
+{
+    ma_command *commands;
+    size_t count, capacity;
+    moore_t **automata;  /* Pool of arrays of STEP commands */
+    size_t automata_count, automata_capacity;
+    size_t in_words;     /* Size of in buffer required by ma_exec */
+    size_t out_words;    /* Size of out buffer required by ma_exec */
+};
+
+/**
+ * @brief Creates empty command buffer
+ *
+ * @return Pointer to command buffer or NULL on error
+ */
+ma_cmd_t *ma_cmd_create(void)
+{
+    ma_cmd_t *cmd = ma_mem_calloc(1, sizeof(ma_cmd_t));
+    if (!cmd)
+        errno = ENOMEM;
+    return cmd;
+}
+
+/**
+ * @brief Frees command buffer (recorded automata are not affected)
+ *
+ * @param cmd Pointer to command buffer (can be NULL)
+ */
+void ma_cmd_delete(ma_cmd_t *cmd)
+{
+    if (!cmd)
+        return;
+
+    ma_mem_free(cmd->commands, cmd->capacity * sizeof(ma_command));
+    ma_mem_free(cmd->automata, cmd->automata_capacity * sizeof(moore_t *));
+    ma_mem_free(cmd, sizeof(ma_cmd_t));
+}
+
+/**
+ * @brief Removes all commands so the buffer can be recorded again
+ *
+ * @param cmd Pointer to command buffer
+ */
+void ma_cmd_clear(ma_cmd_t *cmd)
+{
+    if (!cmd)
+        return;
+
+    cmd->count = 0;
+    cmd->automata_count = 0;
+    cmd->in_words = 0;
+    cmd->out_words = 0;
+}
+
+/**
+ * @brief Appends command to buffer
+ *
+ * @return 0 on success, -1 on error
+ */
+static int append(ma_cmd_t *cmd, ma_command const *command)
+{
+    if (cmd->count == cmd->capacity)
+    {
+        const size_t capacity = cmd->capacity ? cmd->capacity * 2 : CMD_INIT_CAPACITY;
+        ma_command *commands = ma_mem_realloc(cmd->commands, cmd->capacity * sizeof(ma_command),
+                                              capacity * sizeof(ma_command));
+        if (!commands)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+        cmd->commands = commands;
+        cmd->capacity = capacity;
+    }
+
+    cmd->commands[cmd->count++] = *command;
+    return 0;
+}
+
+/**
+ * @brief Records setting of manual inputs from the in buffer of ma_exec
+ *
+ * @param cmd Pointer to command buffer
+ * @param a Automaton with inputs
+ * @param offset Word offset in in buffer ((n + 63) / 64 words are read)
+ * @return 0 on success, -1 on error
+ */
+int ma_cmd_set_input(ma_cmd_t *cmd, moore_t *a, size_t offset)
+{
+    if (!cmd || !a || a->n == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const size_t words = (a->n + 63) / 64;
+    if (offset > SIZE_MAX - words)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const ma_command command = {.op = CMD_SET_INPUT, .a = a, .offset = offset, .words = words};
+    if (append(cmd, &command) != 0)
+        return -1;
+
+    if (offset + words > cmd->in_words)
+        cmd->in_words = offset + words;
+    return 0;
+}
+
+/**
+ * @brief Records copying of outputs to the out buffer of ma_exec
+ *
+ * @param cmd Pointer to command buffer
+ * @param a Automaton
+ * @param offset Word offset in out buffer ((m + 63) / 64 words are written)
+ * @return 0 on success, -1 on error
+ */
+int ma_cmd_get_output(ma_cmd_t *cmd, moore_t *a, size_t offset)
+{
+    if (!cmd || !a)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const size_t words = (a->m + 63) / 64;
+    if (offset > SIZE_MAX - words)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const ma_command command = {.op = CMD_GET_OUTPUT, .a = a, .offset = offset, .words = words};
+    if (append(cmd, &command) != 0)
+        return -1;
+
+    if (offset + words > cmd->out_words)
+        cmd->out_words = offset + words;
+    return 0;
+}
+
+/**
+ * @brief Records count steps of automata
+ *
+ * @param cmd Pointer to command buffer
+ * @param at Array of pointers to automata (copied)
+ * @param num Number of automata in array
+ * @param count Number of steps
+ * @return 0 on success, -1 on error
+ */
+int ma_cmd_step(ma_cmd_t *cmd, moore_t *at[], size_t num, size_t count)
+{
+    if (!cmd || !at || num == 0 || count == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (size_t i = 0; i < num; i++)
+    {
+        if (!at[i])
+        {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    if (cmd->automata_count + num > cmd->automata_capacity)
+    {
+        size_t capacity = cmd->automata_capacity ? cmd->automata_capacity : CMD_INIT_CAPACITY;
+        while (capacity < cmd->automata_count + num)
+            capacity *= 2;
+
+        moore_t **automata = ma_mem_realloc(cmd->automata, cmd->automata_capacity * sizeof(moore_t *),
+                                            capacity * sizeof(moore_t *));
+        if (!automata)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+        cmd->automata = automata;
+        cmd->automata_capacity = capacity;
+    }
+
+    const ma_command command = {.op = CMD_STEP, .first = cmd->automata_count, .num = num, .count = count};
+    if (append(cmd, &command) != 0)
+        return -1;
+
+    memcpy(cmd->automata + cmd->automata_count, at, num * sizeof(moore_t *));
+    cmd->automata_count += num;
+    return 0;
+}
+
+/**
+ * @brief Records count steps of compiled network
+ *
+ * @param cmd Pointer to command buffer
+ * @param net Pointer to network
+ * @param count Number of steps
+ * @return 0 on success, -1 on error
+ */
+int ma_cmd_net_step(ma_cmd_t *cmd, ma_net_t *net, size_t count)
+{
+    if (!cmd || !net || count == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const ma_command command = {.op = CMD_NET_STEP, .net = net, .count = count};
+    return append(cmd, &command);
+}
+
+/**
+ * @brief Records check stopping execution when output bit has given value
+ *
+ * @param cmd Pointer to command buffer
+ * @param a Automaton
+ * @param bit Output bit
+ * @param value Value (0 or 1) that stops execution
+ * @return 0 on success, -1 on error
+ */
+int ma_cmd_watch(ma_cmd_t *cmd, moore_t *a, size_t bit, int value)
+{
+    if (!cmd || !a || bit >= a->m || (value != 0 && value != 1))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const ma_command command = {.op = CMD_WATCH, .a = a, .bit = bit, .value = (uint64_t)value};
+    return append(cmd, &command);
+}
+
+/**
+ * @brief Returns sizes of buffers needed by ma_exec
+ *
+ * @param cmd Pointer to command buffer
+ * @param in_words Receives number of words read from in buffer (can be NULL)
+ * @param out_words Receives number of words written to out buffer (can be NULL)
+ * @return 0 on success, -1 on error
+ */
+int ma_cmd_buffer_sizes(ma_cmd_t const *cmd, size_t *in_words, size_t *out_words)
+{
+    if (!cmd)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (in_words)
+        *in_words = cmd->in_words;
+    if (out_words)
+        *out_words = cmd->out_words;
+    return 0;
+}
+
+/**
+ * @brief Executes recorded commands in order
+ *
+ * @param cmd Pointer to command buffer
+ * @param in Buffer of input words (may be NULL if no input is set)
+ * @param out Buffer receiving output words (may be NULL if none is copied)
+ * @return 0 if all commands ran, k > 0 if the k-th command (a watch)
+ *         stopped execution, -1 on error
+ *
+ * @note One call replaces a whole sequence of set_input/step/get_output
+ *       calls; the buffer stays recorded and can be executed again
+ * @note A failing step (errno ENOMEM, see ma_step) stops execution
+ */
+int ma_exec(ma_cmd_t const *cmd, uint64_t const *in, uint64_t *out)
+{
+    if (!cmd || (cmd->in_words && !in) || (cmd->out_words && !out))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (size_t i = 0; i < cmd->count; i++)
+    {
+        ma_command const *c = &cmd->commands[i];
+        switch (c->op)
+        {
+        case CMD_SET_INPUT:
+            memcpy(c->a->manual_input, in + c->offset, c->words * sizeof(uint64_t));
+            break;
+
+        case CMD_GET_OUTPUT:
+            memcpy(out + c->offset, c->a->output, c->words * sizeof(uint64_t));
+            break;
+
+        case CMD_STEP:
+            for (size_t k = 0; k < c->count; k++)
+                if (ma_step(cmd->automata + c->first, c->num) != 0)
+                    return -1;
+            break;
+
+        case CMD_NET_STEP:
+            for (size_t k = 0; k < c->count; k++)
+                if (ma_net_step(c->net) != 0)
+                    return -1;
+            break;
+
+        case CMD_WATCH:
+            if (((c->a->output[c->bit / 64] >> (c->bit % 64)) & 1) == c->value)
+                return i + 1 < INT_MAX ? (int)(i + 1) : INT_MAX;
+            break;
+        }
+    }
+
+    return 0;
+}
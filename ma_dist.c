@@ -0,0 +1,986 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "ma.h"
+#include "ma_internal.h"
+
+#define DIST_CONNECT_TIMEOUT_MS 30000 /* Time allowed for all ranks to come up */
+#define DIST_RETRY_NS 10000000L       /* Pause between connection attempts */
+#define DIST_IO_TIMEOUT_MS 60000      /* Longest wait for a neighbour message */
+#define DIST_INIT_CAPACITY 8
+
+/**
+ * @brief Automaton of this rank whose outputs other ranks may import
+ *
+ * chain[0] is the exported automaton; chain[i + 1] feeds chain[i] through
+ * a register, so chain[j] holds now what chain[0] outputs j cycles later.
+ */
+typedef struct
+{
+    uint64_t id;     /* Global identifier chosen by user */
+    moore_t **chain; /* depth automata */
+    size_t depth;    /* Lookahead in cycles */
+} dist_export;
+
+/**
+ * @brief Proxy mirroring output bits of an automaton of another rank
+ */
+typedef struct
+{
+    size_t rank;    /* Owner of the exported automaton */
+    uint64_t id;    /* Its identifier */
+    size_t out;     /* First mirrored output bit */
+    size_t num;     /* Number of mirrored bits */
+    moore_t *proxy; /* Local automaton holding the bits as its outputs */
+} dist_import;
+
+/**
+ * @brief Output bits sent to a neighbour every exchange
+ */
+typedef struct
+{
+    dist_export const *export;
+    size_t out; /* First output bit */
+    size_t num; /* Number of bits */
+} dist_send;
+
+/**
+ * @brief Connection with another rank and its message buffers
+ *
+ * A message holds the cycle number followed by batch slots; slot j packs
+ * all cut-edge bits for cycle j of the batch, in subscription order.
+ */
+typedef struct
+{
+    int fd;                /* Socket (-1 if not connected) */
+    dist_send *sends;      /* Bits this rank sends */
+    size_t send_count;
+    size_t send_bits;      /* Bits per slot of outgoing messages */
+    size_t *recvs;         /* Indices of imports filled by incoming messages */
+    size_t recv_count;
+    size_t recv_bits;      /* Bits per slot of incoming messages */
+    uint64_t *send_buf;    /* Outgoing message */
+    uint64_t *recv_buf;    /* Last incoming message */
+    size_t send_words, recv_words;
+
+    /* Progress of current exchange */
+    void const *out_ptr;
+    size_t out_len, out_done;
+    void *in_ptr;
+    size_t in_len, in_done;
+} dist_peer;
+
+/**
+ * @brief Structure representing one rank of a distributed network
+ */
+struct ma_dist
+{
+    moore_t **at;         /* Local automata stepped by this rank */
+    size_t num;
+    size_t rank, ranks;
+    char **addresses;     /* "host:port" of every rank */
+    size_t batch;         /* Cycles per exchange */
+    dist_export *exports;
+    size_t export_count, export_capacity;
+    dist_import *imports;
+    size_t import_count, import_capacity;
+    dist_peer *peers;     /* One per rank (own entry unused) */
+    struct pollfd *polls; /* Scratch array for exchanges */
+    size_t phase;         /* Cycles run since last exchange */
+    uint64_t cycle;       /* Cycles run since start */
+    bool started;
+    bool broken;          /* A network error occurred; steps are refused */
+};
+
+/* Proxies keep their state; outputs are written by exchanges */
+static void proxy_transition(uint64_t *next_state, uint64_t const *input,
+                             uint64_t const *state, size_t n, size_t s)
+{
+    (void)input;
+    (void)n;
+    memcpy(next_state, state, (s + 63) / 64 * sizeof(uint64_t));
+}
+
+static void proxy_output(uint64_t *output, uint64_t const *state, size_t m, size_t s)
+{
+    (void)s;
+    memcpy(output, state, (m + 63) / 64 * sizeof(uint64_t));
+}
+
+/**
+ * @brief Appends element to growing array
+ *
+ * @return 0 on success, -1 on error
+ */
+static int grow(void **array, size_t *capacity, size_t count, size_t element)
+{
+    if (count < *capacity)
+        return 0;
+
+    const size_t capacity_new = *capacity ? *capacity * 2 : DIST_INIT_CAPACITY;
+    void *array_new = ma_mem_realloc(*array, *capacity * element, capacity_new * element);
+    if (!array_new)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    *array = array_new;
+    *capacity = capacity_new;
+    return 0;
+}
+
+/**
+ * @brief Creates rank of a distributed network
+ *
+ * @param at Automata stepped by this rank
+ * @param num Number of automata in array
+ * @param rank Index of this rank
+ * @param ranks Number of ranks
+ * @param addresses "host:port" on which every rank listens (same on all ranks)
+ * @param batch Cycles per exchange (k); k > 1 needs lookahead of every
+ *              exported automaton of at least k cycles
+ * @return Pointer to rank or NULL on error
+ *
+ * @note Declare exports and imports, then call ma_dist_start on all ranks
+ */
+ma_dist_t *ma_dist_create(moore_t *at[], size_t num, size_t rank, size_t ranks,
+                          char const *const addresses[], size_t batch)
+{
+    if (!at || num == 0 || ranks == 0 || rank >= ranks || !addresses || batch == 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < num; i++)
+    {
+        if (!at[i])
+        {
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+
+    for (size_t r = 0; r < ranks; r++)
+    {
+        if (!addresses[r] || !strrchr(addresses[r], ':'))
+        {
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+
+    ma_dist_t *d = ma_mem_calloc(1, sizeof(ma_dist_t));
+    if (!d)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    d->num = num;
+    d->rank = rank;
+    d->ranks = ranks;
+    d->batch = batch;
+    d->at = ma_mem_alloc(num * sizeof(moore_t *));
+    d->addresses = ma_mem_calloc(ranks, sizeof(char *));
+    d->peers = ma_mem_calloc(ranks, sizeof(dist_peer));
+    d->polls = ma_mem_calloc(ranks, sizeof(struct pollfd));
+    if (!d->at || !d->addresses || !d->peers || !d->polls)
+        goto cleanup_fail;
+
+    memcpy(d->at, at, num * sizeof(moore_t *));
+    for (size_t r = 0; r < ranks; r++)
+    {
+        d->peers[r].fd = -1;
+        d->addresses[r] = ma_mem_alloc(strlen(addresses[r]) + 1);
+        if (!d->addresses[r])
+            goto cleanup_fail;
+        strcpy(d->addresses[r], addresses[r]);
+    }
+
+    return d;
+
+cleanup_fail:
+    ma_dist_delete(d);
+    errno = ENOMEM;
+    return NULL;
+}
+
+/**
+ * @brief Makes outputs of local automaton available to other ranks
+ *
+ * @param d Pointer to rank
+ * @param id Identifier unique among exports of this rank
+ * @param chain chain[0] is the exported automaton; for lookahead, chain[i + 1]
+ *              must feed all outputs of chain[i] through a register
+ *              (output of chain[i] at cycle c + 1 equals output of
+ *              chain[i + 1] at cycle c)
+ * @param depth Number of automata in chain (lookahead in cycles)
+ * @return 0 on success, -1 on error
+ *
+ * @note Wiring of the chain is checked; register behaviour of its
+ *       functions is the caller's promise
+ */
+int ma_dist_export(ma_dist_t *d, uint64_t id, moore_t *const chain[], size_t depth)
+{
+    if (!d || d->started || !chain || depth == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (size_t i = 0; i < depth; i++)
+    {
+        if (!chain[i] || chain[i]->m != chain[0]->m)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    /* chain[i] input b must read chain[i + 1] output b */
+    for (size_t i = 0; i + 1 < depth; i++)
+    {
+        if (chain[i]->n < chain[i]->m)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        for (size_t b = 0; b < chain[i]->m; b++)
+        {
+            const input_connection_info *c = &chain[i]->incoming_connections[b];
+            if (c->source_automaton != chain[i + 1] || c->source_output_index != b)
+            {
+                errno = EINVAL;
+                return -1;
+            }
+        }
+    }
+
+    for (size_t e = 0; e < d->export_count; e++)
+    {
+        if (d->exports[e].id == id)
+        {
+            errno = EEXIST;
+            return -1;
+        }
+    }
+
+    if (grow((void **)&d->exports, &d->export_capacity, d->export_count, sizeof(dist_export)) != 0)
+        return -1;
+
+    moore_t **copy = ma_mem_alloc(depth * sizeof(moore_t *));
+    if (!copy)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(copy, chain, depth * sizeof(moore_t *));
+
+    d->exports[d->export_count++] = (dist_export){id, copy, depth};
+    return 0;
+}
+
+/**
+ * @brief Creates local proxy of output bits of an automaton of another rank
+ *
+ * @param d Pointer to rank
+ * @param rank Rank exporting the automaton
+ * @param id Identifier given to ma_dist_export on that rank
+ * @param out First output bit mirrored
+ * @param num Number of bits mirrored
+ * @return Proxy automaton (num outputs, no inputs) or NULL on error
+ *
+ * @note Connect local automata to the proxy with ma_connect; do not step
+ *       or delete it (ma_dist_step updates it, ma_dist_delete frees it)
+ */
+moore_t *ma_dist_import(ma_dist_t *d, size_t rank, uint64_t id, size_t out, size_t num)
+{
+    if (!d || d->started || rank >= d->ranks || rank == d->rank || num == 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (grow((void **)&d->imports, &d->import_capacity, d->import_count, sizeof(dist_import)) != 0)
+        return NULL;
+
+    uint64_t *zero = ma_mem_calloc((num + 63) / 64, sizeof(uint64_t));
+    if (!zero)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    moore_t *proxy = ma_create_full(0, num, num, proxy_transition, proxy_output, zero);
+    ma_mem_free(zero, (num + 63) / 64 * sizeof(uint64_t));
+    if (!proxy)
+        return NULL;
+
+    d->imports[d->import_count++] = (dist_import){rank, id, out, num, proxy};
+    return proxy;
+}
+
+/**
+ * @brief Splits "host:port" and resolves it
+ *
+ * @return Address list (freeaddrinfo) or NULL on error
+ */
+static struct addrinfo *resolve(char const *address, bool passive)
+{
+    char host[256];
+    char const *colon = strrchr(address, ':');
+    const size_t length = (size_t)(colon - address);
+    if (length >= sizeof(host))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    memcpy(host, address, length);
+    host[length] = '\0';
+
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+    struct addrinfo *list = NULL;
+    if (getaddrinfo(length ? host : NULL, colon + 1, &hints, &list) != 0)
+    {
+        errno = EHOSTUNREACH;
+        return NULL;
+    }
+    return list;
+}
+
+/**
+ * @brief Reads or writes whole buffer on blocking socket
+ *
+ * @return 0 on success, -1 on error
+ */
+static int transfer_all(int fd, void *buffer, size_t length, bool write)
+{
+    char *p = buffer;
+    while (length > 0)
+    {
+        const ssize_t done = write ? send(fd, p, length, MSG_NOSIGNAL) : recv(fd, p, length, 0);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+        {
+            if (done == 0)
+                errno = ECONNRESET;
+            return -1;
+        }
+        p += done;
+        length -= (size_t)done;
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns milliseconds of monotonic clock
+ */
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Connects to every other rank (lower ranks are dialled, higher accepted)
+ *
+ * @return 0 on success, -1 on error
+ */
+static int connect_ranks(ma_dist_t *d)
+{
+    int listener = -1;
+    const int one = 1;
+
+    if (d->rank + 1 < d->ranks)
+    {
+        struct addrinfo *list = resolve(d->addresses[d->rank], true);
+        if (!list)
+            return -1;
+
+        listener = socket(list->ai_family, SOCK_STREAM, 0);
+        if (listener < 0 ||
+            setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+            bind(listener, list->ai_addr, list->ai_addrlen) != 0 ||
+            listen(listener, (int)d->ranks) != 0)
+        {
+            const int saved = errno;
+            freeaddrinfo(list);
+            if (listener >= 0)
+                close(listener);
+            errno = saved;
+            return -1;
+        }
+        freeaddrinfo(list);
+    }
+
+    /* Dial lower ranks, retrying until they listen */
+    const int64_t deadline = now_ms() + DIST_CONNECT_TIMEOUT_MS;
+    for (size_t r = 0; r < d->rank; r++)
+    {
+        struct addrinfo *list = resolve(d->addresses[r], false);
+        if (!list)
+            goto cleanup_fail;
+
+        int fd = -1;
+        while (fd < 0)
+        {
+            fd = socket(list->ai_family, SOCK_STREAM, 0);
+            if (fd >= 0 && connect(fd, list->ai_addr, list->ai_addrlen) == 0)
+                break;
+            if (fd >= 0)
+                close(fd);
+            fd = -1;
+            if (now_ms() > deadline)
+            {
+                freeaddrinfo(list);
+                errno = ETIMEDOUT;
+                goto cleanup_fail;
+            }
+            const struct timespec pause = {0, DIST_RETRY_NS};
+            nanosleep(&pause, NULL);
+        }
+        freeaddrinfo(list);
+
+        d->peers[r].fd = fd;
+        uint64_t me = d->rank;
+        if (transfer_all(fd, &me, sizeof(me), true) != 0)
+            goto cleanup_fail;
+    }
+
+    /* Accept higher ranks, which introduce themselves */
+    for (size_t accepted = d->rank + 1; accepted < d->ranks; accepted++)
+    {
+        const int fd = accept(listener, NULL, NULL);
+        if (fd < 0)
+            goto cleanup_fail;
+
+        uint64_t peer;
+        if (transfer_all(fd, &peer, sizeof(peer), false) != 0)
+        {
+            close(fd);
+            goto cleanup_fail;
+        }
+        if (peer <= d->rank || peer >= d->ranks || d->peers[peer].fd >= 0)
+        {
+            close(fd);
+            errno = EPROTO;
+            goto cleanup_fail;
+        }
+        d->peers[peer].fd = fd;
+    }
+
+    if (listener >= 0)
+        close(listener);
+
+    for (size_t r = 0; r < d->ranks; r++)
+    {
+        if (d->peers[r].fd < 0)
+            continue;
+        setsockopt(d->peers[r].fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(d->peers[r].fd, F_SETFL, fcntl(d->peers[r].fd, F_GETFL) | O_NONBLOCK);
+    }
+    return 0;
+
+cleanup_fail:
+    if (listener >= 0)
+    {
+        const int saved = errno;
+        close(listener);
+        errno = saved;
+    }
+    return -1;
+}
+
+/**
+ * @brief Sends and receives buffers prepared in peers, all at once
+ *
+ * @param d Pointer to rank
+ * @return 0 on success, -1 on error
+ *
+ * @note Sockets are polled together, so large messages in both directions
+ *       cannot deadlock on full socket buffers
+ */
+static int exchange(ma_dist_t *d)
+{
+    for (;;)
+    {
+        size_t count = 0;
+        for (size_t r = 0; r < d->ranks; r++)
+        {
+            dist_peer *p = &d->peers[r];
+            if (p->fd < 0)
+                continue;
+
+            short events = 0;
+            if (p->out_done < p->out_len)
+                events |= POLLOUT;
+            if (p->in_done < p->in_len)
+                events |= POLLIN;
+            if (events)
+                d->polls[count++] = (struct pollfd){p->fd, events, 0};
+        }
+
+        if (count == 0)
+            return 0;
+
+        const int ready = poll(d->polls, count, DIST_IO_TIMEOUT_MS);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready <= 0)
+        {
+            if (ready == 0)
+                errno = ETIMEDOUT;
+            return -1;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            dist_peer *p = NULL;
+            for (size_t r = 0; r < d->ranks && !p; r++)
+                if (d->peers[r].fd == d->polls[i].fd)
+                    p = &d->peers[r];
+
+            if (d->polls[i].revents & (POLLERR | POLLNVAL))
+            {
+                errno = ECONNRESET;
+                return -1;
+            }
+
+            if (d->polls[i].revents & POLLOUT)
+            {
+                const ssize_t done = send(p->fd, (char const *)p->out_ptr + p->out_done,
+                                          p->out_len - p->out_done, MSG_NOSIGNAL);
+                if (done < 0 && errno != EAGAIN && errno != EINTR)
+                    return -1;
+                if (done > 0)
+                    p->out_done += (size_t)done;
+            }
+
+            if ((d->polls[i].revents & (POLLIN | POLLHUP)) && p->in_done < p->in_len)
+            {
+                const ssize_t done = recv(p->fd, (char *)p->in_ptr + p->in_done,
+                                          p->in_len - p->in_done, 0);
+                if (done == 0)
+                {
+                    errno = ECONNRESET;
+                    return -1;
+                }
+                if (done < 0 && errno != EAGAIN && errno != EINTR)
+                    return -1;
+                if (done > 0)
+                    p->in_done += (size_t)done;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Prepares transfer of peer for next exchange
+ */
+static inline void set_transfer(dist_peer *p, void const *out, size_t out_len, void *in, size_t in_len)
+{
+    p->out_ptr = out;
+    p->out_len = out_len;
+    p->out_done = 0;
+    p->in_ptr = in;
+    p->in_len = in_len;
+    p->in_done = 0;
+}
+
+/**
+ * @brief Finds export of this rank
+ *
+ * @return Export or NULL if id is unknown
+ */
+static dist_export const *find_export(ma_dist_t const *d, uint64_t id)
+{
+    for (size_t e = 0; e < d->export_count; e++)
+        if (d->exports[e].id == id)
+            return &d->exports[e];
+    return NULL;
+}
+
+/**
+ * @brief Agrees on cut edges with every other rank and sizes message buffers
+ *
+ * @return 0 on success, -1 on error
+ *
+ * @note Each rank sends (id, out, num) of its imports to their owners and
+ *       gets back the lookahead of each, or 0 for an invalid request
+ */
+static int handshake(ma_dist_t *d)
+{
+    int result = -1;
+    const size_t ranks = d->ranks;
+    uint64_t *counts_in = NULL;
+    uint64_t *counts_out = ma_mem_calloc(2 * ranks, sizeof(uint64_t));
+    uint64_t **requests_out = ma_mem_calloc(ranks, sizeof(uint64_t *));
+    uint64_t **requests_in = ma_mem_calloc(ranks, sizeof(uint64_t *));
+    uint64_t **replies_out = ma_mem_calloc(ranks, sizeof(uint64_t *));
+    uint64_t **replies_in = ma_mem_calloc(ranks, sizeof(uint64_t *));
+    if (!counts_out || !requests_out || !requests_in || !replies_out || !replies_in)
+    {
+        errno = ENOMEM;
+        goto cleanup;
+    }
+    counts_in = counts_out + ranks;
+
+    /* Imports grouped by owning rank, in declaration order */
+    for (size_t i = 0; i < d->import_count; i++)
+        d->peers[d->imports[i].rank].recv_count++;
+
+    for (size_t r = 0; r < ranks; r++)
+    {
+        dist_peer *p = &d->peers[r];
+        counts_out[r] = p->recv_count;
+        if (r == d->rank)
+            continue;
+
+        p->recvs = ma_mem_alloc((p->recv_count + 1) * sizeof(size_t));
+        requests_out[r] = ma_mem_alloc((3 * p->recv_count + 1) * sizeof(uint64_t));
+        replies_in[r] = ma_mem_alloc((p->recv_count + 1) * sizeof(uint64_t));
+        if (!p->recvs || !requests_out[r] || !replies_in[r])
+        {
+            errno = ENOMEM;
+            goto cleanup;
+        }
+
+        size_t k = 0;
+        for (size_t i = 0; i < d->import_count; i++)
+        {
+            dist_import const *im = &d->imports[i];
+            if (im->rank != r)
+                continue;
+            p->recvs[k] = i;
+            requests_out[r][3 * k] = im->id;
+            requests_out[r][3 * k + 1] = im->out;
+            requests_out[r][3 * k + 2] = im->num;
+            p->recv_bits += im->num;
+            k++;
+        }
+        set_transfer(p, &counts_out[r], sizeof(uint64_t), &counts_in[r], sizeof(uint64_t));
+    }
+
+    /* Round 1: number of requests, round 2: requests */
+    if (exchange(d) != 0)
+        goto cleanup;
+
+    for (size_t r = 0; r < ranks; r++)
+    {
+        if (r == d->rank)
+            continue;
+        dist_peer *p = &d->peers[r];
+        if (counts_in[r] > SIZE_MAX / (3 * sizeof(uint64_t)))
+        {
+            errno = EPROTO;
+            goto cleanup;
+        }
+        requests_in[r] = ma_mem_alloc((3 * counts_in[r] + 1) * sizeof(uint64_t));
+        replies_out[r] = ma_mem_alloc((counts_in[r] + 1) * sizeof(uint64_t));
+        p->sends = ma_mem_calloc(counts_in[r] + 1, sizeof(dist_send));
+        if (!requests_in[r] || !replies_out[r] || !p->sends)
+        {
+            errno = ENOMEM;
+            goto cleanup;
+        }
+        set_transfer(p, requests_out[r], 3 * p->recv_count * sizeof(uint64_t),
+                     requests_in[r], 3 * counts_in[r] * sizeof(uint64_t));
+    }
+
+    if (exchange(d) != 0)
+        goto cleanup;
+
+    /* Round 3: lookahead of each request (0 = rejected) */
+    bool valid = true;
+    for (size_t r = 0; r < ranks; r++)
+    {
+        if (r == d->rank)
+            continue;
+        dist_peer *p = &d->peers[r];
+        p->send_count = counts_in[r];
+        for (size_t k = 0; k < p->send_count; k++)
+        {
+            const uint64_t id = requests_in[r][3 * k];
+            const uint64_t out = requests_in[r][3 * k + 1];
+            const uint64_t num = requests_in[r][3 * k + 2];
+            dist_export const *e = find_export(d, id);
+
+            replies_out[r][k] = 0;
+            if (e && num > 0 && out < e->chain[0]->m && num <= e->chain[0]->m - out)
+            {
+                replies_out[r][k] = e->depth;
+                p->sends[k] = (dist_send){e, out, num};
+                p->send_bits += num;
+            }
+            if (replies_out[r][k] < d->batch)
+                valid = false;
+        }
+        set_transfer(p, replies_out[r], p->send_count * sizeof(uint64_t),
+                     replies_in[r], p->recv_count * sizeof(uint64_t));
+    }
+
+    if (exchange(d) != 0)
+        goto cleanup;
+
+    for (size_t r = 0; r < ranks; r++)
+    {
+        if (r == d->rank)
+            continue;
+        for (size_t k = 0; k < d->peers[r].recv_count; k++)
+            if (replies_in[r][k] < d->batch)
+                valid = false;
+    }
+
+    if (!valid)
+    {
+        errno = EINVAL;
+        goto cleanup;
+    }
+
+    /* Message buffers: cycle number followed by batch slots */
+    for (size_t r = 0; r < ranks; r++)
+    {
+        if (r == d->rank)
+            continue;
+        dist_peer *p = &d->peers[r];
+        p->send_words = 1 + (d->batch * p->send_bits + 63) / 64;
+        p->recv_words = 1 + (d->batch * p->recv_bits + 63) / 64;
+        p->send_buf = ma_mem_calloc(p->send_words, sizeof(uint64_t));
+        p->recv_buf = ma_mem_calloc(p->recv_words, sizeof(uint64_t));
+        if (!p->send_buf || !p->recv_buf)
+        {
+            errno = ENOMEM;
+            goto cleanup;
+        }
+    }
+    result = 0;
+
+cleanup:
+    for (size_t r = 0; r < ranks && requests_out; r++)
+    {
+        const size_t sent = d->peers[r].recv_count, received = counts_in ? counts_in[r] : 0;
+        ma_mem_free(requests_out[r], (3 * sent + 1) * sizeof(uint64_t));
+        ma_mem_free(replies_in[r], (sent + 1) * sizeof(uint64_t));
+        ma_mem_free(requests_in[r], (3 * received + 1) * sizeof(uint64_t));
+        ma_mem_free(replies_out[r], (received + 1) * sizeof(uint64_t));
+    }
+    ma_mem_free(counts_out, 2 * ranks * sizeof(uint64_t));
+    ma_mem_free(requests_out, ranks * sizeof(uint64_t *));
+    ma_mem_free(requests_in, ranks * sizeof(uint64_t *));
+    ma_mem_free(replies_out, ranks * sizeof(uint64_t *));
+    ma_mem_free(replies_in, ranks * sizeof(uint64_t *));
+    return result;
+}
+
+/**
+ * @brief Packs exported bits for the next batch cycles and swaps messages
+ *
+ * @return 0 on success, -1 on error
+ *
+ * @note Slot j holds what chain[0] outputs j cycles after the current one,
+ *       read now from chain[j]
+ */
+static int exchange_outputs(ma_dist_t *d)
+{
+    for (size_t r = 0; r < d->ranks; r++)
+    {
+        dist_peer *p = &d->peers[r];
+        if (r == d->rank || (p->send_bits == 0 && p->recv_bits == 0))
+            continue;
+
+        p->send_buf[0] = d->cycle;
+        size_t bit = 64;
+        for (size_t j = 0; j < d->batch; j++)
+        {
+            for (size_t k = 0; k < p->send_count; k++)
+            {
+                dist_send const *s = &p->sends[k];
+                ma_copy_bits(p->send_buf, bit, s->export->chain[j]->output, s->out, s->num);
+                bit += s->num;
+            }
+        }
+
+        /* Messages are sent only where cut edges exist */
+        set_transfer(p, p->send_buf, p->send_bits ? p->send_words * sizeof(uint64_t) : 0,
+                     p->recv_buf, p->recv_bits ? p->recv_words * sizeof(uint64_t) : 0);
+    }
+
+    if (exchange(d) != 0)
+        return -1;
+
+    for (size_t r = 0; r < d->ranks; r++)
+    {
+        if (r != d->rank && d->peers[r].recv_bits && d->peers[r].recv_buf[0] != d->cycle)
+        {
+            errno = EPROTO;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes slot of last received messages into proxies
+ *
+ * @param d Pointer to rank
+ * @param slot Cycle within batch
+ */
+static void update_proxies(ma_dist_t *d, size_t slot)
+{
+    for (size_t r = 0; r < d->ranks; r++)
+    {
+        dist_peer const *p = &d->peers[r];
+        if (r == d->rank || p->recv_bits == 0)
+            continue;
+
+        size_t bit = 64 + slot * p->recv_bits;
+        for (size_t k = 0; k < p->recv_count; k++)
+        {
+            dist_import const *im = &d->imports[p->recvs[k]];
+            ma_copy_bits(im->proxy->output, 0, p->recv_buf, bit, im->num);
+            memcpy(im->proxy->state, im->proxy->output, (im->num + 63) / 64 * sizeof(uint64_t));
+            bit += im->num;
+        }
+    }
+}
+
+/**
+ * @brief Connects ranks, agrees on cut edges and exchanges initial outputs
+ *
+ * @param d Pointer to rank
+ * @return 0 on success, -1 on error
+ *
+ * @note Must be called by all ranks; blocks until every rank has joined.
+ *       errno is EINVAL if an import names an unknown export or a range
+ *       beyond its outputs, or a lookahead is shorter than batch.
+ * @note Hosts must share byte order
+ */
+int ma_dist_start(ma_dist_t *d)
+{
+    if (!d || d->started)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    d->started = true;
+    if (connect_ranks(d) != 0 || handshake(d) != 0 || exchange_outputs(d) != 0)
+    {
+        d->broken = true;
+        return -1;
+    }
+
+    d->phase = 0;
+    return 0;
+}
+
+/**
+ * @brief Executes simulation cycles of this rank
+ *
+ * @param d Pointer to started rank
+ * @param cycles Number of cycles (same on all ranks)
+ * @return 0 on success, -1 on error
+ *
+ * @note Each rank steps its automata like ma_step; cut-edge bits are
+ *       exchanged once every batch cycles in one message per neighbour
+ * @note errno is ENOMEM if an in-place automaton lost a write (see
+ *       ma_step); all cycles are still executed
+ */
+int ma_dist_step(ma_dist_t *d, size_t cycles)
+{
+    if (!d || !d->started || cycles == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (d->broken)
+    {
+        errno = ECONNRESET;
+        return -1;
+    }
+
+    /* A lost in-place write is reported after the cycles (ranks stay in step) */
+    bool lost = false;
+    for (size_t c = 0; c < cycles; c++)
+    {
+        update_proxies(d, d->phase);
+        lost |= ma_step(d->at, d->num) != 0;
+        d->cycle++;
+
+        if (++d->phase == d->batch)
+        {
+            if (exchange_outputs(d) != 0)
+            {
+                d->broken = true;
+                return -1;
+            }
+            d->phase = 0;
+        }
+    }
+    if (lost)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Closes connections and frees rank with its proxies
+ *
+ * @param d Pointer to rank (can be NULL)
+ *
+ * @note Sinks of proxies become unconnected
+ */
+void ma_dist_delete(ma_dist_t *d)
+{
+    if (!d)
+        return;
+
+    for (size_t r = 0; d->peers && r < d->ranks; r++)
+    {
+        dist_peer *p = &d->peers[r];
+        if (p->fd >= 0)
+            close(p->fd);
+        ma_mem_free(p->sends, (p->send_count + 1) * sizeof(dist_send));
+        ma_mem_free(p->recvs, (p->recv_count + 1) * sizeof(size_t));
+        ma_mem_free(p->send_buf, p->send_words * sizeof(uint64_t));
+        ma_mem_free(p->recv_buf, p->recv_words * sizeof(uint64_t));
+    }
+
+    for (size_t e = 0; e < d->export_count; e++)
+        ma_mem_free(d->exports[e].chain, d->exports[e].depth * sizeof(moore_t *));
+    for (size_t i = 0; i < d->import_count; i++)
+        ma_delete(d->imports[i].proxy);
+
+    for (size_t r = 0; d->addresses && r < d->ranks; r++)
+        if (d->addresses[r])
+            ma_mem_free(d->addresses[r], strlen(d->addresses[r]) + 1);
+
+    ma_mem_free(d->exports, d->export_capacity * sizeof(dist_export));
+    ma_mem_free(d->imports, d->import_capacity * sizeof(dist_import));
+    ma_mem_free(d->at, d->num * sizeof(moore_t *));
+    ma_mem_free(d->addresses, d->ranks * sizeof(char *));
+    ma_mem_free(d->peers, d->ranks * sizeof(dist_peer));
+    ma_mem_free(d->polls, d->ranks * sizeof(struct pollfd));
+    ma_mem_free(d, sizeof(ma_dist_t));
+}
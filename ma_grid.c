@@ -0,0 +1,731 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "ma.h"
+#include "ma_internal.h"
+
+#define GRID_MAX_DIMS 3
+#define GRID_MAX_NEIGHBOURS 27        /* Moore neighbourhood in 3D including the cell */
+#define GRID_MAX_STATE_BITS 8         /* States are stored as bytes */
+#define GRID_TILE_X 4096              /* Cells per kernel call */
+#define GRID_DEFAULT_L2 (256u << 10)  /* Assumed L2 size if sysconf does not know */
+#define GRID_MAX_THREADS 256
+
+/**
+ * @brief Structure representing a lattice of identical automata
+ *
+ * States are bytes in one dense array padded by a halo of one cell in
+ * every dimension. Neighbours are fixed offsets into that array, so no
+ * connection is stored; periodic boundaries copy opposite edges into
+ * the halo before each step, fixed boundaries keep it constant.
+ */
+struct ma_grid
+{
+    size_t d;                   /* Number of dimensions (1..3) */
+    size_t size[GRID_MAX_DIMS]; /* Cells along x, y, z (1 for missing dimensions) */
+    size_t halo[GRID_MAX_DIMS]; /* Halo width along x, y, z (0 for missing dimensions) */
+    size_t pad[GRID_MAX_DIMS];  /* Padded size along x, y, z */
+    size_t volume;              /* Cells of padded array */
+    size_t s;                   /* State bits per cell */
+    int boundary;               /* MA_GRID_PERIODIC or MA_GRID_FIXED */
+    uint8_t boundary_value;     /* Halo value of fixed boundary */
+    ma_grid_kernel_t kernel;
+    void *ctx;                  /* User context for kernel */
+
+    ptrdiff_t offsets[GRID_MAX_NEIGHBOURS]; /* Neighbour offsets, the cell first */
+    size_t neighbours;
+    size_t tile_rows;           /* Rows per block of 3D sweep */
+
+    uint8_t *cells;             /* CURRENT states */
+    uint8_t *next;              /* NEXT states (calculated by steps) */
+    moore_t *edges[2 * GRID_MAX_DIMS]; /* Automata exposing faces (created on demand) */
+};
+
+/**
+ * @brief Threads stepping one grid together
+ */
+typedef struct
+{
+    ma_grid_t *grid;
+    uint64_t steps;
+    size_t threads;             /* Threads taking part (set before gate opens) */
+    pthread_barrier_t barrier;
+    pthread_mutex_t gate;       /* Held by creator until threads is known */
+} grid_run;
+
+/**
+ * @brief Argument of one stepping thread
+ */
+typedef struct
+{
+    grid_run *run;
+    size_t index;
+} grid_worker;
+
+/**
+ * @brief Returns index of cell (x, y, z) in padded array
+ */
+static inline size_t cell_index(ma_grid_t const *grid, size_t x, size_t y, size_t z)
+{
+    return ((z + grid->halo[2]) * grid->pad[1] + y + grid->halo[1]) * grid->pad[0] + x + 1;
+}
+
+/**
+ * @brief Frees grid, its buffers and its edge automata
+ */
+static void grid_free(ma_grid_t *grid)
+{
+    for (size_t e = 0; e < 2 * GRID_MAX_DIMS; e++)
+        ma_delete(grid->edges[e]);
+    ma_mem_free(grid->cells, grid->volume);
+    ma_mem_free(grid->next, grid->volume);
+    ma_mem_free(grid, sizeof(ma_grid_t));
+}
+
+/**
+ * @brief Sets all halo cells of buffer to value
+ */
+static void fill_fixed(ma_grid_t const *grid, uint8_t *buffer, uint8_t value)
+{
+    const size_t px = grid->pad[0];
+    for (size_t z = 0; z < grid->pad[2]; z++)
+    {
+        const bool z_halo = z < grid->halo[2] || z >= grid->halo[2] + grid->size[2];
+        for (size_t y = 0; y < grid->pad[1]; y++)
+        {
+            uint8_t *row = buffer + (z * grid->pad[1] + y) * px;
+            if (z_halo || y < grid->halo[1] || y >= grid->halo[1] + grid->size[1])
+            {
+                memset(row, value, px);
+            }
+            else
+            {
+                row[0] = value;
+                row[px - 1] = value;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Wraps x halo of rows y0..y1-1 of all planes (periodic boundary)
+ */
+static void fill_x(ma_grid_t const *grid, uint8_t *buffer, size_t y0, size_t y1)
+{
+    const size_t nx = grid->size[0];
+    for (size_t z = 0; z < grid->size[2]; z++)
+    {
+        for (size_t y = y0; y < y1; y++)
+        {
+            uint8_t *row = buffer + cell_index(grid, 0, y, z) - 1;
+            row[0] = row[nx];
+            row[nx + 1] = row[1];
+        }
+    }
+}
+
+/**
+ * @brief Wraps y and z halos (periodic boundary, after fill_x of all rows)
+ *
+ * Whole padded rows and planes are copied, so corners receive the
+ * already wrapped x halo.
+ */
+static void fill_yz(ma_grid_t const *grid, uint8_t *buffer)
+{
+    const size_t px = grid->pad[0];
+    const size_t ny = grid->size[1];
+    const size_t nz = grid->size[2];
+
+    if (grid->halo[1])
+    {
+        for (size_t z = 0; z < nz; z++)
+        {
+            uint8_t *plane = buffer + (z + grid->halo[2]) * grid->pad[1] * px;
+            memcpy(plane, plane + ny * px, px);
+            memcpy(plane + (ny + 1) * px, plane + px, px);
+        }
+    }
+
+    if (grid->halo[2])
+    {
+        const size_t plane = grid->pad[1] * px;
+        memcpy(buffer, buffer + nz * plane, plane);
+        memcpy(buffer + (nz + 1) * plane, buffer + plane, plane);
+    }
+}
+
+/**
+ * @brief Computes next states of one row in tiles of GRID_TILE_X cells
+ */
+static void step_row(ma_grid_t const *grid, uint8_t const *cur, uint8_t *next, size_t y, size_t z)
+{
+    const size_t base = cell_index(grid, 0, y, z);
+    uint8_t const *cell[GRID_MAX_NEIGHBOURS];
+
+    for (size_t x = 0; x < grid->size[0]; x += GRID_TILE_X)
+    {
+        size_t count = grid->size[0] - x;
+        if (count > GRID_TILE_X)
+            count = GRID_TILE_X;
+
+        for (size_t k = 0; k < grid->neighbours; k++)
+            cell[k] = cur + base + x + grid->offsets[k];
+        grid->kernel(next + base + x, cell, count, grid->ctx);
+    }
+}
+
+/**
+ * @brief Computes next states of rows y0..y1-1 of all planes
+ *
+ * Rows are swept in blocks of tile_rows through all planes, so the three
+ * planes a 3D stencil reads stay cache resident.
+ */
+static void step_rows(ma_grid_t const *grid, uint8_t const *cur, uint8_t *next, size_t y0, size_t y1)
+{
+    for (size_t yb = y0; yb < y1; yb += grid->tile_rows)
+    {
+        const size_t ye = y1 - yb > grid->tile_rows ? yb + grid->tile_rows : y1;
+        for (size_t z = 0; z < grid->size[2]; z++)
+        {
+            for (size_t y = yb; y < ye; y++)
+                step_row(grid, cur, next, y, z);
+        }
+    }
+}
+
+/* Waits for all threads of run (no-op when stepping alone) */
+static inline void run_wait(grid_run *run)
+{
+    if (run->threads > 1)
+        pthread_barrier_wait(&run->barrier);
+}
+
+/**
+ * @brief Steps own rows of grid for all steps of run
+ */
+static void *grid_work(void *arg)
+{
+    grid_worker const *w = arg;
+    grid_run *run = w->run;
+
+    /* Thread count is published when the gate opens */
+    pthread_mutex_lock(&run->gate);
+    pthread_mutex_unlock(&run->gate);
+
+    ma_grid_t const *grid = run->grid;
+    const size_t ny = grid->size[1];
+    const size_t y0 = ny * w->index / run->threads;
+    const size_t y1 = ny * (w->index + 1) / run->threads;
+    uint8_t *cur = grid->cells;
+    uint8_t *next = grid->next;
+
+    for (uint64_t step = 0; step < run->steps; step++)
+    {
+        if (grid->boundary == MA_GRID_PERIODIC)
+        {
+            fill_x(grid, cur, y0, y1);
+            run_wait(run);
+            if (w->index == 0)
+                fill_yz(grid, cur);
+            run_wait(run);
+            step_rows(grid, cur, next, y0, y1);
+        }
+        else
+        {
+            step_rows(grid, cur, next, y0, y1);
+            run_wait(run);
+        }
+
+        uint8_t *tmp = cur;
+        cur = next;
+        next = tmp;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Visits cells of face side in order of the remaining coordinates
+ *
+ * @return Number of cells of face
+ */
+static size_t face_cells(ma_grid_t const *grid, size_t side, size_t *first, size_t stride[2],
+                         size_t count[2])
+{
+    const size_t axis = side / 2;
+    size_t coord[GRID_MAX_DIMS] = {0, 0, 0};
+    coord[axis] = side % 2 ? grid->size[axis] - 1 : 0;
+    *first = cell_index(grid, coord[0], coord[1], coord[2]);
+
+    const size_t step[GRID_MAX_DIMS] = {1, grid->pad[0], grid->pad[0] * grid->pad[1]};
+    size_t k = 0;
+    for (size_t a = 0; a < GRID_MAX_DIMS; a++)
+    {
+        if (a == axis)
+            continue;
+        stride[k] = step[a];
+        count[k] = grid->size[a];
+        k++;
+    }
+    return count[0] * count[1];
+}
+
+/**
+ * @brief Stores value of face cell pos in state of edge automaton
+ */
+static inline void edge_put(moore_t *a, size_t s, size_t pos, uint64_t value)
+{
+    const size_t bit = pos * s;
+    const uint64_t mask = ((uint64_t)1 << s) - 1;
+    a->state[bit / 64] = (a->state[bit / 64] & ~(mask << (bit % 64))) | (value << (bit % 64));
+    if (bit % 64 + s > 64)
+    {
+        const unsigned shift = (unsigned)(64 - bit % 64);
+        a->state[bit / 64 + 1] = (a->state[bit / 64 + 1] & ~(mask >> shift)) | (value >> shift);
+    }
+}
+
+/**
+ * @brief Copies face cells into state and output of edge automaton
+ */
+static void refresh_edge(ma_grid_t const *grid, size_t side)
+{
+    moore_t *a = grid->edges[side];
+    size_t first, stride[2], count[2];
+    face_cells(grid, side, &first, stride, count);
+
+    const uint64_t mask = ((uint64_t)1 << grid->s) - 1;
+    size_t pos = 0;
+    for (size_t j = 0; j < count[1]; j++)
+    {
+        uint8_t const *cell = grid->cells + first + j * stride[1];
+        for (size_t i = 0; i < count[0]; i++)
+            edge_put(a, grid->s, pos++, cell[i * stride[0]] & mask);
+    }
+
+    identity_func(a->output, a->state, a->m, a->s);
+}
+
+/* Refreshes all created edge automata */
+static void refresh_edges(ma_grid_t const *grid)
+{
+    for (size_t e = 0; e < 2 * grid->d; e++)
+    {
+        if (grid->edges[e])
+            refresh_edge(grid, e);
+    }
+}
+
+/* Edge automata only expose outputs: stepping them keeps their state */
+static void edge_hold(uint64_t *next_state, uint64_t const *input, uint64_t const *state,
+                      size_t n, size_t s)
+{
+    (void)input;
+    (void)n;
+    memcpy(next_state, state, (s + 63) / 64 * sizeof(uint64_t));
+}
+
+/**
+ * @brief Creates lattice of identical automata stepped by a stencil kernel
+ *
+ * @param d Number of dimensions (1..3)
+ * @param dims Cells along each dimension (x first)
+ * @param s Number of state bits per cell (1..8)
+ * @param neighbourhood MA_GRID_VON_NEUMANN or MA_GRID_MOORE
+ * @param boundary MA_GRID_PERIODIC or MA_GRID_FIXED
+ * @param kernel Stencil kernel
+ * @param ctx User context passed to kernel
+ * @return Pointer to new grid or NULL on error
+ *
+ * @note The kernel receives the cell itself as neighbour 0, followed by
+ *       the other neighbours ordered by z, then y, then x offset; all
+ *       states start at zero, the halo of a fixed boundary too
+ */
+ma_grid_t *ma_grid_create(size_t d, size_t const dims[], size_t s, int neighbourhood,
+                          int boundary, ma_grid_kernel_t kernel, void *ctx)
+{
+    if (d == 0 || d > GRID_MAX_DIMS || !dims || s == 0 || s > GRID_MAX_STATE_BITS || !kernel ||
+        (neighbourhood != MA_GRID_VON_NEUMANN && neighbourhood != MA_GRID_MOORE) ||
+        (boundary != MA_GRID_PERIODIC && boundary != MA_GRID_FIXED))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ma_grid_t *grid = ma_mem_calloc(1, sizeof(ma_grid_t));
+    if (!grid)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    grid->d = d;
+    grid->volume = 1;
+    for (size_t a = 0; a < GRID_MAX_DIMS; a++)
+    {
+        grid->size[a] = a < d ? dims[a] : 1;
+        grid->halo[a] = a < d ? 1 : 0;
+        if (grid->size[a] == 0)
+        {
+            ma_mem_free(grid, sizeof(ma_grid_t));
+            errno = EINVAL;
+            return NULL;
+        }
+        if (grid->size[a] > SIZE_MAX / 2 - 2 || grid->volume > SIZE_MAX / (grid->size[a] + 2))
+        {
+            ma_mem_free(grid, sizeof(ma_grid_t));
+            errno = ENOMEM;
+            return NULL;
+        }
+        grid->pad[a] = grid->size[a] + 2 * grid->halo[a];
+        grid->volume *= grid->pad[a];
+    }
+
+    grid->s = s;
+    grid->boundary = boundary;
+    grid->kernel = kernel;
+    grid->ctx = ctx;
+
+    /* Cell first, then neighbours in z, y, x order */
+    const ptrdiff_t px = (ptrdiff_t)grid->pad[0];
+    const ptrdiff_t plane = px * (ptrdiff_t)grid->pad[1];
+    grid->neighbours = 1;
+    for (ptrdiff_t dz = -(ptrdiff_t)grid->halo[2]; dz <= (ptrdiff_t)grid->halo[2]; dz++)
+    {
+        for (ptrdiff_t dy = -(ptrdiff_t)grid->halo[1]; dy <= (ptrdiff_t)grid->halo[1]; dy++)
+        {
+            for (ptrdiff_t dx = -1; dx <= 1; dx++)
+            {
+                const ptrdiff_t distance = (dx != 0) + (dy != 0) + (dz != 0);
+                if (distance == 0 || (neighbourhood == MA_GRID_VON_NEUMANN && distance > 1))
+                    continue;
+                grid->offsets[grid->neighbours++] = dz * plane + dy * px + dx;
+            }
+        }
+    }
+
+    /* Three planes of tile_rows + 2 rows should fit in half of L2 */
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    const size_t budget = (l2 > 0 ? (size_t)l2 : GRID_DEFAULT_L2) / 2;
+    const size_t rows = budget / (3 * grid->pad[0]);
+    grid->tile_rows = rows > 3 ? rows - 2 : 1;
+
+    grid->cells = ma_mem_calloc(grid->volume, 1);
+    grid->next = ma_mem_calloc(grid->volume, 1);
+    if (!grid->cells || !grid->next)
+    {
+        grid_free(grid);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    return grid;
+}
+
+/**
+ * @brief Deletes grid, its buffers and its edge automata
+ *
+ * @param grid Pointer to grid (can be NULL)
+ */
+void ma_grid_delete(ma_grid_t *grid)
+{
+    if (grid)
+        grid_free(grid);
+}
+
+/**
+ * @brief Sets value held by the halo of a fixed boundary
+ *
+ * @param grid Pointer to grid
+ * @param value Boundary state (s bits)
+ * @return 0 on success, -1 on error
+ */
+int ma_grid_set_boundary(ma_grid_t *grid, uint64_t value)
+{
+    if (!grid || grid->boundary != MA_GRID_FIXED || value >> grid->s)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    grid->boundary_value = (uint8_t)value;
+    fill_fixed(grid, grid->cells, grid->boundary_value);
+    fill_fixed(grid, grid->next, grid->boundary_value);
+    return 0;
+}
+
+/**
+ * @brief Returns index of cell at coordinates or SIZE_MAX if outside grid
+ */
+static size_t coords_index(ma_grid_t const *grid, size_t const coords[])
+{
+    size_t c[GRID_MAX_DIMS] = {0, 0, 0};
+    for (size_t a = 0; a < grid->d; a++)
+    {
+        if (coords[a] >= grid->size[a])
+            return SIZE_MAX;
+        c[a] = coords[a];
+    }
+    return cell_index(grid, c[0], c[1], c[2]);
+}
+
+/**
+ * @brief Sets state of one cell
+ *
+ * @param grid Pointer to grid
+ * @param coords Coordinates of cell (d values, x first)
+ * @param state New state (s bits)
+ * @return 0 on success, -1 on error
+ */
+int ma_grid_set_cell(ma_grid_t *grid, size_t const coords[], uint64_t state)
+{
+    if (!grid || !coords || state >> grid->s)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const size_t i = coords_index(grid, coords);
+    if (i == SIZE_MAX)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    grid->cells[i] = (uint8_t)state;
+
+    /* Only faces containing the cell change */
+    for (size_t side = 0; side < 2 * grid->d; side++)
+    {
+        const size_t axis = side / 2;
+        moore_t *a = grid->edges[side];
+        if (!a || coords[axis] != (side % 2 ? grid->size[axis] - 1 : 0))
+            continue;
+
+        size_t pos = 0, scale = 1;
+        for (size_t b = 0; b < grid->d; b++)
+        {
+            if (b == axis)
+                continue;
+            pos += coords[b] * scale;
+            scale *= grid->size[b];
+        }
+        edge_put(a, grid->s, pos, state);
+        identity_func(a->output, a->state, a->m, a->s);
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns state of one cell
+ *
+ * @param grid Pointer to grid
+ * @param coords Coordinates of cell (d values, x first)
+ * @return State bits (0 on error, errno = EINVAL)
+ */
+uint64_t ma_grid_get_cell(ma_grid_t const *grid, size_t const coords[])
+{
+    const size_t i = grid && coords ? coords_index(grid, coords) : SIZE_MAX;
+    if (i == SIZE_MAX)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    return grid->cells[i] & (((uint64_t)1 << grid->s) - 1);
+}
+
+/**
+ * @brief Executes steps of all cells using several threads
+ *
+ * @param grid Pointer to grid
+ * @param steps Number of steps
+ * @param threads Number of threads (0 for number of online CPUs)
+ * @return 0 on success, -1 on error
+ *
+ * @note Rows (y) are split between threads, which meet at a barrier
+ *       once per step (twice with a periodic boundary); a thread that
+ *       cannot be created leaves its rows to the others
+ */
+int ma_grid_run(ma_grid_t *grid, uint64_t steps, size_t threads)
+{
+    if (!grid)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (threads == 0)
+    {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if (threads > grid->size[1])
+        threads = grid->size[1];
+    if (threads > GRID_MAX_THREADS)
+        threads = GRID_MAX_THREADS;
+
+    grid_run run = {.grid = grid, .steps = steps, .threads = 1};
+    grid_worker workers[GRID_MAX_THREADS];
+    pthread_t ids[GRID_MAX_THREADS];
+    size_t started = 1;
+
+    pthread_mutex_init(&run.gate, NULL);
+    if (threads > 1)
+    {
+        pthread_mutex_lock(&run.gate);
+        for (; started < threads; started++)
+        {
+            workers[started] = (grid_worker){.run = &run, .index = started};
+            if (pthread_create(&ids[started], NULL, grid_work, &workers[started]) != 0)
+                break;
+        }
+        run.threads = started;
+        if (started > 1)
+            pthread_barrier_init(&run.barrier, NULL, (unsigned)started);
+        pthread_mutex_unlock(&run.gate);
+    }
+
+    workers[0] = (grid_worker){.run = &run, .index = 0};
+    grid_work(&workers[0]);
+
+    for (size_t c = 1; c < started; c++)
+        pthread_join(ids[c], NULL);
+    if (started > 1)
+        pthread_barrier_destroy(&run.barrier);
+    pthread_mutex_destroy(&run.gate);
+
+    if (steps % 2)
+    {
+        uint8_t *tmp = grid->cells;
+        grid->cells = grid->next;
+        grid->next = tmp;
+    }
+
+    refresh_edges(grid);
+    return 0;
+}
+
+/**
+ * @brief Executes one step of all cells in the calling thread
+ *
+ * @param grid Pointer to grid
+ * @return 0 on success, -1 on error
+ */
+int ma_grid_step(ma_grid_t *grid)
+{
+    return ma_grid_run(grid, 1, 1);
+}
+
+/**
+ * @brief Returns automaton whose outputs are the states of one face
+ *
+ * @param grid Pointer to grid
+ * @param side Face: 2 * axis for the low side, 2 * axis + 1 for the high
+ *             side (axis 0 is x)
+ * @return Pointer to automaton owned by grid or NULL on error
+ *
+ * @note Output bits i * s .. i * s + s - 1 hold face cell i, with the
+ *       remaining coordinates ordered x first. Outputs follow every
+ *       grid step, so other automata may ma_connect to them; the
+ *       automaton has no inputs and is deleted with the grid.
+ */
+moore_t *ma_grid_edge(ma_grid_t *grid, size_t side)
+{
+    if (!grid || side >= 2 * grid->d)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (!grid->edges[side])
+    {
+        size_t first, stride[2], count[2];
+        const size_t bits = face_cells(grid, side, &first, stride, count) * grid->s;
+
+        uint64_t *q_zero = ma_mem_calloc((bits + 63) / 64, sizeof(uint64_t));
+        if (!q_zero)
+        {
+            errno = ENOMEM;
+            return NULL;
+        }
+        grid->edges[side] = ma_create_full(0, bits, bits, edge_hold, identity_func, q_zero);
+        ma_mem_free(q_zero, (bits + 63) / 64 * sizeof(uint64_t));
+        if (!grid->edges[side])
+            return NULL;
+
+        refresh_edge(grid, side);
+    }
+
+    return grid->edges[side];
+}
+
+/**
+ * @brief Reports memory used by grid
+ *
+ * @param grid Pointer to grid
+ * @param usage Report to fill
+ * @return 0 on success, -1 on error
+ *
+ * @note "used" of state counts interior cells; edge automata are not
+ *       included (see ma_memory_usage)
+ */
+int ma_grid_memory_usage(ma_grid_t const *grid, ma_memory_usage_t *usage)
+{
+    if (!grid || !usage)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const size_t cells = grid->size[0] * grid->size[1] * grid->size[2];
+    memset(usage, 0, sizeof(*usage));
+    ma_usage_add(&usage->headers, grid, sizeof(ma_grid_t), sizeof(ma_grid_t));
+    ma_usage_add(&usage->state, grid->cells, grid->volume, cells);
+    ma_usage_add(&usage->state, grid->next, grid->volume, cells);
+    ma_usage_total(usage);
+    return 0;
+}
+
+/* Sixteen cells processed as one vector (SSE2 or NEON register) */
+typedef uint8_t life_vec __attribute__((vector_size(16)));
+
+/* Loads sixteen cells from unaligned address */
+static inline life_vec life_load(uint8_t const *p)
+{
+    life_vec v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * @brief Stencil kernel of Conway's Game of Life (2D Moore neighbourhood, s = 1)
+ *
+ * @note Sums are formed sixteen cells at a time in byte lanes
+ */
+void ma_grid_life(uint8_t *next, uint8_t const *const cell[], size_t count, void *ctx)
+{
+    (void)ctx;
+    size_t i = 0;
+
+    for (; i + sizeof(life_vec) <= count; i += sizeof(life_vec))
+    {
+        const life_vec sum = life_load(cell[1] + i) + life_load(cell[2] + i) +
+                             life_load(cell[3] + i) + life_load(cell[4] + i) +
+                             life_load(cell[5] + i) + life_load(cell[6] + i) +
+                             life_load(cell[7] + i) + life_load(cell[8] + i);
+        const life_vec alive = (life_vec)(sum == 3) | ((life_vec)(sum == 2) & life_load(cell[0] + i));
+        const life_vec result = alive & 1;
+        memcpy(next + i, &result, sizeof(result));
+    }
+
+    for (; i < count; i++)
+    {
+        const unsigned sum = cell[1][i] + cell[2][i] + cell[3][i] + cell[4][i] +
+                             cell[5][i] + cell[6][i] + cell[7][i] + cell[8][i];
+        next[i] = (uint8_t)(sum == 3 || (sum == 2 && cell[0][i]));
+    }
+}
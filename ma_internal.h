@@ -0,0 +1,230 @@
+#ifndef MA_INTERNAL_H
+#define MA_INTERNAL_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ma.h"
+
+/*
+ * Internal declarations shared by library translation units.
+ * Not installed and not part of the public API.
+ */
+
+// Automaton internals
+#define MA_EXTERNAL_OUTPUT 0x1u /* output lives in a shared mapping */
+#define MA_EXTERNAL_STATE 0x2u  /* state and next_state live in a shared mapping */
+#define MA_EXTERNAL_INPUT 0x4u  /* manual_input lives in a shared mapping */
+#define MA_EXTERNAL_MARK 0x8u   /* Temporary membership mark while a set is validated */
+
+/**
+ * @brief Run of consecutive inputs connected to consecutive outputs of one source
+ *
+ * Input dst_bit + k reads output src_bit + k, or src_bit - k for a
+ * reversed run.
+ */
+typedef struct
+{
+    struct moore *src; /* Source automaton */
+    size_t src_bit;    /* Output bit of source feeding dst_bit */
+    size_t dst_bit;    /* First input bit of receiving automaton */
+    size_t len;        /* Number of bits */
+    bool reversed;     /* Source bits are read in descending order */
+} gather_run;
+
+/**
+ * @brief Scattered bits moved between one source word and one input word
+ *
+ * Bits selected by src_mask are packed (pext) and deposited (pdep) into
+ * bits selected by dst_mask; the mapping preserves bit order.
+ */
+typedef struct
+{
+    struct moore *src; /* Source automaton */
+    size_t src_word;   /* Word of source output */
+    size_t dst_word;   /* Word of final input */
+    uint64_t src_mask; /* Source bits */
+    uint64_t dst_mask; /* Destination bits (same population count) */
+} gather_mask;
+
+/**
+ * @brief Triple buffer passing input vectors to the step thread
+ *
+ * Wait-free for the stepping thread; producers are serialised by a
+ * spinlock. Producers fill the back slot and swap it with middle; the step
+ * thread swaps middle with front when the FRESH flag is set. Each slot is only
+ * touched by its current owner, so vectors are never torn.
+ */
+typedef struct
+{
+    atomic_flag producer_lock; /* Serializes producers (never taken by ma_step) */
+    uint32_t back;             /* Slot filled by producer holding the lock */
+    char pad[64];              /* Keeps producer and consumer fields on separate lines */
+    _Atomic uint32_t middle;   /* Last published slot | MAILBOX_FRESH */
+    uint32_t front;            /* Slot owned by the step thread */
+    size_t n_words;            /* Words per slot */
+    uint64_t slots[];          /* MAILBOX_SLOTS * n_words words */
+} input_mailbox;
+
+/**
+ * @brief State word written by an in-place transition
+ */
+typedef struct
+{
+    size_t word;    /* Index of state word */
+    uint64_t value; /* New value of word */
+} ma_log_entry;
+
+/**
+ * @brief Words recorded by an in-place transition, applied by commit
+ */
+struct ma_write_log
+{
+    ma_log_entry *entries;
+    size_t count;    /* Entries recorded during current step */
+    size_t capacity; /* Capacity of allocated array (kept between steps) */
+    size_t words;    /* Number of state words (bound of word index) */
+    bool lost;       /* A write could not be recorded; the step is dropped */
+};
+
+/**
+ * @brief Structure representing a Moore automaton
+ *
+ * Contains automaton parameters (n, m, s), transition and output functions,
+ * buffers for states and signals, and information about connections to other automata.
+ */
+typedef struct moore
+{
+    /* Basic automaton parameters and logic */
+    size_t n;                /* Number of inputs */
+    size_t m;                /* Number of outputs */
+    size_t s;                /* Number of state bits */
+    transition_function_t t; /* Pointer to transition function */
+    output_function_t y;     /* Pointer to output function */
+    transition_function_ex_t t_ex; /* Context-carrying transition function (used if t is NULL) */
+    output_function_ex_t y_ex;     /* Context-carrying output function (used if y is NULL) */
+    transition_function_log_t t_log; /* In-place transition function (used if t and t_ex are NULL) */
+    void *ctx;                     /* User context passed to t_ex, t_log and y_ex */
+    void (*release)(void *ctx);    /* Frees ctx of built-in automata on ma_delete (NULL otherwise) */
+    bool private_ctx;              /* t writes process-private memory through ctx */
+    bool mutable_storage;          /* t writes storage kept outside the state (memories) */
+
+    /* Clock domain (divider 1 without a gate ticks on every step) */
+    uint64_t clock_divider;    /* Cycles per period of the clock */
+    uint64_t clock_phase;      /* Cycle of the period on which the clock ticks */
+    struct moore *clock_gate;  /* Automaton whose output bit enables ticks (or NULL) */
+    size_t clock_gate_bit;     /* Output bit of clock_gate */
+    uint64_t clock_count;      /* Cycles counted by ma_step for the divider */
+    bool clocked;              /* Divider above 1 or gate set */
+    bool idle;                 /* Clock did not tick in current ma_step */
+
+    /* Data buffers */
+    uint32_t magic; /* Magic number: object lifetime marker (MOORE_MAGIC after creation,
+                       MOORE_DELETED after deletion) */
+    uint64_t *state;      /* Buffer for CURRENT automaton state */
+    uint64_t *next_state; /* Buffer for NEXT state (calculated in ma_step, unused with t_log) */
+    uint64_t *output;     /* Buffer for output signals */
+    struct ma_write_log log; /* Writes of t_log committed by ma_step */
+
+    /* Buffers for input management */
+    uint64_t *manual_input; /* Buffer for values set by ma_set_input */
+    uint64_t *final_input;  /* Buffer for final input signal */
+
+    /* Input connection management */
+    input_connection_info *incoming_connections;
+
+    /* Compiled gather plan (rebuilt by the first gather after plan_dirty is set) */
+    gather_run *runs;           /* Connected runs, in input order */
+    size_t run_count;           /* Number of runs */
+    size_t run_capacity;        /* Capacity of allocated array */
+    gather_mask *masks;         /* Scattered bits grouped per word pair */
+    size_t mask_count;          /* Number of masks */
+    size_t mask_capacity;       /* Capacity of allocated array */
+    size_t connected_inputs;    /* Number of connected input bits */
+    uint64_t const *input_view; /* Buffer passed to t as input */
+    bool plan_dirty;            /* Connections changed since the plan was built */
+    int input_mode;             /* MA_INPUT_COPY or MA_INPUT_SHARED */
+    input_mailbox *mailbox;     /* Inputs posted by other threads (NULL if disabled) */
+    unsigned external;          /* MA_EXTERNAL_* buffers owned by an export or partition */
+
+    /* Disconnection management during automaton deletion */
+    struct moore **connected_to_me;
+    size_t connected_to_me_count;    /* Number of current connections */
+    size_t connected_to_me_capacity; /* Capacity of allocated array */
+} moore_t;
+
+// Pause hint for spin loops
+#if defined(__x86_64__) || defined(__i386__)
+#define MA_CPU_RELAX() __builtin_ia32_pause()
+#else
+#define MA_CPU_RELAX() ((void)0)
+#endif
+
+// Copies len bits from src (starting at src_bit) to dst (starting at dst_bit)
+void ma_copy_bits(uint64_t *dst, size_t dst_bit, uint64_t const *src,
+                  size_t src_bit, size_t len);
+
+// Transition of a whole dispatch group of one built-in primitive
+typedef void (*ma_group_transition_t)(moore_t *const *group, size_t count);
+
+// Group kernel of built-in primitive automaton (NULL for other automata)
+ma_group_transition_t ma_prim_group_kernel(moore_t const *a);
+
+// Transition functions of built-in primitives (also network file kernels)
+void ma_prim_counter(uint64_t *next_state, uint64_t const *input,
+                     uint64_t const *state, size_t n, size_t s);
+
+void ma_prim_shift(uint64_t *next_state, uint64_t const *input,
+                   uint64_t const *state, size_t n, size_t s);
+
+void ma_prim_adder(uint64_t *next_state, uint64_t const *input,
+                   uint64_t const *state, size_t n, size_t s);
+
+void ma_prim_comparator(uint64_t *next_state, uint64_t const *input,
+                        uint64_t const *state, size_t n, size_t s);
+
+// Forces portable pext/pdep loops (false) or BMI2 if available (true);
+// returns whether BMI2 is used
+bool ma_gather_use_bmi2(bool enable);
+
+// Caps instruction set of table shuffle backends (0 scalar, negative no cap);
+// returns level used
+int ma_table_cap_simd(int level);
+
+// Phases of ma_step for callers synchronizing between them
+void ma_step_gather(moore_t *const *at, size_t num);
+
+int ma_step_update(moore_t *const *at, size_t num);
+
+// Output function of ma_create_simple (copies state to output)
+void identity_func(uint64_t *output, uint64_t const *state, size_t m, size_t s);
+
+// Redirects output seqlock of network (NULL restores its own counter)
+void ma_net_set_sequence(ma_net_t *net, _Atomic uint64_t *seq);
+
+// Memory allocation through hooks set by ma_set_allocator
+void *ma_mem_alloc(size_t size);
+
+void *ma_mem_calloc(size_t count, size_t size);
+
+void *ma_mem_realloc(void *ptr, size_t old_size, size_t new_size);
+
+void ma_mem_free(void *ptr, size_t size);
+
+size_t ma_mem_reserved(void const *ptr, size_t size);
+
+// Adds block to memory usage category
+static inline void ma_usage_add(ma_memory_bytes_t *category, void const *ptr,
+                                size_t size, size_t used)
+{
+    if (!ptr)
+        return;
+    category->allocated += ma_mem_reserved(ptr, size);
+    category->used += used;
+}
+
+// Sums categories of memory usage report into its total
+void ma_usage_total(ma_memory_usage_t *usage);
+
+#endif
@@ -0,0 +1,646 @@
+#include <endian.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ma.h"
+#include "ma_internal.h"
+
+#define IO_MAGIC 0x0254454e414dULL    /* "MANET", format version 2 */
+#define IO_MAGIC_V1 0x0154454e414dULL /* Version 1: files without clock records */
+#define IO_MAX_NAME 255            /* Longest kernel name */
+#define REGISTRY_INIT_CAPACITY 16
+
+/**
+ * @brief Named pair of functions that can be stored in network files
+ *
+ * y == NULL denotes the identity output of ma_create_simple. shape, if
+ * set, accepts the sizes the kernel can step without reading past its
+ * input (primitives); registered kernels take any sizes.
+ */
+typedef struct
+{
+    char const *name;
+    transition_function_t t;
+    output_function_t y;
+    bool (*shape)(uint64_t n, uint64_t m, uint64_t s);
+} ma_kernel;
+
+/**
+ * @brief Entry of table mapping automaton pointers to file indices
+ */
+typedef struct
+{
+    moore_t const *a;
+    size_t index;
+} io_index;
+
+/* Kernels registered by ma_register_kernel */
+static ma_kernel *registry = NULL;
+static size_t registry_count = 0;
+static size_t registry_capacity = 0;
+
+/**
+ * @brief Mask of used bits in the last word of a bits-wide buffer
+ */
+static inline uint64_t last_word_mask(size_t bits)
+{
+    return bits % 64 ? ((uint64_t)1 << (bits % 64)) - 1 : ~(uint64_t)0;
+}
+
+/**
+ * @brief Built-in kernel: state <- input (a register delaying input by one cycle)
+ */
+static void kernel_delay(uint64_t *next_state, uint64_t const *input,
+                         uint64_t const *state, size_t n, size_t s)
+{
+    (void)state;
+    const size_t words = (s + 63) / 64, n_words = (n + 63) / 64;
+    for (size_t i = 0; i < words; i++)
+        next_state[i] = i < n_words ? input[i] : 0;
+    if (n < s && n % 64)
+        next_state[n / 64] &= last_word_mask(n);
+    next_state[words - 1] &= last_word_mask(s);
+}
+
+/**
+ * @brief Built-in kernel: state <- state ^ input (toggle flip-flops)
+ */
+static void kernel_toggle(uint64_t *next_state, uint64_t const *input,
+                          uint64_t const *state, size_t n, size_t s)
+{
+    const size_t words = (s + 63) / 64, n_words = (n + 63) / 64;
+    for (size_t i = 0; i < words; i++)
+        next_state[i] = state[i] ^ (i < n_words ? input[i] : 0);
+    next_state[words - 1] &= last_word_mask(s);
+}
+
+/**
+ * @brief Built-in kernel: state <- state + input modulo 2^s (accumulator)
+ */
+static void kernel_add(uint64_t *next_state, uint64_t const *input,
+                       uint64_t const *state, size_t n, size_t s)
+{
+    const size_t words = (s + 63) / 64, n_words = (n + 63) / 64;
+    uint64_t carry = 0;
+    for (size_t i = 0; i < words; i++)
+    {
+        const uint64_t x = i < n_words ? input[i] : 0;
+        const uint64_t sum = state[i] + x;
+        const uint64_t out = sum + carry;
+        carry = (sum < x) | (out < sum);
+        next_state[i] = out;
+    }
+    next_state[words - 1] &= last_word_mask(s);
+}
+
+/* Sizes of primitives as created by ma_create_counter and friends */
+static bool counter_shape(uint64_t n, uint64_t m, uint64_t s)
+{
+    (void)m;
+    (void)s;
+    return n == 2;
+}
+
+static bool shift_shape(uint64_t n, uint64_t m, uint64_t s)
+{
+    (void)m;
+    return n >= 1 && n <= s;
+}
+
+static bool adder_shape(uint64_t n, uint64_t m, uint64_t s)
+{
+    (void)m;
+    return n == 2 * s - 1;
+}
+
+static bool comparator_shape(uint64_t n, uint64_t m, uint64_t s)
+{
+    return n > 0 && n % 2 == 0 && m == 3 && s == 3;
+}
+
+/* Kernels available without registration (all with identity output) */
+static const ma_kernel builtin_kernels[] = {
+    {"delay", kernel_delay, NULL, NULL},
+    {"toggle", kernel_toggle, NULL, NULL},
+    {"add", kernel_add, NULL, NULL},
+    {"counter", ma_prim_counter, NULL, counter_shape},
+    {"shift", ma_prim_shift, NULL, shift_shape},
+    {"adder", ma_prim_adder, NULL, adder_shape},
+    {"comparator", ma_prim_comparator, NULL, comparator_shape},
+};
+
+/**
+ * @brief Finds kernel by name, built-in kernels first
+ *
+ * @return Kernel or NULL if unknown
+ */
+static ma_kernel const *find_by_name(char const *name)
+{
+    for (size_t i = 0; i < sizeof(builtin_kernels) / sizeof(builtin_kernels[0]); i++)
+    {
+        if (strcmp(builtin_kernels[i].name, name) == 0)
+            return &builtin_kernels[i];
+    }
+
+    for (size_t i = 0; i < registry_count; i++)
+    {
+        if (strcmp(registry[i].name, name) == 0)
+            return &registry[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Finds kernel used by automaton
+ *
+ * @return Kernel or NULL if functions of automaton are not registered
+ */
+static ma_kernel const *find_by_functions(moore_t const *a)
+{
+    const bool simple = a->y == identity_func && a->m == a->s;
+
+    for (size_t i = 0; i < sizeof(builtin_kernels) / sizeof(builtin_kernels[0]); i++)
+    {
+        if (builtin_kernels[i].t == a->t && simple)
+            return &builtin_kernels[i];
+    }
+
+    for (size_t i = 0; i < registry_count; i++)
+    {
+        if (registry[i].t == a->t && (registry[i].y ? registry[i].y == a->y : simple))
+            return &registry[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Registers functions under a name used in network files
+ *
+ * @param name Kernel name (at most 255 bytes, copied)
+ * @param t Transition function
+ * @param y Output function (NULL for the identity output of ma_create_simple)
+ * @return 0 on success, -1 on error
+ *
+ * @note Not thread-safe; register kernels before saving or loading networks
+ * @note Built-in kernels "delay", "toggle", "add", "counter", "shift", "adder"
+ *       and "comparator" are always available
+ */
+int ma_register_kernel(char const *name, transition_function_t t, output_function_t y)
+{
+    if (!name || !t || name[0] == '\0' || strlen(name) > IO_MAX_NAME || find_by_name(name))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (registry_count == registry_capacity)
+    {
+        const size_t capacity = registry_capacity ? registry_capacity * 2 : REGISTRY_INIT_CAPACITY;
+        ma_kernel *kernels = ma_mem_realloc(registry, registry_capacity * sizeof(ma_kernel),
+                                            capacity * sizeof(ma_kernel));
+        if (!kernels)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+        registry = kernels;
+        registry_capacity = capacity;
+    }
+
+    const size_t size = strlen(name) + 1;
+    char *copy = ma_mem_alloc(size);
+    if (!copy)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(copy, name, size);
+
+    registry[registry_count++] = (ma_kernel){copy, t, y, NULL};
+    return 0;
+}
+
+/**
+ * @brief Writes little-endian words to stream
+ *
+ * @return 0 on success, -1 on error
+ */
+static int write_words(FILE *f, uint64_t const *words, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint64_t word = htole64(words[i]);
+        if (fwrite(&word, sizeof(word), 1, f) != 1)
+        {
+            errno = EIO;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static inline int write_word(FILE *f, uint64_t word)
+{
+    return write_words(f, &word, 1);
+}
+
+/**
+ * @brief Reads little-endian words from stream
+ *
+ * @return 0 on success, -1 on error (EIO, or EINVAL on truncated file)
+ */
+static int read_words(FILE *f, uint64_t *words, size_t count)
+{
+    if (count && fread(words, sizeof(uint64_t), count, f) != count)
+    {
+        errno = ferror(f) ? EIO : EINVAL;
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        words[i] = le64toh(words[i]);
+    return 0;
+}
+
+static int compare_io_index(void const *lhs, void const *rhs)
+{
+    const uintptr_t a = (uintptr_t)((io_index const *)lhs)->a;
+    const uintptr_t b = (uintptr_t)((io_index const *)rhs)->a;
+    return (a > b) - (a < b);
+}
+
+/**
+ * @brief Returns file index of automaton or SIZE_MAX if it is not saved
+ */
+static size_t lookup_index(io_index const *table, size_t num, moore_t const *a)
+{
+    const io_index key = {a, 0};
+    io_index const *found = bsearch(&key, table, num, sizeof(io_index), compare_io_index);
+    return found ? found->index : SIZE_MAX;
+}
+
+/**
+ * @brief Writes connections of automaton as runs of consecutive bits
+ *
+ * Each run is [dst_bit, source index, src_bit, len].
+ *
+ * @return 0 on success, -1 on error
+ */
+static int write_connections(FILE *f, moore_t const *a, io_index const *table, size_t num)
+{
+    /* First pass counts runs, second pass writes them */
+    for (int pass = 0; pass < 2; pass++)
+    {
+        size_t runs = 0;
+        for (size_t i = 0; i < a->n;)
+        {
+            input_connection_info const *c = &a->incoming_connections[i];
+            if (!c->source_automaton)
+            {
+                i++;
+                continue;
+            }
+
+            size_t len = 1;
+            while (i + len < a->n &&
+                   c[len].source_automaton == c->source_automaton &&
+                   c[len].source_output_index == c->source_output_index + len)
+                len++;
+
+            if (pass == 1)
+            {
+                const size_t src = lookup_index(table, num, c->source_automaton);
+                if (src == SIZE_MAX)
+                {
+                    errno = EINVAL; /* Connection leaves the saved set */
+                    return -1;
+                }
+
+                const uint64_t run[4] = {i, src, c->source_output_index, len};
+                if (write_words(f, run, 4) != 0)
+                    return -1;
+            }
+
+            runs++;
+            i += len;
+        }
+
+        if (pass == 0 && write_word(f, runs) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Writes clock record of automaton: divider, phase, counted cycles,
+ *        gate index + 1 (0 without a gate) and gate bit
+ *
+ * @return 0 on success, -1 on error
+ */
+static int write_clock(FILE *f, moore_t const *a, io_index const *table, size_t num)
+{
+    uint64_t gate = 0;
+    if (a->clock_gate)
+    {
+        const size_t index = lookup_index(table, num, a->clock_gate);
+        if (index == SIZE_MAX)
+        {
+            errno = EINVAL; /* Gate outside the saved set */
+            return -1;
+        }
+        gate = (uint64_t)index + 1;
+    }
+
+    const uint64_t record[5] = {a->clock_divider, a->clock_phase, a->clock_count, gate,
+                                a->clock_gate_bit};
+    return write_words(f, record, 5);
+}
+
+/**
+ * @brief Reads clock record written by write_clock and applies it to at[i]
+ *
+ * @return 0 on success, -1 on error (EINVAL for invalid record)
+ */
+static int read_clock(FILE *f, moore_t **at, size_t i, size_t count)
+{
+    uint64_t record[5];
+    if (read_words(f, record, 5) != 0)
+        return -1;
+
+    const uint64_t gate = record[3];
+    if (gate > count)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    /* ma_set_clock and ma_set_clock_gate check divider, phase and gate bit */
+    if (ma_set_clock(at[i], record[0], record[1]) != 0 ||
+        (gate && ma_set_clock_gate(at[i], at[gate - 1], record[4]) != 0))
+        return -1;
+
+    at[i]->clock_count = record[2];
+    return 0;
+}
+
+/**
+ * @brief Saves automata with their states, manual inputs and connections
+ *
+ * @param f Stream opened for binary writing
+ * @param at Array of pointers to automata
+ * @param num Number of automata in array
+ * @return 0 on success, -1 on error
+ *
+ * @note Every automaton must use registered or built-in functions (ENOENT
+ *       otherwise; context-carrying automata cannot be saved) and all its
+ *       sources and its clock gate must belong to at (EINVAL otherwise)
+ * @note Clock divider, phase, counted cycles and gate are saved, so a
+ *       loaded network continues on the same clock ticks
+ */
+int ma_save_network(FILE *f, moore_t *const at[], size_t num)
+{
+    if (!f || !at || num == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    io_index *table = ma_mem_alloc(num * sizeof(io_index));
+    if (!table)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for (size_t i = 0; i < num; i++)
+    {
+        if (!at[i])
+        {
+            errno = EINVAL;
+            goto cleanup_fail;
+        }
+        table[i] = (io_index){at[i], i};
+    }
+    qsort(table, num, sizeof(io_index), compare_io_index);
+
+    if (write_word(f, IO_MAGIC) != 0 || write_word(f, num) != 0)
+        goto cleanup_fail;
+
+    for (size_t i = 0; i < num; i++)
+    {
+        moore_t const *a = at[i];
+        ma_kernel const *kernel = a->t ? find_by_functions(a) : NULL;
+        if (!kernel)
+        {
+            errno = ENOENT;
+            goto cleanup_fail;
+        }
+
+        /* Name is stored zero-padded to whole words */
+        uint64_t name[(IO_MAX_NAME + 8) / 8] = {0};
+        const size_t name_len = strlen(kernel->name);
+        memcpy(name, kernel->name, name_len);
+
+        const uint64_t header[4] = {a->n, a->m, a->s, name_len};
+        if (write_words(f, header, 4) != 0 ||
+            fwrite(name, 8, (name_len + 7) / 8, f) != (name_len + 7) / 8 ||
+            write_words(f, a->state, (a->s + 63) / 64) != 0 ||
+            write_words(f, a->manual_input, (a->n + 63) / 64) != 0)
+        {
+            errno = EIO;
+            goto cleanup_fail;
+        }
+    }
+
+    for (size_t i = 0; i < num; i++)
+    {
+        if (write_connections(f, at[i], table, num) != 0 ||
+            write_clock(f, at[i], table, num) != 0)
+            goto cleanup_fail;
+    }
+
+    if (fflush(f) != 0)
+    {
+        errno = EIO;
+        goto cleanup_fail;
+    }
+
+    ma_mem_free(table, num * sizeof(io_index));
+    return 0;
+
+cleanup_fail:
+    ma_mem_free(table, num * sizeof(io_index));
+    return -1;
+}
+
+/**
+ * @brief Deletes automata created by ma_load_network and their array
+ *
+ * @param at Array returned by ma_load_network (can be NULL)
+ * @param num Number of automata returned with it
+ */
+void ma_free_network(moore_t **at, size_t num)
+{
+    if (!at)
+        return;
+
+    for (size_t i = 0; i < num; i++)
+        ma_delete(at[i]);
+    ma_mem_free(at, num * sizeof(moore_t *));
+}
+
+/**
+ * @brief Loads automata saved by ma_save_network
+ *
+ * @param f Stream opened for binary reading
+ * @param num Receives number of automata
+ * @return Array of automata in saved order (free with ma_free_network)
+ *         or NULL on error (EINVAL for malformed file or sizes a built-in
+ *         primitive kernel cannot step, ENOENT for unknown kernel name)
+ *
+ * @note Files of format version 1 carry no clock records; their automata
+ *       tick on every cycle
+ */
+moore_t **ma_load_network(FILE *f, size_t *num)
+{
+    if (!f || !num)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    uint64_t header[2];
+    if (read_words(f, header, 2) != 0)
+        return NULL;
+    if ((header[0] != IO_MAGIC && header[0] != IO_MAGIC_V1) || header[1] == 0 || header[1] > SIZE_MAX / sizeof(moore_t *))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    const size_t count = header[1];
+    moore_t **at = ma_mem_calloc(count, sizeof(moore_t *));
+    uint64_t *buffer = NULL;
+    size_t buffer_words = 0;
+    if (!at)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t fields[4];
+        if (read_words(f, fields, 4) != 0)
+            goto cleanup_fail;
+
+        const uint64_t n = fields[0], m = fields[1], s = fields[2], name_len = fields[3];
+        if (m == 0 || s == 0 || name_len == 0 || name_len > IO_MAX_NAME ||
+            n > SIZE_MAX / 64 || m > SIZE_MAX / 64 || s > SIZE_MAX / 64)
+        {
+            errno = EINVAL;
+            goto cleanup_fail;
+        }
+
+        uint64_t name[(IO_MAX_NAME + 8) / 8] = {0};
+        if (fread(name, 8, (name_len + 7) / 8, f) != (name_len + 7) / 8)
+        {
+            errno = ferror(f) ? EIO : EINVAL;
+            goto cleanup_fail;
+        }
+        ((char *)name)[name_len] = '\0';
+
+        ma_kernel const *kernel = find_by_name((char const *)name);
+        if (!kernel)
+        {
+            errno = ENOENT;
+            goto cleanup_fail;
+        }
+        if ((!kernel->y && m != s) || (kernel->shape && !kernel->shape(n, m, s)))
+        {
+            errno = EINVAL;
+            goto cleanup_fail;
+        }
+
+        /* One buffer holds the state and then the manual input */
+        const size_t s_words = (s + 63) / 64, n_words = (n + 63) / 64;
+        const size_t words = s_words > n_words ? s_words : n_words;
+        if (words > buffer_words)
+        {
+            uint64_t *grown = ma_mem_realloc(buffer, buffer_words * sizeof(uint64_t),
+                                             words * sizeof(uint64_t));
+            if (!grown)
+            {
+                errno = ENOMEM;
+                goto cleanup_fail;
+            }
+            buffer = grown;
+            buffer_words = words;
+        }
+
+        if (read_words(f, buffer, s_words) != 0)
+            goto cleanup_fail;
+        buffer[s_words - 1] &= last_word_mask(s);
+
+        at[i] = ma_create_full(n, m, s, kernel->t, kernel->y ? kernel->y : identity_func, buffer);
+        if (!at[i])
+            goto cleanup_fail;
+
+        if (n > 0)
+        {
+            if (read_words(f, buffer, n_words) != 0)
+                goto cleanup_fail;
+            buffer[n_words - 1] &= last_word_mask(n);
+            ma_set_input(at[i], buffer);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t runs;
+        if (read_words(f, &runs, 1) != 0)
+            goto cleanup_fail;
+        if (runs > at[i]->n)
+        {
+            errno = EINVAL;
+            goto cleanup_fail;
+        }
+
+        for (uint64_t r = 0; r < runs; r++)
+        {
+            uint64_t run[4];
+            if (read_words(f, run, 4) != 0)
+                goto cleanup_fail;
+            if (run[1] >= count)
+            {
+                errno = EINVAL;
+                goto cleanup_fail;
+            }
+
+            /* ma_connect checks bit ranges and reports EINVAL */
+            if (ma_connect(at[i], run[0], at[run[1]], run[2], run[3]) != 0)
+                goto cleanup_fail;
+        }
+
+        if (header[0] == IO_MAGIC && read_clock(f, at, i, count) != 0)
+            goto cleanup_fail;
+    }
+
+    ma_mem_free(buffer, buffer_words * sizeof(uint64_t));
+    *num = count;
+    return at;
+
+cleanup_fail:
+    {
+        const int saved = errno;
+        ma_mem_free(buffer, buffer_words * sizeof(uint64_t));
+        ma_free_network(at, count);
+        errno = saved;
+    }
+    return NULL;
+}
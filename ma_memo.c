@@ -0,0 +1,421 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "ma.h"
+#include "ma_internal.h"
+
+#define MEMO_DEFAULT_CAPACITY (1u << 16) /* Entries kept when capacity 0 is given */
+#define MEMO_MAX_CAPACITY (UINT32_MAX - 1)
+#define MEMO_BASE_LEVEL 4                /* 2^4 steps and fewer are always stepped */
+#define MEMO_MAX_LEVEL 63                /* Largest cached superstep is 2^63 cycles */
+#define MEMO_NONE UINT32_MAX             /* Empty link */
+
+/**
+ * @brief Cached superstep: state key after 2^level cycles becomes result
+ *
+ * Key and result words live in the data array of the cache.
+ */
+typedef struct
+{
+    uint64_t hash;      /* Hash of key and level */
+    uint32_t level;     /* log2 of number of cycles */
+    uint32_t chain;     /* Next entry in hash bucket */
+    uint32_t lru_prev;  /* Neighbour closer to most recently used */
+    uint32_t lru_next;  /* Neighbour closer to least recently used */
+} memo_entry;
+
+/**
+ * @brief Structure representing a memoising stepper of an autonomous network
+ *
+ * The joint state of all automata is the key; results of 2^k cycles are
+ * built from two results of 2^(k-1) cycles, so recurring states are
+ * skipped over in exponentially growing jumps.
+ */
+struct ma_memo
+{
+    moore_t **at;           /* Automata of network (copied array) */
+    size_t num;
+    size_t words;           /* Words of joint state */
+    size_t capacity;        /* Maximum number of entries */
+    size_t used;            /* Entries in use */
+    memo_entry *entries;
+    uint64_t *data;         /* Key and result of each entry (2 * words) */
+    uint32_t *buckets;      /* First entry of each hash bucket */
+    size_t bucket_mask;
+    uint32_t lru_head;      /* Most recently used entry */
+    uint32_t lru_tail;      /* Least recently used entry */
+    uint64_t *keys;         /* Joint state saved at each recursion level */
+    ma_memo_stats_t stats;
+};
+
+/**
+ * @brief Mixes word into running hash
+ */
+static inline uint64_t hash_word(uint64_t h, uint64_t w)
+{
+    h ^= w * 0x9e3779b97f4a7c15ULL;
+    h = (h << 31) | (h >> 33);
+    return h * 0xbf58476d1ce4e5b9ULL;
+}
+
+/**
+ * @brief Hashes joint state and level
+ */
+static uint64_t hash_state(uint64_t const *state, size_t words, unsigned level)
+{
+    uint64_t h = level;
+    for (size_t i = 0; i < words; i++)
+        h = hash_word(h, state[i]);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    return h ^ (h >> 33);
+}
+
+/**
+ * @brief Copies states of all automata into one buffer (bits above s cleared)
+ */
+static void save_state(ma_memo_t const *memo, uint64_t *dst)
+{
+    for (size_t i = 0; i < memo->num; i++)
+    {
+        moore_t const *a = memo->at[i];
+        const size_t words = (a->s + 63) / 64;
+        memcpy(dst, a->state, words * sizeof(uint64_t));
+        if (a->s % 64)
+            dst[words - 1] &= ((uint64_t)1 << (a->s % 64)) - 1;
+        dst += words;
+    }
+}
+
+/**
+ * @brief Sets states of all automata from buffer and recomputes outputs
+ */
+static void load_state(ma_memo_t const *memo, uint64_t const *src)
+{
+    for (size_t i = 0; i < memo->num; i++)
+    {
+        ma_set_state(memo->at[i], src);
+        src += (memo->at[i]->s + 63) / 64;
+    }
+}
+
+/**
+ * @brief Unlinks entry from LRU list
+ */
+static void lru_unlink(ma_memo_t *memo, uint32_t e)
+{
+    memo_entry *entry = &memo->entries[e];
+    if (entry->lru_prev != MEMO_NONE)
+        memo->entries[entry->lru_prev].lru_next = entry->lru_next;
+    else
+        memo->lru_head = entry->lru_next;
+    if (entry->lru_next != MEMO_NONE)
+        memo->entries[entry->lru_next].lru_prev = entry->lru_prev;
+    else
+        memo->lru_tail = entry->lru_prev;
+}
+
+/**
+ * @brief Makes entry the most recently used one
+ */
+static void lru_push(ma_memo_t *memo, uint32_t e)
+{
+    memo_entry *entry = &memo->entries[e];
+    entry->lru_prev = MEMO_NONE;
+    entry->lru_next = memo->lru_head;
+    if (memo->lru_head != MEMO_NONE)
+        memo->entries[memo->lru_head].lru_prev = e;
+    else
+        memo->lru_tail = e;
+    memo->lru_head = e;
+}
+
+/**
+ * @brief Finds result of 2^level cycles from key
+ *
+ * @return Result words or NULL on miss
+ */
+static uint64_t const *lookup(ma_memo_t *memo, uint64_t const *key, uint64_t hash, unsigned level)
+{
+    for (uint32_t e = memo->buckets[hash & memo->bucket_mask]; e != MEMO_NONE;
+         e = memo->entries[e].chain)
+    {
+        memo_entry const *entry = &memo->entries[e];
+        uint64_t const *words = memo->data + (size_t)e * 2 * memo->words;
+        if (entry->hash == hash && entry->level == level &&
+            memcmp(words, key, memo->words * sizeof(uint64_t)) == 0)
+        {
+            lru_unlink(memo, e);
+            lru_push(memo, e);
+            return words + memo->words;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Removes entry from its hash bucket
+ */
+static void bucket_unlink(ma_memo_t *memo, uint32_t e)
+{
+    uint32_t *link = &memo->buckets[memo->entries[e].hash & memo->bucket_mask];
+    while (*link != e)
+        link = &memo->entries[*link].chain;
+    *link = memo->entries[e].chain;
+}
+
+/**
+ * @brief Stores result of 2^level cycles from key, evicting the LRU entry if full
+ */
+static void insert(ma_memo_t *memo, uint64_t const *key, uint64_t hash, unsigned level,
+                   uint64_t const *result)
+{
+    uint32_t e;
+    if (memo->used < memo->capacity)
+    {
+        e = (uint32_t)memo->used++;
+    }
+    else
+    {
+        e = memo->lru_tail;
+        lru_unlink(memo, e);
+        bucket_unlink(memo, e);
+        memo->stats.evictions++;
+    }
+
+    memo_entry *entry = &memo->entries[e];
+    entry->hash = hash;
+    entry->level = level;
+    entry->chain = memo->buckets[hash & memo->bucket_mask];
+    memo->buckets[hash & memo->bucket_mask] = e;
+    lru_push(memo, e);
+
+    uint64_t *words = memo->data + (size_t)e * 2 * memo->words;
+    memcpy(words, key, memo->words * sizeof(uint64_t));
+    memcpy(words + memo->words, result, memo->words * sizeof(uint64_t));
+}
+
+/**
+ * @brief Advances network by 2^level cycles
+ *
+ * Small jumps are stepped; larger ones are looked up or composed from
+ * two jumps of half the length, and the composition is cached.
+ *
+ * @return 0 on success, -1 if a step failed (nothing is cached then)
+ */
+static int advance(ma_memo_t *memo, unsigned level)
+{
+    if (level <= MEMO_BASE_LEVEL)
+    {
+        for (size_t k = 0; k < (size_t)1 << level; k++)
+        {
+            if (ma_step(memo->at, memo->num) != 0)
+                return -1;
+            memo->stats.steps++;
+        }
+        return 0;
+    }
+
+    uint64_t *key = memo->keys + (size_t)level * memo->words;
+    save_state(memo, key);
+    const uint64_t hash = hash_state(key, memo->words, level);
+
+    uint64_t const *result = lookup(memo, key, hash, level);
+    if (result)
+    {
+        memo->stats.hits++;
+        load_state(memo, result);
+        return 0;
+    }
+
+    memo->stats.misses++;
+    if (advance(memo, level - 1) != 0 || advance(memo, level - 1) != 0)
+        return -1;
+
+    /* The key buffer of level - 1 is free again and holds the result */
+    uint64_t *after = memo->keys + (size_t)(level - 1) * memo->words;
+    save_state(memo, after);
+    insert(memo, key, hash, level, after);
+    return 0;
+}
+
+/**
+ * @brief Frees memo and its arrays
+ *
+ * @param memo Memo (can be NULL)
+ */
+void ma_memo_delete(ma_memo_t *memo)
+{
+    if (!memo)
+        return;
+
+    size_t buckets = memo->bucket_mask + 1;
+    ma_mem_free(memo->at, memo->num * sizeof(moore_t *));
+    ma_mem_free(memo->entries, memo->capacity * sizeof(memo_entry));
+    ma_mem_free(memo->data, memo->capacity * 2 * memo->words * sizeof(uint64_t));
+    ma_mem_free(memo->buckets, buckets * sizeof(uint32_t));
+    ma_mem_free(memo->keys, (MEMO_MAX_LEVEL + 1) * memo->words * sizeof(uint64_t));
+    ma_mem_free(memo, sizeof(ma_memo_t));
+}
+
+/**
+ * @brief Drops all cached results
+ *
+ * @param memo Memo
+ *
+ * @note Needed after manual inputs or connections of the network change
+ */
+void ma_memo_clear(ma_memo_t *memo)
+{
+    if (!memo)
+        return;
+
+    memset(memo->buckets, 0xff, (memo->bucket_mask + 1) * sizeof(uint32_t));
+    memo->used = 0;
+    memo->lru_head = MEMO_NONE;
+    memo->lru_tail = MEMO_NONE;
+}
+
+/**
+ * @brief Creates memoising stepper for a network without external inputs
+ *
+ * @param at Array of pointers to automata (copied, caller keeps ownership)
+ * @param num Number of automata in array
+ * @param capacity Maximum number of cached results (0 for default of 65536)
+ * @return Pointer to memo or NULL on error (EINVAL if an input is fed by
+ *         an automaton outside at or by an input mailbox, or if an
+ *         automaton is clocked or owns storage outside its state)
+ *
+ * @note Unconnected inputs keep their manual values; t and y must depend
+ *       only on their arguments. Each entry holds two joint states.
+ * @note Automata writing storage outside their state (memories) are
+ *       rejected: a cache hit restores states only and would skip those
+ *       writes. LFSRs and modules, whose context holds only constants and
+ *       scratch buffers, are accepted
+ */
+ma_memo_t *ma_memo_create(moore_t *at[], size_t num, size_t capacity)
+{
+    if (!at || num == 0 || capacity > MEMO_MAX_CAPACITY)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (capacity == 0)
+        capacity = MEMO_DEFAULT_CAPACITY;
+
+    size_t words = 0;
+    for (size_t i = 0; i < num; i++)
+    {
+        /* Clock phases are not part of the cached joint state */
+        if (!at[i] || at[i]->mailbox || at[i]->clocked || at[i]->mutable_storage)
+        {
+            errno = EINVAL;
+            return NULL;
+        }
+        words += (at[i]->s + 63) / 64;
+    }
+
+    /* Every source must be stepped together with its sinks */
+    for (size_t i = 0; i < num; i++)
+    {
+        for (size_t b = 0; b < at[i]->n; b++)
+        {
+            moore_t const *src = at[i]->incoming_connections[b].source_automaton;
+            bool found = !src;
+            for (size_t j = 0; j < num && !found; j++)
+                found = at[j] == src;
+            if (!found)
+            {
+                errno = EINVAL;
+                return NULL;
+            }
+        }
+    }
+
+    if (capacity > SIZE_MAX / (2 * words * sizeof(uint64_t)))
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    ma_memo_t *memo = ma_mem_calloc(1, sizeof(ma_memo_t));
+    if (!memo)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    size_t buckets = 1;
+    while (buckets < capacity)
+        buckets *= 2;
+
+    memo->num = num;
+    memo->words = words;
+    memo->capacity = capacity;
+    memo->bucket_mask = buckets - 1;
+    memo->at = ma_mem_alloc(num * sizeof(moore_t *));
+    memo->entries = ma_mem_alloc(capacity * sizeof(memo_entry));
+    memo->data = ma_mem_alloc(capacity * 2 * words * sizeof(uint64_t));
+    memo->buckets = ma_mem_alloc(buckets * sizeof(uint32_t));
+    memo->keys = ma_mem_alloc((MEMO_MAX_LEVEL + 1) * words * sizeof(uint64_t));
+    if (!memo->at || !memo->entries || !memo->data || !memo->buckets || !memo->keys)
+    {
+        ma_memo_delete(memo);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memcpy(memo->at, at, num * sizeof(moore_t *));
+    ma_memo_clear(memo);
+    return memo;
+}
+
+/**
+ * @brief Advances network by given number of cycles
+ *
+ * @param memo Memo
+ * @param cycles Number of cycles
+ * @return 0 on success, -1 on error
+ *
+ * @note States and outputs of the automata are exactly those after
+ *       cycles calls of ma_step; cache misses fall back to stepping
+ * @note A failing step (errno ENOMEM, see ma_step) stops the run; the
+ *       network is left after the last completed cycle and no jump
+ *       containing the failed cycle is cached
+ */
+int ma_memo_run(ma_memo_t *memo, uint64_t cycles)
+{
+    if (!memo)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (int level = MEMO_MAX_LEVEL; level >= 0; level--)
+    {
+        if ((cycles >> level & 1) && advance(memo, (unsigned)level) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns cache statistics
+ *
+ * @param memo Memo
+ * @param stats Receives statistics
+ * @return 0 on success, -1 on error
+ */
+int ma_memo_stats(ma_memo_t const *memo, ma_memo_stats_t *stats)
+{
+    if (!memo || !stats)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *stats = memo->stats;
+    stats->entries = memo->used;
+    return 0;
+}
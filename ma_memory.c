@@ -0,0 +1,232 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "ma.h"
+#include "ma_internal.h"
+
+#define MEMORY_MAX_ADDRESS_BITS 63
+
+/**
+ * @brief Storage and port layout of a memory automaton (its ctx)
+ *
+ * Word i of the memory occupies bits i * width .. i * width + width - 1
+ * of data. The automaton state holds only the read data registers.
+ */
+typedef struct
+{
+    size_t depth;        /* Number of memory words */
+    size_t width;        /* Bits per memory word */
+    size_t read_ports;
+    size_t write_ports;
+    size_t address_bits; /* Bits of each port address */
+    uint64_t *data;      /* Dense storage */
+    size_t words;        /* Size of data in uint64_t words */
+    bool mapped;         /* Storage is a shared anonymous mapping */
+} ma_memory;
+
+/**
+ * @brief Reads port address of up to 64 bits from input
+ */
+static inline uint64_t read_address(uint64_t const *input, size_t bit, size_t len)
+{
+    uint64_t address = 0;
+    ma_copy_bits(&address, 0, input, bit, len);
+    return address;
+}
+
+/**
+ * @brief Latches read data and applies writes (synchronous, read-first)
+ *
+ * Inputs: read_ports addresses, then for every write port its address,
+ * width data bits and one write enable bit.
+ */
+static void memory_transition(uint64_t *next_state, uint64_t const *input,
+                              uint64_t const *state, size_t n, size_t s, void *ctx)
+{
+    (void)state;
+    (void)n;
+    ma_memory *mem = ctx;
+    const size_t a_bits = mem->address_bits;
+    const size_t width = mem->width;
+
+    memset(next_state, 0, (s + 63) / 64 * sizeof(uint64_t));
+    for (size_t r = 0; r < mem->read_ports; r++)
+    {
+        const uint64_t address = read_address(input, r * a_bits, a_bits);
+        if (address < mem->depth)
+            ma_copy_bits(next_state, r * width, mem->data, address * width, width);
+    }
+
+    size_t bit = mem->read_ports * a_bits;
+    for (size_t w = 0; w < mem->write_ports; w++, bit += a_bits + width + 1)
+    {
+        const uint64_t address = read_address(input, bit, a_bits);
+        const size_t enable = bit + a_bits + width;
+        if (address < mem->depth && (input[enable / 64] >> (enable % 64)) & 1)
+            ma_copy_bits(mem->data, address * width, input, bit + a_bits, width);
+    }
+}
+
+/* Outputs are the read data registers */
+static void memory_output(uint64_t *output, uint64_t const *state, size_t m, size_t s, void *ctx)
+{
+    (void)ctx;
+    identity_func(output, state, m, s);
+}
+
+/**
+ * @brief Frees storage and descriptor of memory (release hook of automaton)
+ */
+static void memory_release(void *ctx)
+{
+    ma_memory *mem = ctx;
+    if (mem->mapped)
+        munmap(mem->data, mem->words * sizeof(uint64_t));
+    else
+        ma_mem_free(mem->data, mem->words * sizeof(uint64_t));
+    ma_mem_free(mem, sizeof(ma_memory));
+}
+
+/**
+ * @brief Creates memory automaton with addressed read and write ports
+ *
+ * @param depth Number of memory words
+ * @param width Bits per memory word
+ * @param read_ports Number of read ports (at least 1)
+ * @param write_ports Number of write ports (0 for a ROM)
+ * @param flags 0 or MA_MEMORY_MMAP
+ * @return Pointer to new automaton or NULL on error
+ *
+ * @note With A = ma_memory_address_bits the inputs are read_ports
+ *       addresses of A bits, then per write port A address bits, width
+ *       data bits and a write enable bit. Outputs are width bits per read
+ *       port holding the word addressed in the previous cycle, read
+ *       before that cycle's writes; of writes to one address the last
+ *       port wins and addresses >= depth are ignored (reading 0).
+ * @note Storage starts zeroed and is not part of the state: a step costs
+ *       O(ports) regardless of depth. MA_MEMORY_MMAP maps it lazily
+ *       (MAP_NORESERVE), which suits multi-GB memories and lets ma_part
+ *       children share it; without it the memory cannot be partitioned.
+ */
+moore_t *ma_create_memory(size_t depth, size_t width, size_t read_ports, size_t write_ports,
+                          unsigned flags)
+{
+    if (depth == 0 || width == 0 || read_ports == 0 || (flags & ~MA_MEMORY_MMAP))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    size_t address_bits = 1;
+    while (address_bits < MEMORY_MAX_ADDRESS_BITS && ((uint64_t)1 << address_bits) < depth)
+        address_bits++;
+
+    /* Storage bits and port bits must not overflow */
+    if (width > SIZE_MAX / 64 / depth || read_ports > SIZE_MAX / 64 / width ||
+        write_ports > SIZE_MAX / 64 / (address_bits + width + 1) ||
+        read_ports > SIZE_MAX / 64 / address_bits)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    ma_memory *mem = ma_mem_calloc(1, sizeof(ma_memory));
+    if (!mem)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    mem->depth = depth;
+    mem->width = width;
+    mem->read_ports = read_ports;
+    mem->write_ports = write_ports;
+    mem->address_bits = address_bits;
+    mem->words = (depth * width + 63) / 64;
+    mem->mapped = flags & MA_MEMORY_MMAP;
+
+    if (mem->mapped)
+    {
+        void *p = mmap(NULL, mem->words * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        mem->data = p == MAP_FAILED ? NULL : p;
+    }
+    else
+    {
+        mem->data = ma_mem_calloc(mem->words, sizeof(uint64_t));
+    }
+
+    const size_t n = read_ports * address_bits + write_ports * (address_bits + width + 1);
+    const size_t s = read_ports * width;
+    uint64_t *q_zero = ma_mem_calloc((s + 63) / 64, sizeof(uint64_t));
+    moore_t *a = NULL;
+    if (mem->data && q_zero)
+        a = ma_create_full_ex(n, s, s, memory_transition, memory_output, q_zero, mem);
+    ma_mem_free(q_zero, (s + 63) / 64 * sizeof(uint64_t));
+
+    if (!a)
+    {
+        if (mem->data)
+            memory_release(mem);
+        else
+            ma_mem_free(mem, sizeof(ma_memory));
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    a->release = memory_release;
+    a->private_ctx = !mem->mapped;
+    a->mutable_storage = true;
+    return a;
+}
+
+/**
+ * @brief Returns memory descriptor of automaton or NULL if it is not a memory
+ */
+static ma_memory *memory_of(moore_t const *a)
+{
+    return a && a->release == memory_release ? a->ctx : NULL;
+}
+
+/**
+ * @brief Returns storage of memory automaton
+ *
+ * @param a Memory automaton
+ * @param words Receives size of storage in uint64_t words (can be NULL)
+ * @return Pointer to storage (word i at bits i * width ..) or NULL on error
+ *
+ * @note Contents may be loaded or inspected between steps
+ */
+uint64_t *ma_memory_data(moore_t *a, size_t *words)
+{
+    ma_memory *mem = memory_of(a);
+    if (!mem)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (words)
+        *words = mem->words;
+    return mem->data;
+}
+
+/**
+ * @brief Returns number of address bits of each port of memory automaton
+ *
+ * @param a Memory automaton
+ * @return Address bits (0 on error, errno = EINVAL)
+ */
+size_t ma_memory_address_bits(moore_t const *a)
+{
+    ma_memory const *mem = memory_of(a);
+    if (!mem)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    return mem->address_bits;
+}
@@ -0,0 +1,572 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "ma.h"
+#include "ma_internal.h"
+
+#define MODULE_INIT_CAPACITY 8
+#define MODULE_UNCONNECTED (SIZE_MAX - 1) /* Source of an unconnected bit */
+
+/**
+ * @brief Source of one input bit of a part or one output bit of the module
+ */
+typedef struct
+{
+    size_t part; /* Sending part, MA_MODULE_PORT or MODULE_UNCONNECTED */
+    size_t bit;  /* Output bit of the part or input bit of the module */
+} module_source;
+
+/**
+ * @brief Run of bits copied into a part input or into the module output
+ */
+typedef struct
+{
+    size_t src_bit; /* First bit in module input or in scratch outputs */
+    size_t dst_bit; /* First bit of part input or module output */
+    size_t len;     /* Number of bits */
+    bool from_port; /* Source is the module input */
+} module_run;
+
+/**
+ * @brief Internal automaton of a module (copied from a prototype)
+ */
+typedef struct
+{
+    size_t n, m, s;
+    transition_function_t t;
+    output_function_t y;
+    transition_function_ex_t t_ex;
+    output_function_ex_t y_ex;
+    void *ctx;
+    void (*release)(void *ctx); /* Reference held on a nested module (or NULL) */
+    uint64_t *initial;          /* Initial state */
+    uint64_t *constant;         /* Values of unconnected inputs */
+    module_source *sources;     /* Source of each input bit */
+    size_t state_word;          /* First word of part state in instance state */
+    size_t output_word;         /* First word of part output in scratch outputs */
+    size_t first_run;           /* Runs gathering inputs of the part */
+    size_t run_count;
+    bool internal;              /* Outputs feed inputs of parts */
+    bool external;              /* Outputs feed module outputs */
+} module_part;
+
+/**
+ * @brief Block of connected automata instantiated as single automata
+ *
+ * Topology, functions and scratch buffers are shared by all instances;
+ * an instance holds only the states of the parts, one after another.
+ */
+struct ma_module
+{
+    size_t n;                /* Module inputs */
+    size_t m;                /* Module outputs */
+    module_part *parts;
+    size_t part_count;
+    size_t part_capacity;
+    module_source *outputs;  /* Source of each module output bit */
+
+    /* Compiled by the first instance (the module is sealed afterwards) */
+    bool sealed;
+    size_t state_words;      /* Words of instance state */
+    module_run *runs;        /* Input runs of all parts, then output runs */
+    size_t run_count;
+    size_t run_capacity;
+    size_t output_first_run; /* Runs filling module outputs */
+    size_t output_run_count;
+    uint64_t *scratch_out;   /* Outputs of all parts during a step */
+    size_t out_words;
+    uint64_t *scratch_in;    /* Input of the part being stepped */
+    size_t in_words;
+
+    size_t references;       /* Live instances and parts of other modules */
+    bool deleted;            /* ma_module_delete was called */
+};
+
+typedef struct ma_module ma_module;
+
+static void module_release(void *ctx);
+
+/**
+ * @brief Frees part buffers and drops its reference on a nested module
+ */
+static void free_part(module_part *p)
+{
+    const size_t s_words = (p->s + 63) / 64, n_words = (p->n + 63) / 64;
+    ma_mem_free(p->initial, s_words * sizeof(uint64_t));
+    ma_mem_free(p->constant, n_words * sizeof(uint64_t));
+    ma_mem_free(p->sources, p->n * sizeof(module_source));
+    if (p->release)
+        p->release(p->ctx);
+}
+
+/**
+ * @brief Frees module and everything it owns
+ */
+static void module_free(ma_module *mod)
+{
+    for (size_t i = 0; i < mod->part_count; i++)
+        free_part(&mod->parts[i]);
+    ma_mem_free(mod->parts, mod->part_capacity * sizeof(module_part));
+    ma_mem_free(mod->outputs, mod->m * sizeof(module_source));
+    ma_mem_free(mod->runs, mod->run_capacity * sizeof(module_run));
+    ma_mem_free(mod->scratch_out, mod->out_words * sizeof(uint64_t));
+    ma_mem_free(mod->scratch_in, mod->in_words * sizeof(uint64_t));
+    ma_mem_free(mod, sizeof(ma_module));
+}
+
+/**
+ * @brief Drops reference of an instance or a part (release hook of instances)
+ */
+static void module_release(void *ctx)
+{
+    ma_module *mod = ctx;
+    if (--mod->references == 0 && mod->deleted)
+        module_free(mod);
+}
+
+/**
+ * @brief Creates empty module with given boundary ports
+ *
+ * @param n Number of module inputs
+ * @param m Number of module outputs (at least 1)
+ * @return Pointer to new module or NULL on error
+ */
+ma_module_t *ma_module_create(size_t n, size_t m)
+{
+    if (m == 0 || m > SIZE_MAX / sizeof(module_source) || n > SIZE_MAX / 64)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ma_module *mod = ma_mem_calloc(1, sizeof(ma_module));
+    if (!mod)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    mod->n = n;
+    mod->m = m;
+    mod->outputs = ma_mem_alloc(m * sizeof(module_source));
+    if (!mod->outputs)
+    {
+        ma_mem_free(mod, sizeof(ma_module));
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (size_t i = 0; i < m; i++)
+        mod->outputs[i].part = MODULE_UNCONNECTED;
+
+    return mod;
+}
+
+/**
+ * @brief Deletes module (freed when its last instance is deleted)
+ *
+ * @param mod Pointer to module (can be NULL)
+ */
+void ma_module_delete(ma_module_t *mod)
+{
+    if (!mod || mod->deleted)
+        return;
+
+    mod->deleted = true;
+    if (mod->references == 0)
+        module_free(mod);
+}
+
+/**
+ * @brief Adds part to module, copied from a prototype automaton
+ *
+ * @param mod Pointer to module
+ * @param proto Prototype (keeps its ownership; may be deleted afterwards)
+ * @return Index of new part (parts are numbered from 0), -1 on error
+ *
+ * @note Sizes, functions, context, current state and manual inputs are
+ *       copied: unconnected part inputs hold the prototype's ma_set_input
+ *       values. Clock settings of the prototype are not copied.
+ * @note Instances of other modules may be parts (nesting); in-place
+ *       automata and built-ins owning their context (memories, LFSRs)
+ *       cannot (EINVAL). Fails with EBUSY once the module has instances.
+ */
+int ma_module_add(ma_module_t *mod, moore_t const *proto)
+{
+    if (!mod || !proto || proto->t_log ||
+        (proto->release && proto->release != module_release))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (mod->sealed)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+    if (mod->part_count == INT_MAX)
+    {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    if (mod->part_count == mod->part_capacity)
+    {
+        const size_t capacity = mod->part_capacity ? mod->part_capacity * 2 : MODULE_INIT_CAPACITY;
+        module_part *parts = ma_mem_realloc(mod->parts, mod->part_capacity * sizeof(module_part),
+                                            capacity * sizeof(module_part));
+        if (!parts)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+        mod->parts = parts;
+        mod->part_capacity = capacity;
+    }
+
+    module_part *p = &mod->parts[mod->part_count];
+    memset(p, 0, sizeof(module_part));
+    p->n = proto->n;
+    p->m = proto->m;
+    p->s = proto->s;
+    p->t = proto->t;
+    p->y = proto->y;
+    p->t_ex = proto->t_ex;
+    p->y_ex = proto->y_ex;
+    p->ctx = proto->ctx;
+
+    const size_t s_words = (p->s + 63) / 64, n_words = (p->n + 63) / 64;
+    p->initial = ma_mem_alloc(s_words * sizeof(uint64_t));
+    if (p->n > 0)
+    {
+        p->constant = ma_mem_alloc(n_words * sizeof(uint64_t));
+        p->sources = ma_mem_alloc(p->n * sizeof(module_source));
+    }
+    if (!p->initial || (p->n > 0 && (!p->constant || !p->sources)))
+    {
+        free_part(p);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    memcpy(p->initial, proto->state, s_words * sizeof(uint64_t));
+    if (p->n > 0)
+    {
+        memcpy(p->constant, proto->manual_input, n_words * sizeof(uint64_t));
+        if (p->n % 64)
+            p->constant[n_words - 1] &= ((uint64_t)1 << (p->n % 64)) - 1;
+        for (size_t i = 0; i < p->n; i++)
+            p->sources[i].part = MODULE_UNCONNECTED;
+    }
+
+    /* A nested module lives as long as a part refers to it */
+    if (proto->release == module_release)
+    {
+        ((ma_module *)proto->ctx)->references++;
+        p->release = module_release;
+    }
+
+    return (int)mod->part_count++;
+}
+
+/**
+ * @brief Connects bits inside module
+ *
+ * @param mod Pointer to module
+ * @param dst Receiving part, or MA_MODULE_PORT for module outputs
+ * @param in First input bit of dst (or first module output bit)
+ * @param src Sending part, or MA_MODULE_PORT for module inputs
+ * @param out First output bit of src (or first module input bit)
+ * @param num Number of connected bits
+ * @return 0 on success, -1 on error
+ *
+ * @note Later connections of a bit replace earlier ones. Module outputs
+ *       must come from parts (a Moore output cannot follow an input).
+ * @note Fails with EBUSY once the module has instances
+ */
+int ma_module_connect(ma_module_t *mod, size_t dst, size_t in, size_t src, size_t out, size_t num)
+{
+    if (!mod || num == 0 || (dst == MA_MODULE_PORT && src == MA_MODULE_PORT) ||
+        (dst != MA_MODULE_PORT && dst >= mod->part_count) ||
+        (src != MA_MODULE_PORT && src >= mod->part_count))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (mod->sealed)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    const size_t dst_bits = dst == MA_MODULE_PORT ? mod->m : mod->parts[dst].n;
+    const size_t src_bits = src == MA_MODULE_PORT ? mod->n : mod->parts[src].m;
+    if (in >= dst_bits || out >= src_bits || num > dst_bits - in || num > src_bits - out)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    module_source *sources = dst == MA_MODULE_PORT ? mod->outputs : mod->parts[dst].sources;
+    for (size_t i = 0; i < num; i++)
+    {
+        sources[in + i].part = src;
+        sources[in + i].bit = out + i;
+    }
+    return 0;
+}
+
+/**
+ * @brief Appends bit to compiled runs, extending the last run if possible
+ *
+ * @param mod Module being sealed
+ * @param first First run of the list being built
+ * @param source Source of the bit
+ * @param dst_bit Destination bit
+ * @return 0 on success, -1 on error
+ */
+static int append_bit(ma_module *mod, size_t first, module_source source, size_t dst_bit)
+{
+    const bool from_port = source.part == MA_MODULE_PORT;
+    const size_t src_bit = from_port ? source.bit
+                                     : mod->parts[source.part].output_word * 64 + source.bit;
+
+    if (mod->run_count > first)
+    {
+        module_run *last = &mod->runs[mod->run_count - 1];
+        if (last->from_port == from_port && last->src_bit + last->len == src_bit &&
+            last->dst_bit + last->len == dst_bit)
+        {
+            last->len++;
+            return 0;
+        }
+    }
+
+    if (mod->run_count == mod->run_capacity)
+    {
+        const size_t capacity = mod->run_capacity ? mod->run_capacity * 2 : MODULE_INIT_CAPACITY;
+        module_run *runs = ma_mem_realloc(mod->runs, mod->run_capacity * sizeof(module_run),
+                                          capacity * sizeof(module_run));
+        if (!runs)
+            return -1;
+        mod->runs = runs;
+        mod->run_capacity = capacity;
+    }
+
+    mod->runs[mod->run_count++] = (module_run){src_bit, dst_bit, 1, from_port};
+    return 0;
+}
+
+/**
+ * @brief Lays out instance state and scratch buffers and compiles runs
+ *
+ * @param mod Module with at least one part
+ * @return 0 on success, -1 on error
+ */
+static int module_seal(ma_module *mod)
+{
+    size_t state_words = 0, out_words = 0, in_words = 1;
+    mod->run_count = 0;
+    for (size_t i = 0; i < mod->part_count; i++)
+    {
+        module_part *p = &mod->parts[i];
+        p->state_word = state_words;
+        p->output_word = out_words;
+        state_words += (p->s + 63) / 64;
+        out_words += (p->m + 63) / 64;
+        if ((p->n + 63) / 64 > in_words)
+            in_words = (p->n + 63) / 64;
+    }
+
+    for (size_t i = 0; i < mod->part_count; i++)
+    {
+        module_part *p = &mod->parts[i];
+        p->first_run = mod->run_count;
+        for (size_t b = 0; b < p->n; b++)
+        {
+            if (p->sources[b].part == MODULE_UNCONNECTED)
+                continue;
+            if (p->sources[b].part != MA_MODULE_PORT)
+                mod->parts[p->sources[b].part].internal = true;
+            if (append_bit(mod, p->first_run, p->sources[b], b) != 0)
+                return -1;
+        }
+        p->run_count = mod->run_count - p->first_run;
+    }
+
+    mod->output_first_run = mod->run_count;
+    for (size_t b = 0; b < mod->m; b++)
+    {
+        if (mod->outputs[b].part == MODULE_UNCONNECTED)
+            continue;
+        mod->parts[mod->outputs[b].part].external = true;
+        if (append_bit(mod, mod->output_first_run, mod->outputs[b], b) != 0)
+            return -1;
+    }
+    mod->output_run_count = mod->run_count - mod->output_first_run;
+
+    mod->scratch_out = ma_mem_calloc(out_words, sizeof(uint64_t));
+    mod->scratch_in = ma_mem_calloc(in_words, sizeof(uint64_t));
+    if (!mod->scratch_out || !mod->scratch_in)
+    {
+        ma_mem_free(mod->scratch_out, out_words * sizeof(uint64_t));
+        ma_mem_free(mod->scratch_in, in_words * sizeof(uint64_t));
+        mod->scratch_out = mod->scratch_in = NULL;
+        return -1;
+    }
+
+    mod->state_words = state_words;
+    mod->out_words = out_words;
+    mod->in_words = in_words;
+    mod->sealed = true;
+    return 0;
+}
+
+/**
+ * @brief Calculates output of part from its slice of instance state
+ */
+static inline void part_output(ma_module const *mod, module_part const *p,
+                               uint64_t const *state)
+{
+    uint64_t *output = mod->scratch_out + p->output_word;
+    if (p->y)
+        p->y(output, state + p->state_word, p->m, p->s);
+    else
+        p->y_ex(output, state + p->state_word, p->m, p->s, p->ctx);
+}
+
+/**
+ * @brief Steps all parts of instance (transition of instances)
+ *
+ * Part outputs are derived from the current state, gathered into each
+ * part's input and the part transitions write their slices of next_state,
+ * exactly as ma_step would on the flattened network.
+ */
+static void module_transition(uint64_t *next_state, uint64_t const *input,
+                              uint64_t const *state, size_t n, size_t s, void *ctx)
+{
+    (void)n;
+    (void)s;
+    ma_module *mod = ctx;
+
+    for (size_t i = 0; i < mod->part_count; i++)
+    {
+        if (mod->parts[i].internal)
+            part_output(mod, &mod->parts[i], state);
+    }
+
+    uint64_t *in = mod->scratch_in;
+    for (size_t i = 0; i < mod->part_count; i++)
+    {
+        module_part const *p = &mod->parts[i];
+        if (p->n > 0)
+        {
+            memcpy(in, p->constant, (p->n + 63) / 64 * sizeof(uint64_t));
+            for (size_t r = p->first_run; r < p->first_run + p->run_count; r++)
+            {
+                const module_run *run = &mod->runs[r];
+                ma_copy_bits(in, run->dst_bit, run->from_port ? input : mod->scratch_out,
+                             run->src_bit, run->len);
+            }
+        }
+
+        if (p->t)
+            p->t(next_state + p->state_word, in, state + p->state_word, p->n, p->s);
+        else
+            p->t_ex(next_state + p->state_word, in, state + p->state_word, p->n, p->s, p->ctx);
+    }
+}
+
+/**
+ * @brief Collects module outputs from part outputs (output of instances)
+ */
+static void module_output(uint64_t *output, uint64_t const *state, size_t m, size_t s, void *ctx)
+{
+    (void)s;
+    ma_module *mod = ctx;
+
+    for (size_t i = 0; i < mod->part_count; i++)
+    {
+        if (mod->parts[i].external)
+            part_output(mod, &mod->parts[i], state);
+    }
+
+    memset(output, 0, (m + 63) / 64 * sizeof(uint64_t));
+    for (size_t r = mod->output_first_run; r < mod->output_first_run + mod->output_run_count; r++)
+    {
+        const module_run *run = &mod->runs[r];
+        ma_copy_bits(output, run->dst_bit, mod->scratch_out, run->src_bit, run->len);
+    }
+}
+
+/**
+ * @brief Creates instance of module as a single automaton
+ *
+ * @param mod Pointer to module (with at least one part)
+ * @return Pointer to new automaton or NULL on error
+ *
+ * @note The instance has the module's n inputs and m outputs and behaves
+ *       like the flattened parts stepped by ma_step; its state is the
+ *       part states one after another, each starting at a word boundary
+ * @note The first instance seals the module. Instances share scratch
+ *       buffers of the module, so instances of one module must not be
+ *       stepped by several threads at once (processes of ma_part are fine).
+ */
+moore_t *ma_module_instance(ma_module_t *mod)
+{
+    if (!mod || mod->deleted || mod->part_count == 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (!mod->sealed && module_seal(mod) != 0)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    uint64_t *q = ma_mem_calloc(mod->state_words, sizeof(uint64_t));
+    if (!q)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (size_t i = 0; i < mod->part_count; i++)
+    {
+        module_part const *p = &mod->parts[i];
+        memcpy(q + p->state_word, p->initial, (p->s + 63) / 64 * sizeof(uint64_t));
+    }
+
+    moore_t *a = ma_create_full_ex(mod->n, mod->m, mod->state_words * 64, module_transition,
+                                   module_output, q, mod);
+    ma_mem_free(q, mod->state_words * sizeof(uint64_t));
+    if (!a)
+        return NULL;
+
+    a->release = module_release;
+    mod->references++;
+    return a;
+}
+
+/**
+ * @brief Returns state of one part of module instance
+ *
+ * @param a Module instance
+ * @param part Index of part
+ * @return Pointer to part state inside instance state, NULL on error
+ *
+ * @note Valid until the next step of the instance
+ */
+uint64_t const *ma_module_part_state(moore_t const *a, size_t part)
+{
+    if (!a || a->release != module_release || part >= ((ma_module *)a->ctx)->part_count)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ma_module const *mod = a->ctx;
+    return a->state + mod->parts[part].state_word;
+}
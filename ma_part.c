@@ -0,0 +1,592 @@
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "ma.h"
+#include "ma_internal.h"
+
+#define PART_CONTROL_SIZE 4096    /* Control block at start of shared mapping */
+#define PART_SPIN 2000            /* Barrier polls before sleeping on the futex */
+#define PART_CHECK_NS 100000000L  /* Parent checks children this often while waiting */
+
+/* Commands issued by the parent process */
+#define PART_RUN 1
+#define PART_EXIT 2
+
+/**
+ * @brief Control block shared by all processes of a partition set
+ *
+ * Producer and barrier fields are kept on separate cache lines.
+ */
+typedef struct
+{
+    _Atomic uint32_t command_seq; /* Bumped by parent for every command */
+    uint32_t command;             /* PART_RUN or PART_EXIT */
+    uint64_t cycles;              /* Cycles of current PART_RUN */
+    char pad[48];
+    _Atomic uint32_t arrived;     /* Workers waiting at barrier */
+    _Atomic uint32_t barrier_seq; /* Bumped when all workers arrived */
+    _Atomic uint32_t lost;        /* An in-place automaton lost a write */
+} part_control;
+
+/**
+ * @brief Stepping state of an automaton handed between parent and its worker
+ *
+ * The mapping has the same address in every process, so buffer pointers
+ * are valid everywhere. The parent's copy is authoritative between steps.
+ */
+typedef struct
+{
+    uint64_t *state;      /* Current state buffer */
+    uint64_t *next_state; /* Other state buffer (NULL for in-place automata) */
+    uint64_t clock_count; /* Cycles counted by the clock of the automaton */
+} part_record;
+
+/**
+ * @brief Structure representing a network split across local processes
+ *
+ * Worker w steps automata at[bounds[w] .. bounds[w + 1]); worker 0 is the
+ * calling process. Outputs, states and manual inputs of all automata live
+ * in one MAP_SHARED mapping, so the outputs of the previous cycle act as
+ * boundary buffers and every process sees them without copying.
+ */
+struct ma_part
+{
+    moore_t **at;        /* Automata in partition order */
+    size_t num;          /* Number of automata */
+    size_t processes;    /* Number of workers */
+    size_t *bounds;      /* processes + 1 slice boundaries */
+    pid_t *pids;         /* Child processes (workers 1 .. processes - 1) */
+    void *base;          /* Shared mapping */
+    size_t size;         /* Size of mapping */
+    part_control *control;
+    part_record *records; /* One per automaton, inside the mapping */
+    bool broken;         /* A child died; steps are refused */
+};
+
+/* Thin wrappers of the futex system call on shared (non-private) words */
+static inline void futex_wait(_Atomic uint32_t *word, uint32_t value, struct timespec const *timeout)
+{
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, value, timeout, NULL, 0);
+}
+
+static inline void futex_wake(_Atomic uint32_t *word)
+{
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/**
+ * @brief Checks whether all child processes are still running
+ *
+ * @param part Partition set
+ * @return true if none of them exited
+ */
+static bool children_alive(ma_part_t *part)
+{
+    for (size_t w = 1; w < part->processes; w++)
+    {
+        if (part->pids[w] > 0 && waitpid(part->pids[w], NULL, WNOHANG) == part->pids[w])
+        {
+            part->pids[w] = 0;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Waits until all workers arrive at barrier
+ *
+ * @param part Partition set
+ * @param parent Caller is worker 0 (checks children while sleeping)
+ * @return 0 on success, -1 if a child died
+ */
+static int part_barrier(ma_part_t *part, bool parent)
+{
+    part_control *control = part->control;
+    const uint32_t seq = atomic_load_explicit(&control->barrier_seq, memory_order_acquire);
+
+    if (atomic_fetch_add_explicit(&control->arrived, 1, memory_order_acq_rel) + 1 == part->processes)
+    {
+        atomic_store_explicit(&control->arrived, 0, memory_order_relaxed);
+        atomic_fetch_add_explicit(&control->barrier_seq, 1, memory_order_release);
+        futex_wake(&control->barrier_seq);
+        return 0;
+    }
+
+    for (unsigned spin = 0; spin < PART_SPIN; spin++)
+    {
+        if (atomic_load_explicit(&control->barrier_seq, memory_order_acquire) != seq)
+            return 0;
+        MA_CPU_RELAX();
+    }
+
+    const struct timespec check = {0, PART_CHECK_NS};
+    while (atomic_load_explicit(&control->barrier_seq, memory_order_acquire) == seq)
+    {
+        futex_wait(&control->barrier_seq, seq, parent ? &check : NULL);
+        if (parent && atomic_load_explicit(&control->barrier_seq, memory_order_acquire) == seq &&
+            !children_alive(part))
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Publishes stepping state of automata at[first .. last) to records
+ */
+static void save_records(ma_part_t *part, size_t first, size_t last)
+{
+    for (size_t i = first; i < last; i++)
+    {
+        moore_t const *a = part->at[i];
+        part->records[i] = (part_record){a->state, a->next_state, a->clock_count};
+    }
+}
+
+/**
+ * @brief Takes stepping state of automata at[first .. last) from records
+ */
+static void load_records(ma_part_t *part, size_t first, size_t last)
+{
+    for (size_t i = first; i < last; i++)
+    {
+        moore_t *a = part->at[i];
+        a->state = part->records[i].state;
+        a->next_state = part->records[i].next_state;
+        a->clock_count = part->records[i].clock_count;
+    }
+}
+
+/**
+ * @brief Runs cycles on slice of worker, meeting other workers twice per cycle
+ *
+ * @param part Partition set
+ * @param w Worker index
+ * @param cycles Number of cycles
+ * @return 0 on success, -1 if a child died
+ *
+ * @note The first barrier ends reading of outputs by gathers, the second
+ *       publishes outputs of the cycle to all workers (and, after the last
+ *       cycle, the records of children)
+ */
+static int run_slice(ma_part_t *part, size_t w, uint64_t cycles)
+{
+    moore_t *const *slice = part->at + part->bounds[w];
+    const size_t count = part->bounds[w + 1] - part->bounds[w];
+
+    for (uint64_t c = 0; c < cycles; c++)
+    {
+        ma_step_gather(slice, count);
+        if (part_barrier(part, w == 0) != 0)
+            return -1;
+
+        if (ma_step_update(slice, count) != 0)
+            atomic_store_explicit(&part->control->lost, 1, memory_order_relaxed);
+        if (w > 0 && c + 1 == cycles)
+            save_records(part, part->bounds[w], part->bounds[w + 1]);
+        if (part_barrier(part, w == 0) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Main loop of child process executing commands of parent
+ *
+ * @param part Partition set (copy inherited through fork)
+ * @param w Worker index
+ */
+static void __attribute__((noreturn)) child_main(ma_part_t *part, size_t w)
+{
+    part_control *control = part->control;
+    uint32_t seen = 0;
+
+    for (;;)
+    {
+        uint32_t seq;
+        while ((seq = atomic_load_explicit(&control->command_seq, memory_order_acquire)) == seen)
+            futex_wait(&control->command_seq, seen, NULL);
+        seen = seq;
+
+        if (control->command == PART_EXIT)
+            _exit(0);
+
+        load_records(part, part->bounds[w], part->bounds[w + 1]);
+        run_slice(part, w, control->cycles);
+    }
+}
+
+/**
+ * @brief Moves buffer into shared mapping
+ *
+ * @param buffer Pointer to buffer field of automaton
+ * @param words Size of buffer in words
+ * @param cursor Next free word of mapping (advanced)
+ */
+static void move_to_shared(uint64_t **buffer, size_t words, uint64_t **cursor)
+{
+    memcpy(*cursor, *buffer, words * sizeof(uint64_t));
+    ma_mem_free(*buffer, words * sizeof(uint64_t));
+    *buffer = *cursor;
+    *cursor += words;
+}
+
+/**
+ * @brief Moves buffer out of shared mapping into preallocated private memory
+ *
+ * @param buffer Pointer to buffer field of automaton
+ * @param words Size of buffer in words
+ * @param private Private buffer of words words
+ */
+static void move_to_private(uint64_t **buffer, size_t words, uint64_t *private)
+{
+    memcpy(private, *buffer, words * sizeof(uint64_t));
+    *buffer = private;
+}
+
+/**
+ * @brief Forces automaton and its sinks to rebuild their gather plans
+ *
+ * @param a Automaton whose buffers moved
+ */
+static void invalidate_plans(moore_t *a)
+{
+    a->plan_dirty = true;
+    for (size_t i = 0; i < a->connected_to_me_count; i++)
+    {
+        if (a->connected_to_me[i])
+            a->connected_to_me[i]->plan_dirty = true;
+    }
+}
+
+/**
+ * @brief Stops child processes and waits for them
+ *
+ * @param part Partition set
+ */
+static void stop_children(ma_part_t *part)
+{
+    part->control->command = PART_EXIT;
+    atomic_fetch_add_explicit(&part->control->command_seq, 1, memory_order_release);
+    futex_wake(&part->control->command_seq);
+
+    for (size_t w = 1; w < part->processes; w++)
+    {
+        if (part->pids[w] <= 0)
+            continue;
+
+        /* After a failure the others may sleep in a barrier that never opens */
+        if (part->broken)
+            kill(part->pids[w], SIGKILL);
+        waitpid(part->pids[w], NULL, 0);
+        part->pids[w] = 0;
+    }
+}
+
+/**
+ * @brief Frees private memory of partition set (mapping included)
+ *
+ * @param part Partition set
+ */
+static void part_free(ma_part_t *part)
+{
+    if (part->base)
+        munmap(part->base, part->size);
+    ma_mem_free(part->at, part->num * sizeof(moore_t *));
+    ma_mem_free(part->bounds, (part->processes + 1) * sizeof(size_t));
+    ma_mem_free(part->pids, part->processes * sizeof(pid_t));
+    ma_mem_free(part, sizeof(ma_part_t));
+}
+
+/**
+ * @brief Splits automata across local processes sharing their buffers
+ *
+ * @param at Array of pointers to automata (stepped like by ma_step)
+ * @param num Number of automata in array
+ * @param processes Number of processes including the caller (clamped to num)
+ * @return Pointer to partition set or NULL on error
+ *
+ * @note Forks processes - 1 children, each owning a contiguous slice of at.
+ *       Connections crossing slices read outputs of the previous cycle
+ *       from the shared mapping, so results equal a single-process run.
+ * @note Until ma_part_delete: do not change connections, functions or clocks; use
+ *       ma_set_input, ma_set_state and ma_get_output only between steps
+ * @note errno is EBUSY if a buffer of an automaton already lives in a
+ *       shared mapping, EINVAL if an automaton appears twice, has an input
+ *       mailbox or private storage (a memory without MA_MEMORY_MMAP), or
+ *       if an input or clock gate is fed by an automaton outside at
+ */
+ma_part_t *ma_part_create(moore_t *at[], size_t num, size_t processes)
+{
+    if (!at || num == 0 || processes == 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    size_t words = 0;
+    for (size_t i = 0; i < num; i++)
+    {
+        if (!at[i] || at[i]->mailbox || at[i]->private_ctx)
+        {
+            errno = EINVAL;
+            return NULL;
+        }
+        if (at[i]->external)
+        {
+            errno = EBUSY;
+            return NULL;
+        }
+        words += (at[i]->next_state ? 2 : 1) * ((at[i]->s + 63) / 64) + (at[i]->m + 63) / 64 +
+                 (at[i]->n + 63) / 64;
+    }
+
+    /* Mark members, stopping at a duplicate; workers would keep stale
+       private copies of outputs of sources outside the set */
+    size_t marked = 0;
+    while (marked < num && !(at[marked]->external & MA_EXTERNAL_MARK))
+        at[marked++]->external |= MA_EXTERNAL_MARK;
+
+    bool valid = marked == num;
+    for (size_t i = 0; valid && i < num; i++)
+    {
+        valid = !at[i]->clock_gate || (at[i]->clock_gate->external & MA_EXTERNAL_MARK);
+        for (size_t b = 0; valid && b < at[i]->n; b++)
+        {
+            moore_t const *src = at[i]->incoming_connections[b].source_automaton;
+            valid = !src || (src->external & MA_EXTERNAL_MARK);
+        }
+    }
+
+    for (size_t i = 0; i < marked; i++)
+        at[i]->external &= ~MA_EXTERNAL_MARK;
+    if (!valid)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (processes > num)
+        processes = num;
+
+    ma_part_t *part = ma_mem_calloc(1, sizeof(ma_part_t));
+    if (!part)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    part->num = num;
+    part->processes = processes;
+    part->at = ma_mem_alloc(num * sizeof(moore_t *));
+    part->bounds = ma_mem_alloc((processes + 1) * sizeof(size_t));
+    part->pids = ma_mem_calloc(processes, sizeof(pid_t));
+    if (!part->at || !part->bounds || !part->pids)
+    {
+        part_free(part);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    part->size = PART_CONTROL_SIZE + num * sizeof(part_record) + words * sizeof(uint64_t);
+    part->base = mmap(NULL, part->size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (part->base == MAP_FAILED)
+    {
+        part->base = NULL;
+        part_free(part);
+        errno = ENOMEM;
+        return NULL;
+    }
+    part->control = part->base;
+    part->records = (part_record *)((char *)part->base + PART_CONTROL_SIZE);
+
+    memcpy(part->at, at, num * sizeof(moore_t *));
+    for (size_t w = 0; w <= processes; w++)
+        part->bounds[w] = num * w / processes;
+
+    /* Move buffers of every automaton next to each other */
+    uint64_t *cursor = (uint64_t *)(part->records + num);
+    for (size_t i = 0; i < num; i++)
+    {
+        moore_t *a = at[i];
+        const size_t s_words = (a->s + 63) / 64;
+
+        move_to_shared(&a->state, s_words, &cursor);
+        if (a->next_state)
+            move_to_shared(&a->next_state, s_words, &cursor);
+        move_to_shared(&a->output, (a->m + 63) / 64, &cursor);
+        a->external = MA_EXTERNAL_STATE | MA_EXTERNAL_OUTPUT;
+        if (a->n > 0)
+        {
+            move_to_shared(&a->manual_input, (a->n + 63) / 64, &cursor);
+            a->external |= MA_EXTERNAL_INPUT;
+        }
+        invalidate_plans(a);
+    }
+
+    /* Start workers 1 .. processes - 1 */
+    const pid_t parent = getpid();
+    for (size_t w = 1; w < processes; w++)
+    {
+        const pid_t pid = fork();
+        if (pid == 0)
+        {
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            if (getppid() != parent)
+                _exit(1);
+            child_main(part, w);
+        }
+
+        if (pid < 0)
+        {
+            const int saved = errno;
+            ma_part_delete(part); /* Also stops children started so far */
+            errno = saved;
+            return NULL;
+        }
+        part->pids[w] = pid;
+    }
+
+    return part;
+}
+
+/**
+ * @brief Executes simulation cycles on all partitions
+ *
+ * @param part Pointer to partition set
+ * @param cycles Number of cycles to execute
+ * @return 0 on success, -1 on error
+ *
+ * @note Equivalent to cycles calls of ma_step on the array given to
+ *       ma_part_create; returns when every process finished the last cycle
+ * @note errno is ECHILD if a child process died (the set is unusable then),
+ *       ENOMEM if an in-place automaton lost a write (see ma_step)
+ */
+int ma_part_step(ma_part_t *part, size_t cycles)
+{
+    if (!part || cycles == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (part->broken)
+    {
+        errno = ECHILD;
+        return -1;
+    }
+
+    if (part->processes > 1)
+    {
+        save_records(part, part->bounds[1], part->num);
+        part->control->cycles = cycles;
+        part->control->command = PART_RUN;
+        atomic_fetch_add_explicit(&part->control->command_seq, 1, memory_order_release);
+        futex_wake(&part->control->command_seq);
+    }
+
+    if (run_slice(part, 0, cycles) != 0)
+    {
+        part->broken = true;
+        errno = ECHILD;
+        return -1;
+    }
+
+    /* Follow state buffers and clocks of automata stepped by children
+       (clocked automata swap buffers only on their ticks) */
+    load_records(part, part->bounds[1], part->num);
+
+    if (atomic_exchange_explicit(&part->control->lost, 0, memory_order_relaxed))
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Stops child processes and moves buffers back to private memory
+ *
+ * @param part Pointer to partition set (can be NULL)
+ * @return 0 on success, -1 on error (partition set stays intact)
+ *
+ * @note Automata keep the states and outputs reached by the last step
+ */
+int ma_part_delete(ma_part_t *part)
+{
+    if (!part)
+        return 0;
+
+    /* Allocate all private buffers first so failure changes nothing */
+    const size_t blocks = 4 * part->num;
+    uint64_t **buffers = ma_mem_calloc(blocks, sizeof(uint64_t *));
+    if (!buffers)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    bool failed = false;
+    for (size_t i = 0; i < part->num && !failed; i++)
+    {
+        moore_t const *a = part->at[i];
+        const size_t sizes[4] = {(a->s + 63) / 64, a->next_state ? (a->s + 63) / 64 : 0,
+                                 (a->m + 63) / 64, (a->n + 63) / 64};
+        for (size_t k = 0; k < 4 && !failed; k++)
+        {
+            if (sizes[k] == 0)
+                continue;
+            buffers[4 * i + k] = ma_mem_alloc(sizes[k] * sizeof(uint64_t));
+            failed = !buffers[4 * i + k];
+        }
+    }
+
+    if (failed)
+    {
+        for (size_t i = 0; i < part->num; i++)
+        {
+            moore_t const *a = part->at[i];
+            const size_t sizes[4] = {(a->s + 63) / 64, a->next_state ? (a->s + 63) / 64 : 0,
+                                 (a->m + 63) / 64, (a->n + 63) / 64};
+            for (size_t k = 0; k < 4; k++)
+                ma_mem_free(buffers[4 * i + k], sizes[k] * sizeof(uint64_t));
+        }
+        ma_mem_free(buffers, blocks * sizeof(uint64_t *));
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (part->processes > 1)
+        stop_children(part);
+
+    for (size_t i = 0; i < part->num; i++)
+    {
+        moore_t *a = part->at[i];
+        const size_t s_words = (a->s + 63) / 64;
+
+        move_to_private(&a->state, s_words, buffers[4 * i]);
+        if (a->next_state)
+            move_to_private(&a->next_state, s_words, buffers[4 * i + 1]);
+        move_to_private(&a->output, (a->m + 63) / 64, buffers[4 * i + 2]);
+        if (a->n > 0)
+            move_to_private(&a->manual_input, (a->n + 63) / 64, buffers[4 * i + 3]);
+        a->external = 0;
+        invalidate_plans(a);
+    }
+
+    ma_mem_free(buffers, blocks * sizeof(uint64_t *));
+    part_free(part);
+    return 0;
+}
@@ -0,0 +1,489 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "ma.h"
+#include "ma_internal.h"
+
+#define POOL_BLOCK 64                 /* Automata per block (spans whole words for every width) */
+#define POOL_UNCONNECTED UINT32_MAX   /* Connection entry of an unconnected input */
+#define POOL_MAX_BITS 64              /* Largest n, m and s of a pooled automaton */
+
+/**
+ * @brief Structure representing a pool of packed tiny automata
+ *
+ * States, outputs and inputs of all automata are stored as fields of
+ * power-of-two width packed into shared words. Every automaton of a
+ * pool uses the same batch kernels.
+ */
+struct ma_pool
+{
+    size_t count;              /* Number of automata */
+    size_t padded;             /* count rounded up to POOL_BLOCK */
+    ma_pool_layout_t layout;   /* Field widths passed to kernels */
+    ma_batch_transition_t t;   /* Batch transition function */
+    ma_batch_output_t y;       /* Batch output function */
+    void *ctx;                 /* User context for t and y */
+
+    /* Packed buffers */
+    uint64_t *state;        /* CURRENT states */
+    uint64_t *next_state;   /* NEXT states (calculated in ma_pool_step) */
+    uint64_t *output;       /* Outputs */
+    uint64_t *manual_input; /* Values set by ma_pool_set_input */
+    uint64_t *final_input;  /* Gathered inputs */
+
+    /* Intra-pool connections: for each input bit, global output bit index
+       of its source (src * m_width + out) or POOL_UNCONNECTED. Allocated
+       by the first ma_pool_connect. */
+    uint32_t *connections;
+    size_t connected_bits; /* Number of connected input bits */
+};
+
+/**
+ * @brief Returns smallest power-of-two field width holding bits
+ *
+ * @param bits Number of bits (0..64)
+ * @return Field width (0 for bits == 0, otherwise 1..64)
+ */
+static unsigned field_width(size_t bits)
+{
+    if (bits == 0)
+        return 0;
+
+    unsigned width = 1;
+    while (width < bits)
+        width *= 2;
+    return width;
+}
+
+/**
+ * @brief Returns number of words holding fields of all automata of pool
+ *
+ * @param pool Pool
+ * @param width Field width
+ */
+static inline size_t pool_words(ma_pool_t const *pool, unsigned width)
+{
+    return pool->padded / 64 * width;
+}
+
+/* Field mask for given width */
+static inline uint64_t field_mask(unsigned width)
+{
+    return width == 64 ? ~(uint64_t)0 : ((uint64_t)1 << width) - 1;
+}
+
+/**
+ * @brief Frees pool and its buffers
+ *
+ * @param pool Pool (can be partially initialized)
+ */
+static void pool_free(ma_pool_t *pool)
+{
+    const ma_pool_layout_t *l = &pool->layout;
+    ma_mem_free(pool->state, pool_words(pool, l->s_width) * sizeof(uint64_t));
+    ma_mem_free(pool->next_state, pool_words(pool, l->s_width) * sizeof(uint64_t));
+    ma_mem_free(pool->output, pool_words(pool, l->m_width) * sizeof(uint64_t));
+    ma_mem_free(pool->manual_input, pool_words(pool, l->n_width) * sizeof(uint64_t));
+    ma_mem_free(pool->final_input, pool_words(pool, l->n_width) * sizeof(uint64_t));
+    ma_mem_free(pool->connections, pool->count * l->n * sizeof(uint32_t));
+    ma_mem_free(pool, sizeof(ma_pool_t));
+}
+
+/**
+ * @brief Calculates outputs of one block of automata
+ *
+ * @param pool Pool
+ * @param block Index of block of POOL_BLOCK automata
+ */
+static void pool_output_block(ma_pool_t *pool, size_t block)
+{
+    const ma_pool_layout_t *l = &pool->layout;
+    pool->y(pool->output + block * l->m_width, pool->state + block * l->s_width,
+            POOL_BLOCK, l, pool->ctx);
+}
+
+/**
+ * @brief Creates pool of packed tiny automata sharing batch kernels
+ *
+ * @param count Number of automata
+ * @param n Number of inputs of each automaton (0..64)
+ * @param m Number of outputs of each automaton (1..64)
+ * @param s Number of state bits of each automaton (1..64)
+ * @param t Batch transition function
+ * @param y Batch output function
+ * @param ctx User context passed to t and y
+ * @return Pointer to new pool or NULL on error
+ *
+ * @note Fields are rounded up to power-of-two widths so that they never
+ *       straddle words; all states start at zero
+ * @note Kernels are always called on multiples of 64 automata; padding
+ *       automata beyond count have zero state and inputs
+ */
+ma_pool_t *ma_pool_create(size_t count, size_t n, size_t m, size_t s,
+                          ma_batch_transition_t t, ma_batch_output_t y, void *ctx)
+{
+    if (count == 0 || !t || !y || m == 0 || s == 0 ||
+        n > POOL_MAX_BITS || m > POOL_MAX_BITS || s > POOL_MAX_BITS)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (count > SIZE_MAX - POOL_BLOCK || count > SIZE_MAX / POOL_MAX_BITS)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    ma_pool_t *pool = ma_mem_calloc(1, sizeof(ma_pool_t));
+    if (!pool)
+        return NULL;
+
+    pool->count = count;
+    pool->padded = (count + POOL_BLOCK - 1) / POOL_BLOCK * POOL_BLOCK;
+    pool->layout.n = n;
+    pool->layout.m = m;
+    pool->layout.s = s;
+    pool->layout.n_width = field_width(n);
+    pool->layout.m_width = field_width(m);
+    pool->layout.s_width = field_width(s);
+    pool->t = t;
+    pool->y = y;
+    pool->ctx = ctx;
+
+    const ma_pool_layout_t *l = &pool->layout;
+    pool->state = ma_mem_calloc(pool_words(pool, l->s_width), sizeof(uint64_t));
+    pool->next_state = ma_mem_calloc(pool_words(pool, l->s_width), sizeof(uint64_t));
+    pool->output = ma_mem_calloc(pool_words(pool, l->m_width), sizeof(uint64_t));
+    if (!pool->state || !pool->next_state || !pool->output)
+        goto cleanup_fail;
+
+    if (n > 0)
+    {
+        pool->manual_input = ma_mem_calloc(pool_words(pool, l->n_width), sizeof(uint64_t));
+        pool->final_input = ma_mem_calloc(pool_words(pool, l->n_width), sizeof(uint64_t));
+        if (!pool->manual_input || !pool->final_input)
+            goto cleanup_fail;
+    }
+
+    /* Calculate initial outputs */
+    y(pool->output, pool->state, pool->padded, l, ctx);
+    return pool;
+
+cleanup_fail:
+    pool_free(pool);
+    errno = ENOMEM;
+    return NULL;
+}
+
+/**
+ * @brief Deletes pool and frees all memory used by it
+ *
+ * @param pool Pointer to pool (can be NULL)
+ */
+void ma_pool_delete(ma_pool_t *pool)
+{
+    if (pool)
+        pool_free(pool);
+}
+
+/**
+ * @brief Returns field layout of pool
+ *
+ * @param pool Pointer to pool
+ * @return Pointer to layout or NULL on error
+ */
+ma_pool_layout_t const *ma_pool_layout(ma_pool_t const *pool)
+{
+    if (!pool)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return &pool->layout;
+}
+
+/**
+ * @brief Connects inputs of one pooled automaton with outputs of another
+ *
+ * @param pool Pointer to pool
+ * @param dst Index of receiving automaton
+ * @param in Index of first input of dst
+ * @param src Index of sending automaton
+ * @param out Index of first output of src
+ * @param num Number of connected signals
+ * @return 0 on success, -1 on error
+ */
+int ma_pool_connect(ma_pool_t *pool, size_t dst, size_t in, size_t src, size_t out, size_t num)
+{
+    if (!pool || num == 0 || dst >= pool->count || src >= pool->count)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const ma_pool_layout_t *l = &pool->layout;
+    if (in >= l->n || out >= l->m || num > l->n - in || num > l->m - out)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Output bit indices must fit connection entries */
+    if (pool->padded * l->m_width >= POOL_UNCONNECTED)
+    {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    if (!pool->connections)
+    {
+        const size_t entries = pool->count * l->n;
+        pool->connections = ma_mem_alloc(entries * sizeof(uint32_t));
+        if (!pool->connections)
+            return -1;
+        memset(pool->connections, 0xff, entries * sizeof(uint32_t));
+    }
+
+    uint32_t *entry = pool->connections + dst * l->n + in;
+    const size_t first = src * l->m_width + out;
+    for (size_t i = 0; i < num; i++)
+    {
+        if (entry[i] == POOL_UNCONNECTED)
+            pool->connected_bits++;
+        entry[i] = (uint32_t)(first + i);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Disconnects consecutive inputs of pooled automaton
+ *
+ * @param pool Pointer to pool
+ * @param dst Index of automaton
+ * @param in Index of first input to disconnect
+ * @param num Number of inputs to disconnect
+ * @return 0 on success, -1 on error
+ */
+int ma_pool_disconnect(ma_pool_t *pool, size_t dst, size_t in, size_t num)
+{
+    if (!pool || num == 0 || dst >= pool->count ||
+        in >= pool->layout.n || num > pool->layout.n - in)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (!pool->connections)
+        return 0;
+
+    uint32_t *entry = pool->connections + dst * pool->layout.n + in;
+    for (size_t i = 0; i < num; i++)
+    {
+        if (entry[i] != POOL_UNCONNECTED)
+            pool->connected_bits--;
+        entry[i] = POOL_UNCONNECTED;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Sets values of unconnected inputs of pooled automaton
+ *
+ * @param pool Pointer to pool
+ * @param i Index of automaton
+ * @param input Input bits (bit j is input j)
+ * @return 0 on success, -1 on error
+ */
+int ma_pool_set_input(ma_pool_t *pool, size_t i, uint64_t input)
+{
+    if (!pool || i >= pool->count || pool->layout.n == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const unsigned w = pool->layout.n_width;
+    ma_pool_set_field(pool->manual_input, w, i, input & field_mask((unsigned)pool->layout.n));
+    return 0;
+}
+
+/**
+ * @brief Sets state of pooled automaton
+ *
+ * @param pool Pointer to pool
+ * @param i Index of automaton
+ * @param state New state (s bits)
+ * @return 0 on success, -1 on error
+ *
+ * @note Outputs of the block of 64 automata containing i are recalculated
+ */
+int ma_pool_set_state(ma_pool_t *pool, size_t i, uint64_t state)
+{
+    if (!pool || i >= pool->count)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const unsigned s = (unsigned)pool->layout.s;
+    ma_pool_set_field(pool->state, pool->layout.s_width, i, state & field_mask(s));
+    pool_output_block(pool, i / POOL_BLOCK);
+    return 0;
+}
+
+/**
+ * @brief Returns state of pooled automaton
+ *
+ * @param pool Pointer to pool
+ * @param i Index of automaton
+ * @return State bits (0 on error, errno = EINVAL)
+ */
+uint64_t ma_pool_get_state(ma_pool_t const *pool, size_t i)
+{
+    if (!pool || i >= pool->count)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    return ma_pool_get_field(pool->state, pool->layout.s_width, i);
+}
+
+/**
+ * @brief Returns outputs of pooled automaton
+ *
+ * @param pool Pointer to pool
+ * @param i Index of automaton
+ * @return Output bits (0 on error, errno = EINVAL)
+ */
+uint64_t ma_pool_get_output(ma_pool_t const *pool, size_t i)
+{
+    if (!pool || i >= pool->count)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    return ma_pool_get_field(pool->output, pool->layout.m_width, i) &
+           field_mask((unsigned)pool->layout.m);
+}
+
+/**
+ * @brief Gathers inputs of all pooled automata
+ *
+ * @param pool Pool with connections
+ *
+ * @note Connected bits are read straight from packed output fields and
+ *       final input words are assembled in registers
+ */
+static void pool_gather(ma_pool_t *pool)
+{
+    const ma_pool_layout_t *l = &pool->layout;
+    const size_t n = l->n;
+    const unsigned width = l->n_width;
+    const size_t per_word = 64 / width;
+    const uint64_t *output = pool->output;
+
+    for (size_t word = 0; word < pool_words(pool, width); word++)
+    {
+        const size_t first = word * per_word;
+        uint64_t manual = pool->manual_input[word];
+        uint64_t result = manual;
+
+        for (size_t k = 0; k < per_word && first + k < pool->count; k++)
+        {
+            const uint32_t *entry = pool->connections + (first + k) * n;
+            const unsigned base = (unsigned)(k * width);
+
+            for (size_t j = 0; j < n; j++)
+            {
+                const uint32_t bit = entry[j];
+                if (bit == POOL_UNCONNECTED)
+                    continue;
+
+                const uint64_t value = (output[bit / 64] >> (bit % 64)) & 1u;
+                const unsigned pos = base + (unsigned)j;
+                result = (result & ~((uint64_t)1 << pos)) | (value << pos);
+            }
+        }
+
+        pool->final_input[word] = result;
+    }
+}
+
+/**
+ * @brief Executes one simulation step for all automata of pool
+ *
+ * @param pool Pointer to pool
+ * @return 0 on success, -1 on error
+ */
+int ma_pool_step(ma_pool_t *pool)
+{
+    if (!pool)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const ma_pool_layout_t *l = &pool->layout;
+    uint64_t const *input = pool->manual_input;
+
+    /* Without connections manual inputs are final inputs */
+    if (pool->connected_bits > 0)
+    {
+        pool_gather(pool);
+        input = pool->final_input;
+    }
+
+    pool->t(pool->next_state, input, pool->state, pool->padded, l, pool->ctx);
+
+    uint64_t *tmp = pool->state;
+    pool->state = pool->next_state;
+    pool->next_state = tmp;
+
+    pool->y(pool->output, pool->state, pool->padded, l, pool->ctx);
+    return 0;
+}
+
+/**
+ * @brief Reports memory used by pool
+ *
+ * @param pool Pointer to pool
+ * @param usage Report to fill
+ * @return 0 on success, -1 on error
+ *
+ * @note "used" counts meaningful field bits of the count automata
+ */
+int ma_pool_memory_usage(ma_pool_t const *pool, ma_memory_usage_t *usage)
+{
+    if (!pool || !usage)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const ma_pool_layout_t *l = &pool->layout;
+    const size_t s_size = pool_words(pool, l->s_width) * sizeof(uint64_t);
+    const size_t m_size = pool_words(pool, l->m_width) * sizeof(uint64_t);
+    const size_t n_size = pool_words(pool, l->n_width) * sizeof(uint64_t);
+    const size_t s_used = (pool->count * l->s + 7) / 8;
+    const size_t m_used = (pool->count * l->m + 7) / 8;
+    const size_t n_used = (pool->count * l->n + 7) / 8;
+
+    memset(usage, 0, sizeof(*usage));
+    ma_usage_add(&usage->headers, pool, sizeof(ma_pool_t), sizeof(ma_pool_t));
+    ma_usage_add(&usage->state, pool->state, s_size, s_used);
+    ma_usage_add(&usage->state, pool->next_state, s_size, s_used);
+    ma_usage_add(&usage->output, pool->output, m_size, m_used);
+    ma_usage_add(&usage->input, pool->manual_input, n_size, n_used);
+    ma_usage_add(&usage->input, pool->final_input, n_size, n_used);
+    ma_usage_add(&usage->connections, pool->connections, pool->count * l->n * sizeof(uint32_t),
+                 pool->connected_bits * sizeof(uint32_t));
+    ma_usage_total(usage);
+    return 0;
+}
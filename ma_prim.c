@@ -0,0 +1,488 @@
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include "ma.h"
+#include "ma_internal.h"
+
+#define PRIM_MAX_SELECT_BITS 32 /* Largest select field of a mux */
+
+/**
+ * @brief Taps of Galois LFSR (ctx of its automaton)
+ */
+typedef struct
+{
+    size_t words;
+    uint64_t taps[]; /* Feedback mask XORed when bit 0 shifts out */
+} prim_lfsr;
+
+/* Mask of bits of last word of buffer holding bits */
+static inline uint64_t top_mask(size_t bits)
+{
+    return bits % 64 ? ((uint64_t)1 << (bits % 64)) - 1 : ~(uint64_t)0;
+}
+
+/**
+ * @brief Reads len (1..64) bits starting at bit of buffer
+ *
+ * @note Never touches words beyond the last requested bit
+ */
+static inline uint64_t load_bits(uint64_t const *src, size_t bit, size_t len)
+{
+    const size_t w = bit / 64, o = bit % 64;
+    uint64_t value = src[w] >> o;
+    if (o && o + len > 64)
+        value |= src[w + 1] << (64 - o);
+    return len == 64 ? value : value & (((uint64_t)1 << len) - 1);
+}
+
+/**
+ * @brief Counter: inputs enable (bit 0) and reset (bit 1), counts modulo 2^s
+ *
+ * @note The carry stops at the first word that does not wrap
+ */
+void ma_prim_counter(uint64_t *next_state, uint64_t const *input,
+                     uint64_t const *state, size_t n, size_t s)
+{
+    (void)n;
+    const size_t words = (s + 63) / 64;
+
+    if (input[0] & 2)
+    {
+        memset(next_state, 0, words * sizeof(uint64_t));
+        return;
+    }
+
+    memcpy(next_state, state, words * sizeof(uint64_t));
+    if (input[0] & 1)
+    {
+        for (size_t i = 0; i < words && ++next_state[i] == 0; i++)
+            ;
+        next_state[words - 1] &= top_mask(s);
+    }
+}
+
+/**
+ * @brief Shift register: state moves up by n bits, inputs enter at bit 0
+ */
+void ma_prim_shift(uint64_t *next_state, uint64_t const *input,
+                   uint64_t const *state, size_t n, size_t s)
+{
+    const size_t words = (s + 63) / 64;
+    const size_t q = n / 64, r = n % 64;
+
+    for (size_t i = words; i-- > 0;)
+    {
+        uint64_t value = 0;
+        if (i >= q)
+        {
+            value = state[i - q] << r;
+            if (r && i > q)
+                value |= state[i - q - 1] >> (64 - r);
+        }
+        next_state[i] = value;
+    }
+
+    if (n <= 64)
+        next_state[0] |= load_bits(input, 0, n);
+    else
+        ma_copy_bits(next_state, 0, input, 0, n);
+    next_state[words - 1] &= top_mask(s);
+}
+
+/**
+ * @brief Adder: s - 1 bit operands a and b and carry in, s bit sum
+ *
+ * Words are added with a carry chain, one 64-bit addition per word.
+ */
+void ma_prim_adder(uint64_t *next_state, uint64_t const *input,
+                   uint64_t const *state, size_t n, size_t s)
+{
+    (void)state;
+    (void)n;
+    const size_t width = s - 1;
+    const size_t words = (s + 63) / 64;
+    uint64_t carry = load_bits(input, 2 * width, 1);
+
+    for (size_t i = 0; i < words; i++)
+    {
+        const size_t bit = i * 64;
+        if (bit >= width)
+        {
+            next_state[i] = carry;
+            break;
+        }
+
+        const size_t len = width - bit < 64 ? width - bit : 64;
+        const uint64_t a = load_bits(input, bit, len);
+        const uint64_t b = load_bits(input, width + bit, len);
+        const uint64_t sum = a + b;
+        const uint64_t total = sum + carry;
+        next_state[i] = total;
+        carry = len == 64 ? (sum < a) | (total < sum) : 0;
+    }
+}
+
+/**
+ * @brief Comparator: operands a and b of n / 2 bits, state bits lt, eq, gt
+ */
+void ma_prim_comparator(uint64_t *next_state, uint64_t const *input,
+                        uint64_t const *state, size_t n, size_t s)
+{
+    (void)state;
+    (void)s;
+    const size_t width = n / 2;
+    uint64_t result = 2; /* eq */
+
+    for (size_t bit = (width - 1) / 64 * 64;; bit -= 64)
+    {
+        const size_t len = width - bit < 64 ? width - bit : 64;
+        const uint64_t a = load_bits(input, bit, len);
+        const uint64_t b = load_bits(input, width + bit, len);
+        if (a != b)
+        {
+            result = a < b ? 1 : 4;
+            break;
+        }
+        if (bit == 0)
+            break;
+    }
+
+    next_state[0] = result;
+}
+
+/**
+ * @brief Mux: select field, then ways data words of s bits (ctx holds ways)
+ */
+static void prim_mux(uint64_t *next_state, uint64_t const *input,
+                     uint64_t const *state, size_t n, size_t s, void *ctx)
+{
+    (void)state;
+    const size_t ways = (size_t)(uintptr_t)ctx;
+    const size_t select_bits = n - ways * s;
+    const uint64_t select = load_bits(input, 0, select_bits);
+
+    memset(next_state, 0, (s + 63) / 64 * sizeof(uint64_t));
+    if (select < ways)
+        ma_copy_bits(next_state, 0, input, select_bits + select * s, s);
+}
+
+/**
+ * @brief Galois LFSR: shifts down, XORs taps when bit 0 was set
+ */
+static void prim_lfsr_step(uint64_t *next_state, uint64_t const *input,
+                           uint64_t const *state, size_t n, size_t s, void *ctx)
+{
+    (void)input;
+    (void)n;
+    (void)s;
+    prim_lfsr const *lfsr = ctx;
+    const uint64_t feedback = -(state[0] & 1);
+
+    for (size_t i = 0; i < lfsr->words; i++)
+    {
+        uint64_t value = state[i] >> 1;
+        if (i + 1 < lfsr->words)
+            value |= state[i + 1] << 63;
+        next_state[i] = value ^ (lfsr->taps[i] & feedback);
+    }
+}
+
+/* Output of mux and LFSR automata (the state) */
+static void prim_output(uint64_t *output, uint64_t const *state, size_t m, size_t s, void *ctx)
+{
+    (void)ctx;
+    identity_func(output, state, m, s);
+}
+
+/* Frees taps of LFSR (release hook of automaton) */
+static void prim_lfsr_release(void *ctx)
+{
+    prim_lfsr *lfsr = ctx;
+    ma_mem_free(lfsr, sizeof(prim_lfsr) + lfsr->words * sizeof(uint64_t));
+}
+
+/*
+ * Group kernels: a dispatch group of one primitive runs in one loop with
+ * the one-word case inlined and no indirect calls.
+ */
+
+static void group_counter(moore_t *const *group, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        moore_t *a = group[i];
+        if (a->s > 64)
+        {
+            ma_prim_counter(a->next_state, a->input_view, a->state, a->n, a->s);
+            continue;
+        }
+        const uint64_t in = a->input_view[0];
+        const uint64_t next = (a->state[0] + (in & 1)) & top_mask(a->s);
+        a->next_state[0] = in & 2 ? 0 : next;
+    }
+}
+
+static void group_shift(moore_t *const *group, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        moore_t *a = group[i];
+        if (a->s >= 64)
+        {
+            ma_prim_shift(a->next_state, a->input_view, a->state, a->n, a->s);
+            continue;
+        }
+        const uint64_t in = a->input_view[0] & top_mask(a->n);
+        a->next_state[0] = ((a->state[0] << a->n) | in) & top_mask(a->s);
+    }
+}
+
+static void group_adder(moore_t *const *group, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        moore_t *a = group[i];
+        if (a->n > 64)
+        {
+            ma_prim_adder(a->next_state, a->input_view, a->state, a->n, a->s);
+            continue;
+        }
+        const size_t width = a->s - 1;
+        const uint64_t in = a->input_view[0];
+        const uint64_t mask = ((uint64_t)1 << width) - 1;
+        a->next_state[0] = (in & mask) + ((in >> width) & mask) + ((in >> (2 * width)) & 1);
+    }
+}
+
+static void group_comparator(moore_t *const *group, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        moore_t *a = group[i];
+        if (a->n > 64)
+        {
+            ma_prim_comparator(a->next_state, a->input_view, a->state, a->n, a->s);
+            continue;
+        }
+        const size_t width = a->n / 2;
+        const uint64_t mask = top_mask(width);
+        const uint64_t x = a->input_view[0] & mask;
+        const uint64_t y = (a->input_view[0] >> width) & mask;
+        a->next_state[0] = (uint64_t)(x < y) | (uint64_t)(x == y) << 1 | (uint64_t)(x > y) << 2;
+    }
+}
+
+static void group_mux(moore_t *const *group, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        moore_t *a = group[i];
+        prim_mux(a->next_state, a->input_view, a->state, a->n, a->s, a->ctx);
+    }
+}
+
+static void group_lfsr(moore_t *const *group, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        moore_t *a = group[i];
+        prim_lfsr const *lfsr = a->ctx;
+        if (lfsr->words > 1)
+        {
+            prim_lfsr_step(a->next_state, a->input_view, a->state, a->n, a->s, a->ctx);
+            continue;
+        }
+        const uint64_t st = a->state[0];
+        a->next_state[0] = (st >> 1) ^ (lfsr->taps[0] & -(st & 1));
+    }
+}
+
+/**
+ * @brief Returns group kernel of built-in primitive automaton
+ *
+ * @param a Automaton
+ * @return Kernel stepping a whole dispatch group, NULL for other automata
+ */
+ma_group_transition_t ma_prim_group_kernel(moore_t const *a)
+{
+    if (a->t == ma_prim_counter)
+        return group_counter;
+    if (a->t == ma_prim_shift)
+        return group_shift;
+    if (a->t == ma_prim_adder)
+        return group_adder;
+    if (a->t == ma_prim_comparator)
+        return group_comparator;
+    if (a->t_ex == prim_mux)
+        return group_mux;
+    if (a->t_ex == prim_lfsr_step)
+        return group_lfsr;
+    return NULL;
+}
+
+/**
+ * @brief Creates counter with enable and synchronous reset
+ *
+ * @param width Number of counter bits
+ * @return Pointer to new automaton or NULL on error
+ *
+ * @note Input 0 enables counting, input 1 resets to zero (reset wins);
+ *       outputs are the counter bits
+ */
+moore_t *ma_create_counter(size_t width)
+{
+    return ma_create_simple(2, width, ma_prim_counter);
+}
+
+/**
+ * @brief Creates shift register taking lanes bits per step
+ *
+ * @param length Number of register bits
+ * @param lanes Number of inputs shifted in at bit 0 each step (1..length)
+ * @return Pointer to new automaton or NULL on error
+ *
+ * @note Outputs are the register bits; the oldest bits are the highest
+ */
+moore_t *ma_create_shift_register(size_t length, size_t lanes)
+{
+    if (lanes == 0 || lanes > length)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return ma_create_simple(lanes, length, ma_prim_shift);
+}
+
+/**
+ * @brief Creates registered adder
+ *
+ * @param width Number of bits of each operand
+ * @return Pointer to new automaton or NULL on error
+ *
+ * @note Inputs are a (bits 0 .. width - 1), b (width .. 2 * width - 1)
+ *       and carry in (2 * width); outputs are the sum of the previous
+ *       cycle with carry out at bit width
+ */
+moore_t *ma_create_adder(size_t width)
+{
+    if (width == 0 || width > SIZE_MAX / 2 - 1)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return ma_create_simple(2 * width + 1, width + 1, ma_prim_adder);
+}
+
+/**
+ * @brief Creates registered unsigned comparator
+ *
+ * @param width Number of bits of each operand
+ * @return Pointer to new automaton or NULL on error
+ *
+ * @note Inputs are a (bits 0 .. width - 1) and b (width .. 2 * width - 1);
+ *       outputs are a < b, a == b and a > b of the previous cycle
+ */
+moore_t *ma_create_comparator(size_t width)
+{
+    if (width == 0 || width > SIZE_MAX / 2)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    const uint64_t q[] = {2};
+    return ma_create_full(2 * width, 3, 3, ma_prim_comparator, identity_func, q);
+}
+
+/**
+ * @brief Creates registered multiplexer
+ *
+ * @param width Number of bits of each data word
+ * @param ways Number of data words (at least 2)
+ * @return Pointer to new automaton or NULL on error
+ *
+ * @note Inputs are the select field (bits needed to count ways), then
+ *       ways data words; outputs are the selected word of the previous
+ *       cycle (zero if select >= ways)
+ */
+moore_t *ma_create_mux(size_t width, size_t ways)
+{
+    if (width == 0 || ways < 2 || ways > ((size_t)1 << PRIM_MAX_SELECT_BITS) ||
+        width > (SIZE_MAX - PRIM_MAX_SELECT_BITS) / ways)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    size_t select_bits = 1;
+    while (((size_t)1 << select_bits) < ways)
+        select_bits++;
+
+    uint64_t *q_zero = ma_mem_calloc((width + 63) / 64, sizeof(uint64_t));
+    if (!q_zero)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* The number of ways travels in ctx, so no descriptor is allocated */
+    moore_t *a = ma_create_full_ex(select_bits + ways * width, width, width, prim_mux,
+                                   prim_output, q_zero, (void *)(uintptr_t)ways);
+    ma_mem_free(q_zero, (width + 63) / 64 * sizeof(uint64_t));
+    return a;
+}
+
+/**
+ * @brief Creates Galois LFSR without inputs
+ *
+ * @param width Number of register bits
+ * @param taps Feedback mask of width bits (bit width - 1 must be set)
+ * @param seed Initial register value (nonzero)
+ * @return Pointer to new automaton or NULL on error
+ *
+ * @note Each step shifts the register down and XORs taps into it when
+ *       bit 0 shifted out; outputs are the register bits
+ */
+moore_t *ma_create_lfsr(size_t width, uint64_t const *taps, uint64_t const *seed)
+{
+    if (width == 0 || !taps || !seed || width > SIZE_MAX - 63)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    const size_t words = (width + 63) / 64;
+    uint64_t bits = 0;
+    for (size_t i = 0; i < words; i++)
+        bits |= seed[i] & (i + 1 == words ? top_mask(width) : ~(uint64_t)0);
+    if (!bits || !((taps[words - 1] >> ((width - 1) % 64)) & 1) ||
+        (taps[words - 1] & ~top_mask(width)))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    prim_lfsr *lfsr = ma_mem_alloc(sizeof(prim_lfsr) + words * sizeof(uint64_t));
+    if (!lfsr)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    lfsr->words = words;
+    memcpy(lfsr->taps, taps, words * sizeof(uint64_t));
+
+    moore_t *a = ma_create_full_ex(0, width, width, prim_lfsr_step, prim_output, seed, lfsr);
+    if (!a)
+    {
+        prim_lfsr_release(lfsr);
+        return NULL;
+    }
+
+    /* Seed bits above width would otherwise shift into the register */
+    a->state[words - 1] &= top_mask(width);
+    prim_output(a->output, a->state, a->m, a->s, NULL);
+    a->release = prim_lfsr_release;
+    return a;
+}
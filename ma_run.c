@@ -0,0 +1,613 @@
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "ma.h"
+#include "ma_internal.h"
+
+/*
+ * ma-run: streams fixed-width input frames through a saved network.
+ *
+ * Every frame holds ceil(n / 8) bytes for each input automaton (-I, in
+ * order); the network steps once per frame and the selected output bits
+ * (-O) are packed LSB first into an output frame padded to whole bytes.
+ */
+
+#define RUN_BUFFER_SIZE (1u << 20) /* Bytes read or written per system call */
+
+/**
+ * @brief Output bits copied to every output frame
+ */
+typedef struct
+{
+    moore_t *a;
+    size_t bit;
+    size_t len;
+} selection;
+
+/**
+ * @brief State of a streaming run
+ */
+typedef struct
+{
+    moore_t **at;         /* Loaded automata */
+    size_t num;
+    ma_net_t *net;        /* Network stepped on the general path */
+    moore_t **inputs;     /* Automata receiving frame bytes, in frame order */
+    size_t input_count;
+    selection *outputs;   /* Selected output bits, in frame order */
+    size_t output_count;
+    size_t in_frame;      /* Bytes per input frame */
+    size_t out_frame;     /* Bytes per output frame */
+    uint64_t *out_words;  /* Staging buffer of packed output frame */
+    bool fast;            /* Single unconnected automaton stepped without network */
+    bool direct_input;    /* Fast path passes frame words to t without copying */
+    bool direct_output;   /* Output frame is the output buffer of one automaton */
+    int out_fd;
+    unsigned char *out_buf;
+    size_t out_fill;
+    uint64_t frames;
+} runner;
+
+static void usage(FILE *f)
+{
+    fprintf(f,
+            "Usage: ma-run [options] NETWORK\n"
+            "  -i FILE          read input frames from FILE (default: stdin)\n"
+            "  -o FILE          write output frames to FILE (default: stdout)\n"
+            "  -I INDEX         automaton fed by the next ceil(n/8) bytes of each frame\n"
+            "                   (repeatable, default: 0)\n"
+            "  -O INDEX[:BIT[:LEN]]\n"
+            "                   output bits appended to each output frame\n"
+            "                   (repeatable, default: all outputs of the last automaton)\n"
+            "  -k PLUGIN        load kernels from shared object calling ma_register_kernel\n"
+            "                   from its int ma_plugin_init(void)\n"
+            "  -n FRAMES        stop after FRAMES frames (required without inputs)\n"
+            "  -r               print throughput report to stderr\n"
+            "  -h               show this help\n");
+}
+
+/**
+ * @brief Parses unsigned decimal number
+ *
+ * @return 0 on success, -1 on malformed number
+ */
+static int parse_size(char const *text, char **end, size_t *value)
+{
+    if (*text < '0' || *text > '9')
+        return -1;
+
+    errno = 0;
+    unsigned long long v = strtoull(text, end, 10);
+    if (errno || v > SIZE_MAX)
+        return -1;
+    *value = (size_t)v;
+    return 0;
+}
+
+/**
+ * @brief Loads plugin and lets it register its kernels
+ *
+ * @return 0 on success, -1 on error (reported to stderr)
+ */
+static int load_plugin(char const *path)
+{
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle)
+    {
+        fprintf(stderr, "ma-run: %s\n", dlerror());
+        return -1;
+    }
+
+    int (*init)(void) = (int (*)(void))dlsym(handle, "ma_plugin_init");
+    if (!init)
+    {
+        fprintf(stderr, "ma-run: %s: no ma_plugin_init\n", path);
+        return -1;
+    }
+    if (init() != 0)
+    {
+        fprintf(stderr, "ma-run: %s: ma_plugin_init failed\n", path);
+        return -1;
+    }
+
+    /* Handle stays open: registered kernels point into the plugin */
+    return 0;
+}
+
+/**
+ * @brief Writes whole buffer to descriptor
+ *
+ * @return 0 on success, -1 on error
+ */
+static int write_all(int fd, unsigned char const *buf, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t written = write(fd, buf, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += written;
+        size -= (size_t)written;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads until buffer is full or input ends
+ *
+ * @return Number of bytes read or -1 on error
+ */
+static ssize_t read_full(int fd, unsigned char *buf, size_t size)
+{
+    size_t total = 0;
+    while (total < size)
+    {
+        const ssize_t got = read(fd, buf + total, size - total);
+        if (got < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (got == 0)
+            break;
+        total += (size_t)got;
+    }
+    return (ssize_t)total;
+}
+
+/**
+ * @brief Copies frame bytes to manual inputs of automaton
+ */
+static inline void load_input(moore_t *a, unsigned char const *frame)
+{
+    const size_t bytes = (a->n + 7) / 8;
+    a->manual_input[(a->n - 1) / 64] = 0;
+    memcpy(a->manual_input, frame, bytes);
+    if (a->n % 64)
+        a->manual_input[(a->n - 1) / 64] &= ((uint64_t)1 << (a->n % 64)) - 1;
+}
+
+/**
+ * @brief Steps network on one input frame and appends output frame
+ *
+ * @return 0 on success, -1 on step or write error
+ */
+static inline int run_frame(runner *r, unsigned char const *frame)
+{
+    if (r->fast)
+    {
+        /* Same transition/commit as ma_step for an automaton without sources */
+        moore_t *a = r->at[0];
+        uint64_t const *input = a->manual_input;
+        if (r->direct_input)
+            input = (uint64_t const *)frame;
+        else if (r->input_count)
+            load_input(a, frame);
+
+        a->t(a->next_state, input, a->state, a->n, a->s);
+        uint64_t *state = a->state;
+        a->state = a->next_state;
+        a->next_state = state;
+        a->y(a->output, a->state, a->m, a->s);
+    }
+    else
+    {
+        for (size_t i = 0; i < r->input_count; i++)
+        {
+            load_input(r->inputs[i], frame);
+            frame += (r->inputs[i]->n + 7) / 8;
+        }
+        if (ma_net_step(r->net) != 0)
+        {
+            fprintf(stderr, "ma-run: step failed at frame %llu\n", (unsigned long long)r->frames);
+            return -1;
+        }
+    }
+
+    if (RUN_BUFFER_SIZE - r->out_fill < r->out_frame)
+    {
+        if (write_all(r->out_fd, r->out_buf, r->out_fill) != 0)
+            return -1;
+        r->out_fill = 0;
+    }
+
+    if (r->direct_output)
+    {
+        memcpy(r->out_buf + r->out_fill, r->outputs[0].a->output, r->out_frame);
+    }
+    else
+    {
+        size_t bit = 0;
+        for (size_t i = 0; i < r->output_count; i++)
+        {
+            selection const *sel = &r->outputs[i];
+            ma_copy_bits(r->out_words, bit, sel->a->output, sel->bit, sel->len);
+            bit += sel->len;
+        }
+        memcpy(r->out_buf + r->out_fill, r->out_words, r->out_frame);
+    }
+
+    r->out_fill += r->out_frame;
+    r->frames++;
+    return 0;
+}
+
+/**
+ * @brief Runs frames of a memory-mapped input file
+ *
+ * @return 0 on success, -1 on error
+ */
+static int run_mapped(runner *r, unsigned char const *data, size_t size, uint64_t limit)
+{
+    const uint64_t frames = r->in_frame ? size / r->in_frame : limit;
+    const uint64_t count = frames < limit ? frames : limit;
+
+    for (uint64_t f = 0; f < count; f++)
+    {
+        if (run_frame(r, data + f * r->in_frame) != 0)
+            return -1;
+    }
+
+    if (r->in_frame && count == frames && size % r->in_frame)
+        fprintf(stderr, "ma-run: ignoring %zu trailing bytes\n", size % r->in_frame);
+    return 0;
+}
+
+/**
+ * @brief Runs frames read from a pipe or other non-mappable descriptor
+ *
+ * @return 0 on success, -1 on error
+ */
+static int run_stream(runner *r, int fd, uint64_t limit)
+{
+    const size_t frames_per_buffer = r->in_frame < RUN_BUFFER_SIZE ? RUN_BUFFER_SIZE / r->in_frame : 1;
+    const size_t capacity = frames_per_buffer * r->in_frame;
+    unsigned char *buf = aligned_alloc(64, (capacity + 63) & ~(size_t)63);
+    if (!buf)
+        return -1;
+
+    size_t fill = 0;
+    while (r->frames < limit)
+    {
+        const ssize_t got = read_full(fd, buf + fill, capacity - fill);
+        if (got < 0)
+        {
+            free(buf);
+            return -1;
+        }
+        fill += (size_t)got;
+
+        const size_t frames = fill / r->in_frame;
+        for (size_t f = 0; f < frames && r->frames < limit; f++)
+        {
+            if (run_frame(r, buf + f * r->in_frame) != 0)
+            {
+                free(buf);
+                return -1;
+            }
+        }
+
+        /* read_full only leaves the buffer short at end of input */
+        if (fill < capacity)
+        {
+            if (fill % r->in_frame && r->frames < limit)
+                fprintf(stderr, "ma-run: ignoring %zu trailing bytes\n", fill % r->in_frame);
+            break;
+        }
+        fill = 0;
+    }
+
+    free(buf);
+    return 0;
+}
+
+/**
+ * @brief Parses output selection INDEX[:BIT[:LEN]]
+ *
+ * @return 0 on success, -1 on malformed or out-of-range selection
+ */
+static int parse_selection(char const *text, moore_t **at, size_t num, selection *sel)
+{
+    char *end;
+    size_t index, bit = 0, len = 0;
+    if (parse_size(text, &end, &index) != 0 || index >= num)
+        return -1;
+
+    const size_t m = at[index]->m;
+    len = m;
+    if (*end == ':')
+    {
+        if (parse_size(end + 1, &end, &bit) != 0 || bit >= m)
+            return -1;
+        len = m - bit;
+        if (*end == ':' && (parse_size(end + 1, &end, &len) != 0 || len == 0 || len > m - bit))
+            return -1;
+    }
+    if (*end != '\0')
+        return -1;
+
+    *sel = (selection){at[index], bit, len};
+    return 0;
+}
+
+/**
+ * @brief Checks whether automaton has any connected input
+ */
+static bool has_sources(moore_t const *a)
+{
+    for (size_t i = 0; i < a->n; i++)
+    {
+        if (a->incoming_connections[i].source_automaton)
+            return true;
+    }
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    char const *in_path = NULL, *out_path = NULL;
+    char const **input_args = NULL, **output_args = NULL;
+    size_t input_args_count = 0, output_args_count = 0;
+    uint64_t limit = UINT64_MAX;
+    bool report = false;
+    runner r = {0};
+    int status = 1;
+    int opt;
+
+    input_args = calloc((size_t)argc, sizeof(char *));
+    output_args = calloc((size_t)argc, sizeof(char *));
+    if (!input_args || !output_args)
+    {
+        perror("ma-run");
+        goto cleanup;
+    }
+
+    while ((opt = getopt(argc, argv, "i:o:I:O:k:n:rh")) != -1)
+    {
+        size_t value;
+        char *end;
+        switch (opt)
+        {
+        case 'i':
+            in_path = optarg;
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'I':
+            input_args[input_args_count++] = optarg;
+            break;
+        case 'O':
+            output_args[output_args_count++] = optarg;
+            break;
+        case 'k':
+            if (load_plugin(optarg) != 0)
+                goto cleanup;
+            break;
+        case 'n':
+            if (parse_size(optarg, &end, &value) != 0 || *end != '\0')
+            {
+                usage(stderr);
+                status = 2;
+                goto cleanup;
+            }
+            limit = value;
+            break;
+        case 'r':
+            report = true;
+            break;
+        case 'h':
+            usage(stdout);
+            status = 0;
+            goto cleanup;
+        default:
+            usage(stderr);
+            status = 2;
+            goto cleanup;
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        usage(stderr);
+        status = 2;
+        goto cleanup;
+    }
+
+    FILE *net_file = fopen(argv[optind], "rb");
+    if (!net_file)
+    {
+        perror(argv[optind]);
+        goto cleanup;
+    }
+
+    r.at = ma_load_network(net_file, &r.num);
+    fclose(net_file);
+    if (!r.at)
+    {
+        fprintf(stderr, "ma-run: %s: %s\n", argv[optind],
+                errno == ENOENT   ? "unknown kernel (missing -k plugin?)"
+                : errno == EINVAL ? "not a valid network file"
+                                  : strerror(errno));
+        goto cleanup;
+    }
+
+    r.inputs = calloc(input_args_count ? input_args_count : 1, sizeof(moore_t *));
+    r.outputs = calloc(output_args_count ? output_args_count : 1, sizeof(selection));
+    r.out_buf = aligned_alloc(64, RUN_BUFFER_SIZE);
+    if (!r.inputs || !r.outputs || !r.out_buf)
+    {
+        perror("ma-run");
+        goto cleanup;
+    }
+
+    /* Input automata (default: first automaton if it has inputs) */
+    for (size_t i = 0; i < input_args_count; i++)
+    {
+        char *end;
+        size_t index;
+        if (parse_size(input_args[i], &end, &index) != 0 || *end != '\0' ||
+            index >= r.num || r.at[index]->n == 0)
+        {
+            fprintf(stderr, "ma-run: bad input automaton '%s'\n", input_args[i]);
+            goto cleanup;
+        }
+        r.inputs[r.input_count++] = r.at[index];
+    }
+    if (input_args_count == 0 && r.at[0]->n > 0)
+        r.inputs[r.input_count++] = r.at[0];
+
+    for (size_t i = 0; i < r.input_count; i++)
+        r.in_frame += (r.inputs[i]->n + 7) / 8;
+
+    if (r.in_frame == 0 && limit == UINT64_MAX)
+    {
+        fprintf(stderr, "ma-run: network has no inputs, use -n\n");
+        goto cleanup;
+    }
+
+    /* Output selections (default: all outputs of last automaton) */
+    for (size_t i = 0; i < output_args_count; i++)
+    {
+        if (parse_selection(output_args[i], r.at, r.num, &r.outputs[r.output_count++]) != 0)
+        {
+            fprintf(stderr, "ma-run: bad output selection '%s'\n", output_args[i]);
+            goto cleanup;
+        }
+    }
+    if (output_args_count == 0)
+        r.outputs[r.output_count++] = (selection){r.at[r.num - 1], 0, r.at[r.num - 1]->m};
+
+    size_t out_bits = 0;
+    for (size_t i = 0; i < r.output_count; i++)
+        out_bits += r.outputs[i].len;
+    r.out_frame = (out_bits + 7) / 8;
+    if (r.out_frame > RUN_BUFFER_SIZE)
+    {
+        fprintf(stderr, "ma-run: output frame too large\n");
+        goto cleanup;
+    }
+
+    r.out_words = calloc((out_bits + 63) / 64, sizeof(uint64_t));
+    if (!r.out_words)
+    {
+        perror("ma-run");
+        goto cleanup;
+    }
+
+    /* Choose fast path for one automaton without sources */
+    r.fast = r.num == 1 && !has_sources(r.at[0]) && r.at[0]->t && r.at[0]->y;
+    r.direct_input = r.fast && r.input_count == 1 && r.at[0]->n % 64 == 0;
+    r.direct_output = r.output_count == 1 && r.outputs[0].bit == 0 && r.outputs[0].len % 8 == 0;
+    if (!r.fast)
+    {
+        r.net = ma_net_create(r.at, r.num, MA_NET_GROUP_DISPATCH);
+        if (!r.net)
+        {
+            perror("ma-run");
+            goto cleanup;
+        }
+    }
+
+    int in_fd = in_path ? open(in_path, O_RDONLY) : STDIN_FILENO;
+    if (in_fd < 0)
+    {
+        perror(in_path);
+        goto cleanup;
+    }
+    r.out_fd = out_path ? open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDOUT_FILENO;
+    if (r.out_fd < 0)
+    {
+        perror(out_path);
+        if (in_path)
+            close(in_fd);
+        goto cleanup;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* Regular files are mapped, everything else is read in large blocks */
+    struct stat st;
+    int result;
+    if (r.in_frame == 0)
+    {
+        result = run_mapped(&r, NULL, 0, limit);
+    }
+    else if (fstat(in_fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, in_fd, 0);
+        if (data == MAP_FAILED)
+        {
+            result = run_stream(&r, in_fd, limit);
+        }
+        else
+        {
+            madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+            result = run_mapped(&r, data, (size_t)st.st_size, limit);
+            munmap(data, (size_t)st.st_size);
+        }
+    }
+    else
+    {
+        result = run_stream(&r, in_fd, limit);
+    }
+
+    if (result == 0)
+        result = write_all(r.out_fd, r.out_buf, r.out_fill);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (in_path)
+        close(in_fd);
+    if (out_path && close(r.out_fd) != 0)
+        result = -1;
+
+    if (result != 0)
+    {
+        perror("ma-run");
+        goto cleanup;
+    }
+
+    if (report)
+    {
+        const double seconds = (double)(end.tv_sec - start.tv_sec) +
+                               (double)(end.tv_nsec - start.tv_nsec) * 1e-9;
+        const double in_bytes = (double)r.frames * (double)r.in_frame;
+        const double out_bytes = (double)r.frames * (double)r.out_frame;
+        fprintf(stderr,
+                "ma-run: %llu frames in %.3f s (%s path): %.2f Mframes/s, "
+                "in %.1f MB/s, out %.1f MB/s\n",
+                (unsigned long long)r.frames, seconds, r.fast ? "fast" : "network",
+                seconds > 0 ? (double)r.frames / seconds * 1e-6 : 0.0,
+                seconds > 0 ? in_bytes / seconds * 1e-6 : 0.0,
+                seconds > 0 ? out_bytes / seconds * 1e-6 : 0.0);
+    }
+    status = 0;
+
+cleanup:
+    ma_net_delete(r.net);
+    ma_free_network(r.at, r.num);
+    free(r.out_words);
+    free(r.out_buf);
+    free(r.outputs);
+    free(r.inputs);
+    free(output_args);
+    free(input_args);
+    return status;
+}
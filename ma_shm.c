@@ -0,0 +1,484 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ma.h"
+#include "ma_internal.h"
+#include "ma_shm.h"
+
+#define SHM_ALIGN 64 /* Alignment of entry table and output area */
+
+/**
+ * @brief Structure representing an export of outputs to shared memory
+ *
+ * Output buffers of exported automata live inside the mapping, so y
+ * writes them there directly; the network seqlock is the header counter.
+ */
+struct ma_shm
+{
+    ma_net_t *net;   /* Network whose steps rewrite the outputs */
+    char *name;      /* Name given to shm_open */
+    size_t name_size;
+    void *base;      /* Mapping of the region */
+    size_t size;     /* Size of mapping */
+    moore_t **at;    /* Exported automata */
+    size_t num;      /* Number of exported automata */
+    pid_t creator;   /* Process which created the region (the only one unlinking it) */
+};
+
+/**
+ * @brief Structure representing a read-only mapping of an exported region
+ */
+struct ma_shm_reader
+{
+    void *base;                     /* Mapping of the region */
+    size_t size;                    /* Size of mapping */
+    ma_shm_header_t const *header;  /* Header at start of region */
+    ma_shm_entry_t const *entries;  /* One entry per exported automaton */
+};
+
+/**
+ * @brief Rounds size up to multiple of SHM_ALIGN
+ */
+static inline size_t shm_align(size_t size)
+{
+    return (size + SHM_ALIGN - 1) & ~(size_t)(SHM_ALIGN - 1);
+}
+
+/**
+ * @brief Forces sinks of automaton to rebuild their gather plans
+ *
+ * @param a Automaton whose output buffer moved
+ *
+ * @note Plans of MA_INPUT_SHARED sinks may point into the old buffer
+ */
+static void invalidate_sinks(moore_t *a)
+{
+    for (size_t i = 0; i < a->connected_to_me_count; i++)
+    {
+        if (a->connected_to_me[i])
+            a->connected_to_me[i]->plan_dirty = true;
+    }
+}
+
+/**
+ * @brief Moves output buffers of automata into a named shared-memory region
+ *
+ * @param net Network stepping the automata (its steps update the header seqlock)
+ * @param name Name of POSIX shared-memory object (e.g. "/ma_outputs")
+ * @param at Automata of net whose outputs are exported (pass the array given
+ *           to ma_net_create to export all of them)
+ * @param num Number of automata in array
+ * @return Pointer to export or NULL on error
+ *
+ * @note Outputs are written in place by y, so readers get them with zero
+ *       copy; entries follow the order of at
+ * @note Step exported automata only with ma_net_step of net; delete the
+ *       export before the network and the automata
+ * @note errno is EBUSY if an automaton is exported twice or its outputs
+ *       already live in another shared mapping, EEXIST if a region named
+ *       name already exists (a live export is never truncated)
+ */
+ma_shm_t *ma_shm_export(ma_net_t *net, char const *name, moore_t *const at[], size_t num)
+{
+    if (!net || !name || !at || num == 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < num; i++)
+    {
+        if (!at[i])
+        {
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+
+    /* Mark automata, rejecting duplicates and already exported ones */
+    for (size_t i = 0; i < num; i++)
+    {
+        if (at[i]->external & MA_EXTERNAL_OUTPUT)
+        {
+            for (size_t j = 0; j < i; j++)
+                at[j]->external &= ~MA_EXTERNAL_OUTPUT;
+            errno = EBUSY;
+            return NULL;
+        }
+        at[i]->external |= MA_EXTERNAL_OUTPUT;
+    }
+
+    /* Compute layout */
+    const size_t entries_offset = shm_align(sizeof(ma_shm_header_t));
+    const size_t data_offset = shm_align(entries_offset + num * sizeof(ma_shm_entry_t));
+    size_t size = data_offset;
+    for (size_t i = 0; i < num; i++)
+        size += (at[i]->m + 63) / 64 * sizeof(uint64_t);
+
+    int fd = -1;
+    ma_shm_t *shm = ma_mem_calloc(1, sizeof(ma_shm_t));
+    if (!shm)
+    {
+        errno = ENOMEM;
+        goto cleanup_fail;
+    }
+
+    shm->name_size = strlen(name) + 1;
+    shm->name = ma_mem_alloc(shm->name_size);
+    shm->at = ma_mem_alloc(num * sizeof(moore_t *));
+    if (!shm->name || !shm->at)
+    {
+        errno = ENOMEM;
+        goto cleanup_fail;
+    }
+    memcpy(shm->name, name, shm->name_size);
+    memcpy(shm->at, at, num * sizeof(moore_t *));
+    shm->num = num;
+    shm->net = net;
+    shm->size = size;
+    shm->creator = getpid();
+
+    /* Create and map region, failing if another export owns the name */
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+        goto cleanup_fail;
+    if (ftruncate(fd, (off_t)size) != 0)
+        goto cleanup_unlink;
+
+    shm->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm->base == MAP_FAILED)
+    {
+        shm->base = NULL;
+        goto cleanup_unlink;
+    }
+    close(fd);
+
+    /* Fill header and move outputs */
+    ma_shm_header_t *header = shm->base;
+    ma_shm_entry_t *entries = (ma_shm_entry_t *)((char *)shm->base + entries_offset);
+    header->version = MA_SHM_VERSION;
+    header->size = size;
+    header->count = num;
+    header->entries_offset = entries_offset;
+
+    size_t offset = data_offset;
+    for (size_t i = 0; i < num; i++)
+    {
+        moore_t *a = at[i];
+        const size_t m_size = (a->m + 63) / 64 * sizeof(uint64_t);
+        uint64_t *output = (uint64_t *)((char *)shm->base + offset);
+
+        memcpy(output, a->output, m_size);
+        ma_mem_free(a->output, m_size);
+        a->output = output;
+        invalidate_sinks(a);
+
+        entries[i].bits = a->m;
+        entries[i].offset = offset;
+        offset += m_size;
+    }
+
+    /* Network steps now bracket their commit phase with the header counter */
+    ma_net_set_sequence(net, &header->seq);
+    atomic_store_explicit(&header->magic, MA_SHM_MAGIC, memory_order_release);
+    return shm;
+
+cleanup_unlink:
+    {
+        const int saved = errno;
+        close(fd);
+        shm_unlink(name);
+        errno = saved;
+    }
+cleanup_fail:
+    for (size_t i = 0; i < num; i++)
+        at[i]->external &= ~MA_EXTERNAL_OUTPUT;
+    if (shm)
+    {
+        ma_mem_free(shm->name, shm->name_size);
+        ma_mem_free(shm->at, num * sizeof(moore_t *));
+        ma_mem_free(shm, sizeof(ma_shm_t));
+    }
+    return NULL;
+}
+
+/**
+ * @brief Moves outputs back to private buffers and removes shared-memory region
+ *
+ * @param shm Pointer to export (can be NULL)
+ * @return 0 on success, -1 on error (export stays intact)
+ *
+ * @note Readers which still map the region see the last outputs, but its
+ *       counter stops advancing
+ * @note The name is unlinked only by the process which created the region;
+ *       a forked child deleting its copy just unmaps it
+ */
+int ma_shm_delete(ma_shm_t *shm)
+{
+    if (!shm)
+        return 0;
+
+    /* Allocate all private buffers first so failure changes nothing */
+    uint64_t **outputs = ma_mem_calloc(shm->num, sizeof(uint64_t *));
+    if (!outputs)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for (size_t i = 0; i < shm->num; i++)
+    {
+        outputs[i] = ma_mem_alloc((shm->at[i]->m + 63) / 64 * sizeof(uint64_t));
+        if (!outputs[i])
+        {
+            for (size_t j = 0; j < i; j++)
+                ma_mem_free(outputs[j], (shm->at[j]->m + 63) / 64 * sizeof(uint64_t));
+            ma_mem_free(outputs, shm->num * sizeof(uint64_t *));
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    ma_net_set_sequence(shm->net, NULL);
+
+    for (size_t i = 0; i < shm->num; i++)
+    {
+        moore_t *a = shm->at[i];
+        memcpy(outputs[i], a->output, (a->m + 63) / 64 * sizeof(uint64_t));
+        a->output = outputs[i];
+        a->external &= ~MA_EXTERNAL_OUTPUT;
+        invalidate_sinks(a);
+    }
+
+    munmap(shm->base, shm->size);
+    if (shm->creator == getpid())
+        shm_unlink(shm->name);
+    ma_mem_free(outputs, shm->num * sizeof(uint64_t *));
+    ma_mem_free(shm->name, shm->name_size);
+    ma_mem_free(shm->at, shm->num * sizeof(moore_t *));
+    ma_mem_free(shm, sizeof(ma_shm_t));
+    return 0;
+}
+
+/**
+ * @brief Maps region exported by ma_shm_export (usually in another process)
+ *
+ * @param name Name given to ma_shm_export
+ * @return Pointer to reader or NULL on error
+ *
+ * @note errno is EAGAIN if the writer has not finished initializing the
+ *       region, EPROTO if its layout is not recognized
+ */
+ma_shm_reader_t *ma_shm_open(char const *name)
+{
+    if (!name)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    const int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    const size_t size = (size_t)st.st_size;
+    if (size < sizeof(ma_shm_header_t))
+    {
+        close(fd);
+        errno = EAGAIN;
+        return NULL;
+    }
+
+    void *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    ma_shm_header_t const *header = base;
+    if (atomic_load_explicit(&header->magic, memory_order_acquire) != MA_SHM_MAGIC)
+    {
+        munmap(base, size);
+        errno = EAGAIN;
+        return NULL;
+    }
+
+    /* Validate layout before trusting any offset */
+    ma_shm_entry_t const *entries = (ma_shm_entry_t const *)((char const *)base + header->entries_offset);
+    bool valid = header->version == MA_SHM_VERSION && header->size == size &&
+                 header->entries_offset <= size &&
+                 header->count <= (size - header->entries_offset) / sizeof(ma_shm_entry_t);
+    for (size_t i = 0; valid && i < header->count; i++)
+    {
+        const uint64_t words = (entries[i].bits + 63) / 64;
+        valid = entries[i].offset % sizeof(uint64_t) == 0 && entries[i].offset <= size &&
+                words <= (size - entries[i].offset) / sizeof(uint64_t);
+    }
+
+    if (!valid)
+    {
+        munmap(base, size);
+        errno = EPROTO;
+        return NULL;
+    }
+
+    ma_shm_reader_t *reader = ma_mem_alloc(sizeof(ma_shm_reader_t));
+    if (!reader)
+    {
+        munmap(base, size);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    reader->base = base;
+    reader->size = size;
+    reader->header = header;
+    reader->entries = entries;
+    return reader;
+}
+
+/**
+ * @brief Unmaps region and frees reader
+ *
+ * @param reader Pointer to reader (can be NULL)
+ */
+void ma_shm_close(ma_shm_reader_t *reader)
+{
+    if (!reader)
+        return;
+
+    munmap(reader->base, reader->size);
+    ma_mem_free(reader, sizeof(ma_shm_reader_t));
+}
+
+/**
+ * @brief Returns number of exported automata
+ *
+ * @param reader Pointer to reader
+ * @return Number of automata (0 on error)
+ */
+size_t ma_shm_count(ma_shm_reader_t const *reader)
+{
+    if (!reader)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    return reader->header->count;
+}
+
+/**
+ * @brief Returns number of outputs of exported automaton
+ *
+ * @param reader Pointer to reader
+ * @param i Index of automaton (order of array given to ma_shm_export)
+ * @return Number of output bits (0 on error)
+ */
+size_t ma_shm_bits(ma_shm_reader_t const *reader, size_t i)
+{
+    if (!reader || i >= reader->header->count)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    return reader->entries[i].bits;
+}
+
+/**
+ * @brief Returns pointer to outputs of exported automaton inside the region
+ *
+ * @param reader Pointer to reader
+ * @param i Index of automaton
+ * @return Pointer to output words or NULL on error
+ *
+ * @note Zero copy: read between ma_shm_read_begin and ma_shm_read_retry
+ *       to get values of one cycle
+ */
+uint64_t const *ma_shm_output(ma_shm_reader_t const *reader, size_t i)
+{
+    if (!reader || i >= reader->header->count)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return (uint64_t const *)((char const *)reader->base + reader->entries[i].offset);
+}
+
+/**
+ * @brief Starts consistent read of exported outputs
+ *
+ * @param reader Pointer to reader
+ * @return Sequence value to pass to ma_shm_read_retry (cycle is value / 2)
+ *
+ * @note Spins while the writer is in its commit phase; no system calls
+ */
+uint64_t ma_shm_read_begin(ma_shm_reader_t const *reader)
+{
+    uint64_t seq;
+    while ((seq = atomic_load_explicit(&reader->header->seq, memory_order_acquire)) & 1)
+        MA_CPU_RELAX();
+    return seq;
+}
+
+/**
+ * @brief Checks whether outputs read since ma_shm_read_begin may be torn
+ *
+ * @param reader Pointer to reader
+ * @param begin Value returned by ma_shm_read_begin
+ * @return true if the read must be repeated
+ */
+bool ma_shm_read_retry(ma_shm_reader_t const *reader, uint64_t begin)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&reader->header->seq, memory_order_relaxed) != begin;
+}
+
+/**
+ * @brief Copies consistent snapshot of all exported outputs
+ *
+ * @param reader Pointer to reader
+ * @param dst Buffer receiving outputs one after another, each taking
+ *            (bits + 63) / 64 words
+ * @param cycle If not NULL, receives number of the step which produced them
+ * @return 0 on success, -1 on error
+ */
+int ma_shm_read(ma_shm_reader_t const *reader, uint64_t *dst, uint64_t *cycle)
+{
+    if (!reader || !dst)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint64_t begin;
+    do
+    {
+        begin = ma_shm_read_begin(reader);
+
+        uint64_t *out = dst;
+        for (size_t i = 0; i < reader->header->count; i++)
+        {
+            const size_t words = (reader->entries[i].bits + 63) / 64;
+            memcpy(out, ma_shm_output(reader, i), words * sizeof(uint64_t));
+            out += words;
+        }
+    } while (ma_shm_read_retry(reader, begin));
+
+    if (cycle)
+        *cycle = begin / 2;
+    return 0;
+}
@@ -0,0 +1,57 @@
+#ifndef MA_SHM_H
+#define MA_SHM_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ma.h"
+
+// Layout of a shared-memory output region (all offsets in bytes from its start)
+#define MA_SHM_MAGIC 0x4d415348u /* "MASH", stored last when the region is ready */
+#define MA_SHM_VERSION 1u
+
+typedef struct
+{
+    _Atomic uint32_t magic;   /* MA_SHM_MAGIC once initialized */
+    uint32_t version;         /* MA_SHM_VERSION */
+    uint64_t size;            /* Size of region */
+    uint64_t count;           /* Number of exported automata */
+    uint64_t entries_offset;  /* Offset of ma_shm_entry_t array */
+    uint64_t reserved[4];
+    _Atomic uint64_t seq;     /* Seqlock: odd while outputs are rewritten, cycle = seq / 2 */
+} ma_shm_header_t;
+
+typedef struct
+{
+    uint64_t bits;   /* Number of outputs (m) */
+    uint64_t offset; /* Offset of output words */
+} ma_shm_entry_t;
+
+// Writer: places outputs of at[0..num) (automata of net) in a region named name
+typedef struct ma_shm ma_shm_t;
+
+ma_shm_t *ma_shm_export(ma_net_t *net, char const *name, moore_t *const at[], size_t num);
+
+int ma_shm_delete(ma_shm_t *shm);
+
+// Reader library for other processes (does not need the network)
+typedef struct ma_shm_reader ma_shm_reader_t;
+
+ma_shm_reader_t *ma_shm_open(char const *name);
+
+void ma_shm_close(ma_shm_reader_t *reader);
+
+size_t ma_shm_count(ma_shm_reader_t const *reader);
+
+size_t ma_shm_bits(ma_shm_reader_t const *reader, size_t i);
+
+uint64_t const *ma_shm_output(ma_shm_reader_t const *reader, size_t i);
+
+uint64_t ma_shm_read_begin(ma_shm_reader_t const *reader);
+
+bool ma_shm_read_retry(ma_shm_reader_t const *reader, uint64_t begin);
+
+int ma_shm_read(ma_shm_reader_t const *reader, uint64_t *dst, uint64_t *cycle);
+
+#endif
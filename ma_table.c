@@ -0,0 +1,954 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "ma.h"
+#include "ma_internal.h"
+
+#define TABLE_MAX_N 16            /* Largest input width (symbols are uint16_t) */
+#define TABLE_MAX_S 16            /* Largest state width (entries are uint16_t) */
+#define TABLE_MAX_INDEX_BITS 24   /* Largest s + k * n of any table */
+#define TABLE_MAX_STRIDE 4        /* Symbols consumed per lookup of widest table */
+#define TABLE_DEFAULT_L2 (256u << 10) /* Assumed L2 size if sysconf does not know */
+#define TABLE_MIN_CHUNK (1u << 16)    /* Fewest symbols per thread of ma_table_run_parallel */
+#define TABLE_MAX_THREADS 256
+#define TABLE_SHUFFLE_MAX_S 6     /* Largest s with a byte table for shuffle backends */
+#define TABLE_SHUFFLE_PAD 128     /* Readable bytes past byte table (full-register loads) */
+#define TABLE_CONVERGE_CHECK 64   /* Symbols between convergence checks of shuffle maps */
+
+/* Instruction sets used by shuffle backends, best last */
+enum
+{
+    TABLE_SIMD_NONE,
+    TABLE_SIMD_SSSE3, /* pshufb, 16 states */
+    TABLE_SIMD_AVX2,  /* vpshufb on 32 instances */
+    TABLE_SIMD_VBMI   /* vpermb/vpermi2b, 64 and 128 entries */
+};
+
+/**
+ * @brief Structure representing an automaton tabulated over all states and inputs
+ *
+ * next[k] maps (state << (k * n)) | symbols to the state reached after
+ * the k packed symbols (first symbol in the lowest bits). Only strides 1
+ * and the selected one are built.
+ */
+struct ma_table
+{
+    size_t n, m, s;                          /* Inputs, outputs and state bits */
+    uint16_t *next[TABLE_MAX_STRIDE + 1];    /* Stride tables (next[1] always present) */
+    uint64_t *out;                           /* Output of each state */
+    uint8_t *bytes;                          /* Next state of [input << s | state] (s <= 6, else NULL) */
+    size_t stride;                           /* Symbols consumed per lookup by ma_table_run */
+    uint16_t state;                          /* Current state */
+};
+
+/**
+ * @brief Size of stride-k table in bytes
+ */
+static inline size_t stride_bytes(ma_table_t const *table, size_t k)
+{
+    return ((size_t)1 << (table->s + k * table->n)) * sizeof(uint16_t);
+}
+
+/**
+ * @brief Frees table and its arrays
+ *
+ * @param table Table (can be NULL)
+ */
+void ma_table_delete(ma_table_t *table)
+{
+    if (!table)
+        return;
+
+    for (size_t k = 1; k <= TABLE_MAX_STRIDE; k++)
+        ma_mem_free(table->next[k], table->next[k] ? stride_bytes(table, k) : 0);
+    ma_mem_free(table->out, ((size_t)1 << table->s) * sizeof(uint64_t));
+    ma_mem_free(table->bytes, ((size_t)1 << (table->n + table->s)) + TABLE_SHUFFLE_PAD);
+    ma_mem_free(table, sizeof(ma_table_t));
+}
+
+/**
+ * @brief Tabulates automaton by calling t and y for every state and input
+ *
+ * @param n Number of inputs (at most 16)
+ * @param m Number of outputs (at most 64)
+ * @param s Number of state bits (at most 16, n + s at most 24)
+ * @param t Transition function
+ * @param y Output function
+ * @param q Initial state
+ * @return Pointer to new table or NULL on error
+ *
+ * @note t and y are only called here; they must not depend on anything
+ *       but their arguments
+ */
+ma_table_t *ma_table_create(size_t n, size_t m, size_t s, transition_function_t t,
+                            output_function_t y, uint64_t q)
+{
+    if (!t || !y || n == 0 || n > TABLE_MAX_N || m == 0 || m > 64 || s == 0 ||
+        s > TABLE_MAX_S || n + s > TABLE_MAX_INDEX_BITS || q >> s)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ma_table_t *table = ma_mem_calloc(1, sizeof(ma_table_t));
+    if (!table)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    table->n = n;
+    table->m = m;
+    table->s = s;
+    table->stride = 1;
+    table->state = (uint16_t)q;
+
+    const size_t states = (size_t)1 << s, symbols = (size_t)1 << n;
+    table->next[1] = ma_mem_alloc(stride_bytes(table, 1));
+    table->out = ma_mem_alloc(states * sizeof(uint64_t));
+    if (!table->next[1] || !table->out)
+    {
+        ma_table_delete(table);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    for (size_t st = 0; st < states; st++)
+    {
+        const uint64_t state = st;
+        for (size_t in = 0; in < symbols; in++)
+        {
+            const uint64_t input = in;
+            uint64_t next = 0;
+            t(&next, &input, &state, n, s);
+            table->next[1][(st << n) | in] = (uint16_t)(next & (states - 1));
+        }
+
+        uint64_t output = 0;
+        y(&output, &state, m, s);
+        table->out[st] = m == 64 ? output : output & (((uint64_t)1 << m) - 1);
+    }
+
+    /* Rows of the byte table are the state maps of single symbols */
+    if (s <= TABLE_SHUFFLE_MAX_S)
+    {
+        table->bytes = ma_mem_calloc(((size_t)1 << (n + s)) + TABLE_SHUFFLE_PAD, 1);
+        if (!table->bytes)
+        {
+            ma_table_delete(table);
+            errno = ENOMEM;
+            return NULL;
+        }
+        for (size_t st = 0; st < states; st++)
+            for (size_t in = 0; in < symbols; in++)
+                table->bytes[(in << s) | st] = (uint8_t)table->next[1][(st << n) | in];
+    }
+
+    return table;
+}
+
+/**
+ * @brief Builds stride-2k table by composing two stride-k lookups
+ *
+ * @return 0 on success, -1 on error
+ */
+static int build_stride(ma_table_t *table, size_t k2)
+{
+    if (table->next[k2])
+        return 0;
+
+    const size_t k = k2 / 2;
+    if (build_stride(table, k) != 0)
+        return -1;
+
+    uint16_t *next = ma_mem_alloc(stride_bytes(table, k2));
+    if (!next)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    /* Entry [st][hi][lo] = next_k[next_k[st][lo]][hi] */
+    const size_t half = k * table->n;
+    const size_t states = (size_t)1 << table->s, words = (size_t)1 << half;
+    uint16_t const *prev = table->next[k];
+    for (size_t st = 0; st < states; st++)
+    {
+        uint16_t *block = next + (st << (2 * half));
+        for (size_t lo = 0; lo < words; lo++)
+        {
+            uint16_t const *row = prev + ((size_t)prev[(st << half) | lo] << half);
+            for (size_t hi = 0; hi < words; hi++)
+                block[(hi << half) | lo] = row[hi];
+        }
+    }
+
+    table->next[k2] = next;
+    return 0;
+}
+
+/**
+ * @brief Chooses stride from table sizes and the L2 cache size
+ *
+ * A composed table replaces k dependent loads by one, which pays off
+ * while it stays cache resident: the widest stride whose table fits in
+ * half of L2 is taken.
+ */
+static size_t auto_stride(ma_table_t const *table)
+{
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    const size_t budget = (l2 > 0 ? (size_t)l2 : TABLE_DEFAULT_L2) / 2;
+
+    for (size_t k = TABLE_MAX_STRIDE; k > 1; k /= 2)
+    {
+        if (table->s + k * table->n <= TABLE_MAX_INDEX_BITS && stride_bytes(table, k) <= budget)
+            return k;
+    }
+    return 1;
+}
+
+/**
+ * @brief Selects number of symbols consumed per table lookup
+ *
+ * @param table Table
+ * @param k 1, 2 or 4, or 0 to choose from n, s and the L2 size
+ * @return 0 on success, -1 on error (EINVAL if s + k * n exceeds 24)
+ *
+ * @note Composed tables are built here, so the call may take a while
+ */
+int ma_table_set_stride(ma_table_t *table, size_t k)
+{
+    if (!table || (k != 0 && k != 1 && k != 2 && k != 4))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (k == 0)
+        k = auto_stride(table);
+    if (table->s + k * table->n > TABLE_MAX_INDEX_BITS)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (k > 1 && build_stride(table, k) != 0)
+        return -1;
+
+    table->stride = k;
+    return 0;
+}
+
+/**
+ * @brief Returns number of symbols consumed per lookup (0 on error)
+ */
+size_t ma_table_stride(ma_table_t const *table)
+{
+    return table ? table->stride : 0;
+}
+
+/**
+ * @brief Sets current state of table automaton
+ *
+ * @return 0 on success, -1 on error
+ */
+int ma_table_set_state(ma_table_t *table, uint64_t state)
+{
+    if (!table || state >> table->s)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    table->state = (uint16_t)state;
+    return 0;
+}
+
+/**
+ * @brief Returns current state (0 if table is NULL)
+ */
+uint64_t ma_table_get_state(ma_table_t const *table)
+{
+    return table ? table->state : 0;
+}
+
+/**
+ * @brief Returns output of current state (0 if table is NULL)
+ */
+uint64_t ma_table_get_output(ma_table_t const *table)
+{
+    return table ? table->out[table->state] : 0;
+}
+
+/**
+ * @brief Runs dependent chain of lookups from given state
+ *
+ * @param table Table
+ * @param state Start state
+ * @param input Input symbols
+ * @param count Number of symbols
+ * @param output Receives output after each symbol (or NULL)
+ * @return State after the last symbol
+ *
+ * @note With stride k only every k-th state is on the dependent chain;
+ *       intermediate outputs are recomputed from it with independent
+ *       single-step lookups
+ */
+static size_t run_chain(ma_table_t const *table, size_t state, uint16_t const *input,
+                        size_t count, uint64_t *output)
+{
+    const size_t n = table->n, k = table->stride;
+    const uint32_t symbol_mask = ((uint32_t)1 << n) - 1;
+    uint16_t const *next1 = table->next[1];
+    uint64_t const *out = table->out;
+    size_t i = 0;
+
+    if (k > 1)
+    {
+        uint16_t const *nextk = table->next[k];
+        for (; i + k <= count; i += k)
+        {
+            size_t packed = 0;
+            for (size_t j = 0; j < k; j++)
+                packed |= (size_t)(input[i + j] & symbol_mask) << (j * n);
+
+            if (output)
+            {
+                size_t st = state;
+                for (size_t j = 0; j + 1 < k; j++)
+                {
+                    st = next1[(st << n) | (input[i + j] & symbol_mask)];
+                    output[i + j] = out[st];
+                }
+            }
+
+            state = nextk[(state << (k * n)) | packed];
+            if (output)
+                output[i + k - 1] = out[state];
+        }
+    }
+
+    for (; i < count; i++)
+    {
+        state = next1[(state << n) | (input[i] & symbol_mask)];
+        if (output)
+            output[i] = out[state];
+    }
+
+    return state;
+}
+
+/**
+ * @brief Consumes a stream of input symbols, one ma_step per symbol
+ *
+ * @param table Table
+ * @param input Input vectors (bits above n are ignored)
+ * @param count Number of symbols
+ * @param output Receives output after each symbol (NULL if only the final
+ *               state is needed)
+ * @return 0 on success, -1 on error
+ */
+int ma_table_run(ma_table_t *table, uint16_t const *input, size_t count, uint64_t *output)
+{
+    if (!table || (!input && count > 0))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    table->state = (uint16_t)run_chain(table, table->state, input, count, output);
+    return 0;
+}
+
+/**
+ * @brief Chunk of a stream processed by one thread of ma_table_run_parallel
+ *
+ * Chunks other than the first do not know their start state, so they
+ * run every state at once and merge those that meet; active[slot[q]] is
+ * the state reached from start state q. Once a single state is left the
+ * rest of the chunk no longer depends on the start state and is run as
+ * one chain, writing outputs.
+ */
+typedef struct
+{
+    ma_table_t const *table;
+    uint16_t const *input;   /* First symbol of chunk */
+    size_t count;            /* Symbols in chunk */
+    uint64_t *output;        /* Outputs of chunk (or NULL) */
+    size_t start;            /* Start state (known for first chunk, else set before replay) */
+    bool known;              /* Start state known in phase one */
+    uint16_t *active;        /* Distinct states still followed */
+    uint16_t *slot;          /* Index in active of each start state */
+    uint32_t *seen;          /* Merge scratch: index of state in new active set */
+    uint16_t *remap;         /* Merge scratch: new index of each active entry */
+    size_t active_count;
+    size_t converged;        /* Symbols consumed before one state was left */
+    bool resolved;           /* Map is known (else the chunk is run sequentially) */
+} stream_chunk;
+
+/**
+ * @brief Merges equal active states of chunk
+ */
+static void merge_active(stream_chunk *chunk, size_t states)
+{
+    uint16_t *remap = chunk->remap;
+    size_t count = 0;
+
+    for (size_t j = 0; j < chunk->active_count; j++)
+    {
+        const uint16_t st = chunk->active[j];
+        if (chunk->seen[st] == UINT32_MAX)
+        {
+            chunk->seen[st] = (uint32_t)count;
+            chunk->active[count++] = st;
+        }
+        remap[j] = (uint16_t)chunk->seen[st];
+    }
+
+    for (size_t j = 0; j < count; j++)
+        chunk->seen[chunk->active[j]] = UINT32_MAX;
+    for (size_t q = 0; q < states; q++)
+        chunk->slot[q] = remap[chunk->slot[q]];
+    chunk->active_count = count;
+}
+
+/**
+ * @brief Stores state map computed by a shuffle backend in chunk
+ *
+ * @param chunk Chunk
+ * @param map State reached from each start state
+ * @param pos Symbols consumed when the map was taken
+ * @param merged All start states reached the same state
+ */
+static void finish_map(stream_chunk *chunk, uint8_t const *map, size_t pos, bool merged)
+{
+    const size_t states = (size_t)1 << chunk->table->s;
+
+    chunk->resolved = true;
+    if (merged)
+    {
+        chunk->converged = pos;
+        chunk->active_count = 1;
+        chunk->active[0] = (uint16_t)run_chain(chunk->table, map[0], chunk->input + pos,
+                                               chunk->count - pos,
+                                               chunk->output ? chunk->output + pos : NULL);
+        return;
+    }
+
+    for (size_t q = 0; q < states; q++)
+    {
+        chunk->active[q] = map[q];
+        chunk->slot[q] = (uint16_t)q;
+    }
+    chunk->active_count = states;
+    chunk->converged = chunk->count;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static _Atomic int simd_level = -1;             /* Cached result of CPU check */
+static _Atomic int simd_cap = TABLE_SIMD_VBMI; /* Best level allowed by ma_table_cap_simd */
+
+/**
+ * @brief Returns best instruction set usable by shuffle backends (checked once)
+ *
+ * @note Called by worker threads of ma_table_run_parallel; concurrent
+ *       first calls store the same value
+ */
+static int table_simd_level(void)
+{
+    int level = atomic_load_explicit(&simd_level, memory_order_relaxed);
+    if (level < 0)
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("avx512bw"))
+            level = TABLE_SIMD_VBMI;
+        else if (__builtin_cpu_supports("avx2"))
+            level = TABLE_SIMD_AVX2;
+        else if (__builtin_cpu_supports("ssse3"))
+            level = TABLE_SIMD_SSSE3;
+        else
+            level = TABLE_SIMD_NONE;
+        atomic_store_explicit(&simd_level, level, memory_order_relaxed);
+    }
+    const int cap = atomic_load_explicit(&simd_cap, memory_order_relaxed);
+    return level < cap ? level : cap;
+}
+#endif
+
+/**
+ * @brief Limits instruction set of shuffle backends (for tests)
+ *
+ * @param level Best level allowed (0 for scalar lookups, negative for no limit)
+ * @return Level now used (never above what the CPU supports)
+ */
+int ma_table_cap_simd(int level)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    atomic_store_explicit(&simd_cap, level < 0 ? TABLE_SIMD_VBMI : level, memory_order_relaxed);
+    return table_simd_level();
+#else
+    (void)level;
+    return TABLE_SIMD_NONE;
+#endif
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * @brief Computes state map of chunk for up to 16 states with pshufb
+ *
+ * Byte q of the register holds the state reached from start state q, so
+ * one shuffle by the row of each symbol advances all start states; the
+ * chain has the latency of pshufb instead of a dependent load.
+ */
+__attribute__((target("ssse3"))) static void shuffle_map_ssse3(stream_chunk *chunk)
+{
+    ma_table_t const *table = chunk->table;
+    const size_t s = table->s;
+    const uint32_t symbol_mask = ((uint32_t)1 << table->n) - 1;
+    const int lanes = (1 << ((size_t)1 << s)) - 1;
+    uint8_t const *bytes = table->bytes;
+
+    __m128i map = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    bool merged = false;
+    size_t pos = 0;
+    while (pos < chunk->count && !merged)
+    {
+        const size_t end = chunk->count - pos < TABLE_CONVERGE_CHECK ? chunk->count
+                                                                     : pos + TABLE_CONVERGE_CHECK;
+        for (; pos < end; pos++)
+        {
+            const size_t row = (size_t)(chunk->input[pos] & symbol_mask) << s;
+            map = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *)(bytes + row)), map);
+        }
+
+        const __m128i first = _mm_shuffle_epi8(map, _mm_setzero_si128());
+        merged = (_mm_movemask_epi8(_mm_cmpeq_epi8(map, first)) & lanes) == lanes;
+    }
+
+    uint8_t result[16];
+    _mm_storeu_si128((__m128i *)result, map);
+    finish_map(chunk, result, pos, merged);
+}
+
+/**
+ * @brief Computes state map of chunk for up to 64 states with vpermb
+ */
+__attribute__((target("avx512f,avx512bw,avx512vbmi"))) static void shuffle_map_vbmi(stream_chunk *chunk)
+{
+    static const uint8_t identity[64] = {
+        0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15,
+        16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+        32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47,
+        48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63};
+    ma_table_t const *table = chunk->table;
+    const size_t s = table->s, states = (size_t)1 << s;
+    const uint32_t symbol_mask = ((uint32_t)1 << table->n) - 1;
+    const uint64_t lanes = states == 64 ? ~(uint64_t)0 : ((uint64_t)1 << states) - 1;
+    uint8_t const *bytes = table->bytes;
+
+    __m512i map = _mm512_loadu_si512(identity);
+    bool merged = false;
+    size_t pos = 0;
+    while (pos < chunk->count && !merged)
+    {
+        const size_t end = chunk->count - pos < TABLE_CONVERGE_CHECK ? chunk->count
+                                                                     : pos + TABLE_CONVERGE_CHECK;
+        for (; pos < end; pos++)
+        {
+            const size_t row = (size_t)(chunk->input[pos] & symbol_mask) << s;
+            map = _mm512_permutexvar_epi8(map, _mm512_loadu_si512(bytes + row));
+        }
+
+        const __m512i first = _mm512_permutexvar_epi8(_mm512_setzero_si512(), map);
+        merged = (_mm512_cmpeq_epi8_mask(map, first) & lanes) == lanes;
+    }
+
+    uint8_t result[64];
+    _mm512_storeu_si512(result, map);
+    finish_map(chunk, result, pos, merged);
+}
+#endif
+
+/**
+ * @brief Computes state map of chunk with a shuffle backend if one applies
+ *
+ * @return true if the map was computed
+ */
+static bool shuffle_map(stream_chunk *chunk)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    const size_t s = chunk->table->s;
+    const int level = table_simd_level();
+    if (s <= 4 && level >= TABLE_SIMD_SSSE3)
+    {
+        shuffle_map_ssse3(chunk);
+        return true;
+    }
+    if (s <= TABLE_SHUFFLE_MAX_S && level >= TABLE_SIMD_VBMI)
+    {
+        shuffle_map_vbmi(chunk);
+        return true;
+    }
+#else
+    (void)chunk;
+#endif
+    return false;
+}
+
+/**
+ * @brief Phase one: computes state map of chunk (or runs it if start is known)
+ */
+static void *stream_map(void *arg)
+{
+    stream_chunk *chunk = arg;
+    ma_table_t const *table = chunk->table;
+
+    if (chunk->known)
+    {
+        chunk->active[0] = (uint16_t)run_chain(table, chunk->start, chunk->input,
+                                               chunk->count, chunk->output);
+        chunk->converged = 0;
+        chunk->resolved = true;
+        return NULL;
+    }
+
+    if (shuffle_map(chunk))
+        return NULL;
+
+    const size_t n = table->n, states = (size_t)1 << table->s;
+    const uint32_t symbol_mask = ((uint32_t)1 << n) - 1;
+    uint16_t const *next1 = table->next[1];
+
+    for (size_t q = 0; q < states; q++)
+    {
+        chunk->active[q] = (uint16_t)q;
+        chunk->slot[q] = (uint16_t)q;
+        chunk->seen[q] = UINT32_MAX;
+    }
+    chunk->active_count = states;
+
+    /* Merging costs O(states), so it waits until stepping did as much work.
+       Following more states than the chunk is long costs more than running
+       it sequentially later, so the map is then abandoned. */
+    size_t pos = 0, work = 0, since_merge = 0;
+    while (pos < chunk->count && chunk->active_count > 1)
+    {
+        if (work > chunk->count)
+        {
+            chunk->resolved = false;
+            return NULL;
+        }
+
+        const size_t symbol = chunk->input[pos++] & symbol_mask;
+        for (size_t j = 0; j < chunk->active_count; j++)
+            chunk->active[j] = next1[((size_t)chunk->active[j] << n) | symbol];
+
+        work += chunk->active_count;
+        since_merge += chunk->active_count;
+        if (since_merge >= states)
+        {
+            merge_active(chunk, states);
+            since_merge = 0;
+        }
+    }
+
+    chunk->resolved = true;
+    chunk->converged = pos;
+    if (chunk->active_count == 1)
+        chunk->active[0] = (uint16_t)run_chain(table, chunk->active[0], chunk->input + pos,
+                                               chunk->count - pos,
+                                               chunk->output ? chunk->output + pos : NULL);
+    return NULL;
+}
+
+/**
+ * @brief Phase two: writes outputs of chunk up to the point where it converged
+ */
+static void *stream_replay(void *arg)
+{
+    stream_chunk *chunk = arg;
+    run_chain(chunk->table, chunk->start, chunk->input, chunk->converged, chunk->output);
+    return NULL;
+}
+
+/**
+ * @brief Runs function on all chunks, chunk 0 in the calling thread
+ *
+ * @note A chunk whose thread cannot be created runs in the calling thread
+ */
+static void run_chunks(stream_chunk *chunks, size_t count, void *(*fn)(void *))
+{
+    pthread_t threads[count];
+    bool started[count];
+
+    for (size_t c = 1; c < count; c++)
+        started[c] = pthread_create(&threads[c], NULL, fn, &chunks[c]) == 0;
+
+    fn(&chunks[0]);
+    for (size_t c = 1; c < count; c++)
+    {
+        if (started[c])
+            pthread_join(threads[c], NULL);
+        else
+            fn(&chunks[c]);
+    }
+}
+
+/**
+ * @brief Consumes a long stream of input symbols using several threads
+ *
+ * The stream is split into chunks; every chunk but the first computes
+ * its state -> state map by following all start states at once until
+ * they merge. The maps are composed in order to find each chunk's start
+ * state, and only the parts run before merging are replayed for outputs.
+ *
+ * @param table Table
+ * @param input Input vectors (bits above n are ignored)
+ * @param count Number of symbols
+ * @param output Receives output after each symbol (or NULL)
+ * @param threads Number of threads (0 for number of online CPUs)
+ * @return 0 on success, -1 on error
+ *
+ * @note Results equal ma_table_run; scaling is near linear when states
+ *       merge quickly (typical for DFA-style automata). Chunks whose
+ *       states do not merge within the work of one sequential pass over
+ *       them are run sequentially, so each thread wastes at most that much
+ */
+int ma_table_run_parallel(ma_table_t *table, uint16_t const *input, size_t count,
+                          uint64_t *output, size_t threads)
+{
+    if (!table || (!input && count > 0))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (threads == 0)
+    {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if (threads > count / TABLE_MIN_CHUNK)
+        threads = count / TABLE_MIN_CHUNK;
+    if (threads > TABLE_MAX_THREADS)
+        threads = TABLE_MAX_THREADS;
+    if (threads <= 1)
+        return ma_table_run(table, input, count, output);
+
+    const size_t states = (size_t)1 << table->s;
+    const size_t per_chunk = states * (3 * sizeof(uint16_t) + sizeof(uint32_t));
+    stream_chunk *chunks = ma_mem_calloc(threads, sizeof(stream_chunk));
+    uint8_t *scratch = ma_mem_alloc(threads * per_chunk);
+    if (!chunks || !scratch)
+    {
+        ma_mem_free(chunks, threads * sizeof(stream_chunk));
+        ma_mem_free(scratch, threads * per_chunk);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for (size_t c = 0; c < threads; c++)
+    {
+        const size_t first = count / threads * c;
+        const size_t last = c + 1 == threads ? count : count / threads * (c + 1);
+        uint8_t *base = scratch + c * per_chunk;
+        chunks[c] = (stream_chunk){
+            .table = table,
+            .input = input + first,
+            .count = last - first,
+            .output = output ? output + first : NULL,
+            .start = table->state,
+            .known = c == 0,
+            .seen = (uint32_t *)base,
+            .active = (uint16_t *)(base + states * sizeof(uint32_t)),
+            .slot = (uint16_t *)(base + states * (sizeof(uint32_t) + sizeof(uint16_t))),
+            .remap = (uint16_t *)(base + states * (sizeof(uint32_t) + 2 * sizeof(uint16_t))),
+        };
+    }
+
+    run_chunks(chunks, threads, stream_map);
+
+    /* Compose maps: end state of chunk c is the start state of chunk c + 1 */
+    size_t state = chunks[0].active[0];
+    for (size_t c = 1; c < threads; c++)
+    {
+        stream_chunk *chunk = &chunks[c];
+        chunk->start = state;
+        if (!chunk->resolved)
+        {
+            state = run_chain(table, state, chunk->input, chunk->count, chunk->output);
+            chunk->converged = 0;
+        }
+        else if (chunk->active_count == 1)
+        {
+            state = chunk->active[0];
+        }
+        else
+        {
+            state = chunk->active[chunk->slot[state]];
+        }
+    }
+
+    if (output)
+        run_chunks(chunks + 1, threads - 1, stream_replay);
+
+    table->state = (uint16_t)state;
+    ma_mem_free(chunks, threads * sizeof(stream_chunk));
+    ma_mem_free(scratch, threads * per_chunk);
+    return 0;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * @brief Steps 16 instances at a time with pshufb (s <= 4, n <= 4)
+ *
+ * Every symbol value shuffles its row by the states and the instances
+ * reading that symbol take the result.
+ *
+ * @return Number of instances stepped
+ */
+__attribute__((target("ssse3"))) static size_t step_many_ssse3(ma_table_t const *table,
+                                                               uint8_t *states,
+                                                               uint8_t const *input,
+                                                               size_t count)
+{
+    const size_t s = table->s, symbols = (size_t)1 << table->n;
+    const __m128i state_mask = _mm_set1_epi8((char)((1 << s) - 1));
+    const __m128i symbol_mask = _mm_set1_epi8((char)(symbols - 1));
+    __m128i rows[16];
+    for (size_t v = 0; v < symbols; v++)
+        rows[v] = _mm_loadu_si128((__m128i const *)(table->bytes + (v << s)));
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i st = _mm_and_si128(_mm_loadu_si128((__m128i const *)(states + i)), state_mask);
+        const __m128i in = _mm_and_si128(_mm_loadu_si128((__m128i const *)(input + i)), symbol_mask);
+        __m128i next = _mm_setzero_si128();
+        for (size_t v = 0; v < symbols; v++)
+        {
+            const __m128i take = _mm_cmpeq_epi8(in, _mm_set1_epi8((char)v));
+            next = _mm_or_si128(next, _mm_and_si128(take, _mm_shuffle_epi8(rows[v], st)));
+        }
+        _mm_storeu_si128((__m128i *)(states + i), next);
+    }
+    return i;
+}
+
+/**
+ * @brief Steps 32 instances at a time with vpshufb (s <= 4, n <= 4)
+ *
+ * @return Number of instances stepped
+ */
+__attribute__((target("avx2"))) static size_t step_many_avx2(ma_table_t const *table,
+                                                             uint8_t *states,
+                                                             uint8_t const *input,
+                                                             size_t count)
+{
+    const size_t s = table->s, symbols = (size_t)1 << table->n;
+    const __m256i state_mask = _mm256_set1_epi8((char)((1 << s) - 1));
+    const __m256i symbol_mask = _mm256_set1_epi8((char)(symbols - 1));
+    __m256i rows[16];
+    for (size_t v = 0; v < symbols; v++)
+        rows[v] = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i const *)(table->bytes + (v << s))));
+
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        const __m256i st = _mm256_and_si256(_mm256_loadu_si256((__m256i const *)(states + i)), state_mask);
+        const __m256i in = _mm256_and_si256(_mm256_loadu_si256((__m256i const *)(input + i)), symbol_mask);
+        __m256i next = _mm256_setzero_si256();
+        for (size_t v = 0; v < symbols; v++)
+        {
+            const __m256i take = _mm256_cmpeq_epi8(in, _mm256_set1_epi8((char)v));
+            next = _mm256_blendv_epi8(next, _mm256_shuffle_epi8(rows[v], st), take);
+        }
+        _mm256_storeu_si256((__m256i *)(states + i), next);
+    }
+    return i;
+}
+
+/**
+ * @brief Steps 64 instances at a time with one vpermi2b (n + s <= 7)
+ *
+ * The index (input << s) | state selects the entry of the whole
+ * 128-byte table directly.
+ *
+ * @return Number of instances stepped
+ */
+__attribute__((target("avx512f,avx512bw,avx512vbmi"))) static size_t step_many_vbmi(ma_table_t const *table,
+                                                                                    uint8_t *states,
+                                                                                    uint8_t const *input,
+                                                                                    size_t count)
+{
+    const size_t s = table->s;
+    const __m512i state_mask = _mm512_set1_epi8((char)((1 << s) - 1));
+    const __m512i symbol_mask = _mm512_set1_epi8((char)((1 << table->n) - 1));
+    const __m512i low = _mm512_loadu_si512(table->bytes);
+    const __m512i high = _mm512_loadu_si512(table->bytes + 64);
+
+    size_t i = 0;
+    for (; i + 64 <= count; i += 64)
+    {
+        const __m512i st = _mm512_and_si512(_mm512_loadu_si512(states + i), state_mask);
+        const __m512i in = _mm512_and_si512(_mm512_loadu_si512(input + i), symbol_mask);
+        /* Byte values stay below 128, so 16-bit shifts do not cross bytes */
+        const __m512i index = _mm512_or_si512(_mm512_slli_epi16(in, (unsigned)s), st);
+        _mm512_storeu_si512(states + i, _mm512_permutex2var_epi8(low, index, high));
+    }
+    return i;
+}
+#endif
+
+/**
+ * @brief Steps many instances of a table automaton once, each with its own input
+ *
+ * @param table Table (n and s at most 8)
+ * @param states States of instances (bytes, updated)
+ * @param input Input symbol of each instance (bits above n are ignored)
+ * @param count Number of instances
+ * @param output Receives output of each instance after the step (or NULL)
+ * @return 0 on success, -1 on error
+ *
+ * @note Uses byte shuffles when available (AVX-512 VBMI for n + s <= 7,
+ *       AVX2 or SSSE3 for s <= 4 and n <= 4), otherwise scalar lookups;
+ *       the state of the table itself is not changed
+ */
+int ma_table_step_many(ma_table_t const *table, uint8_t *states, uint8_t const *input,
+                       size_t count, uint64_t *output)
+{
+    if (!table || table->n > 8 || table->s > 8 || (count > 0 && (!states || !input)))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const size_t n = table->n, s = table->s;
+    size_t i = 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+    const int level = table_simd_level();
+    if (table->bytes && level >= TABLE_SIMD_VBMI && n + s <= 7)
+        i = step_many_vbmi(table, states, input, count);
+    else if (table->bytes && level >= TABLE_SIMD_AVX2 && s <= 4 && n <= 4)
+        i = step_many_avx2(table, states, input, count);
+    else if (table->bytes && level >= TABLE_SIMD_SSSE3 && s <= 4 && n <= 4)
+        i = step_many_ssse3(table, states, input, count);
+#endif
+
+    const size_t state_mask = ((size_t)1 << s) - 1, symbol_mask = ((size_t)1 << n) - 1;
+    for (; i < count; i++)
+        states[i] = (uint8_t)table->next[1][((states[i] & state_mask) << n) | (input[i] & symbol_mask)];
+
+    if (output)
+    {
+        for (size_t j = 0; j < count; j++)
+            output[j] = table->out[states[j]];
+    }
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef MA_TEST_H
+#define MA_TEST_H
+
+#include <stdio.h>
+
+/* Number of failed checks, reported by TEST_DONE */
+static int test_failures;
+
+#define CHECK(cond)                                                                \
+    do                                                                             \
+    {                                                                              \
+        if (!(cond))                                                               \
+        {                                                                          \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++;                                                       \
+        }                                                                          \
+    } while (0)
+
+/* Ends main: prints summary and returns exit status */
+#define TEST_DONE()                                                                \
+    do                                                                             \
+    {                                                                              \
+        printf("%s: %s\n", __FILE__, test_failures ? "FAILED" : "ok");             \
+        return test_failures ? 1 : 0;                                              \
+    } while (0)
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * Allocation hooks: threads creating, stepping and deleting independent
+ * automata from the huge page pool leave no live blocks behind, so the
+ * allocator can be switched back afterwards.
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include "ma.h"
+#include "test.h"
+
+#define THREADS 4
+#define ROUNDS 2000
+
+static void increment(uint64_t *next_state, uint64_t const *input, uint64_t const *state,
+                      size_t n, size_t s)
+{
+    (void)input;
+    (void)n;
+    (void)s;
+    next_state[0] = state[0] + 1;
+}
+
+/* Returns number of wrong results */
+static void *churn(void *arg)
+{
+    (void)arg;
+    uintptr_t errors = 0;
+    for (size_t r = 0; r < ROUNDS; r++)
+    {
+        /* Sizes spread over small and medium classes */
+        moore_t *at[2] = {ma_create_simple(0, 64 * (1 + r % 40), increment),
+                          ma_create_simple(64, 64 * (1 + r % 300), increment)};
+        if (!at[0] || !at[1] || ma_connect(at[1], 0, at[0], 0, 64) != 0)
+            return (void *)(uintptr_t)ROUNDS;
+        for (size_t c = 0; c < 3; c++)
+            ma_step(at, 2);
+        errors += ma_get_output(at[0])[0] != 3 || ma_get_output(at[1])[0] != 3;
+        ma_delete(at[0]);
+        ma_delete(at[1]);
+    }
+    return (void *)errors;
+}
+
+int main(void)
+{
+    CHECK(ma_set_hugepages(MA_HUGEPAGES_TRANSPARENT) == 0);
+
+    pthread_t threads[THREADS];
+    for (size_t i = 0; i < THREADS; i++)
+        CHECK(pthread_create(&threads[i], NULL, churn, NULL) == 0);
+    for (size_t i = 0; i < THREADS; i++)
+    {
+        void *errors;
+        pthread_join(threads[i], &errors);
+        CHECK(errors == NULL);
+    }
+
+    /* Succeeds only if the live block count returned to zero */
+    CHECK(ma_set_hugepages(MA_HUGEPAGES_OFF) == 0);
+    TEST_DONE();
+}
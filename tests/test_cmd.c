@@ -0,0 +1,58 @@
+/*
+ * Command buffers: ma_exec runs recorded inputs, steps and output copies
+ * like the direct calls, and a watch that fires returns its 1-based
+ * index in the buffer (also for output bits past the first word).
+ */
+#include <stdint.h>
+#include "ma.h"
+#include "test.h"
+
+int main(void)
+{
+    /* 70-bit counter three steps before carrying into bit 64 */
+    moore_t *a = ma_create_counter(70);
+    CHECK(a != NULL);
+    const uint64_t start[2] = {~(uint64_t)0 - 2, 0};
+    CHECK(ma_set_state(a, start) == 0);
+
+    ma_cmd_t *cmd = ma_cmd_create();
+    CHECK(cmd != NULL);
+    CHECK(ma_cmd_set_input(cmd, a, 0) == 0);
+    CHECK(ma_cmd_step(cmd, &a, 1, 1) == 0);
+    CHECK(ma_cmd_watch(cmd, a, 64, 1) == 0);
+    CHECK(ma_cmd_get_output(cmd, a, 1) == 0);
+
+    size_t in_words, out_words;
+    CHECK(ma_cmd_buffer_sizes(cmd, &in_words, &out_words) == 0);
+    CHECK(in_words == 1 && out_words == 3);
+
+    /* Enable counting; the watch (third command) fires on the third run */
+    const uint64_t in[1] = {1};
+    uint64_t out[3] = {0, 0, 0};
+    CHECK(ma_exec(cmd, in, out) == 0 && out[1] == ~(uint64_t)0 - 1 && out[2] == 0);
+    CHECK(ma_exec(cmd, in, out) == 0 && out[1] == ~(uint64_t)0 && out[2] == 0);
+    CHECK(ma_exec(cmd, in, out) == 3);
+    /* Stopped before copying outputs */
+    CHECK(out[1] == ~(uint64_t)0 && out[2] == 0);
+    CHECK(ma_get_output(a)[0] == 0 && ma_get_output(a)[1] == 1);
+
+    /* Network steps: bit 0 alternates, the watch for 0 is the second command */
+    ma_net_t *net = ma_net_create(&a, 1, 0);
+    CHECK(net != NULL);
+    ma_cmd_clear(cmd);
+    CHECK(ma_cmd_net_step(cmd, net, 1) == 0);
+    CHECK(ma_cmd_watch(cmd, a, 0, 0) == 0);
+    CHECK(ma_cmd_get_output(cmd, a, 0) == 0);
+    CHECK(ma_exec(cmd, NULL, out) == 0 && out[0] == 1);
+    CHECK(ma_exec(cmd, NULL, out) == 2);
+    CHECK(ma_exec(cmd, NULL, out) == 0 && out[0] == 3);
+
+    /* Invalid watches are refused */
+    CHECK(ma_cmd_watch(cmd, a, 70, 1) == -1);
+    CHECK(ma_cmd_watch(cmd, a, 0, 2) == -1);
+
+    ma_net_delete(net);
+    ma_cmd_delete(cmd);
+    ma_delete(a);
+    TEST_DONE();
+}
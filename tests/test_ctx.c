@@ -0,0 +1,99 @@
+/*
+ * Context callbacks: every automaton created with ma_create_full_ex gets
+ * its own ctx in t and y, stepped by ma_step and by a network grouping
+ * automata that share the functions; results match a plain reference.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include "ma.h"
+#include "test.h"
+
+#define CHAIN 4
+#define CYCLES 10
+
+typedef struct
+{
+    uint64_t mul; /* Factor applied by t, mask applied by y */
+    size_t calls; /* Transitions run with this ctx */
+} gain;
+
+static void scale(uint64_t *next_state, uint64_t const *input, uint64_t const *state, size_t n,
+                  size_t s, void *ctx)
+{
+    (void)n;
+    (void)s;
+    gain *g = ctx;
+    g->calls++;
+    next_state[0] = (state[0] * g->mul + input[0]) & 0xffff;
+}
+
+static void mask(uint64_t *output, uint64_t const *state, size_t m, size_t s, void *ctx)
+{
+    (void)m;
+    (void)s;
+    output[0] = state[0] ^ ((gain const *)ctx)->mul;
+}
+
+/* Chain where automaton i reads output of i - 1 (the first its manual input) */
+static void build(moore_t *at[CHAIN], gain g[CHAIN])
+{
+    for (size_t i = 0; i < CHAIN; i++)
+    {
+        const uint64_t q = i + 1;
+        g[i] = (gain){3 + 2 * i, 0};
+        CHECK((at[i] = ma_create_full_ex(16, 16, 16, scale, mask, &q, &g[i])) != NULL);
+        if (i > 0)
+            CHECK(ma_connect(at[i], 0, at[i - 1], 0, 16) == 0);
+    }
+    const uint64_t input = 0x55;
+    CHECK(ma_set_input(at[0], &input) == 0);
+}
+
+int main(void)
+{
+    moore_t *stepped[CHAIN], *netted[CHAIN];
+    gain g_stepped[CHAIN], g_netted[CHAIN];
+    build(stepped, g_stepped);
+    build(netted, g_netted);
+    ma_net_t *net = ma_net_create(netted, CHAIN, MA_NET_GROUP_DISPATCH);
+    CHECK(net != NULL);
+
+    /* Reference with the same factors */
+    uint64_t state[CHAIN];
+    for (size_t i = 0; i < CHAIN; i++)
+        state[i] = i + 1;
+
+    bool match = true;
+    for (size_t c = 0; c < CYCLES; c++)
+    {
+        uint64_t next[CHAIN];
+        for (size_t i = 0; i < CHAIN; i++)
+        {
+            const uint64_t in = i ? state[i - 1] ^ g_stepped[i - 1].mul : 0x55;
+            next[i] = (state[i] * g_stepped[i].mul + in) & 0xffff;
+        }
+        for (size_t i = 0; i < CHAIN; i++)
+            state[i] = next[i];
+
+        ma_step(stepped, CHAIN);
+        CHECK(ma_net_step(net) == 0);
+        for (size_t i = 0; i < CHAIN; i++)
+        {
+            match &= ma_get_output(stepped[i])[0] == (state[i] ^ g_stepped[i].mul);
+            match &= ma_get_output(netted[i])[0] == (state[i] ^ g_netted[i].mul);
+        }
+    }
+    CHECK(match);
+
+    /* Each context saw exactly the transitions of its own automaton */
+    for (size_t i = 0; i < CHAIN; i++)
+        CHECK(g_stepped[i].calls == CYCLES && g_netted[i].calls == CYCLES);
+
+    ma_net_delete(net);
+    for (size_t i = 0; i < CHAIN; i++)
+    {
+        ma_delete(stepped[i]);
+        ma_delete(netted[i]);
+    }
+    TEST_DONE();
+}
@@ -0,0 +1,88 @@
+/*
+ * Distributed stepping: two ranks in forked processes over loopback, each
+ * owning one accumulator fed by the other rank's accumulator, must end with
+ * the outputs of the same network stepped by ma_step in one process.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "ma.h"
+#include "test.h"
+
+#define RANKS 2
+#define CYCLES 1000
+
+/* Rank r adds r + 1, so the two automata of the ring differ */
+static void accumulate(uint64_t *next_state, uint64_t const *input, uint64_t const *state,
+                       size_t n, size_t s)
+{
+    (void)n;
+    (void)s;
+    next_state[0] = state[0] * 3 + input[0] + (input[1] & 0xff);
+}
+
+/* Accumulator with its rank in the upper input word (set manually) */
+static moore_t *create_accumulator(size_t rank)
+{
+    moore_t *a = ma_create_simple(128, 64, accumulate);
+    const uint64_t input[2] = {0, rank + 1};
+    if (a)
+        ma_set_input(a, input);
+    return a;
+}
+
+/* Steps rank of the ring and returns its final output (0 with errno on error) */
+static uint64_t run_rank(size_t rank, char const *const addresses[], size_t batch)
+{
+    moore_t *a = create_accumulator(rank);
+    ma_dist_t *d = ma_dist_create(&a, 1, rank, RANKS, addresses, batch);
+    if (!a || !d || ma_dist_export(d, 0, &a, 1) != 0)
+        return 0;
+
+    moore_t *proxy = ma_dist_import(d, (rank + 1) % RANKS, 0, 0, 64);
+    if (!proxy || ma_connect(a, 0, proxy, 0, 64) != 0 || ma_dist_start(d) != 0 ||
+        ma_dist_step(d, CYCLES) != 0)
+        return 0;
+
+    const uint64_t result = ma_get_output(a)[0];
+    ma_dist_delete(d);
+    ma_delete(a);
+    return result;
+}
+
+int main(void)
+{
+    /* Reference: the whole ring in one process */
+    moore_t *ring[RANKS];
+    for (size_t r = 0; r < RANKS; r++)
+        CHECK((ring[r] = create_accumulator(r)) != NULL);
+    for (size_t r = 0; r < RANKS; r++)
+        CHECK(ma_connect(ring[r], 0, ring[(r + 1) % RANKS], 0, 64) == 0);
+    for (size_t c = 0; c < CYCLES; c++)
+        ma_step(ring, RANKS);
+
+    char ports[RANKS][32];
+    char const *addresses[RANKS];
+    for (size_t r = 0; r < RANKS; r++)
+    {
+        snprintf(ports[r], sizeof(ports[r]), "127.0.0.1:%d", 20000 + (int)(getpid() % 20000) * 2 + (int)r);
+        addresses[r] = ports[r];
+    }
+
+    /* Rank 1 runs in a child and reports whether it matched the reference */
+    const pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0)
+        _exit(run_rank(1, addresses, 1) == ma_get_output(ring[1])[0] ? 0 : 1);
+
+    CHECK(run_rank(0, addresses, 1) == ma_get_output(ring[0])[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    for (size_t r = 0; r < RANKS; r++)
+        ma_delete(ring[r]);
+    TEST_DONE();
+}
@@ -0,0 +1,194 @@
+/*
+ * Gather plans: random connections (forward and reversed runs, scattered
+ * bits compiled into pext/pdep masks, unconnected gaps) in both input
+ * modes deliver the same bits as a bit-by-bit reference, with the
+ * portable mask loops and with BMI2.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "ma.h"
+#include "ma_internal.h"
+#include "test.h"
+
+#define SEEDS 30
+#define SOURCES 3
+#define MAX_BITS 320
+#define WORDS (MAX_BITS / 64)
+
+static uint64_t rng;
+
+static uint64_t next_random(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static size_t random_below(size_t bound)
+{
+    return (size_t)(next_random() % bound);
+}
+
+static bool get_bit(uint64_t const *v, size_t bit)
+{
+    return (v[bit / 64] >> (bit % 64)) & 1;
+}
+
+static void hold(uint64_t *next_state, uint64_t const *input, uint64_t const *state, size_t n,
+                 size_t s)
+{
+    (void)input;
+    (void)n;
+    memcpy(next_state, state, (s + 63) / 64 * sizeof(uint64_t));
+}
+
+/* Latches its inputs; bits >= n are ignored as MA_INPUT_SHARED requires */
+static void latch(uint64_t *next_state, uint64_t const *input, uint64_t const *state, size_t n,
+                  size_t s)
+{
+    (void)state;
+    (void)s;
+    memcpy(next_state, input, (n + 63) / 64 * sizeof(uint64_t));
+    if (n % 64 != 0)
+        next_state[n / 64] &= ((uint64_t)1 << (n % 64)) - 1;
+}
+
+/* Source of one input bit (src < 0 for manual input) */
+typedef struct
+{
+    int src;
+    size_t bit;
+} wire;
+
+/* Connects n sink inputs in random pieces, recording the source of each bit */
+static void wire_sink(moore_t *sink, moore_t *src[SOURCES], size_t const m[SOURCES],
+                      wire *wires, size_t n)
+{
+    size_t out[MAX_BITS];
+    for (size_t i = 0; i < n;)
+    {
+        const int s = (int)random_below(SOURCES);
+        const size_t kind = random_below(4);
+        size_t len = 1 + random_below(kind == 1 || kind == 2 ? 80 : 20);
+        if (len > n - i)
+            len = n - i;
+        if (len > m[s])
+            len = m[s];
+
+        const size_t start = random_below(m[s] - len + 1);
+        for (size_t k = 0; k < len; k++)
+        {
+            if (kind == 0)
+                out[k] = 0;
+            else if (kind == 1)
+                out[k] = start + k;
+            else if (kind == 2)
+                out[k] = start + len - 1 - k;
+            else
+                out[k] = random_below(m[s]);
+            wires[i + k] = (wire){kind == 0 ? -1 : s, out[k]};
+        }
+        if (kind != 0)
+            CHECK(ma_connect_permuted(sink, i, src[s], out, len) == 0);
+        i += len;
+    }
+}
+
+static void randomize(uint64_t *v, size_t bits)
+{
+    for (size_t w = 0; w < (bits + 63) / 64; w++)
+        v[w] = next_random();
+}
+
+/* Steps network of SOURCES sources and one sink; returns true if sink latched the reference */
+static bool step_matches(moore_t *at[SOURCES + 1], size_t const m[SOURCES], wire const *wires,
+                         size_t n, uint64_t const *manual)
+{
+    uint64_t states[SOURCES][WORDS];
+    for (size_t s = 0; s < SOURCES; s++)
+    {
+        randomize(states[s], m[s]);
+        CHECK(ma_set_state(at[s], states[s]) == 0);
+    }
+    ma_step(at, SOURCES + 1);
+
+    uint64_t const *got = ma_get_output(at[SOURCES]);
+    for (size_t i = 0; i < n; i++)
+    {
+        const bool want = wires[i].src < 0 ? get_bit(manual, i)
+                                           : get_bit(states[wires[i].src], wires[i].bit);
+        if (get_bit(got, i) != want)
+            return false;
+    }
+    return true;
+}
+
+/* Random networks under current mask path; returns number of mismatches */
+static size_t run_seeds(void)
+{
+    size_t mismatches = 0;
+    for (uint64_t seed = 1; seed <= SEEDS; seed++)
+    {
+        rng = seed * 0x9e3779b97f4a7c15u;
+
+        size_t m[SOURCES];
+        moore_t *at[SOURCES + 1];
+        for (size_t s = 0; s < SOURCES; s++)
+        {
+            m[s] = 64 + random_below(MAX_BITS - 64);
+            CHECK((at[s] = ma_create_simple(0, m[s], hold)) != NULL);
+        }
+
+        wire wires[MAX_BITS];
+        size_t n = 1 + random_below(MAX_BITS);
+        const int mode = seed % 2 ? MA_INPUT_SHARED : MA_INPUT_COPY;
+        if (seed % 5 == 0)
+        {
+            /* One aligned run covering all inputs (read in place when shared) */
+            n = 128;
+            m[0] = MAX_BITS;
+            ma_delete(at[0]);
+            CHECK((at[0] = ma_create_simple(0, m[0], hold)) != NULL);
+        }
+        CHECK((at[SOURCES] = ma_create_simple(n, n, latch)) != NULL);
+        CHECK(ma_set_input_mode(at[SOURCES], mode) == 0);
+
+        if (seed % 5 == 0)
+        {
+            CHECK(ma_connect(at[SOURCES], 0, at[0], 64, n) == 0);
+            for (size_t i = 0; i < n; i++)
+                wires[i] = (wire){0, 64 + i};
+        }
+        else if (seed % 7 != 0) /* Every seventh sink reads manual input only */
+            wire_sink(at[SOURCES], at, m, wires, n);
+        else
+            for (size_t i = 0; i < n; i++)
+                wires[i] = (wire){-1, 0};
+
+        uint64_t manual[WORDS];
+        randomize(manual, n);
+        CHECK(ma_set_input(at[SOURCES], manual) == 0);
+
+        /* Second step reuses the compiled plan */
+        for (size_t round = 0; round < 2; round++)
+            mismatches += !step_matches(at, m, wires, n, manual);
+
+        for (size_t s = 0; s <= SOURCES; s++)
+            ma_delete(at[s]);
+    }
+    return mismatches;
+}
+
+int main(void)
+{
+    CHECK(!ma_gather_use_bmi2(false));
+    CHECK(run_seeds() == 0);
+
+    if (ma_gather_use_bmi2(true))
+        CHECK(run_seeds() == 0);
+    else
+        printf("%s: BMI2 not available, portable path only\n", __FILE__);
+    TEST_DONE();
+}
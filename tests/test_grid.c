@@ -0,0 +1,240 @@
+/*
+ * Grids: lattices in one to three dimensions with both neighbourhoods
+ * and both boundaries, stepped by one or several threads, match a
+ * cell-by-cell reference; edge automata expose the face cells.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ma.h"
+#include "test.h"
+
+#define STEPS 7
+#define BOUNDARY 5
+
+static uint64_t rng = 0x2545f4914f6cdd1du;
+
+static uint64_t next_random(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+/* Context of weigh kernel */
+typedef struct
+{
+    unsigned salt;
+    size_t neighbours; /* Cell included */
+} weigh_ctx;
+
+/* Weighted sum of neighbours plus salt (depends on neighbour order) */
+static void weigh(uint8_t *next, uint8_t const *const cell[], size_t count, void *ctx)
+{
+    weigh_ctx const *w = ctx;
+    for (size_t i = 0; i < count; i++)
+    {
+        unsigned sum = w->salt;
+        for (size_t k = 0; k < w->neighbours; k++)
+            sum += (unsigned)(k + 1) * cell[k][i];
+        next[i] = (uint8_t)(sum & 7);
+    }
+}
+
+typedef struct
+{
+    size_t d;
+    size_t dims[3];
+    int neighbourhood;
+    int boundary;
+} grid_case;
+
+/* Steps cells of case one by one; returns neighbours per cell (cell included) */
+static size_t reference_step(grid_case const *c, uint8_t const *cur, uint8_t *next, unsigned salt)
+{
+    size_t size[3] = {1, 1, 1}, k = 0;
+    for (size_t a = 0; a < c->d; a++)
+        size[a] = c->dims[a];
+
+    for (size_t z = 0; z < size[2]; z++)
+        for (size_t y = 0; y < size[1]; y++)
+            for (size_t x = 0; x < size[0]; x++)
+            {
+                const size_t pos[3] = {x, y, z};
+                unsigned sum = salt;
+                k = 0;
+
+                /* Cell first, then neighbours in z, y, x order */
+                for (int pass = 0; pass < 2; pass++)
+                    for (int dz = -1; dz <= 1; dz++)
+                        for (int dy = -1; dy <= 1; dy++)
+                            for (int dx = -1; dx <= 1; dx++)
+                            {
+                                const int delta[3] = {dx, dy, dz};
+                                const int distance = (dx != 0) + (dy != 0) + (dz != 0);
+                                if ((pass == 0) != (distance == 0) ||
+                                    (c->neighbourhood == MA_GRID_VON_NEUMANN && distance > 1) ||
+                                    (dy != 0 && c->d < 2) || (dz != 0 && c->d < 3))
+                                    continue;
+
+                                bool outside = false;
+                                size_t idx = 0;
+                                for (int a = 2; a >= 0; a--)
+                                {
+                                    ptrdiff_t p = (ptrdiff_t)pos[a] + delta[a];
+                                    if (p < 0 || p >= (ptrdiff_t)size[a])
+                                    {
+                                        outside = c->boundary == MA_GRID_FIXED;
+                                        p = (p + (ptrdiff_t)size[a]) % (ptrdiff_t)size[a];
+                                    }
+                                    idx = idx * size[a] + (size_t)p;
+                                }
+                                sum += (unsigned)(k + 1) * (outside ? BOUNDARY : cur[idx]);
+                                k++;
+                            }
+                next[(z * size[1] + y) * size[0] + x] = (uint8_t)(sum & 7);
+            }
+    return k;
+}
+
+/* Coordinates of cell i of case */
+static void coords_of(grid_case const *c, size_t i, size_t coords[3])
+{
+    for (size_t a = 0; a < c->d; a++)
+    {
+        coords[a] = i % c->dims[a];
+        i /= c->dims[a];
+    }
+}
+
+/* Checks that edge automaton of each face holds the face cells (x first) */
+static bool edges_match(grid_case const *c, ma_grid_t *grid, uint8_t const *cells)
+{
+    size_t size[3] = {1, 1, 1};
+    for (size_t a = 0; a < c->d; a++)
+        size[a] = c->dims[a];
+
+    for (size_t side = 0; side < 2 * c->d; side++)
+    {
+        const size_t axis = side / 2;
+        uint64_t const *out = ma_get_output(ma_grid_edge(grid, side));
+        if (!out)
+            return false;
+
+        size_t bit = 0;
+        for (size_t i = 0; i < size[0] * size[1] * size[2]; i++)
+        {
+            size_t coords[3] = {0, 0, 0};
+            coords_of(c, i, coords);
+            if (coords[axis] != (side % 2 ? size[axis] - 1 : 0))
+                continue;
+            uint64_t got = out[bit / 64] >> (bit % 64);
+            if (bit % 64 > 61) /* Cell straddles two words */
+                got |= out[bit / 64 + 1] << (64 - bit % 64);
+            if ((got & 7) != cells[i])
+                return false;
+            bit += 3;
+        }
+    }
+    return true;
+}
+
+static const grid_case cases[] = {
+    {1, {29}, MA_GRID_VON_NEUMANN, MA_GRID_PERIODIC},
+    {1, {29}, MA_GRID_MOORE, MA_GRID_FIXED},
+    {2, {37, 23}, MA_GRID_VON_NEUMANN, MA_GRID_FIXED},
+    {2, {37, 23}, MA_GRID_MOORE, MA_GRID_PERIODIC},
+    {3, {7, 5, 6}, MA_GRID_VON_NEUMANN, MA_GRID_PERIODIC},
+    {3, {7, 5, 6}, MA_GRID_MOORE, MA_GRID_FIXED},
+};
+
+/* Life on a 2D torus: a glider returns shifted by one cell every 4 steps */
+static void check_glider(void)
+{
+    const size_t dims[2] = {8, 8};
+    ma_grid_t *grid = ma_grid_create(2, dims, 1, MA_GRID_MOORE, MA_GRID_PERIODIC, ma_grid_life,
+                                     NULL);
+    CHECK(grid != NULL);
+    static const size_t glider[5][2] = {{1, 0}, {2, 1}, {0, 2}, {1, 2}, {2, 2}};
+    for (size_t i = 0; i < 5; i++)
+        CHECK(ma_grid_set_cell(grid, glider[i], 1) == 0);
+
+    /* 32 steps move it 8 cells diagonally: back where it started */
+    CHECK(ma_grid_run(grid, 32, 2) == 0);
+    size_t alive = 0;
+    for (size_t i = 0; i < 5; i++)
+        alive += ma_grid_get_cell(grid, glider[i]) == 1;
+    CHECK(alive == 5);
+    ma_grid_delete(grid);
+}
+
+int main(void)
+{
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        const grid_case *gc = &cases[c];
+        size_t cells = 1;
+        for (size_t a = 0; a < gc->d; a++)
+            cells *= gc->dims[a];
+
+        uint8_t *ref = malloc(cells), *tmp = malloc(cells);
+        size_t neighbours = 1;
+        for (size_t a = 0; a < gc->d; a++)
+            neighbours = gc->neighbourhood == MA_GRID_MOORE ? neighbours * 3 : neighbours + 2;
+        weigh_ctx ctx = {3, neighbours};
+        ma_grid_t *grids[2];
+        for (size_t g = 0; g < 2; g++)
+        {
+            grids[g] = ma_grid_create(gc->d, gc->dims, 3, gc->neighbourhood, gc->boundary, weigh,
+                                      &ctx);
+            CHECK(grids[g] != NULL);
+            if (gc->boundary == MA_GRID_FIXED)
+                CHECK(ma_grid_set_boundary(grids[g], BOUNDARY) == 0);
+        }
+
+        for (size_t i = 0; i < cells; i++)
+        {
+            size_t coords[3];
+            coords_of(gc, i, coords);
+            ref[i] = (uint8_t)(next_random() & 7);
+            for (size_t g = 0; g < 2; g++)
+                CHECK(ma_grid_set_cell(grids[g], coords, ref[i]) == 0);
+        }
+
+        /* Edges created before the run must follow it */
+        for (size_t side = 0; side < 2 * gc->d; side++)
+            CHECK(ma_grid_edge(grids[1], side) != NULL);
+
+        /* Single steps in one grid, a multi-threaded run in the other */
+        for (size_t step = 0; step < STEPS; step++)
+        {
+            CHECK(reference_step(gc, ref, tmp, ctx.salt) == neighbours);
+            memcpy(ref, tmp, cells);
+            CHECK(ma_grid_step(grids[0]) == 0);
+        }
+        CHECK(ma_grid_run(grids[1], STEPS, 3) == 0);
+
+        bool match = true;
+        for (size_t i = 0; i < cells; i++)
+        {
+            size_t coords[3];
+            coords_of(gc, i, coords);
+            for (size_t g = 0; g < 2; g++)
+                match &= ma_grid_get_cell(grids[g], coords) == ref[i];
+        }
+        if (!match)
+            fprintf(stderr, "case %zu: mismatch\n", c);
+        CHECK(match);
+        CHECK(edges_match(gc, grids[1], ref));
+
+        for (size_t g = 0; g < 2; g++)
+            ma_grid_delete(grids[g]);
+        free(ref);
+        free(tmp);
+    }
+
+    check_glider();
+    TEST_DONE();
+}
@@ -0,0 +1,174 @@
+/*
+ * In-place automata: no next state buffer is allocated, and stepping them
+ * with ma_step, ma_net_step or a partition set gives the same states as
+ * equivalent automata computing a full next state. A write the log cannot
+ * record fails the step and leaves the state untouched.
+ */
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ma.h"
+#include "test.h"
+
+#define WORDS 64
+#define PAIRS 4
+
+static void count(uint64_t *next_state, uint64_t const *input, uint64_t const *state, size_t n,
+                  size_t s)
+{
+    (void)input;
+    (void)n;
+    (void)s;
+    next_state[0] = state[0] * 6364136223846793005ULL + 1442695040888963407ULL;
+}
+
+/* Writes word 0 and one word picked by state and input */
+static void touch_log(ma_write_log_t *log, uint64_t const *input, uint64_t const *state, size_t n,
+                      size_t s, void *ctx)
+{
+    (void)n;
+    (void)s;
+    (void)ctx;
+    const size_t k = (state[0] + input[0]) % WORDS;
+    ma_log_write(log, k, state[k] * 31 + input[0] + 1);
+    ma_log_write(log, 0, state[0] + 1);
+}
+
+static void touch_full(uint64_t *next_state, uint64_t const *input, uint64_t const *state,
+                       size_t n, size_t s, void *ctx)
+{
+    (void)n;
+    (void)ctx;
+    const size_t k = (state[0] + input[0]) % WORDS;
+    memcpy(next_state, state, s / 8);
+    next_state[k] = state[k] * 31 + input[0] + 1;
+    next_state[0] = state[0] + 1;
+}
+
+/* Increments every word */
+static void touch_all(ma_write_log_t *log, uint64_t const *input, uint64_t const *state, size_t n,
+                      size_t s, void *ctx)
+{
+    (void)input;
+    (void)n;
+    (void)s;
+    (void)ctx;
+    for (size_t i = 0; i < WORDS; i++)
+        ma_log_write(log, i, state[i] + 1);
+}
+
+static void copy_state(uint64_t *output, uint64_t const *state, size_t m, size_t s, void *ctx)
+{
+    (void)s;
+    (void)ctx;
+    memcpy(output, state, m / 8);
+}
+
+/* Allocator failing requests above limit (SIZE_MAX: never) */
+static size_t limit = SIZE_MAX;
+
+static void *limited_alloc(size_t size, void *ctx)
+{
+    (void)ctx;
+    return size > limit ? NULL : malloc(size);
+}
+
+static void limited_free(void *ptr, size_t size, void *ctx)
+{
+    (void)size;
+    (void)ctx;
+    free(ptr);
+}
+
+/* Builds source, PAIRS in-place automata and PAIRS references fed by it */
+static void build(moore_t *at[2 * PAIRS + 1])
+{
+    static const uint64_t zero[WORDS];
+    at[0] = ma_create_simple(0, 64, count);
+    CHECK(at[0] != NULL);
+    for (size_t i = 0; i < PAIRS; i++)
+    {
+        at[1 + i] = ma_create_in_place(64, 64 * WORDS, 64 * WORDS, touch_log, copy_state, zero, NULL);
+        at[1 + PAIRS + i] = ma_create_full_ex(64, 64 * WORDS, 64 * WORDS, touch_full, copy_state,
+                                              zero, NULL);
+        CHECK(at[1 + i] && at[1 + PAIRS + i]);
+        CHECK(ma_connect(at[1 + i], 0, at[0], 0, 64) == 0);
+        CHECK(ma_connect(at[1 + PAIRS + i], 0, at[0], 0, 64) == 0);
+    }
+}
+
+static bool pairs_match(moore_t *at[2 * PAIRS + 1])
+{
+    for (size_t i = 0; i < PAIRS; i++)
+        if (memcmp(ma_get_output(at[1 + i]), ma_get_output(at[1 + PAIRS + i]), WORDS * 8) != 0)
+            return false;
+    return true;
+}
+
+static void destroy(moore_t *at[2 * PAIRS + 1])
+{
+    for (size_t i = 0; i < 2 * PAIRS + 1; i++)
+        ma_delete(at[i]);
+}
+
+int main(void)
+{
+    moore_t *at[2 * PAIRS + 1];
+    CHECK(ma_set_allocator(limited_alloc, limited_free, NULL) == 0);
+
+    /* One state buffer instead of two */
+    build(at);
+    ma_memory_usage_t in_place, full;
+    CHECK(ma_memory_usage(at[1], &in_place) == 0);
+    CHECK(ma_memory_usage(at[1 + PAIRS], &full) == 0);
+    CHECK(in_place.state.allocated < 2 * WORDS * 8);
+    CHECK(full.state.allocated >= 2 * WORDS * 8);
+
+    for (size_t c = 0; c < 100; c++)
+        CHECK(ma_step(at, 2 * PAIRS + 1) == 0);
+    CHECK(pairs_match(at));
+
+    ma_net_t *net = ma_net_create(at, 2 * PAIRS + 1, MA_NET_GROUP_DISPATCH);
+    CHECK(net != NULL);
+    for (size_t c = 0; c < 100; c++)
+        CHECK(ma_net_step(net) == 0);
+    CHECK(pairs_match(at));
+    ma_net_delete(net);
+    destroy(at);
+
+    /* Partition set moves only existing buffers and hands them back */
+    build(at);
+    ma_part_t *part = ma_part_create(at, 2 * PAIRS + 1, 2);
+    CHECK(part != NULL);
+    CHECK(ma_part_step(part, 7) == 0);
+    CHECK(pairs_match(at));
+    CHECK(ma_part_delete(part) == 0);
+    CHECK(ma_step(at, 2 * PAIRS + 1) == 0);
+    CHECK(pairs_match(at));
+    destroy(at);
+
+    /* Log cannot grow past 16 entries: nothing of the step is applied */
+    static const uint64_t zero[WORDS];
+    moore_t *a = ma_create_in_place(0, 64 * WORDS, 64 * WORDS, touch_all, copy_state, zero, NULL);
+    CHECK(a != NULL);
+    limit = 16 * 2 * sizeof(uint64_t);
+    errno = 0;
+    CHECK(ma_step(&a, 1) == -1 && errno == ENOMEM);
+    CHECK(memcmp(ma_get_output(a), zero, sizeof(zero)) == 0);
+    net = ma_net_create(&a, 1, 0);
+    CHECK(net != NULL);
+    errno = 0;
+    CHECK(ma_net_step(net) == -1 && errno == ENOMEM);
+    CHECK(memcmp(ma_get_output(a), zero, sizeof(zero)) == 0);
+
+    limit = SIZE_MAX;
+    CHECK(ma_net_step(net) == 0);
+    for (size_t i = 0; i < WORDS; i++)
+        CHECK(ma_get_output(a)[i] == 1);
+    ma_net_delete(net);
+    ma_delete(a);
+
+    TEST_DONE();
+}
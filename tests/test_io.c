@@ -0,0 +1,305 @@
+/*
+ * Network files: a saved network loads into one that saves to the same
+ * bytes and steps like the original, also with clock dividers, phases
+ * and gates, and ma-run streams frames through it like ma_step. Files of
+ * format version 1 (without clocks) still load. Files whose sizes a built-in primitive kernel cannot
+ * step (and would read past its input) are refused with EINVAL.
+ */
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ma.h"
+#include "test.h"
+
+#define CYCLES 20
+#define FRAMES 50
+
+/* Saves one automaton to memory; returns buffer (free) and its size */
+static uint64_t *save_one(moore_t *a, size_t *size)
+{
+    char *data = NULL;
+    FILE *f = open_memstream(&data, size);
+    CHECK(f && ma_save_network(f, &a, 1) == 0);
+    fclose(f);
+    return (uint64_t *)data;
+}
+
+/* Loads buffer with word i replaced by value; returns errno of failure or 0 */
+static int load_patched(uint64_t const *data, size_t size, size_t i, uint64_t value)
+{
+    uint64_t *copy = malloc(size);
+    memcpy(copy, data, size);
+    copy[i] = value;
+
+    FILE *f = fmemopen(copy, size, "rb");
+    size_t num = 0;
+    errno = 0;
+    moore_t **at = ma_load_network(f, &num);
+    const int error = at ? 0 : errno;
+    ma_free_network(at, num);
+    fclose(f);
+    free(copy);
+    return error;
+}
+
+/* Word indices of fields of the first automaton (after magic and count) */
+enum { FIELD_N = 2, FIELD_M = 3, FIELD_S = 4 };
+
+/* Saves network to memory; returns buffer (free) and its size */
+static char *save_all(moore_t *const at[], size_t num, size_t *size)
+{
+    char *data = NULL;
+    FILE *f = open_memstream(&data, size);
+    CHECK(f && ma_save_network(f, at, num) == 0);
+    fclose(f);
+    return data;
+}
+
+static moore_t **load_all(char const *data, size_t size, size_t *num)
+{
+    FILE *f = fmemopen((void *)data, size, "rb");
+    moore_t **at = ma_load_network(f, num);
+    fclose(f);
+    return at;
+}
+
+/* Adder summing manual inputs, counter enabled by its bit 0, shift register of counter bits */
+static void build(moore_t *at[3])
+{
+    static const size_t picked[3] = {7, 2, 5};
+    const uint64_t adder_state = 0x13;
+    at[0] = ma_create_adder(4);
+    at[1] = ma_create_counter(8);
+    at[2] = ma_create_shift_register(12, 3);
+    CHECK(at[0] && at[1] && at[2]);
+    CHECK(ma_set_state(at[0], &adder_state) == 0);
+    CHECK(ma_connect(at[1], 0, at[0], 0, 1) == 0);
+    CHECK(ma_connect_permuted(at[2], 0, at[1], picked, 3) == 0);
+}
+
+/* Saved network loads into one that saves identically and steps the same */
+static void check_round_trip(void)
+{
+    moore_t *at[3];
+    build(at);
+
+    size_t size, again_size, num = 0;
+    char *data = save_all(at, 3, &size);
+    moore_t **loaded = load_all(data, size, &num);
+    CHECK(loaded && num == 3);
+    char *again = save_all(loaded, num, &again_size);
+    CHECK(again_size == size && memcmp(again, data, size) == 0);
+
+    bool match = true;
+    for (uint64_t c = 0; c < CYCLES; c++)
+    {
+        const uint64_t input = (c * 0x9e3779b9u) >> 7 & 0x1ff;
+        CHECK(ma_set_input(at[0], &input) == 0);
+        CHECK(ma_set_input(loaded[0], &input) == 0);
+        ma_step(at, 3);
+        ma_step(loaded, 3);
+        for (size_t i = 0; i < 3; i++)
+            match &= ma_get_output(at[i])[0] == ma_get_output(loaded[i])[0];
+    }
+    CHECK(match);
+
+    free(data);
+    free(again);
+    ma_free_network(loaded, num);
+    for (size_t i = 0; i < 3; i++)
+        ma_delete(at[i]);
+}
+
+/* Divided and gated clocks survive saving mid-period; version 1 files load */
+static void check_clocks(void)
+{
+    moore_t *at[3];
+    build(at);
+    CHECK(ma_set_clock(at[1], 3, 1) == 0);
+    CHECK(ma_set_clock_gate(at[2], at[0], 1) == 0);
+    for (uint64_t c = 0; c < 4; c++)
+    {
+        const uint64_t input = c * 0x55 & 0x1ff;
+        CHECK(ma_set_input(at[0], &input) == 0);
+        ma_step(at, 3);
+    }
+
+    size_t size, again_size, num = 0;
+    char *data = save_all(at, 3, &size);
+    moore_t **loaded = load_all(data, size, &num);
+    CHECK(loaded && num == 3);
+    char *again = save_all(loaded, num, &again_size);
+    CHECK(again_size == size && memcmp(again, data, size) == 0);
+
+    bool match = true;
+    for (uint64_t c = 0; c < CYCLES; c++)
+    {
+        const uint64_t input = (c * 0x9e3779b9u) >> 5 & 0x1ff;
+        CHECK(ma_set_input(at[0], &input) == 0);
+        CHECK(ma_set_input(loaded[0], &input) == 0);
+        ma_step(at, 3);
+        ma_step(loaded, 3);
+        for (size_t i = 0; i < 3; i++)
+            match &= ma_get_output(at[i])[0] == ma_get_output(loaded[i])[0];
+    }
+    CHECK(match);
+
+    /* A gate outside the saved set cannot be saved */
+    char *partial = NULL;
+    size_t partial_size;
+    FILE *f = open_memstream(&partial, &partial_size);
+    errno = 0;
+    CHECK(f && ma_save_network(f, at + 1, 2) == -1 && errno == EINVAL);
+    fclose(f);
+    free(partial);
+
+    free(data);
+    free(again);
+    ma_free_network(loaded, num);
+    for (size_t i = 0; i < 3; i++)
+        ma_delete(at[i]);
+
+    /* Version 1: same layout without the five-word clock record at the end */
+    moore_t *counter = ma_create_counter(4);
+    CHECK(counter != NULL);
+    uint64_t *file = save_one(counter, &size);
+    const size_t words = size / 8;
+    CHECK(file[words - 5] == 1 && file[words - 2] == 0);
+    CHECK(load_patched(file, size - 5 * 8, 0, 0x0154454e414dULL) == 0);
+    CHECK(load_patched(file, size - 5 * 8, 0, 0x0354454e414dULL) == EINVAL);
+    /* Phase must lie below the divider */
+    CHECK(load_patched(file, size, words - 4, 1) == EINVAL);
+    free(file);
+    ma_delete(counter);
+}
+
+/* Writes buffer to new temporary file; returns its path (free) */
+static char *temp_file(void const *data, size_t size)
+{
+    char *path = strdup("/tmp/test_io_XXXXXX");
+    const int fd = mkstemp(path);
+    CHECK(fd >= 0 && write(fd, data, size) == (ssize_t)size);
+    close(fd);
+    return path;
+}
+
+/*
+ * Runs ma-run with options on the first num automata of build, fed by
+ * two byte frames; output frames must match ma_step of the same network
+ * with the selected outputs (sel[i] automaton, len[i] bits) packed in order
+ */
+static void check_ma_run(moore_t *const at[], size_t num, char const *options,
+                         size_t const sel[], size_t const len[], size_t count)
+{
+    size_t size, loaded_num = 0;
+    char *data = save_all(at, num, &size);
+    moore_t **ref = load_all(data, size, &loaded_num);
+    CHECK(ref && loaded_num == num);
+
+    unsigned char frames[FRAMES][2];
+    for (size_t f = 0; f < FRAMES; f++)
+    {
+        frames[f][0] = (unsigned char)(f * 37 + 11);
+        frames[f][1] = (unsigned char)(f * 13);
+    }
+
+    char *net_path = temp_file(data, size), *in_path = temp_file(frames, sizeof(frames));
+    char *out_path = temp_file("", 0);
+    char const *ma_run = getenv("MA_RUN") ? getenv("MA_RUN") : "../ma-run";
+    char command[512];
+    snprintf(command, sizeof(command), "%s %s -i %s -o %s %s", ma_run, options, in_path,
+             out_path, net_path);
+    CHECK(system(command) == 0);
+
+    size_t out_bits = 0;
+    for (size_t i = 0; i < count; i++)
+        out_bits += len[i];
+    const size_t out_frame = (out_bits + 7) / 8;
+
+    FILE *f = fopen(out_path, "rb");
+    unsigned char *got = calloc(FRAMES, out_frame);
+    CHECK(f && fread(got, out_frame, FRAMES, f) == FRAMES && fgetc(f) == EOF);
+    if (f)
+        fclose(f);
+
+    bool match = true;
+    for (size_t fr = 0; fr < FRAMES; fr++)
+    {
+        const uint64_t input = frames[fr][0] | (uint64_t)frames[fr][1] << 8;
+        const uint64_t masked = input & 0x1ff; /* Adder inputs */
+        CHECK(ma_set_input(ref[0], &masked) == 0);
+        ma_step(ref, num);
+
+        uint64_t packed = 0;
+        size_t bit = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            packed |= (ma_get_output(ref[sel[i]])[0] & ((1u << len[i]) - 1)) << bit;
+            bit += len[i];
+        }
+        for (size_t b = 0; b < out_frame; b++)
+            match &= got[fr * out_frame + b] == (unsigned char)(packed >> (8 * b));
+    }
+    CHECK(match);
+
+    unlink(net_path);
+    unlink(in_path);
+    unlink(out_path);
+    free(net_path);
+    free(in_path);
+    free(out_path);
+    free(got);
+    free(data);
+    ma_free_network(ref, loaded_num);
+}
+
+int main(void)
+{
+    check_round_trip();
+    check_clocks();
+
+    /* Network path with packed selections, fast path of a lone automaton */
+    moore_t *at[3];
+    build(at);
+    static const size_t sel[2] = {1, 2}, len[2] = {8, 12};
+    check_ma_run(at, 3, "-O 1 -O 2", sel, len, 2);
+    static const size_t lone_sel[1] = {0}, lone_len[1] = {5};
+    check_ma_run(at, 1, "", lone_sel, lone_len, 1);
+    for (size_t i = 0; i < 3; i++)
+        ma_delete(at[i]);
+
+    /* Files of unchanged primitives load */
+    moore_t *prims[4] = {ma_create_counter(4), ma_create_shift_register(6, 2), ma_create_adder(5),
+                         ma_create_comparator(7)};
+    uint64_t *files[4];
+    size_t sizes[4];
+    for (size_t i = 0; i < 4; i++)
+    {
+        CHECK(prims[i] != NULL);
+        files[i] = save_one(prims[i], &sizes[i]);
+        CHECK(load_patched(files[i], sizes[i], FIELD_N, i == 0 ? 2 : 0) ==
+              (i == 0 ? 0 : EINVAL));
+    }
+
+    /* Counter needs its enable and reset inputs */
+    CHECK(load_patched(files[0], sizes[0], FIELD_N, 1) == EINVAL);
+    /* Shift register takes 1 .. s inputs per step */
+    CHECK(load_patched(files[1], sizes[1], FIELD_N, 7) == EINVAL);
+    CHECK(load_patched(files[1], sizes[1], FIELD_N, 6) == 0);
+    /* Adder reads 2 (s - 1) + 1 inputs */
+    CHECK(load_patched(files[2], sizes[2], FIELD_N, 10) == EINVAL);
+    /* Comparator has even input, three state and output bits */
+    CHECK(load_patched(files[3], sizes[3], FIELD_N, 13) == EINVAL);
+    CHECK(load_patched(files[3], sizes[3], FIELD_M, 4) == EINVAL);
+
+    for (size_t i = 0; i < 4; i++)
+    {
+        free(files[i]);
+        ma_delete(prims[i]);
+    }
+    TEST_DONE();
+}
@@ -0,0 +1,68 @@
+/*
+ * Input mailbox: a producer thread posts vectors whose words are all equal
+ * while the main thread steps the automaton; every vector seen by a gather
+ * must be complete and values must never go back.
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "ma.h"
+#include "test.h"
+
+#define WORDS 8
+#define STEPS 200000
+
+static atomic_bool stop;
+
+/* state[0]: torn vectors seen, state[1]: last value, state[2]: regressions */
+static void observe(uint64_t *next_state, uint64_t const *input, uint64_t const *state, size_t n,
+                    size_t s)
+{
+    (void)n;
+    (void)s;
+    uint64_t torn = 0;
+    for (size_t i = 1; i < WORDS; i++)
+        torn |= input[i] != input[0];
+    next_state[0] = state[0] + torn;
+    next_state[1] = input[0];
+    next_state[2] = state[2] + (input[0] < state[1]);
+}
+
+static void *produce(void *arg)
+{
+    moore_t *a = arg;
+    uint64_t vector[WORDS];
+    for (uint64_t k = 1; !atomic_load(&stop); k++)
+    {
+        for (size_t i = 0; i < WORDS; i++)
+            vector[i] = k;
+        ma_post_input(a, vector);
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    moore_t *a = ma_create_simple(64 * WORDS, 64 * 3, observe);
+    CHECK(a != NULL);
+    CHECK(ma_enable_input_mailbox(a) == 0);
+    CHECK(ma_enable_input_mailbox(a) == 0);
+
+    pthread_t producer;
+    CHECK(pthread_create(&producer, NULL, produce, a) == 0);
+    for (size_t i = 0; i < STEPS; i++)
+        ma_step(&a, 1);
+    atomic_store(&stop, true);
+    pthread_join(producer, NULL);
+
+    /* One more step takes the last vector posted */
+    ma_step(&a, 1);
+    uint64_t const *out = ma_get_output(a);
+    CHECK(out[0] == 0);
+    CHECK(out[2] == 0);
+    CHECK(out[1] > 0);
+
+    ma_delete(a);
+    TEST_DONE();
+}
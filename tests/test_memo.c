@@ -0,0 +1,189 @@
+/*
+ * Memoised stepping: a pure network ends in the same state as plain
+ * stepping, and a recurring one does so through cache hits, also when built
+ * from an LFSR and a module instance. A network with a memory primitive
+ * (storage outside the state, so a cache hit would skip its writes) is
+ * refused, and a step failing midway fails the run without
+ * caching anything.
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "ma.h"
+#include "test.h"
+
+#define CYCLES 96
+#define LONG_CYCLES 4096
+#define WORDS 64
+
+static void count6(uint64_t *next_state, uint64_t const *input, uint64_t const *state, size_t n,
+                   size_t s)
+{
+    (void)input;
+    (void)n;
+    (void)s;
+    next_state[0] = (state[0] + 1) & 63;
+}
+
+static void accumulate(uint64_t *next_state, uint64_t const *input, uint64_t const *state,
+                       size_t n, size_t s)
+{
+    (void)n;
+    (void)s;
+    next_state[0] = (state[0] * 5 + input[0]) & 0xffff;
+}
+
+static void delay(uint64_t *next_state, uint64_t const *input, uint64_t const *state, size_t n,
+                  size_t s)
+{
+    (void)state;
+    (void)n;
+    (void)s;
+    next_state[0] = input[0];
+}
+
+/* Increments every word through the write log */
+static void touch_all(ma_write_log_t *log, uint64_t const *input, uint64_t const *state, size_t n,
+                      size_t s, void *ctx)
+{
+    (void)input;
+    (void)n;
+    (void)s;
+    (void)ctx;
+    for (size_t i = 0; i < WORDS; i++)
+        ma_log_write(log, i, state[i] + 1);
+}
+
+static void copy_first(uint64_t *output, uint64_t const *state, size_t m, size_t s, void *ctx)
+{
+    (void)m;
+    (void)s;
+    (void)ctx;
+    output[0] = state[0];
+}
+
+/* Allocator failing requests above limit (SIZE_MAX: never) */
+static size_t limit = SIZE_MAX;
+
+static void *limited_alloc(size_t size, void *ctx)
+{
+    (void)ctx;
+    return size > limit ? NULL : malloc(size);
+}
+
+static void limited_free(void *ptr, size_t size, void *ctx)
+{
+    (void)size;
+    (void)ctx;
+    free(ptr);
+}
+
+int main(void)
+{
+    /* Pure network: counter feeding an accumulator */
+    moore_t *ref[2] = {ma_create_simple(0, 6, count6), ma_create_simple(6, 16, accumulate)};
+    moore_t *at[2] = {ma_create_simple(0, 6, count6), ma_create_simple(6, 16, accumulate)};
+    CHECK(ref[0] && ref[1] && at[0] && at[1]);
+    CHECK(ma_connect(ref[1], 0, ref[0], 0, 6) == 0);
+    CHECK(ma_connect(at[1], 0, at[0], 0, 6) == 0);
+
+    for (size_t c = 0; c < CYCLES; c++)
+        ma_step(ref, 2);
+    ma_memo_t *memo = ma_memo_create(at, 2, 0);
+    CHECK(memo != NULL);
+    CHECK(ma_memo_run(memo, CYCLES) == 0);
+    CHECK(ma_get_output(at[0])[0] == ma_get_output(ref[0])[0]);
+    CHECK(ma_get_output(at[1])[0] == ma_get_output(ref[1])[0]);
+    ma_memo_delete(memo);
+
+    /* Counter and a delay line repeat every 64 cycles: long runs hit the cache */
+    moore_t *loop_ref[2] = {ma_create_simple(0, 6, count6), ma_create_simple(6, 6, delay)};
+    moore_t *loop[2] = {ma_create_simple(0, 6, count6), ma_create_simple(6, 6, delay)};
+    CHECK(loop_ref[0] && loop_ref[1] && loop[0] && loop[1]);
+    CHECK(ma_connect(loop_ref[1], 0, loop_ref[0], 0, 6) == 0);
+    CHECK(ma_connect(loop[1], 0, loop[0], 0, 6) == 0);
+    for (size_t c = 0; c < LONG_CYCLES + 37; c++)
+        ma_step(loop_ref, 2);
+    memo = ma_memo_create(loop, 2, 0);
+    CHECK(memo != NULL);
+    CHECK(ma_memo_run(memo, LONG_CYCLES) == 0);
+    CHECK(ma_memo_run(memo, 37) == 0);
+    ma_memo_stats_t stats;
+    CHECK(ma_memo_stats(memo, &stats) == 0);
+    CHECK(stats.hits > 0 && stats.steps < LONG_CYCLES);
+    CHECK(ma_get_output(loop[0])[0] == ma_get_output(loop_ref[0])[0]);
+    CHECK(ma_get_output(loop[1])[0] == ma_get_output(loop_ref[1])[0]);
+    ma_memo_delete(memo);
+    for (size_t i = 0; i < 2; i++)
+    {
+        ma_delete(loop_ref[i]);
+        ma_delete(loop[i]);
+    }
+
+    /* LFSR feeding a module around a delay line: context-owning but pure */
+    const uint64_t taps = 0x30, seed = 1; /* x^6 + x^5 + 1, period 63 */
+    ma_module_t *mod = ma_module_create(6, 6);
+    moore_t *part = ma_create_simple(6, 6, delay);
+    CHECK(mod && part);
+    CHECK(ma_module_add(mod, part) == 0);
+    CHECK(ma_module_connect(mod, 0, 0, MA_MODULE_PORT, 0, 6) == 0);
+    CHECK(ma_module_connect(mod, MA_MODULE_PORT, 0, 0, 0, 6) == 0);
+    moore_t *pure_ref[2] = {ma_create_lfsr(6, &taps, &seed), ma_module_instance(mod)};
+    moore_t *pure[2] = {ma_create_lfsr(6, &taps, &seed), ma_module_instance(mod)};
+    CHECK(pure_ref[0] && pure_ref[1] && pure[0] && pure[1]);
+    CHECK(ma_connect(pure_ref[1], 0, pure_ref[0], 0, 6) == 0);
+    CHECK(ma_connect(pure[1], 0, pure[0], 0, 6) == 0);
+    for (size_t c = 0; c < LONG_CYCLES; c++)
+        ma_step(pure_ref, 2);
+    memo = ma_memo_create(pure, 2, 0);
+    CHECK(memo != NULL);
+    CHECK(ma_memo_run(memo, LONG_CYCLES) == 0);
+    CHECK(ma_memo_stats(memo, &stats) == 0 && stats.hits > 0);
+    CHECK(ma_get_output(pure[0])[0] == ma_get_output(pure_ref[0])[0]);
+    CHECK(ma_get_output(pure[1])[0] == ma_get_output(pure_ref[1])[0]);
+    ma_memo_delete(memo);
+    for (size_t i = 0; i < 2; i++)
+    {
+        ma_delete(pure_ref[i]);
+        ma_delete(pure[i]);
+    }
+    ma_delete(part);
+    ma_module_delete(mod);
+
+    /* Counter driving write address and data of a 33 x 1 bit memory */
+    moore_t *mem = ma_create_memory(33, 1, 1, 1, 0);
+    CHECK(mem != NULL);
+    const size_t bits = ma_memory_address_bits(mem);
+    CHECK(ma_connect(mem, bits, at[0], 0, 6) == 0);
+    CHECK(ma_connect(mem, 2 * bits, at[0], 0, 2) == 0);
+    moore_t *with_memory[2] = {at[0], mem};
+    errno = 0;
+    CHECK(ma_memo_create(with_memory, 2, 0) == NULL && errno == EINVAL);
+
+    ma_delete(mem);
+    for (size_t i = 0; i < 2; i++)
+    {
+        ma_delete(ref[i]);
+        ma_delete(at[i]);
+    }
+
+    /* In-place automaton whose write log cannot grow: the step error ends the run */
+    CHECK(ma_set_allocator(limited_alloc, limited_free, NULL) == 0);
+    static const uint64_t zero[WORDS];
+    moore_t *a = ma_create_in_place(0, 64, 64 * WORDS, touch_all, copy_first, zero, NULL);
+    CHECK(a != NULL);
+    memo = ma_memo_create(&a, 1, 0);
+    CHECK(memo != NULL);
+    limit = 16 * 2 * sizeof(uint64_t);
+    errno = 0;
+    CHECK(ma_memo_run(memo, 64) == -1 && errno == ENOMEM);
+    CHECK(ma_memo_stats(memo, &stats) == 0);
+    CHECK(stats.entries == 0 && stats.steps == 0);
+    CHECK(ma_get_output(a)[0] == 0);
+    limit = SIZE_MAX;
+    CHECK(ma_memo_run(memo, 64) == 0 && ma_get_output(a)[0] == 64);
+    ma_memo_delete(memo);
+    ma_delete(a);
+    CHECK(ma_set_allocator(NULL, NULL, NULL) == 0);
+    TEST_DONE();
+}
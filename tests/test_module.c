@@ -0,0 +1,121 @@
+/*
+ * Modules: an instance steps like its parts connected and stepped by
+ * ma_step, also when nested in another module. Deleting the modules and
+ * prototypes before the instances keeps them working, and the last
+ * instance frees everything.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include "ma.h"
+#include "test.h"
+
+#define CYCLES 50
+
+static void source_step(uint64_t *next_state, uint64_t const *input, uint64_t const *state,
+                        size_t n, size_t s)
+{
+    (void)input;
+    (void)n;
+    (void)s;
+    next_state[0] = (state[0] * 13 + 7) & 0xff;
+}
+
+static void accumulate(uint64_t *next_state, uint64_t const *input, uint64_t const *state,
+                       size_t n, size_t s)
+{
+    (void)n;
+    (void)s;
+    next_state[0] = (state[0] * 3 + input[0]) & 0xffff;
+}
+
+static void fold(uint64_t *next_state, uint64_t const *input, uint64_t const *state, size_t n,
+                 size_t s)
+{
+    (void)n;
+    (void)s;
+    next_state[0] = (input[0] ^ (input[0] >> 8) ^ (state[0] >> 1)) & 0xff;
+}
+
+/* Accumulator feeding a fold: 8 inputs, 8 outputs */
+static ma_module_t *build_inner(void)
+{
+    ma_module_t *mod = ma_module_create(8, 8);
+    moore_t *acc = ma_create_simple(8, 16, accumulate), *fl = ma_create_simple(16, 8, fold);
+    CHECK(mod && acc && fl);
+    CHECK(ma_module_add(mod, acc) == 0);
+    CHECK(ma_module_add(mod, fl) == 1);
+    CHECK(ma_module_connect(mod, 0, 0, MA_MODULE_PORT, 0, 8) == 0);
+    CHECK(ma_module_connect(mod, 1, 0, 0, 0, 16) == 0);
+    CHECK(ma_module_connect(mod, MA_MODULE_PORT, 0, 1, 0, 8) == 0);
+    ma_delete(acc);
+    ma_delete(fl);
+    return mod;
+}
+
+/* Flattened inner module fed by src: at[0] accumulator, at[1] fold */
+static void build_flat(moore_t *at[2], moore_t *src)
+{
+    at[0] = ma_create_simple(8, 16, accumulate);
+    at[1] = ma_create_simple(16, 8, fold);
+    CHECK(at[0] && at[1]);
+    CHECK(ma_connect(at[0], 0, src, 0, 8) == 0);
+    CHECK(ma_connect(at[1], 0, at[0], 0, 16) == 0);
+}
+
+int main(void)
+{
+    /* Flat: source -> (acc -> fold) -> (acc -> fold) */
+    moore_t *flat[5];
+    CHECK((flat[0] = ma_create_simple(0, 8, source_step)) != NULL);
+    build_flat(flat + 1, flat[0]);
+    build_flat(flat + 3, flat[2]);
+
+    /* Single instance of inner module */
+    ma_module_t *inner = build_inner();
+    moore_t *single[2] = {ma_create_simple(0, 8, source_step), ma_module_instance(inner)};
+    CHECK(single[0] && single[1]);
+    CHECK(ma_connect(single[1], 0, single[0], 0, 8) == 0);
+
+    /* Outer module chaining two inner instances */
+    ma_module_t *outer = ma_module_create(8, 8);
+    CHECK(outer != NULL);
+    moore_t *proto = ma_module_instance(inner);
+    CHECK(proto != NULL);
+    CHECK(ma_module_add(outer, proto) == 0);
+    CHECK(ma_module_add(outer, proto) == 1);
+    CHECK(ma_module_connect(outer, 0, 0, MA_MODULE_PORT, 0, 8) == 0);
+    CHECK(ma_module_connect(outer, 1, 0, 0, 0, 8) == 0);
+    CHECK(ma_module_connect(outer, MA_MODULE_PORT, 0, 1, 0, 8) == 0);
+    moore_t *nested[2] = {ma_create_simple(0, 8, source_step), ma_module_instance(outer)};
+    CHECK(nested[0] && nested[1]);
+    CHECK(ma_connect(nested[1], 0, nested[0], 0, 8) == 0);
+
+    /* Instances hold the modules: drop every other reference now */
+    ma_delete(proto);
+    ma_module_delete(inner);
+    ma_module_delete(outer);
+
+    bool match = true;
+    for (size_t c = 0; c < CYCLES; c++)
+    {
+        ma_step(flat, 5);
+        ma_step(single, 2);
+        ma_step(nested, 2);
+        match &= ma_get_output(single[1])[0] == ma_get_output(flat[2])[0];
+        match &= ma_module_part_state(single[1], 0)[0] == ma_get_output(flat[1])[0];
+        match &= ma_get_output(nested[1])[0] == ma_get_output(flat[4])[0];
+    }
+    CHECK(match);
+
+    for (size_t i = 0; i < 5; i++)
+        ma_delete(flat[i]);
+    for (size_t i = 0; i < 2; i++)
+    {
+        ma_delete(single[i]);
+        ma_delete(nested[i]);
+    }
+
+    /* Succeeds only if no block of the library is left */
+    CHECK(ma_set_hugepages(MA_HUGEPAGES_OFF) == 0);
+    TEST_DONE();
+}
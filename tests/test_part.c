@@ -0,0 +1,85 @@
+/*
+ * Partition sets: a ring of accumulators, every other one on a divided
+ * clock, stepped by two processes must match ma_step after each
+ * ma_part_step and keep matching once the set is deleted. Sets with a
+ * duplicate automaton or a source outside the set are refused.
+ */
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "ma.h"
+#include "test.h"
+
+#define RING 8
+
+static void accumulate(uint64_t *next_state, uint64_t const *input, uint64_t const *state,
+                       size_t n, size_t s)
+{
+    (void)n;
+    (void)s;
+    next_state[0] = state[0] * 3 + input[0] + 1;
+}
+
+/* Ring where even automata tick every second cycle */
+static void build(moore_t *at[RING])
+{
+    for (size_t i = 0; i < RING; i++)
+    {
+        CHECK((at[i] = ma_create_simple(64, 64, accumulate)) != NULL);
+        if (i % 2 == 0)
+            CHECK(ma_set_clock(at[i], 2, 0) == 0);
+    }
+    for (size_t i = 0; i < RING; i++)
+        CHECK(ma_connect(at[i], 0, at[(i + RING - 1) % RING], 0, 64) == 0);
+}
+
+static bool outputs_match(moore_t *at[RING], moore_t *ref[RING])
+{
+    for (size_t i = 0; i < RING; i++)
+        if (ma_get_output(at[i])[0] != ma_get_output(ref[i])[0])
+            return false;
+    return true;
+}
+
+int main(void)
+{
+    moore_t *ref[RING], *at[RING];
+    build(ref);
+    build(at);
+
+    /* Duplicates and half a ring (sources outside the set) */
+    moore_t *twice[3] = {at[0], at[1], at[0]};
+    errno = 0;
+    CHECK(ma_part_create(twice, 3, 2) == NULL && errno == EINVAL);
+    errno = 0;
+    CHECK(ma_part_create(at, RING / 2, 2) == NULL && errno == EINVAL);
+
+    ma_part_t *part = ma_part_create(at, RING, 2);
+    CHECK(part != NULL);
+
+    /* Odd and even step counts, so clocked automata swap unevenly */
+    static const size_t steps[] = {3, 1, 2, 5};
+    for (size_t k = 0; k < sizeof(steps) / sizeof(steps[0]); k++)
+    {
+        CHECK(ma_part_step(part, steps[k]) == 0);
+        for (size_t c = 0; c < steps[k]; c++)
+            ma_step(ref, RING);
+        CHECK(outputs_match(at, ref));
+    }
+
+    /* Buffers and clock phases come back to the caller */
+    CHECK(ma_part_delete(part) == 0);
+    for (size_t c = 0; c < 3; c++)
+    {
+        ma_step(at, RING);
+        ma_step(ref, RING);
+        CHECK(outputs_match(at, ref));
+    }
+
+    for (size_t i = 0; i < RING; i++)
+    {
+        ma_delete(at[i]);
+        ma_delete(ref[i]);
+    }
+    TEST_DONE();
+}
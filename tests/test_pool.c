@@ -0,0 +1,105 @@
+/*
+ * Packed pools: a ring of tiny automata with packed fields, stepped by
+ * batch kernels, matches the same ring computed automaton by automaton,
+ * before and after part of it is disconnected.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include "ma.h"
+#include "test.h"
+
+#define COUNT 100 /* Not a multiple of 64: the last block is padded */
+#define CYCLES 30
+
+typedef struct
+{
+    size_t calls;
+    bool whole_blocks; /* Every kernel call covered multiples of 64 automata */
+} kernel_stats;
+
+static uint64_t next_of(uint64_t state, uint64_t input)
+{
+    return (state * 3 + input + 1) & 31;
+}
+
+static uint64_t output_of(uint64_t state)
+{
+    return (state ^ (state >> 2)) & 3;
+}
+
+static void batch_step(uint64_t *next_state, uint64_t const *input, uint64_t const *state,
+                       size_t count, ma_pool_layout_t const *layout, void *ctx)
+{
+    kernel_stats *stats = ctx;
+    stats->calls++;
+    stats->whole_blocks &= count % 64 == 0;
+    for (size_t i = 0; i < count; i++)
+        ma_pool_set_field(next_state, layout->s_width, i,
+                          next_of(ma_pool_get_field(state, layout->s_width, i),
+                                  ma_pool_get_field(input, layout->n_width, i)));
+}
+
+static void batch_output(uint64_t *output, uint64_t const *state, size_t count,
+                         ma_pool_layout_t const *layout, void *ctx)
+{
+    (void)ctx;
+    for (size_t i = 0; i < count; i++)
+        ma_pool_set_field(output, layout->m_width, i,
+                          output_of(ma_pool_get_field(state, layout->s_width, i)));
+}
+
+int main(void)
+{
+    kernel_stats stats = {0, true};
+    ma_pool_t *pool = ma_pool_create(COUNT, 3, 2, 5, batch_step, batch_output, &stats);
+    CHECK(pool != NULL);
+
+    /* Inputs 0-1 read outputs of the previous automaton, input 2 is manual */
+    uint64_t state[COUNT], manual[COUNT];
+    bool connected[COUNT];
+    for (size_t i = 0; i < COUNT; i++)
+    {
+        state[i] = (i * 7) & 31;
+        manual[i] = (i % 3 == 0) << 2 | (i & 3);
+        connected[i] = true;
+        CHECK(ma_pool_set_state(pool, i, state[i]) == 0);
+        CHECK(ma_pool_set_input(pool, i, manual[i]) == 0);
+        CHECK(ma_pool_connect(pool, i, 0, (i + COUNT - 1) % COUNT, 0, 2) == 0);
+    }
+
+    bool match = true;
+    for (size_t c = 0; c < CYCLES; c++)
+    {
+        /* Halfway, every fourth automaton falls back to its manual inputs */
+        if (c == CYCLES / 2)
+            for (size_t i = 0; i < COUNT; i += 4)
+            {
+                CHECK(ma_pool_disconnect(pool, i, 0, 2) == 0);
+                connected[i] = false;
+            }
+
+        uint64_t next[COUNT];
+        for (size_t i = 0; i < COUNT; i++)
+        {
+            const uint64_t in = connected[i]
+                                    ? (manual[i] & 4) | output_of(state[(i + COUNT - 1) % COUNT])
+                                    : manual[i];
+            next[i] = next_of(state[i], in);
+        }
+        for (size_t i = 0; i < COUNT; i++)
+            state[i] = next[i];
+
+        CHECK(ma_pool_step(pool) == 0);
+        for (size_t i = 0; i < COUNT; i++)
+            match &= ma_pool_get_state(pool, i) == state[i] &&
+                     ma_pool_get_output(pool, i) == output_of(state[i]);
+    }
+    CHECK(match);
+    CHECK(stats.calls == CYCLES && stats.whole_blocks);
+
+    ma_pool_layout_t const *layout = ma_pool_layout(pool);
+    CHECK(layout && layout->n_width == 4 && layout->m_width == 2 && layout->s_width == 8);
+
+    ma_pool_delete(pool);
+    TEST_DONE();
+}
@@ -0,0 +1,272 @@
+/*
+ * Primitives: narrow and wide counters, shift registers, adders,
+ * comparators, muxes and LFSRs driven by random inputs give the same
+ * outputs stepped by ma_step (scalar kernels), by a network with group
+ * dispatch (group kernels) and by a bit-by-bit reference.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "ma.h"
+#include "test.h"
+
+#define CYCLES 40
+#define MAX_BITS 512
+#define WORDS (MAX_BITS / 64)
+
+enum { COUNTER, SHIFT, ADDER, COMPARATOR, MUX, LFSR };
+
+typedef struct
+{
+    int kind;
+    size_t width; /* Bits (length of a shift register) */
+    size_t extra; /* Lanes of a shift register, ways of a mux */
+} prim_case;
+
+static const prim_case cases[] = {
+    {COUNTER, 5, 0},    {COUNTER, 64, 0},    {COUNTER, 130, 0},   {SHIFT, 10, 3},
+    {SHIFT, 63, 1},     {SHIFT, 64, 5},      {SHIFT, 200, 70},    {ADDER, 7, 0},
+    {ADDER, 31, 0},     {ADDER, 32, 0},      {ADDER, 63, 0},      {ADDER, 64, 0},
+    {ADDER, 150, 0},    {COMPARATOR, 5, 0},  {COMPARATOR, 32, 0}, {COMPARATOR, 33, 0},
+    {COMPARATOR, 100, 0}, {MUX, 9, 3},       {MUX, 70, 5},        {LFSR, 16, 0},
+    {LFSR, 100, 0},
+};
+
+#define CASES (sizeof(cases) / sizeof(cases[0]))
+
+static uint64_t rng = 0x853c49e6748fea9bu;
+
+static uint64_t next_random(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static bool get_bit(uint64_t const *v, size_t bit)
+{
+    return (v[bit / 64] >> (bit % 64)) & 1;
+}
+
+static void set_bit(uint64_t *v, size_t bit, bool value)
+{
+    v[bit / 64] = (v[bit / 64] & ~((uint64_t)1 << (bit % 64))) | (uint64_t)value << (bit % 64);
+}
+
+static size_t select_bits(size_t ways)
+{
+    size_t bits = 0;
+    while (((size_t)1 << bits) < ways)
+        bits++;
+    return bits;
+}
+
+/* Taps of LFSR case: top bit and a few fixed ones */
+static void lfsr_taps(size_t width, uint64_t taps[WORDS])
+{
+    memset(taps, 0, WORDS * sizeof(uint64_t));
+    set_bit(taps, width - 1, true);
+    set_bit(taps, width / 2, true);
+    set_bit(taps, 3, true);
+}
+
+static moore_t *create(prim_case const *c)
+{
+    uint64_t taps[WORDS], seed[WORDS] = {0x1234567u, 0x89abcdefu};
+    switch (c->kind)
+    {
+    case COUNTER:
+        return ma_create_counter(c->width);
+    case SHIFT:
+        return ma_create_shift_register(c->width, c->extra);
+    case ADDER:
+        return ma_create_adder(c->width);
+    case COMPARATOR:
+        return ma_create_comparator(c->width);
+    case MUX:
+        return ma_create_mux(c->width, c->extra);
+    default:
+        lfsr_taps(c->width, taps);
+        return ma_create_lfsr(c->width, taps, seed);
+    }
+}
+
+/* Number of inputs of case */
+static size_t inputs(prim_case const *c)
+{
+    switch (c->kind)
+    {
+    case COUNTER:
+        return 2;
+    case SHIFT:
+        return c->extra;
+    case ADDER:
+        return 2 * c->width + 1;
+    case COMPARATOR:
+        return 2 * c->width;
+    case MUX:
+        return select_bits(c->extra) + c->extra * c->width;
+    default:
+        return 0;
+    }
+}
+
+/* Number of state (and output) bits of case */
+static size_t state_bits(prim_case const *c)
+{
+    return c->kind == ADDER ? c->width + 1 : c->kind == COMPARATOR ? 3 : c->width;
+}
+
+/* Steps reference state of case bit by bit */
+static void reference_step(prim_case const *c, uint64_t *state, uint64_t const *in)
+{
+    uint64_t next[WORDS] = {0};
+    const size_t w = c->width;
+
+    switch (c->kind)
+    {
+    case COUNTER:
+    {
+        bool carry = get_bit(in, 0);
+        for (size_t i = 0; i < w; i++)
+        {
+            set_bit(next, i, !get_bit(in, 1) && (get_bit(state, i) ^ carry));
+            carry = carry && get_bit(state, i);
+        }
+        break;
+    }
+    case SHIFT:
+        for (size_t i = 0; i < w; i++)
+            set_bit(next, i, i < c->extra ? get_bit(in, i) : get_bit(state, i - c->extra));
+        break;
+    case ADDER:
+    {
+        bool carry = get_bit(in, 2 * w);
+        for (size_t i = 0; i < w; i++)
+        {
+            const bool a = get_bit(in, i), b = get_bit(in, w + i);
+            set_bit(next, i, a ^ b ^ carry);
+            carry = (a && b) || (carry && (a || b));
+        }
+        set_bit(next, w, carry);
+        break;
+    }
+    case COMPARATOR:
+    {
+        size_t result = 1; /* eq */
+        for (size_t i = w; i-- > 0 && result == 1;)
+            if (get_bit(in, i) != get_bit(in, w + i))
+                result = get_bit(in, w + i) ? 0 : 2; /* lt or gt */
+        set_bit(next, result, true);
+        break;
+    }
+    case MUX:
+    {
+        const size_t sel_bits = select_bits(c->extra);
+        size_t select = 0;
+        for (size_t i = 0; i < sel_bits; i++)
+            select |= (size_t)get_bit(in, i) << i;
+        if (select < c->extra)
+            for (size_t i = 0; i < w; i++)
+                set_bit(next, i, get_bit(in, sel_bits + select * w + i));
+        break;
+    }
+    default:
+    {
+        uint64_t taps[WORDS];
+        lfsr_taps(w, taps);
+        const bool feedback = get_bit(state, 0);
+        for (size_t i = 0; i < w; i++)
+            set_bit(next, i, (i + 1 < w && get_bit(state, i + 1)) ^ (feedback && get_bit(taps, i)));
+        break;
+    }
+    }
+
+    memcpy(state, next, sizeof(next));
+}
+
+int main(void)
+{
+    moore_t *scalar[CASES], *grouped[CASES];
+    uint64_t ref[CASES][WORDS] = {{0}};
+    for (size_t i = 0; i < CASES; i++)
+    {
+        CHECK((scalar[i] = create(&cases[i])) != NULL);
+        CHECK((grouped[i] = create(&cases[i])) != NULL);
+        if (cases[i].kind == COUNTER)
+        {
+            /* Close to wrapping, so carries cross words */
+            const uint64_t start[WORDS] = {~(uint64_t)0 - 3, ~(uint64_t)0, 0};
+            CHECK(ma_set_state(scalar[i], start) == 0);
+            CHECK(ma_set_state(grouped[i], start) == 0);
+            for (size_t b = 0; b < cases[i].width; b++)
+                set_bit(ref[i], b, get_bit(start, b));
+        }
+        else if (cases[i].kind == LFSR)
+            memcpy(ref[i], ma_get_output(scalar[i]),
+                   (cases[i].width + 63) / 64 * sizeof(uint64_t));
+    }
+
+    ma_net_t *net = ma_net_create(grouped, CASES, MA_NET_GROUP_DISPATCH);
+    CHECK(net != NULL);
+
+    bool match = true;
+    for (size_t cycle = 0; cycle < CYCLES; cycle++)
+    {
+        for (size_t i = 0; i < CASES; i++)
+        {
+            const size_t n = inputs(&cases[i]);
+            uint64_t in[WORDS] = {0};
+            for (size_t w = 0; w < (n + 63) / 64; w++)
+                in[w] = next_random();
+            if (cases[i].kind == COUNTER)
+                in[0] = (in[0] & 3) != 0 ? 1 : 2; /* Mostly counting, sometimes reset */
+            if (cases[i].kind == COMPARATOR && cycle % 3 == 0)
+                for (size_t b = 0; b < cases[i].width; b++) /* b = a, or a ^ 1 */
+                    set_bit(in, cases[i].width + b, get_bit(in, b) ^ (b == 0 && cycle % 2));
+            if (cases[i].kind == ADDER && cycle % 4 == 1)
+            {
+                /* a + b has all bits set, so the carry in ripples through */
+                for (size_t b = 0; b < cases[i].width; b++)
+                    set_bit(in, cases[i].width + b, !get_bit(in, b));
+                set_bit(in, 2 * cases[i].width, true);
+            }
+            if (n % 64 != 0)
+                in[n / 64] &= ((uint64_t)1 << (n % 64)) - 1;
+
+            if (n > 0)
+            {
+                CHECK(ma_set_input(scalar[i], in) == 0);
+                CHECK(ma_set_input(grouped[i], in) == 0);
+            }
+            reference_step(&cases[i], ref[i], in);
+        }
+
+        ma_step(scalar, CASES);
+        CHECK(ma_net_step(net) == 0);
+
+        for (size_t i = 0; i < CASES; i++)
+        {
+            uint64_t const *out[2] = {ma_get_output(scalar[i]), ma_get_output(grouped[i])};
+            for (size_t b = 0; b < state_bits(&cases[i]); b++)
+                for (size_t k = 0; k < 2; k++)
+                    if (get_bit(out[k], b) != get_bit(ref[i], b))
+                    {
+                        if (match)
+                            fprintf(stderr, "case %zu (%s), cycle %zu, bit %zu\n", i,
+                                    k ? "group" : "scalar", cycle, b);
+                        match = false;
+                    }
+        }
+    }
+    CHECK(match);
+
+    ma_net_delete(net);
+    for (size_t i = 0; i < CASES; i++)
+    {
+        ma_delete(scalar[i]);
+        ma_delete(grouped[i]);
+    }
+    TEST_DONE();
+}
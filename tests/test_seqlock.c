@@ -0,0 +1,86 @@
+/*
+ * Output snapshots: a thread calling ma_net_read_outputs while another
+ * runs ma_net_step only sees whole steps. Every output word of the
+ * network equals the step count, so a torn copy or a wrong cycle shows.
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "ma.h"
+#include "test.h"
+
+#define AUTOMATA 4
+#define WORDS 4 /* Output words per automaton */
+#define STEPS 200000
+
+typedef struct
+{
+    ma_net_t *net;
+    moore_t **at;
+    atomic_bool done;
+    size_t snapshots;
+    size_t errors;
+} reader_args;
+
+/* Every state word counts steps */
+static void count_all(uint64_t *next_state, uint64_t const *input, uint64_t const *state,
+                      size_t n, size_t s)
+{
+    (void)input;
+    (void)n;
+    for (size_t w = 0; w < (s + 63) / 64; w++)
+        next_state[w] = state[0] + 1;
+}
+
+static void *reader(void *arg)
+{
+    reader_args *r = arg;
+    uint64_t last = 0;
+    while (!atomic_load(&r->done))
+    {
+        uint64_t out[AUTOMATA * WORDS], cycle;
+        if (ma_net_read_outputs(r->net, r->at, AUTOMATA, out, &cycle) != 0)
+        {
+            r->errors++;
+            break;
+        }
+        bool ok = cycle >= last;
+        for (size_t w = 0; w < AUTOMATA * WORDS; w++)
+            ok &= out[w] == cycle;
+        r->errors += !ok;
+        r->snapshots++;
+        last = cycle;
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    moore_t *at[AUTOMATA];
+    for (size_t i = 0; i < AUTOMATA; i++)
+        CHECK((at[i] = ma_create_simple(0, 64 * WORDS, count_all)) != NULL);
+    ma_net_t *net = ma_net_create(at, AUTOMATA, 0);
+    CHECK(net != NULL);
+
+    reader_args r = {net, at, false, 0, 0};
+    pthread_t thread;
+    CHECK(pthread_create(&thread, NULL, reader, &r) == 0);
+    for (size_t c = 0; c < STEPS; c++)
+        CHECK(ma_net_step(net) == 0);
+    atomic_store(&r.done, true);
+    pthread_join(thread, NULL);
+
+    CHECK(r.errors == 0);
+    CHECK(r.snapshots > 0);
+
+    /* Quiet network: the snapshot is the final step */
+    uint64_t out[AUTOMATA * WORDS], cycle;
+    CHECK(ma_net_read_outputs(net, at, AUTOMATA, out, &cycle) == 0);
+    CHECK(cycle == STEPS && out[0] == STEPS && out[AUTOMATA * WORDS - 1] == STEPS);
+
+    ma_net_delete(net);
+    for (size_t i = 0; i < AUTOMATA; i++)
+        ma_delete(at[i]);
+    TEST_DONE();
+}
@@ -0,0 +1,112 @@
+/*
+ * Shared-memory export: a forked reader process maps the region with
+ * ma_shm_open while the parent steps the network, and every snapshot it
+ * takes must hold outputs of a single cycle. A second export under the
+ * same name must fail with EEXIST without touching the live region.
+ */
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "ma.h"
+#include "ma_shm.h"
+#include "test.h"
+
+#define COUNTERS 64
+#define CYCLES 20000
+
+static void count(uint64_t *next_state, uint64_t const *input, uint64_t const *state, size_t n,
+                  size_t s)
+{
+    (void)input;
+    (void)n;
+    (void)s;
+    next_state[0] = state[0] + 1;
+}
+
+/* Reader process: snapshots must be untorn and cycles must not go back */
+static int reader(char const *name)
+{
+    ma_shm_reader_t *r;
+    while (!(r = ma_shm_open(name)))
+    {
+        if (errno != ENOENT && errno != EAGAIN)
+            return 2;
+        usleep(100);
+    }
+    if (ma_shm_count(r) != COUNTERS || ma_shm_bits(r, 0) != 64)
+        return 3;
+
+    uint64_t values[COUNTERS];
+    uint64_t cycle = 0, last = 0, snapshots = 0;
+    while (cycle < CYCLES)
+    {
+        if (ma_shm_read(r, values, &cycle) != 0 || cycle < last)
+            return 4;
+        for (size_t i = 0; i < COUNTERS; i++)
+            if (values[i] != cycle)
+                return 5;
+        last = cycle;
+        snapshots++;
+    }
+    ma_shm_close(r);
+    return snapshots > 0 ? 0 : 6;
+}
+
+int main(void)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/ma_test_shm_%d", (int)getpid());
+
+    moore_t *at[COUNTERS];
+    for (size_t i = 0; i < COUNTERS; i++)
+        CHECK((at[i] = ma_create_simple(0, 64, count)) != NULL);
+    ma_net_t *net = ma_net_create(at, COUNTERS, 0);
+    CHECK(net != NULL);
+    ma_shm_t *shm = ma_shm_export(net, name, at, COUNTERS);
+    CHECK(shm != NULL);
+    if (!shm)
+        TEST_DONE();
+
+    /* Exporting under a taken name must not truncate the live region */
+    moore_t *other = ma_create_simple(0, 64, count);
+    ma_net_t *other_net = ma_net_create(&other, 1, 0);
+    errno = 0;
+    CHECK(ma_shm_export(other_net, name, &other, 1) == NULL && errno == EEXIST);
+
+    const pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0)
+        _exit(reader(name));
+
+    /* Step until the reader has seen the last cycle it waits for */
+    int status = 0;
+    bool reaped = false;
+    for (uint64_t i = 0; i < 100 * CYCLES && !reaped; i++)
+    {
+        ma_net_step(net);
+        reaped = i >= CYCLES && waitpid(pid, &status, WNOHANG) == pid;
+    }
+    if (!reaped)
+    {
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+    }
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    /* Outputs move back intact and the name is gone */
+    CHECK(ma_shm_delete(shm) == 0);
+    CHECK(ma_get_output(at[0])[0] == ma_net_cycle(net));
+    errno = 0;
+    CHECK(ma_shm_open(name) == NULL && errno == ENOENT);
+
+    ma_net_delete(other_net);
+    ma_delete(other);
+    ma_net_delete(net);
+    for (size_t i = 0; i < COUNTERS; i++)
+        ma_delete(at[i]);
+    TEST_DONE();
+}
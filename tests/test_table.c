@@ -0,0 +1,164 @@
+/*
+ * Table automata: ma_table_run at every stride, ma_table_run_parallel
+ * (chunks whose states merge and chunks replayed sequentially) and
+ * ma_table_step_many match stepping t and y directly, for each
+ * instruction set level the CPU supports.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "ma.h"
+#include "ma_internal.h"
+#include "test.h"
+
+#define COUNT (5 * 65536 + 123) /* Enough symbols for four parallel chunks */
+#define INSTANCES 1000
+#define M 16
+
+static uint64_t rng = 0x9e3779b97f4a7c15u;
+
+static uint64_t next_random(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+/* Mixing transition: start states merge at varying speed */
+static void mix(uint64_t *next_state, uint64_t const *input, uint64_t const *state, size_t n,
+                size_t s)
+{
+    (void)n;
+    next_state[0] = ((state[0] * 5 + input[0] * 3 + 1) ^ (state[0] >> 2)) & ((1u << s) - 1);
+}
+
+/* Permutation of states for every input: start states never merge */
+static void rotate(uint64_t *next_state, uint64_t const *input, uint64_t const *state, size_t n,
+                   size_t s)
+{
+    (void)n;
+    next_state[0] = (state[0] + input[0] + 1) & ((1u << s) - 1);
+}
+
+/* Shifts in input parity: start states merge after s symbols */
+static void shift_in(uint64_t *next_state, uint64_t const *input, uint64_t const *state,
+                     size_t n, size_t s)
+{
+    (void)n;
+    next_state[0] = ((state[0] << 1) | (__builtin_popcountll(input[0]) & 1)) & ((1u << s) - 1);
+}
+
+static void scramble(uint64_t *output, uint64_t const *state, size_t m, size_t s)
+{
+    (void)s;
+    output[0] = (state[0] * 0x9e37 + 7) & ((1u << m) - 1);
+}
+
+/* Next state and output computed with t and y */
+static uint64_t reference_step(transition_function_t t, size_t n, size_t s, uint64_t state,
+                               uint64_t symbol, uint64_t *output)
+{
+    uint64_t input = symbol & ((1u << n) - 1), next;
+    t(&next, &input, &state, n, s);
+    scramble(output, &next, M, s);
+    return next;
+}
+
+typedef struct
+{
+    size_t n, s;
+    transition_function_t t;
+} table_case;
+
+static const table_case cases[] = {
+    {2, 3, mix}, {2, 3, rotate}, {4, 4, shift_in}, {2, 6, mix},
+    {1, 6, rotate}, {3, 10, shift_in}, {5, 8, mix},
+};
+
+/* Checks one case at current level; returns true if everything matched */
+static bool check_case(table_case const *c, uint16_t const *input, uint64_t *output)
+{
+    const uint64_t q = 1;
+    ma_table_t *table = ma_table_create(c->n, M, c->s, c->t, scramble, q);
+    CHECK(table != NULL);
+
+    uint64_t *ref = malloc(COUNT * sizeof(uint64_t));
+    uint64_t state = q;
+    for (size_t i = 0; i < COUNT; i++)
+        state = reference_step(c->t, c->n, c->s, state, input[i], &ref[i]);
+
+    bool ok = true;
+    static const size_t strides[] = {1, 2, 4};
+    for (size_t k = 0; k < 3; k++)
+    {
+        if (ma_table_set_stride(table, strides[k]) != 0)
+            continue;
+        ma_table_set_state(table, q);
+        ok &= ma_table_run(table, input, COUNT, output) == 0;
+        for (size_t i = 0; i < COUNT && ok; i++)
+            ok = output[i] == ref[i];
+        ok &= ma_table_get_state(table) == state && ma_table_get_output(table) == ref[COUNT - 1];
+    }
+
+    for (size_t threads = 1; threads <= 4; threads++)
+    {
+        ma_table_set_state(table, q);
+        ok &= ma_table_run_parallel(table, input, COUNT, output, threads) == 0;
+        for (size_t i = 0; i < COUNT && ok; i++)
+            ok = output[i] == ref[i];
+        ok &= ma_table_get_state(table) == state;
+
+        /* Final state only */
+        ma_table_set_state(table, q);
+        ok &= ma_table_run_parallel(table, input, COUNT, NULL, threads) == 0;
+        ok &= ma_table_get_state(table) == state;
+    }
+
+    if (c->n <= 8 && c->s <= 8)
+    {
+        uint8_t states[INSTANCES], symbols[INSTANCES];
+        uint64_t expected[INSTANCES], out;
+        for (size_t i = 0; i < INSTANCES; i++)
+        {
+            states[i] = (uint8_t)(next_random() & ((1u << c->s) - 1));
+            symbols[i] = (uint8_t)next_random();
+            expected[i] = reference_step(c->t, c->n, c->s, states[i], symbols[i], &out);
+            ref[i] = out;
+        }
+        ok &= ma_table_step_many(table, states, symbols, INSTANCES, output) == 0;
+        for (size_t i = 0; i < INSTANCES && ok; i++)
+            ok = states[i] == expected[i] && output[i] == ref[i];
+    }
+
+    free(ref);
+    ma_table_delete(table);
+    return ok;
+}
+
+int main(void)
+{
+    uint16_t *input = malloc(COUNT * sizeof(uint16_t));
+    uint64_t *output = malloc(COUNT * sizeof(uint64_t));
+    CHECK(input && output);
+    /* Bits above n are set too and must be ignored */
+    for (size_t i = 0; i < COUNT; i++)
+        input[i] = (uint16_t)next_random();
+
+    const int best = ma_table_cap_simd(-1);
+    for (int level = 0; level <= best; level++)
+    {
+        CHECK(ma_table_cap_simd(level) == level);
+        for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+            if (!check_case(&cases[c], input, output))
+            {
+                fprintf(stderr, "level %d, case %zu: mismatch\n", level, c);
+                CHECK(false);
+            }
+    }
+    ma_table_cap_simd(-1);
+
+    free(input);
+    free(output);
+    TEST_DONE();
+}
@@ -0,0 +1,139 @@
+/*
+ * Memory usage reports: with allocation hooks installed, the bytes
+ * reported as allocated for automata, networks, pools and grids equal
+ * the bytes the hooks handed out; used bytes follow the sizes, and the
+ * total is the sum of the categories.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "ma.h"
+#include "test.h"
+
+static size_t live_bytes;
+
+static void *counting_alloc(size_t size, void *ctx)
+{
+    (void)ctx;
+    live_bytes += size;
+    return malloc(size ? size : 1);
+}
+
+static void counting_free(void *ptr, size_t size, void *ctx)
+{
+    (void)ctx;
+    live_bytes -= size;
+    free(ptr);
+}
+
+static void increment(uint64_t *next_state, uint64_t const *input, uint64_t const *state,
+                      size_t n, size_t s)
+{
+    (void)input;
+    (void)n;
+    (void)s;
+    next_state[0] = state[0] + 1;
+}
+
+static void batch_keep(uint64_t *next_state, uint64_t const *input, uint64_t const *state,
+                       size_t count, ma_pool_layout_t const *layout, void *ctx)
+{
+    (void)input;
+    (void)ctx;
+    for (size_t i = 0; i < count; i++)
+        ma_pool_set_field(next_state, layout->s_width, i,
+                          ma_pool_get_field(state, layout->s_width, i));
+}
+
+static void batch_zero(uint64_t *output, uint64_t const *state, size_t count,
+                       ma_pool_layout_t const *layout, void *ctx)
+{
+    (void)state;
+    (void)ctx;
+    for (size_t i = 0; i < count; i++)
+        ma_pool_set_field(output, layout->m_width, i, 0);
+}
+
+static void keep_cell(uint8_t *next, uint8_t const *const cell[], size_t count, void *ctx)
+{
+    (void)ctx;
+    for (size_t i = 0; i < count; i++)
+        next[i] = cell[0][i];
+}
+
+/* Total must be the sum of the categories */
+static bool total_adds_up(ma_memory_usage_t const *u)
+{
+    ma_memory_bytes_t const *c[] = {&u->headers, &u->state,       &u->output,
+                                    &u->input,   &u->connections, &u->fanout};
+    size_t allocated = 0, used = 0;
+    for (size_t i = 0; i < sizeof(c) / sizeof(c[0]); i++)
+    {
+        if (c[i]->used > c[i]->allocated)
+            return false;
+        allocated += c[i]->allocated;
+        used += c[i]->used;
+    }
+    return u->total.allocated == allocated && u->total.used == used;
+}
+
+int main(void)
+{
+    CHECK(ma_set_allocator(counting_alloc, counting_free, NULL) == 0);
+    ma_memory_usage_t u;
+
+    /* Lone automaton: 100 inputs, 130 state and output bits */
+    moore_t *lone = ma_create_simple(100, 130, increment);
+    CHECK(lone != NULL);
+    CHECK(ma_memory_usage(lone, &u) == 0 && total_adds_up(&u));
+    CHECK(u.total.allocated == live_bytes);
+    CHECK(u.state.used == 2 * 17 && u.output.used == 17 && u.input.used == 2 * 13);
+    CHECK(u.connections.used == 0 && u.fanout.used == 0);
+    ma_delete(lone);
+    CHECK(live_bytes == 0);
+
+    /* Connected network with compiled gather plans, then its compiled form */
+    moore_t *at[3] = {ma_create_simple(0, 64, increment), ma_create_simple(64, 64, increment),
+                      ma_create_simple(128, 64, increment)};
+    CHECK(at[0] && at[1] && at[2]);
+    CHECK(ma_connect(at[1], 0, at[0], 0, 64) == 0);
+    CHECK(ma_connect(at[2], 0, at[0], 0, 64) == 0);
+    CHECK(ma_connect(at[2], 64, at[1], 0, 3) == 0);
+    ma_step(at, 3);
+    CHECK(ma_network_memory_usage(at, 3, &u) == 0 && total_adds_up(&u));
+    CHECK(u.total.allocated == live_bytes);
+    CHECK(u.fanout.used == 3 * sizeof(moore_t *));
+
+    const size_t network_bytes = live_bytes;
+    ma_net_t *net = ma_net_create(at, 3, MA_NET_GROUP_DISPATCH);
+    CHECK(net != NULL);
+    CHECK(ma_net_memory_usage(net, &u) == 0 && total_adds_up(&u));
+    CHECK(u.total.allocated == live_bytes && live_bytes > network_bytes);
+    ma_net_delete(net);
+    for (size_t i = 0; i < 3; i++)
+        ma_delete(at[i]);
+    CHECK(live_bytes == 0);
+
+    /* Pool of 100 automata: 3, 2 and 5 bits in 4, 2 and 8 bit fields */
+    ma_pool_t *pool = ma_pool_create(100, 3, 2, 5, batch_keep, batch_zero, NULL);
+    CHECK(pool != NULL);
+    CHECK(ma_pool_connect(pool, 1, 0, 0, 0, 2) == 0);
+    CHECK(ma_pool_memory_usage(pool, &u) == 0 && total_adds_up(&u));
+    CHECK(u.total.allocated == live_bytes);
+    CHECK(u.state.used == 2 * 63 && u.output.used == 25 && u.input.used == 2 * 38);
+    ma_pool_delete(pool);
+    CHECK(live_bytes == 0);
+
+    /* Grid of 10 x 6 cells */
+    const size_t dims[2] = {10, 6};
+    ma_grid_t *grid = ma_grid_create(2, dims, 2, MA_GRID_VON_NEUMANN, MA_GRID_PERIODIC, keep_cell,
+                                     NULL);
+    CHECK(grid != NULL);
+    CHECK(ma_grid_memory_usage(grid, &u) == 0 && total_adds_up(&u));
+    CHECK(u.total.allocated == live_bytes && u.state.used == 2 * 60);
+    ma_grid_delete(grid);
+    CHECK(live_bytes == 0);
+
+    CHECK(ma_set_allocator(NULL, NULL, NULL) == 0);
+    TEST_DONE();
+}